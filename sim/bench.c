@@ -0,0 +1,155 @@
+/*
+ * bench.c
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <gentyp.h>
+#include "sysconf.h"
+#include "criterr.h"
+#include "udp.h"
+#include "usb_std_def.h"
+#include "usb_ctl_req_trc.h"
+#include "usb_ctl_req.h"
+#include "sim_os.h"
+#include "sim_udp.h"
+
+// Control transfer benchmark. Vendor IN and OUT requests of wLength bytes
+// run through simulated endpoint 0 for packet sizes 8..64. Reported are
+// transfers per second and TSC cycles per endpoint 0 interrupt (engine
+// and simulated controller together).
+
+#define BENCH_TM_NS 200000000LL
+#define BUF_SZ 4096
+
+static struct usb_ctl_req bench_stp(struct usb_ctl_req_dev *dev, struct usb_stp_pkt *stp);
+static boolean_t bench_rec(struct usb_ctl_req_dev *dev);
+static void bench_ack(struct usb_ctl_req_dev *dev);
+static void run(struct usb_ctl_req_dev *dev, struct sim_udp *sim, int type, int len);
+static int64_t now(void);
+
+static struct usb_ctl_req_clbks bench_clbks = {
+	.stp_clbk = bench_stp,
+	.in_req_ack_clbk = bench_ack,
+	.out_req_rec_clbk = bench_rec,
+	.out_req_ack_clbk = bench_ack
+};
+
+static uint8_t dev_buf[BUF_SZ];
+static uint8_t host_buf[BUF_SZ];
+static struct usb_ctl_req_dev devs[8];
+static struct sim_udp sims[8];
+
+int main(void)
+{
+	static const int mps_tbl[] = {8, 16, 32, 64};
+	static const int lens[] = {0, 8, 64, 255, 1024, 4096};
+	int i, j;
+
+	printf("%-4s %-4s %-4s %6s %12s %12s\n", "dir", "mps", "bat", "len", "trans/s", "cyc/evnt");
+	for (i = 0; i < 8; i++) {
+		sims[i].mps = mps_tbl[i % 4];
+		sims[i].dev = &devs[i];
+		init_usb_ctl_req(&devs[i], (i < 4) ? &sim_udp_drv : &sim_udp_bat_drv, &sims[i]);
+		add_usb_ctl_req_vnd_clbks(&devs[i], &bench_clbks);
+		for (j = 0; j < (int) (sizeof(lens) / sizeof(lens[0])); j++) {
+			run(&devs[i], &sims[i], 0xC0, lens[j]);
+			if (lens[j]) {
+				run(&devs[i], &sims[i], 0x40, lens[j]);
+			}
+		}
+	}
+	return (0);
+}
+
+/**
+ * run
+ */
+static void run(struct usb_ctl_req_dev *dev, struct sim_udp *sim, int type, int len)
+{
+	uint8_t stp[8];
+	uint64_t cyc, evnt;
+	int64_t tm;
+	long cnt = 0;
+	int i;
+
+	sim_udp_stp(stp, type, 1, 0, 0, len);
+	evnt = sim->evnt_cnt;
+	tm = now();
+	cyc = sim_cycles();
+	do {
+		for (i = 0; i < 64; i++) {
+			if (sim_udp_ctl(sim, stp, host_buf) != len) {
+				crit_err_exit(APP_ERROR);
+			}
+		}
+		cnt += 64;
+	} while (now() - tm < BENCH_TM_NS);
+	cyc = sim_cycles() - cyc;
+	tm = now() - tm;
+	evnt = sim->evnt_cnt - evnt;
+	printf("%-4s %-4d %-4d %6d %12.0f %12.1f\n", (type & 0x80) ? "in" : "out", sim->mps,
+	       dev->drv->in_bat, len, cnt * 1e9 / tm, (double) cyc / evnt);
+}
+
+/**
+ * bench_stp
+ */
+static struct usb_ctl_req bench_stp(struct usb_ctl_req_dev *dev, struct usb_stp_pkt *stp)
+{
+	struct usb_ctl_req req = {0};
+
+	req.valid = TRUE;
+	req.buf = dev_buf;
+	req.nmb = stp->w_length;
+	if (stp->bm_request_type & 0x80) {
+		req.trans_nmb = stp->w_length;
+		req.trans_dir = UDP_CTL_TRANS_IN;
+	} else {
+		req.trans_dir = UDP_CTL_TRANS_OUT;
+	}
+	return (req);
+}
+
+/**
+ * bench_rec
+ */
+static boolean_t bench_rec(struct usb_ctl_req_dev *dev)
+{
+	return (TRUE);
+}
+
+/**
+ * bench_ack
+ */
+static void bench_ack(struct usb_ctl_req_dev *dev)
+{
+}
+
+/**
+ * now
+ */
+static int64_t now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
@@ -0,0 +1,51 @@
+/*
+ * FreeRTOS.h
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef INC_FREERTOS_H
+#define INC_FREERTOS_H
+
+// FreeRTOS shim of host simulation. Tasks are run cooperatively by
+// sim_run_tsks() in thread which created them, critical sections are
+// one recursive mutex (interrupts are disabled for all threads).
+
+#include <stdint.h>
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdFAIL 0
+#define pdPASS 1
+#define portMAX_DELAY 0xFFFFFFFFUL
+#define configMAX_PRIORITIES 5
+#define configMINIMAL_STACK_SIZE 128
+#define configTICK_RATE_HZ 1000
+#define pdMS_TO_TICKS(ms) ((TickType_t) (ms))
+
+void sim_enter_critical(void);
+void sim_exit_critical(void);
+
+#define taskENTER_CRITICAL() sim_enter_critical()
+#define taskEXIT_CRITICAL() sim_exit_critical()
+#define taskENTER_CRITICAL_FROM_ISR() (sim_enter_critical(), 0UL)
+#define taskEXIT_CRITICAL_FROM_ISR(msk) ((void) (msk), sim_exit_critical())
+#define portYIELD_FROM_ISR(wkn) ((void) (wkn))
+
+#endif
@@ -0,0 +1,40 @@
+/*
+ * sysconf.h
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef SYSCONF_H
+#define SYSCONF_H
+
+// Configuration of host simulation. Engine switches can be overridden
+// from command line (benchmark is built without deferring, trace and
+// instrumentation).
+
+#define TERMOUT 1
+
+#ifndef USB_CTL_REQ_DEFER
+ #define USB_CTL_REQ_DEFER 1
+#endif
+#ifndef USB_CTL_REQ_TRC
+ #define USB_CTL_REQ_TRC 1
+#endif
+#ifndef USB_CTL_REQ_INSTR
+ #define USB_CTL_REQ_INSTR 1
+#endif
+#define USB_CTL_REQ_TRC_SZ 256
+#define USB_CTL_REQ_INSTR_HIST_BASE 10 // Time stamps are ns.
+
+#endif
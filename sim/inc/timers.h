@@ -0,0 +1,34 @@
+/*
+ * timers.h
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef TIMERS_H
+#define TIMERS_H
+
+// Timers fire from sim_tick() in thread which advances time.
+
+typedef struct sim_tmr *TimerHandle_t;
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t reload, void *id,
+			   void (*clbk)(TimerHandle_t tmr));
+BaseType_t xTimerStart(TimerHandle_t tmr, TickType_t tmo);
+BaseType_t xTimerStop(TimerHandle_t tmr, TickType_t tmo);
+BaseType_t xTimerReset(TimerHandle_t tmr, TickType_t tmo);
+BaseType_t xTimerIsTimerActive(TimerHandle_t tmr);
+void *pvTimerGetTimerID(TimerHandle_t tmr);
+
+#endif
@@ -0,0 +1,52 @@
+/*
+ * udp.h
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef UDP_H
+#define UDP_H
+
+// udp.h driver API of host simulation (implemented by sim_udp.c).
+
+enum udp_endp_type {
+	UDP_CTRL_ENDP,
+	UDP_ISO_OUT_ENDP,
+	UDP_BULK_OUT_ENDP,
+	UDP_INT_OUT_ENDP,
+	UDP_ISO_IN_ENDP = 5,
+	UDP_BULK_IN_ENDP,
+	UDP_INT_IN_ENDP
+};
+
+#define UDP_CTL_TRANS_OUT 0
+#define UDP_CTL_TRANS_IN 1
+
+int udp_endp0_pkt_sz(void);
+void add_udp_endp0_rxstp_clbk(void (*clbk)(void));
+void add_udp_endp0_txcomp_clbk(void (*clbk)(void));
+void add_udp_endp0_rxdata_clbk(void (*clbk)(int nmb));
+void add_udp_endp0_stlsnt_clbk(void (*clbk)(void));
+void read_udp_endp0_fifo(void *buf, int nmb);
+void write_udp_endp0_fifo(const void *buf, int nmb);
+void udp_endp0_rxstp_done(int dir);
+void udp_endp0_tx_pkt_rdy(void);
+void udp_endp0_req_stl(void);
+void udp_endp0_disable_stl(void);
+void udp_endp0_txcomp_accept(void);
+void udp_endp0_rxdata_done(void);
+void udp_endp0_stlsnt_accept(void);
+
+#endif
@@ -0,0 +1,148 @@
+/*
+ * pcap_dev.c
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <gentyp.h>
+#include "sysconf.h"
+#include "criterr.h"
+#include "udp.h"
+#include "usb_std_def.h"
+#include "usb_ctl_req_trc.h"
+#include "usb_ctl_req.h"
+#include "usb_str_desc.h"
+#include "usb_std_req.h"
+#include "usb_desc_bld.h"
+#include "pcap_dev.h"
+
+#define VND_EP(EP) \
+	EP(out, usb_std_endp_addr(1, USB_STD_OUT_ENDP), USB_STD_TRANS_BULK, 64, 0) \
+	EP(in, usb_std_endp_addr(2, USB_STD_IN_ENDP), USB_STD_TRANS_BULK, 64, 0)
+#define CONF(IAD, IFACE) \
+	IFACE(vnd, 0, 0, 0xFF, 0, 0, 0, USB_DESC_BLD_NONE, VND_EP)
+
+static void set_addr(struct usb_std_req *sr, int addr);
+static struct usb_ctl_req vnd_stp(struct usb_ctl_req_dev *dev, struct usb_stp_pkt *stp);
+static void vnd_ack(struct usb_ctl_req_dev *dev);
+static boolean_t vnd_rec(struct usb_ctl_req_dev *dev);
+
+USB_DESC_BLD_CONF(conf_desc, CONF, 1, 0, USB_STD_BUS_POWER_NO_RWAKE, usb_std_max_power_mamp(100));
+
+const struct usb_dev_desc pcap_dev_desc = {
+	.size = sizeof(struct usb_dev_desc),
+	.type = USB_DEV_DESC,
+	.bcd_usb = USB_STD_USB2_00_VER_BCD,
+	.b_max_packet_size0 = 64,
+	.id_vendor = 0x1209,
+	.id_product = 0x0001,
+	.bcd_device = 0x0100,
+	.i_manufacturer = 1,
+	.i_product = 2,
+	.b_num_configurations = 1
+};
+
+const void *const pcap_dev_conf = &conf_desc;
+const int pcap_dev_conf_sz = sizeof(conf_desc);
+
+static const char *const str_en[] = {"aztech", "usb-std replay"};
+static const struct usb_str_desc_tbl str_tbl = {
+	.langid = USB_STD_LANGID_EN_US,
+	.nmb = sizeof(str_en) / sizeof(str_en[0]),
+	.str = str_en
+};
+
+static const struct usb_std_req_hooks hooks = {
+	.set_addr = set_addr
+};
+
+static struct usb_desc_idx conf_idx;
+static const struct usb_std_req_conf conf = {
+	.desc = &conf_desc,
+	.desc_sz = sizeof(conf_desc),
+	.idx = &conf_idx
+};
+
+static struct usb_ctl_req_clbks vnd_clbks = {
+	.stp_clbk = vnd_stp,
+	.in_req_ack_clbk = vnd_ack,
+	.out_req_rec_clbk = vnd_rec,
+	.out_req_ack_clbk = vnd_ack
+};
+
+static struct usb_str_desc str_desc;
+static struct usb_std_req std_req;
+
+uint8_t pcap_dev_out[PCAP_DEV_OUT_SZ];
+
+/**
+ * init_pcap_dev
+ */
+void init_pcap_dev(struct usb_ctl_req_dev *dev)
+{
+	init_usb_str_desc(&str_desc, &str_tbl, 1, NULL);
+	std_req.dev_desc = &pcap_dev_desc;
+	std_req.conf = &conf;
+	std_req.conf_nmb = 1;
+	std_req.str = &str_desc;
+	std_req.hooks = &hooks;
+	init_usb_std_req(&std_req, dev);
+	add_usb_ctl_req_vnd_clbks(dev, &vnd_clbks);
+}
+
+/**
+ * set_addr
+ *
+ * Replay has no controller address register.
+ */
+static void set_addr(struct usb_std_req *sr, int addr)
+{
+}
+
+/**
+ * vnd_stp
+ */
+static struct usb_ctl_req vnd_stp(struct usb_ctl_req_dev *dev, struct usb_stp_pkt *stp)
+{
+	struct usb_ctl_req req = {0};
+
+	if (stp->b_request != PCAP_DEV_REQ_OUT || (stp->bm_request_type & 0x80) ||
+	    stp->w_length > PCAP_DEV_OUT_SZ) {
+		return (req);
+	}
+	req.buf = pcap_dev_out;
+	req.nmb = stp->w_length;
+	req.trans_dir = UDP_CTL_TRANS_OUT;
+	req.valid = TRUE;
+	return (req);
+}
+
+/**
+ * vnd_ack
+ */
+static void vnd_ack(struct usb_ctl_req_dev *dev)
+{
+}
+
+/**
+ * vnd_rec
+ */
+static boolean_t vnd_rec(struct usb_ctl_req_dev *dev)
+{
+	return (TRUE);
+}
@@ -0,0 +1,43 @@
+/*
+ * pcap_dev.h
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef PCAP_DEV_H
+#define PCAP_DEV_H
+
+// Sample device of pcap replay: chapter 9 requests (usb_std_req) with
+// one configuration of vendor interface and two bulk endpoints, strings
+// in English. Vendor request PCAP_DEV_REQ_OUT stores its OUT data stage
+// to pcap_dev_out. Replay of capture of other device needs its own
+// descriptors and class callbacks registered here.
+
+#define PCAP_DEV_REQ_OUT 1
+#define PCAP_DEV_OUT_SZ 64
+
+extern const struct usb_dev_desc pcap_dev_desc;
+extern const void *const pcap_dev_conf;
+extern const int pcap_dev_conf_sz;
+extern uint8_t pcap_dev_out[PCAP_DEV_OUT_SZ];
+
+/**
+ * init_pcap_dev
+ *
+ * Registers requests of sample device to engine instance dev.
+ */
+void init_pcap_dev(struct usb_ctl_req_dev *dev);
+
+#endif
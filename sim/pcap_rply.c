@@ -0,0 +1,173 @@
+/*
+ * pcap_rply.c
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <gentyp.h>
+#include "sysconf.h"
+#include "criterr.h"
+#include "udp.h"
+#include "usb_std_def.h"
+#include "usb_ctl_req_trc.h"
+#include "usb_ctl_req.h"
+#include "usb_pcap.h"
+#include "usb_pcap_rply.h"
+#include "pcap_dev.h"
+
+// Replays control transfers of usbmon capture against sample device
+// (pcap_dev.c) and reports how engine responses compare with capture.
+//
+// pcap_rply [-m mps] [-d bus.dev] [-o out.pcap] [-v] capture.pcap
+//
+// -m  endpoint 0 max packet size (default 64)
+// -d  replay only transfers of device (address follows SET_ADDRESS)
+// -o  export transfers as performed by engine
+// -v  print transfers which do not match
+//
+// Exit status is 0 if no transfer differs, 1 if some does, 2 on error.
+
+static void usage(void);
+static void print_ctl(const char *what, const struct usb_pcap_ctl *c);
+
+static const char *const res_name[] = {"match", "stall differs", "data differs", "no status", "skipped"};
+
+static struct usb_ctl_req_dev dev;
+static struct usb_pcap_rply rply;
+static struct usb_pcap_rd rd;
+static struct usb_pcap_wr wr;
+static struct usb_pcap_ctl ctl, res;
+
+int main(int argc, char **argv)
+{
+	FILE *in, *out = NULL;
+	struct timespec t0, t1;
+	enum usb_pcap_rply_res r;
+	int c, rv, mps = 64, bus = -1, addr = -1, verbose = 0;
+	unsigned int n = 0;
+	double tm;
+
+	while ((c = getopt(argc, argv, "m:d:o:v")) != -1) {
+		switch (c) {
+		case 'm' :
+			mps = atoi(optarg);
+			if (mps != 8 && mps != 16 && mps != 32 && mps != 64) {
+				usage();
+			}
+			break;
+		case 'd' :
+			if (sscanf(optarg, "%d.%d", &bus, &addr) != 2) {
+				usage();
+			}
+			break;
+		case 'o' :
+			if (!(out = fopen(optarg, "wb")) || init_usb_pcap_wr(&wr, out)) {
+				fprintf(stderr, "pcap_rply: can not write %s\n", optarg);
+				return (2);
+			}
+			break;
+		case 'v' :
+			verbose = 1;
+			break;
+		default :
+			usage();
+			break;
+		}
+	}
+	if (optind != argc - 1) {
+		usage();
+	}
+	if (!(in = fopen(argv[optind], "rb")) || init_usb_pcap_rd(&rd, in)) {
+		fprintf(stderr, "pcap_rply: %s is not usbmon capture\n", argv[optind]);
+		return (2);
+	}
+	rply.mps = mps;
+	init_usb_ctl_req(&dev, &usb_pcap_rply_drv, &rply);
+	init_usb_pcap_rply(&rply, &dev);
+	init_pcap_dev(&dev);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	while ((rv = usb_pcap_rd_ctl(&rd, &ctl)) == 1) {
+		if (bus >= 0 && (ctl.bus != bus || ctl.dev != addr)) {
+			continue;
+		}
+		r = usb_pcap_rply_ctl(&rply, &ctl, &res);
+		n++;
+		if (verbose && r != USB_PCAP_RPLY_MATCH && r != USB_PCAP_RPLY_SKIP) {
+			printf("#%u %s\n", n, res_name[r]);
+			print_ctl("capture", &ctl);
+			print_ctl("replay", &res);
+		}
+		if (out && usb_pcap_wr_ctl(&wr, &res)) {
+			fprintf(stderr, "pcap_rply: write error\n");
+			return (2);
+		}
+		// SET_ADDRESS completed in capture.
+		if (bus >= 0 && ctl.stp[0] == 0x00 && ctl.stp[1] == USB_SET_ADDRESS &&
+		    ctl.status == USB_PCAP_STATUS_OK) {
+			addr = ctl.stp[2] & 0x7F;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	if (rv < 0) {
+		fprintf(stderr, "pcap_rply: %s is damaged\n", argv[optind]);
+		return (2);
+	}
+	if (out && fclose(out)) {
+		fprintf(stderr, "pcap_rply: write error\n");
+		return (2);
+	}
+	fclose(in);
+	tm = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+	printf("transfers %u", n);
+	for (c = 0; c <= USB_PCAP_RPLY_SKIP; c++) {
+		printf(", %s %u", res_name[c], rply.stats.cnt[c]);
+	}
+	printf("\n%.0f transfers/s\n", (tm > 0) ? n / tm : 0);
+	return ((rply.stats.cnt[USB_PCAP_RPLY_STALL_DIFF] || rply.stats.cnt[USB_PCAP_RPLY_DATA_DIFF]) ? 1 : 0);
+}
+
+/**
+ * usage
+ */
+static void usage(void)
+{
+	fprintf(stderr, "usage: pcap_rply [-m mps] [-d bus.dev] [-o out.pcap] [-v] capture.pcap\n");
+	exit(2);
+}
+
+/**
+ * print_ctl
+ */
+static void print_ctl(const char *what, const struct usb_pcap_ctl *c)
+{
+	uint32_t i;
+
+	printf("  %-8s %u.%u stp", what, c->bus, c->dev);
+	for (i = 0; i < sizeof(c->stp); i++) {
+		printf(" %02x", c->stp[i]);
+	}
+	printf(" status %d len %u", c->status, c->len);
+	for (i = 0; i < c->nmb && i < 16; i++) {
+		printf("%s%02x", (i) ? " " : " data ", c->data[i]);
+	}
+	printf("%s\n", (c->nmb > 16) ? " ..." : "");
+}
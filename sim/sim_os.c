@@ -0,0 +1,293 @@
+/*
+ * sim_os.c
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include <pthread.h>
+#include <time.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <timers.h>
+#include <gentyp.h>
+#include "sysconf.h"
+#include "msgconf.h"
+#include "criterr.h"
+#include "sim_os.h"
+
+struct sim_tsk {
+	void (*fn)(void *);
+	void *arg;
+	uint32_t ntf;
+	struct sim_tsk *next;
+};
+
+struct sim_tmr {
+	TickType_t period;
+	TickType_t exp;
+	boolean_t reload;
+	boolean_t active;
+	void *id;
+	void (*clbk)(TimerHandle_t tmr);
+	struct sim_tmr *next;
+};
+
+static pthread_mutex_t crit_mtx = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+static __thread struct sim_tsk *tsk_list;
+static __thread struct sim_tsk *cur_tsk;
+static __thread jmp_buf *tsk_exit;
+static __thread struct sim_tmr *tmr_list;
+static __thread TickType_t ticks;
+
+/**
+ * sim_enter_critical
+ */
+void sim_enter_critical(void)
+{
+	pthread_mutex_lock(&crit_mtx);
+}
+
+/**
+ * sim_exit_critical
+ */
+void sim_exit_critical(void)
+{
+	pthread_mutex_unlock(&crit_mtx);
+}
+
+/**
+ * xTaskCreate
+ */
+BaseType_t xTaskCreate(void (*fn)(void *), const char *name, uint16_t stack, void *arg, UBaseType_t prio,
+		       TaskHandle_t *hndl)
+{
+	struct sim_tsk *t;
+
+	if (!(t = calloc(1, sizeof(struct sim_tsk)))) {
+		return (pdFAIL);
+	}
+	t->fn = fn;
+	t->arg = arg;
+	t->next = tsk_list;
+	tsk_list = t;
+	if (hndl) {
+		*hndl = t;
+	}
+	return (pdPASS);
+}
+
+/**
+ * vTaskNotifyGiveFromISR
+ */
+void vTaskNotifyGiveFromISR(TaskHandle_t tsk, BaseType_t *wkn)
+{
+	tsk->ntf++;
+	if (wkn) {
+		*wkn = pdTRUE;
+	}
+}
+
+/**
+ * ulTaskNotifyTake
+ *
+ * Task without notification leaves its function, sim_run_tsks() calls
+ * it again from beginning when it is notified.
+ */
+uint32_t ulTaskNotifyTake(BaseType_t clr, TickType_t tmo)
+{
+	uint32_t n;
+
+	if (!cur_tsk) {
+		crit_err_exit(APP_ERROR);
+	}
+	if (cur_tsk->ntf == 0) {
+		longjmp(*tsk_exit, 1);
+	}
+	n = cur_tsk->ntf;
+	cur_tsk->ntf = (clr) ? 0 : n - 1;
+	return (n);
+}
+
+/**
+ * sim_run_tsks
+ */
+void sim_run_tsks(void)
+{
+	struct sim_tsk *volatile t;
+	jmp_buf env;
+	boolean_t run;
+
+	if (cur_tsk) {
+		return;
+	}
+	do {
+		run = FALSE;
+		for (t = tsk_list; t; t = t->next) {
+			if (t->ntf == 0) {
+				continue;
+			}
+			run = TRUE;
+			cur_tsk = t;
+			tsk_exit = &env;
+			if (!setjmp(env)) {
+				t->fn(t->arg);
+			}
+			cur_tsk = NULL;
+		}
+	} while (run);
+}
+
+/**
+ * xTaskGetTickCount
+ */
+TickType_t xTaskGetTickCount(void)
+{
+	return (ticks);
+}
+
+/**
+ * xTaskGetTickCountFromISR
+ */
+TickType_t xTaskGetTickCountFromISR(void)
+{
+	return (ticks);
+}
+
+/**
+ * xTimerCreate
+ */
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t reload, void *id,
+			   void (*clbk)(TimerHandle_t tmr))
+{
+	struct sim_tmr *t;
+
+	if (!(t = calloc(1, sizeof(struct sim_tmr)))) {
+		return (NULL);
+	}
+	t->period = period;
+	t->reload = (reload) ? TRUE : FALSE;
+	t->id = id;
+	t->clbk = clbk;
+	t->next = tmr_list;
+	tmr_list = t;
+	return (t);
+}
+
+/**
+ * xTimerStart
+ */
+BaseType_t xTimerStart(TimerHandle_t tmr, TickType_t tmo)
+{
+	tmr->exp = ticks + tmr->period;
+	tmr->active = TRUE;
+	return (pdPASS);
+}
+
+/**
+ * xTimerStop
+ */
+BaseType_t xTimerStop(TimerHandle_t tmr, TickType_t tmo)
+{
+	tmr->active = FALSE;
+	return (pdPASS);
+}
+
+/**
+ * xTimerReset
+ */
+BaseType_t xTimerReset(TimerHandle_t tmr, TickType_t tmo)
+{
+	return (xTimerStart(tmr, tmo));
+}
+
+/**
+ * xTimerIsTimerActive
+ */
+BaseType_t xTimerIsTimerActive(TimerHandle_t tmr)
+{
+	return ((tmr->active) ? pdTRUE : pdFALSE);
+}
+
+/**
+ * pvTimerGetTimerID
+ */
+void *pvTimerGetTimerID(TimerHandle_t tmr)
+{
+	return (tmr->id);
+}
+
+/**
+ * sim_tick
+ */
+void sim_tick(int nmb)
+{
+	struct sim_tmr *t;
+
+	while (nmb-- > 0) {
+		ticks++;
+		for (t = tmr_list; t; t = t->next) {
+			if (t->active && t->exp == ticks) {
+				if (t->reload) {
+					t->exp = ticks + t->period;
+				} else {
+					t->active = FALSE;
+				}
+				t->clbk(t);
+			}
+		}
+		sim_run_tsks();
+	}
+}
+
+/**
+ * sim_cycles
+ */
+uint64_t sim_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return (__builtin_ia32_rdtsc());
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec);
+#endif
+}
+
+/**
+ * crit_err_exit
+ */
+void crit_err_exit(enum crit_err err)
+{
+	fprintf(stderr, "crit_err_exit: %d\n", err);
+	abort();
+}
+
+/**
+ * msg
+ */
+void msg(int lvl, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+}
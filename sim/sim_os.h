@@ -0,0 +1,45 @@
+/*
+ * sim_os.h
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef SIM_OS_H
+#define SIM_OS_H
+
+/**
+ * sim_run_tsks
+ *
+ * Runs tasks created by calling thread until none of them has pending
+ * notification (task gives up CPU in ulTaskNotifyTake()).
+ */
+void sim_run_tsks(void);
+
+/**
+ * sim_tick
+ *
+ * Advances tick count by nmb ticks and fires expired timers of calling
+ * thread.
+ */
+void sim_tick(int nmb);
+
+/**
+ * sim_cycles
+ *
+ * Returns CPU time stamp counter (monotonic clock ns if not available).
+ */
+uint64_t sim_cycles(void);
+
+#endif
@@ -0,0 +1,450 @@
+/*
+ * sim_udp.c
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <gentyp.h>
+#include "sysconf.h"
+#include "criterr.h"
+#include "udp.h"
+#include "usb_std_def.h"
+#include "usb_ctl_req_trc.h"
+#include "usb_ctl_req.h"
+#include "sim_os.h"
+#include "sim_udp.h"
+
+enum phase {
+	PHASE_IN,
+	PHASE_OUT,
+	PHASE_STATUS_IN,
+	PHASE_STATUS_OUT,
+	PHASE_DONE
+};
+
+static int run(struct sim_udp *sim);
+static boolean_t stalled(struct sim_udp *sim);
+static void rxstp(struct sim_udp *sim);
+static void txcomp(struct sim_udp *sim);
+static void rxdata(struct sim_udp *sim, int nmb);
+static void stlsnt(struct sim_udp *sim);
+static int pkt_sz(void *hw);
+static void read_fifo(void *hw, void *buf, int nmb);
+static void write_fifo(void *hw, const void *buf, int nmb);
+static void rxstp_done(void *hw, int dir);
+static void tx_pkt_rdy(void *hw);
+static void req_stl(void *hw);
+static void nop(void *hw);
+
+const struct usb_ctl_req_drv sim_udp_drv = {
+	.in_bat = 1,
+	.pkt_sz = pkt_sz,
+	.read_fifo = read_fifo,
+	.write_fifo = write_fifo,
+	.rxstp_done = rxstp_done,
+	.tx_pkt_rdy = tx_pkt_rdy,
+	.req_stl = req_stl,
+	.disable_stl = nop,
+	.txcomp_accept = nop,
+	.rxdata_done = nop,
+	.stlsnt_accept = nop
+};
+
+const struct usb_ctl_req_drv sim_udp_bat_drv = {
+	.in_bat = 2,
+	.pkt_sz = pkt_sz,
+	.read_fifo = read_fifo,
+	.write_fifo = write_fifo,
+	.rxstp_done = rxstp_done,
+	.tx_pkt_rdy = tx_pkt_rdy,
+	.req_stl = req_stl,
+	.disable_stl = nop,
+	.txcomp_accept = nop,
+	.rxdata_done = nop,
+	.stlsnt_accept = nop
+};
+
+struct sim_udp sim_udp0 = {
+	.mps = 8
+};
+
+static void (*udp_rxstp_clbk)(void);
+static void (*udp_txcomp_clbk)(void);
+static void (*udp_rxdata_clbk)(int nmb);
+static void (*udp_stlsnt_clbk)(void);
+
+/**
+ * sim_udp_ctl
+ */
+int sim_udp_ctl(struct sim_udp *sim, const uint8_t *stp, uint8_t *buf)
+{
+	memcpy(sim->stp, stp, sizeof(sim->stp));
+	sim->buf = buf;
+	sim->len = stp[6] | (stp[7] << 8);
+	sim->offs = 0;
+	sim->tx_nmb = 0;
+	sim->pkt_nmb = 0;
+	sim->que_nmb = 0;
+	sim->stall = FALSE;
+	sim->rx = sim->stp;
+	sim->rx_nmb = sizeof(sim->stp);
+	rxstp(sim);
+	if (stp[0] & 0x80) {
+		sim->phase = PHASE_IN;
+	} else {
+		sim->phase = (sim->len) ? PHASE_OUT : PHASE_STATUS_IN;
+	}
+	return (run(sim));
+}
+
+/**
+ * sim_udp_resume
+ */
+int sim_udp_resume(struct sim_udp *sim)
+{
+	return (run(sim));
+}
+
+/**
+ * run
+ *
+ * Host stops IN data stage after short packet or wLength bytes.
+ */
+static int run(struct sim_udp *sim)
+{
+	int i, n;
+
+	while (sim->phase != PHASE_DONE) {
+		if (stalled(sim)) {
+			return (SIM_UDP_STALL);
+		}
+		switch (sim->phase) {
+		case PHASE_IN :
+			if (sim->que_nmb == 0) {
+				return (SIM_UDP_NAK);
+			}
+			for (i = 0; i < sim->que_nmb && sim->phase == PHASE_IN; i++) {
+				n = sim->pkt_que[i];
+				sim->offs += n;
+				if (n < sim->mps || sim->offs >= sim->len) {
+					sim->phase = PHASE_STATUS_OUT;
+				}
+			}
+			sim->que_nmb = 0;
+			txcomp(sim);
+			break;
+		case PHASE_OUT :
+			n = (sim->len - sim->offs < sim->mps) ? sim->len - sim->offs : sim->mps;
+			sim->rx = sim->buf + sim->offs;
+			sim->rx_nmb = n;
+			sim->offs += n;
+			if (sim->offs == sim->len) {
+				sim->phase = PHASE_STATUS_IN;
+			}
+			rxdata(sim, n);
+			break;
+		case PHASE_STATUS_IN :
+			if (sim->que_nmb == 0) {
+				return (SIM_UDP_NAK);
+			}
+			sim->que_nmb = 0;
+			sim->phase = PHASE_DONE;
+			txcomp(sim);
+			break;
+		case PHASE_STATUS_OUT :
+			sim->rx_nmb = 0;
+			sim->phase = PHASE_DONE;
+			rxdata(sim, 0);
+			break;
+		}
+	}
+	return ((sim->stp[0] & 0x80) ? ((sim->offs < sim->len) ? sim->offs : sim->len) : sim->len);
+}
+
+/**
+ * stalled
+ *
+ * Host gets STALL handshake, controller reports it.
+ */
+static boolean_t stalled(struct sim_udp *sim)
+{
+	if (!sim->stall) {
+		return (FALSE);
+	}
+	if (sim->phase != PHASE_DONE) {
+		sim->phase = PHASE_DONE;
+		stlsnt(sim);
+	}
+	return (TRUE);
+}
+
+/**
+ * sim_udp_stp
+ */
+void sim_udp_stp(uint8_t *stp, int type, int req, int val, int idx, int len)
+{
+	stp[0] = type;
+	stp[1] = req;
+	stp[2] = val;
+	stp[3] = val >> 8;
+	stp[4] = idx;
+	stp[5] = idx >> 8;
+	stp[6] = len;
+	stp[7] = len >> 8;
+}
+
+/**
+ * rxstp
+ */
+static void rxstp(struct sim_udp *sim)
+{
+	sim->evnt_cnt++;
+	if (sim->dev) {
+		usb_ctl_req_rxstp(sim->dev);
+	} else {
+		udp_rxstp_clbk();
+	}
+	sim_run_tsks();
+}
+
+/**
+ * txcomp
+ */
+static void txcomp(struct sim_udp *sim)
+{
+	sim->evnt_cnt++;
+	if (sim->dev) {
+		usb_ctl_req_txcomp(sim->dev);
+	} else {
+		udp_txcomp_clbk();
+	}
+	sim_run_tsks();
+}
+
+/**
+ * rxdata
+ */
+static void rxdata(struct sim_udp *sim, int nmb)
+{
+	sim->evnt_cnt++;
+	if (sim->dev) {
+		usb_ctl_req_rxdata(sim->dev, nmb);
+	} else {
+		udp_rxdata_clbk(nmb);
+	}
+	sim_run_tsks();
+}
+
+/**
+ * stlsnt
+ */
+static void stlsnt(struct sim_udp *sim)
+{
+	sim->evnt_cnt++;
+	if (sim->dev) {
+		usb_ctl_req_stlsnt(sim->dev);
+	} else {
+		udp_stlsnt_clbk();
+	}
+}
+
+/**
+ * pkt_sz
+ */
+static int pkt_sz(void *hw)
+{
+	return (((struct sim_udp *) hw)->mps);
+}
+
+/**
+ * read_fifo
+ */
+static void read_fifo(void *hw, void *buf, int nmb)
+{
+	struct sim_udp *sim = hw;
+
+	if (nmb > sim->rx_nmb) {
+		crit_err_exit(APP_ERROR);
+	}
+	memcpy(buf, sim->rx, nmb);
+}
+
+/**
+ * write_fifo
+ *
+ * Bytes beyond wLength are counted, host does not read them.
+ */
+static void write_fifo(void *hw, const void *buf, int nmb)
+{
+	struct sim_udp *sim = hw;
+	int n;
+
+	if (sim->tx_nmb < sim->len) {
+		n = (sim->tx_nmb + nmb <= sim->len) ? nmb : sim->len - sim->tx_nmb;
+		memcpy(sim->buf + sim->tx_nmb, buf, n);
+	}
+	sim->tx_nmb += nmb;
+	sim->pkt_nmb += nmb;
+}
+
+/**
+ * rxstp_done
+ */
+static void rxstp_done(void *hw, int dir)
+{
+	((struct sim_udp *) hw)->dir = dir;
+}
+
+/**
+ * tx_pkt_rdy
+ */
+static void tx_pkt_rdy(void *hw)
+{
+	struct sim_udp *sim = hw;
+	int bat = (sim->dev) ? sim->dev->drv->in_bat : 1;
+
+	// Engine must not queue more packets than controller holds.
+	if (sim->pkt_nmb > sim->mps || sim->que_nmb == bat || sim->que_nmb == SIM_UDP_PKT_QUE_SZ) {
+		crit_err_exit(APP_ERROR);
+	}
+	sim->pkt_que[sim->que_nmb++] = sim->pkt_nmb;
+	sim->pkt_nmb = 0;
+}
+
+/**
+ * req_stl
+ */
+static void req_stl(void *hw)
+{
+	((struct sim_udp *) hw)->stall = TRUE;
+}
+
+/**
+ * nop
+ */
+static void nop(void *hw)
+{
+}
+
+/**
+ * udp_endp0_pkt_sz
+ */
+int udp_endp0_pkt_sz(void)
+{
+	return (pkt_sz(&sim_udp0));
+}
+
+/**
+ * add_udp_endp0_rxstp_clbk
+ */
+void add_udp_endp0_rxstp_clbk(void (*clbk)(void))
+{
+	udp_rxstp_clbk = clbk;
+}
+
+/**
+ * add_udp_endp0_txcomp_clbk
+ */
+void add_udp_endp0_txcomp_clbk(void (*clbk)(void))
+{
+	udp_txcomp_clbk = clbk;
+}
+
+/**
+ * add_udp_endp0_rxdata_clbk
+ */
+void add_udp_endp0_rxdata_clbk(void (*clbk)(int nmb))
+{
+	udp_rxdata_clbk = clbk;
+}
+
+/**
+ * add_udp_endp0_stlsnt_clbk
+ */
+void add_udp_endp0_stlsnt_clbk(void (*clbk)(void))
+{
+	udp_stlsnt_clbk = clbk;
+}
+
+/**
+ * read_udp_endp0_fifo
+ */
+void read_udp_endp0_fifo(void *buf, int nmb)
+{
+	read_fifo(&sim_udp0, buf, nmb);
+}
+
+/**
+ * write_udp_endp0_fifo
+ */
+void write_udp_endp0_fifo(const void *buf, int nmb)
+{
+	write_fifo(&sim_udp0, buf, nmb);
+}
+
+/**
+ * udp_endp0_rxstp_done
+ */
+void udp_endp0_rxstp_done(int dir)
+{
+	rxstp_done(&sim_udp0, dir);
+}
+
+/**
+ * udp_endp0_tx_pkt_rdy
+ */
+void udp_endp0_tx_pkt_rdy(void)
+{
+	tx_pkt_rdy(&sim_udp0);
+}
+
+/**
+ * udp_endp0_req_stl
+ */
+void udp_endp0_req_stl(void)
+{
+	req_stl(&sim_udp0);
+}
+
+/**
+ * udp_endp0_disable_stl
+ */
+void udp_endp0_disable_stl(void)
+{
+}
+
+/**
+ * udp_endp0_txcomp_accept
+ */
+void udp_endp0_txcomp_accept(void)
+{
+}
+
+/**
+ * udp_endp0_rxdata_done
+ */
+void udp_endp0_rxdata_done(void)
+{
+}
+
+/**
+ * udp_endp0_stlsnt_accept
+ */
+void udp_endp0_stlsnt_accept(void)
+{
+}
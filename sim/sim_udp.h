@@ -0,0 +1,80 @@
+/*
+ * sim_udp.h
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef SIM_UDP_H
+#define SIM_UDP_H
+
+#define SIM_UDP_STALL (-1) // Request stalled.
+#define SIM_UDP_NAK (-2) // Data or status stage NAKed (deferred or pending request).
+
+#define SIM_UDP_PKT_QUE_SZ 8
+
+// Simulated endpoint 0 of device controller. Host side of control
+// transfers is played by sim_udp_ctl(). Engine instance dev is driven by
+// sim_udp_drv or sim_udp_bat_drv (two IN banks) with simulated controller
+// as hw. sim_udp0 (dev NULL) is controller of udp.h API, its events go to
+// callbacks registered by init_usb_ctl_req_udp(). mps and dev must be set
+// before engine is initialized, members after evnt_cnt are private.
+struct sim_udp {
+	uint8_t mps;
+	struct usb_ctl_req_dev *dev;
+	uint64_t evnt_cnt; // Events delivered to engine.
+	uint8_t stp[8];
+	uint8_t *buf;
+	int len;
+	int offs;
+	uint8_t phase;
+	const uint8_t *rx;
+	int rx_nmb;
+	int tx_nmb;
+	int pkt_nmb;
+	uint16_t pkt_que[SIM_UDP_PKT_QUE_SZ];
+	int que_nmb;
+	boolean_t stall;
+	int dir;
+};
+
+extern const struct usb_ctl_req_drv sim_udp_drv;
+extern const struct usb_ctl_req_drv sim_udp_bat_drv;
+extern struct sim_udp sim_udp0;
+
+/**
+ * sim_udp_ctl
+ *
+ * Performs control transfer of setup packet stp. OUT data stage is sent
+ * from buf, IN data stage is stored to buf (wLength bytes). Deferred
+ * callbacks run before host sends next token. Returns number of data
+ * stage bytes, SIM_UDP_STALL or SIM_UDP_NAK (continue by sim_udp_resume()).
+ */
+int sim_udp_ctl(struct sim_udp *sim, const uint8_t *stp, uint8_t *buf);
+
+/**
+ * sim_udp_resume
+ *
+ * Host retries NAKed stage of transfer. Returns as sim_udp_ctl().
+ */
+int sim_udp_resume(struct sim_udp *sim);
+
+/**
+ * sim_udp_stp
+ *
+ * Fills setup packet stp.
+ */
+void sim_udp_stp(uint8_t *stp, int type, int req, int val, int idx, int len);
+
+#endif
@@ -0,0 +1,818 @@
+/*
+ * test_ctl_req.c
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <gentyp.h>
+#include "sysconf.h"
+#include "criterr.h"
+#include "udp.h"
+#include "usb_std_def.h"
+#include "usb_ctl_req_trc.h"
+#include "usb_ctl_req.h"
+#include "sim_udp.h"
+
+#define CHECK(c) do {if (!(c)) {fail(__LINE__, #c);}} while (0)
+
+#define VND_OUT 0x40
+#define VND_IN 0xC0
+#define BUF_SZ 1024
+
+enum vnd_req {
+	REQ_IN = 1,
+	REQ_OUT,
+	REQ_NO_DATA,
+	REQ_STALL,
+	REQ_FRAG,
+	REQ_OUT_PKT,
+	REQ_IN_PKT,
+	REQ_HNDLR,
+	REQ_DEFER_NO_DATA,
+	REQ_DEFER_IN,
+	REQ_DEFER_OUT,
+	REQ_PEND,
+	REQ_DEFER_PEND
+};
+
+#define CLS_OUT 0x20
+
+static void fail(int line, const char *cond);
+static struct usb_ctl_req vnd_stp(struct usb_ctl_req_dev *dev, struct usb_stp_pkt *stp);
+static void in_ack(struct usb_ctl_req_dev *dev);
+static boolean_t out_rec(struct usb_ctl_req_dev *dev);
+static void out_ack(struct usb_ctl_req_dev *dev);
+static void abort_req(struct usb_ctl_req_dev *dev);
+static void in_pkt(void *arg, uint8_t *pkt, int nmb, int rem);
+static uint8_t *out_pkt(void *arg, uint8_t *pkt, int nmb);
+static void fill(uint8_t *buf, int nmb, int seed);
+static void add_clbks(struct usb_ctl_req_dev *dev, int n);
+static void run_cfg(struct usb_ctl_req_dev *dev, struct sim_udp *sim);
+static void test_in(struct usb_ctl_req_dev *dev, struct sim_udp *sim, int req, int len, int w_len);
+static void test_out(struct usb_ctl_req_dev *dev, struct sim_udp *sim, int req, int len);
+static void test_no_data(struct usb_ctl_req_dev *dev, struct sim_udp *sim);
+static void test_hndlr(struct usb_ctl_req_dev *dev, struct sim_udp *sim);
+static struct usb_ctl_req scope_stp(struct usb_ctl_req_dev *dev, struct usb_stp_pkt *stp);
+static struct usb_ctl_req any_stp(struct usb_ctl_req_dev *dev, struct usb_stp_pkt *stp);
+static void test_fn(struct usb_ctl_req_dev *dev, struct sim_udp *sim);
+static void test_defer(struct usb_ctl_req_dev *dev, struct sim_udp *sim);
+static void test_pend(struct usb_ctl_req_dev *dev, struct sim_udp *sim);
+#if USB_CTL_REQ_TRC == 1
+static void test_trc(struct usb_ctl_req_dev *dev, struct sim_udp *sim);
+#endif
+#if USB_CTL_REQ_INSTR == 1
+static void test_instr(struct usb_ctl_req_dev *dev, struct sim_udp *sim);
+static struct usb_ctl_req_req_instr *find_instr(struct usb_ctl_req_instr *instr, int req);
+#endif
+static struct usb_ctl_req fn_a_stp(struct usb_ctl_req_dev *dev, struct usb_stp_pkt *stp);
+static struct usb_ctl_req fn_b_stp(struct usb_ctl_req_dev *dev, struct usb_stp_pkt *stp);
+
+static struct usb_ctl_req_clbks vnd_clbks = {
+	.stp_clbk = vnd_stp,
+	.in_req_ack_clbk = in_ack,
+	.out_req_rec_clbk = out_rec,
+	.out_req_ack_clbk = out_ack,
+	.abort_clbk = abort_req,
+	.arg = &vnd_clbks
+};
+
+static struct usb_ctl_req_clbks defer_clbks = {
+	.stp_clbk = vnd_stp,
+	.in_req_ack_clbk = in_ack,
+	.out_req_rec_clbk = out_rec,
+	.out_req_ack_clbk = out_ack,
+	.abort_clbk = abort_req,
+	.defer = (USB_CTL_REQ_DEFER == 1) ? TRUE : FALSE,
+	.arg = &defer_clbks
+};
+
+static struct usb_ctl_req_clbks scope_clbks = {
+	.stp_clbk = scope_stp,
+	.in_req_ack_clbk = in_ack,
+	.out_req_rec_clbk = out_rec,
+	.out_req_ack_clbk = out_ack
+};
+
+static struct usb_ctl_req_clbks any_clbks = {
+	.stp_clbk = any_stp,
+	.in_req_ack_clbk = in_ack,
+	.out_req_rec_clbk = out_rec,
+	.out_req_ack_clbk = out_ack
+};
+
+// Wildcard handler registered before scoped one.
+static const struct usb_ctl_req_hndlr hndlr_tmpl[] = {
+	{USB_VENDOR_REQUEST, USB_IFACE_RECIPIENT, REQ_HNDLR, USB_CTL_REQ_ANY_SCOPE, &any_clbks, NULL},
+	{USB_VENDOR_REQUEST, USB_IFACE_RECIPIENT, REQ_HNDLR, 2, &scope_clbks, NULL}
+};
+
+static struct usb_ctl_req_clbks fn_a_clbks = {
+	.stp_clbk = fn_a_stp,
+	.in_req_ack_clbk = in_ack,
+	.out_req_rec_clbk = out_rec,
+	.out_req_ack_clbk = out_ack
+};
+
+static struct usb_ctl_req_clbks fn_b_clbks = {
+	.stp_clbk = fn_b_stp,
+	.in_req_ack_clbk = in_ack,
+	.out_req_rec_clbk = out_rec,
+	.out_req_ack_clbk = out_ack
+};
+
+static const struct usb_ctl_req_fn fn_tmpl[] = {
+	{0, &fn_a_clbks, NULL},
+	{2, &fn_b_clbks, NULL}
+};
+
+// Function A (IAD, interfaces 0 and 1), function B (interface 2).
+static const uint8_t fn_conf[] = {
+	9, USB_CONF_DESC, 58, 0, 3, 1, 0, USB_STD_BUS_POWER_NO_RWAKE, 50,
+	8, USB_IFACE_ASSOC_DESC, 0, 2, 0xFF, 0, 0, 0,
+	9, USB_IFACE_DESC, 0, 0, 1, 0xFF, 0, 0, 0,
+	7, USB_ENDP_DESC, 0x81, USB_STD_TRANS_INTERRUPT, 8, 0, 10,
+	9, USB_IFACE_DESC, 1, 0, 0, 0xFF, 0, 0, 0,
+	9, USB_IFACE_DESC, 2, 0, 1, 0xFF, 0, 0, 0,
+	7, USB_ENDP_DESC, 0x02, USB_STD_TRANS_BULK, 64, 0, 0
+};
+
+static struct usb_desc_idx fn_idx;
+static uint8_t in_data[BUF_SZ];
+static uint8_t out_data[BUF_SZ];
+static uint8_t pkt_buf[64];
+static struct usb_ctl_req_frag frag[4];
+static int out_offs;
+static int out_lim;
+static int in_ack_cnt;
+static int out_rec_cnt;
+static int out_ack_cnt;
+static int hndlr_hit;
+static int abort_cnt;
+static int defer_cnt;
+static int last_req;
+static int pend_tag;
+static int preempt_tag;
+static boolean_t in_defer_stp;
+static boolean_t abort_in_defer_stp;
+static void *abort_arg;
+static struct sim_udp *cur_sim;
+
+// Instances driven by sim_udp_drv and sim_udp_bat_drv (one per mps) and
+// instance bound to udp.h driver. Handler objects can be registered to
+// one instance only.
+static struct usb_ctl_req_dev devs[9];
+static struct sim_udp sims[8];
+static struct usb_ctl_req_hndlr hndlrs[9][2];
+static struct usb_ctl_req_hndlr defer_hndlr[9][4];
+static struct usb_ctl_req_fn fns[9][2];
+
+static const int mps_tbl[] = {8, 16, 32, 64};
+
+int main(void)
+{
+	int i;
+
+	CHECK(init_usb_desc_idx(&fn_idx, fn_conf, sizeof(fn_conf)));
+	for (i = 0; i < 8; i++) {
+		sims[i].mps = mps_tbl[i % 4];
+		sims[i].dev = &devs[i];
+		init_usb_ctl_req(&devs[i], (i < 4) ? &sim_udp_drv : &sim_udp_bat_drv, &sims[i]);
+		add_clbks(&devs[i], i);
+		run_cfg(&devs[i], &sims[i]);
+	}
+	init_usb_ctl_req_udp(&devs[8]);
+	add_clbks(&devs[8], 8);
+	run_cfg(&devs[8], &sim_udp0);
+	printf("test_ctl_req: ok\n");
+	return (0);
+}
+
+/**
+ * add_clbks
+ */
+static void add_clbks(struct usb_ctl_req_dev *dev, int n)
+{
+	int i;
+
+	add_usb_ctl_req_vnd_clbks(dev, &vnd_clbks);
+	for (i = 0; i < 2; i++) {
+		hndlrs[n][i] = hndlr_tmpl[i];
+		add_usb_ctl_req_hndlr(dev, &hndlrs[n][i]);
+	}
+	for (i = 0; i < 4; i++) {
+		defer_hndlr[n][i].type = USB_VENDOR_REQUEST;
+		defer_hndlr[n][i].recp = USB_DEVICE_RECIPIENT;
+		defer_hndlr[n][i].b_request = (i < 3) ? REQ_DEFER_NO_DATA + i : REQ_DEFER_PEND;
+		defer_hndlr[n][i].scope = USB_CTL_REQ_ANY_SCOPE;
+		defer_hndlr[n][i].clbks = &defer_clbks;
+		add_usb_ctl_req_hndlr(dev, &defer_hndlr[n][i]);
+	}
+	for (i = 0; i < 2; i++) {
+		fns[n][i] = fn_tmpl[i];
+		add_usb_ctl_req_fn_clbks(dev, &fns[n][i]);
+	}
+}
+
+/**
+ * run_cfg
+ */
+static void run_cfg(struct usb_ctl_req_dev *dev, struct sim_udp *sim)
+{
+	static const int lens[] = {0, 1, 7, 8, 9, 16, 63, 64, 65, 128, 200, 512};
+	int i, j;
+
+#if USB_CTL_REQ_INSTR == 1
+	// Request slots are taken in order of arrival, slots of measured
+	// requests must not overflow.
+	test_instr(dev, sim);
+#endif
+	for (i = 0; i < (int) (sizeof(lens) / sizeof(lens[0])); i++) {
+		for (j = 0; j < (int) (sizeof(lens) / sizeof(lens[0])); j++) {
+			test_in(dev, sim, REQ_IN, lens[i], lens[j]);
+			test_in(dev, sim, REQ_FRAG, lens[i], lens[j]);
+			test_in(dev, sim, REQ_IN_PKT, lens[i], lens[j]);
+		}
+		if (lens[i]) {
+			test_out(dev, sim, REQ_OUT, lens[i]);
+			test_out(dev, sim, REQ_OUT_PKT, lens[i]);
+		}
+	}
+	test_no_data(dev, sim);
+	test_hndlr(dev, sim);
+	test_fn(dev, sim);
+	test_defer(dev, sim);
+	test_pend(dev, sim);
+#if USB_CTL_REQ_TRC == 1
+	test_trc(dev, sim);
+#endif
+	CHECK(get_usb_ctl_req_stats(dev)->unexp_udp_evnt_cnt == 0);
+}
+
+/**
+ * test_in
+ *
+ * Device has len bytes, host asks for w_len bytes.
+ */
+static void test_in(struct usb_ctl_req_dev *dev, struct sim_udp *sim, int req, int len, int w_len)
+{
+	uint8_t stp[8], buf[BUF_SZ];
+	int n, exp;
+
+	fill(in_data, len, req);
+	memset(buf, 0xEE, sizeof(buf));
+	sim_udp_stp(stp, VND_IN, req, len, 0, w_len);
+	in_ack_cnt = 0;
+	n = sim_udp_ctl(sim, stp, buf);
+	if (w_len == 0) {
+		// IN request without data stage is OUT no data request.
+		CHECK(n == SIM_UDP_STALL);
+		return;
+	}
+	exp = (len < w_len) ? len : w_len;
+	CHECK(n == exp);
+	CHECK(!memcmp(buf, in_data, exp));
+	CHECK(in_ack_cnt == 1);
+}
+
+/**
+ * test_out
+ */
+static void test_out(struct usb_ctl_req_dev *dev, struct sim_udp *sim, int req, int len)
+{
+	uint8_t stp[8], buf[BUF_SZ];
+
+	fill(buf, len, req + len);
+	memset(out_data, 0, sizeof(out_data));
+	sim_udp_stp(stp, VND_OUT, req, 0, 0, len);
+	out_rec_cnt = out_ack_cnt = 0;
+	CHECK(sim_udp_ctl(sim, stp, buf) == len);
+	CHECK(!memcmp(buf, out_data, len));
+	CHECK(out_rec_cnt == 1 && out_ack_cnt == 1);
+	// Host sends more bytes than request accepts (wValue).
+	sim_udp_stp(stp, VND_OUT, req, 1, 0, len);
+	CHECK(sim_udp_ctl(sim, stp, buf) == ((len > ((req == REQ_OUT) ? 1 : sim->mps)) ? SIM_UDP_STALL : len));
+}
+
+/**
+ * test_no_data
+ */
+static void test_no_data(struct usb_ctl_req_dev *dev, struct sim_udp *sim)
+{
+	uint8_t stp[8];
+
+	sim_udp_stp(stp, VND_OUT, REQ_NO_DATA, 0, 0, 0);
+	out_ack_cnt = 0;
+	CHECK(sim_udp_ctl(sim, stp, NULL) == 0);
+	CHECK(out_ack_cnt == 1);
+	sim_udp_stp(stp, VND_OUT, REQ_STALL, 0, 0, 0);
+	CHECK(sim_udp_ctl(sim, stp, NULL) == SIM_UDP_STALL);
+	// Standard request without std callbacks.
+	sim_udp_stp(stp, 0x80, USB_GET_STATUS, 0, 0, 2);
+	CHECK(sim_udp_ctl(sim, stp, pkt_buf) == SIM_UDP_STALL);
+	CHECK(sim_udp_ctl(sim, stp, pkt_buf) == SIM_UDP_STALL);
+}
+
+/**
+ * test_hndlr
+ */
+static void test_hndlr(struct usb_ctl_req_dev *dev, struct sim_udp *sim)
+{
+	uint8_t stp[8];
+	unsigned int bad;
+
+	// Scoped handler wins for its interface.
+	hndlr_hit = 0;
+	sim_udp_stp(stp, VND_OUT | USB_IFACE_RECIPIENT, REQ_HNDLR, 0, 2, 0);
+	CHECK(sim_udp_ctl(sim, stp, NULL) == 0 && hndlr_hit == 2);
+	sim_udp_stp(stp, VND_OUT | USB_IFACE_RECIPIENT, REQ_HNDLR, 0, 0x0102, 0);
+	CHECK(sim_udp_ctl(sim, stp, NULL) == 0 && hndlr_hit == 2);
+	sim_udp_stp(stp, VND_OUT | USB_IFACE_RECIPIENT, REQ_HNDLR, 0, 3, 0);
+	CHECK(sim_udp_ctl(sim, stp, NULL) == 0 && hndlr_hit == 1);
+	// Other recipient and bRequest of same bucket (default table size)
+	// fall back to vnd callbacks.
+	hndlr_hit = 0;
+	sim_udp_stp(stp, VND_OUT, REQ_HNDLR, 0, 2, 0);
+	CHECK(sim_udp_ctl(sim, stp, NULL) == SIM_UDP_STALL && hndlr_hit == 0);
+	sim_udp_stp(stp, VND_OUT | USB_IFACE_RECIPIENT, REQ_HNDLR + 16, 0, 2, 0);
+	CHECK(sim_udp_ctl(sim, stp, NULL) == SIM_UDP_STALL && hndlr_hit == 0);
+	out_ack_cnt = 0;
+	sim_udp_stp(stp, VND_OUT | USB_IFACE_RECIPIENT, REQ_NO_DATA, 0, 2, 0);
+	CHECK(sim_udp_ctl(sim, stp, NULL) == 0 && hndlr_hit == 0 && out_ack_cnt == 1);
+	// Reserved request type.
+	bad = get_usb_ctl_req_stats(dev)->bad_stp_req_cnt;
+	sim_udp_stp(stp, 0x60, REQ_HNDLR, 0, 0, 0);
+	CHECK(sim_udp_ctl(sim, stp, NULL) == SIM_UDP_STALL);
+	CHECK(get_usb_ctl_req_stats(dev)->bad_stp_req_cnt == bad + 1);
+}
+
+/**
+ * scope_stp
+ */
+static struct usb_ctl_req scope_stp(struct usb_ctl_req_dev *dev, struct usb_stp_pkt *stp)
+{
+	struct usb_ctl_req req = {0};
+
+	hndlr_hit = 2;
+	req.valid = TRUE;
+	req.trans_dir = UDP_CTL_TRANS_OUT;
+	return (req);
+}
+
+/**
+ * any_stp
+ */
+static struct usb_ctl_req any_stp(struct usb_ctl_req_dev *dev, struct usb_stp_pkt *stp)
+{
+	struct usb_ctl_req req = {0};
+
+	hndlr_hit = 1;
+	req.valid = TRUE;
+	req.trans_dir = UDP_CTL_TRANS_OUT;
+	return (req);
+}
+
+/**
+ * test_defer
+ */
+static void test_defer(struct usb_ctl_req_dev *dev, struct sim_udp *sim)
+{
+	uint8_t stp[8], buf[BUF_SZ];
+
+	defer_cnt = 0;
+	sim_udp_stp(stp, VND_OUT, REQ_DEFER_NO_DATA, 0, 0, 0);
+	CHECK(sim_udp_ctl(sim, stp, NULL) == 0);
+	fill(in_data, 100, 3);
+	sim_udp_stp(stp, VND_IN, REQ_DEFER_IN, 100, 0, 100);
+	CHECK(sim_udp_ctl(sim, stp, buf) == 100);
+	CHECK(!memcmp(buf, in_data, 100));
+	fill(buf, 70, 4);
+	sim_udp_stp(stp, VND_OUT, REQ_DEFER_OUT, 0, 0, 70);
+	out_rec_cnt = 0;
+	CHECK(sim_udp_ctl(sim, stp, buf) == 70);
+	CHECK(!memcmp(buf, out_data, 70));
+	CHECK(out_rec_cnt == 1);
+#if USB_CTL_REQ_DEFER == 1
+	CHECK(defer_cnt == 3);
+	// Deferred IN request answered with OUT direction.
+	sim_udp_stp(stp, VND_IN, REQ_DEFER_NO_DATA, 0, 0, 8);
+	CHECK(sim_udp_ctl(sim, stp, buf) == SIM_UDP_STALL);
+#endif
+}
+
+/**
+ * test_pend
+ */
+static void test_pend(struct usb_ctl_req_dev *dev, struct sim_udp *sim)
+{
+	uint8_t stp[8], buf[BUF_SZ];
+
+	sim_udp_stp(stp, VND_OUT, REQ_PEND, 0, 0, 0);
+	out_ack_cnt = 0;
+	CHECK(sim_udp_ctl(sim, stp, NULL) == SIM_UDP_NAK);
+	CHECK(sim_udp_resume(sim) == SIM_UDP_NAK);
+	CHECK(complete_usb_ctl_req(dev, pend_tag, TRUE));
+	CHECK(!complete_usb_ctl_req(dev, pend_tag, TRUE));
+	CHECK(sim_udp_resume(sim) == 0);
+	CHECK(out_ack_cnt == 1);
+	// Rejected pending request.
+	CHECK(sim_udp_ctl(sim, stp, NULL) == SIM_UDP_NAK);
+	CHECK(complete_usb_ctl_req(dev, pend_tag, FALSE));
+	CHECK(sim_udp_resume(sim) == SIM_UDP_STALL);
+	// Pending OUT data stage.
+	fill(buf, 20, 5);
+	sim_udp_stp(stp, VND_OUT, REQ_PEND, 0, 0, 20);
+	CHECK(sim_udp_ctl(sim, stp, buf) == SIM_UDP_NAK);
+	CHECK(!memcmp(buf, out_data, 20));
+	CHECK(complete_usb_ctl_req(dev, pend_tag, TRUE));
+	CHECK(sim_udp_resume(sim) == 20);
+	// New SETUP aborts pending request.
+	sim_udp_stp(stp, VND_OUT, REQ_PEND, 0, 0, 0);
+	CHECK(sim_udp_ctl(sim, stp, NULL) == SIM_UDP_NAK);
+	preempt_tag = pend_tag;
+	abort_cnt = 0;
+	sim_udp_stp(stp, VND_OUT, REQ_NO_DATA, 0, 0, 0);
+	CHECK(sim_udp_ctl(sim, stp, NULL) == 0);
+	CHECK(abort_cnt == 1);
+	CHECK(!complete_usb_ctl_req(dev, preempt_tag, TRUE));
+	// Finished request is not aborted.
+	CHECK(sim_udp_ctl(sim, stp, NULL) == 0);
+	CHECK(abort_cnt == 1);
+#if USB_CTL_REQ_DEFER == 1
+	// Tag of deferred request is not tag of request which overran it.
+	cur_sim = sim;
+	sim_udp_stp(stp, VND_OUT, REQ_DEFER_PEND, 0, 0, 0);
+	CHECK(sim_udp_ctl(sim, stp, NULL) == SIM_UDP_NAK);
+	CHECK(complete_usb_ctl_req(dev, pend_tag, TRUE));
+	CHECK(sim_udp_resume(sim) == 0);
+	sim_udp_stp(stp, VND_OUT, REQ_DEFER_PEND, 1, 0, 0);
+	abort_cnt = 0;
+	abort_arg = NULL;
+	CHECK(sim_udp_ctl(sim, stp, NULL) == SIM_UDP_NAK);
+	// Overrun deferred request is aborted after its callback returned.
+	CHECK(abort_cnt == 1 && !abort_in_defer_stp && abort_arg == &defer_clbks);
+	CHECK(!complete_usb_ctl_req(dev, pend_tag, TRUE));
+	CHECK(complete_usb_ctl_req(dev, preempt_tag, TRUE));
+	CHECK(sim_udp_resume(sim) == 0);
+#endif
+}
+
+#if USB_CTL_REQ_TRC == 1
+/**
+ * test_trc
+ */
+static void test_trc(struct usb_ctl_req_dev *dev, struct sim_udp *sim)
+{
+	static struct usb_ctl_req_trc rec[USB_CTL_REQ_TRC_SZ];
+	uint8_t stp[8];
+	char txt[100];
+	unsigned int drop;
+	int i, n;
+
+	while (drain_usb_ctl_req_trc(dev, rec, USB_CTL_REQ_TRC_SZ)) {
+		;
+	}
+	sim_udp_stp(stp, VND_OUT, REQ_STALL, 0, 0, 0);
+	CHECK(sim_udp_ctl(sim, stp, NULL) == SIM_UDP_STALL);
+	CHECK(drain_usb_ctl_req_trc(dev, rec, USB_CTL_REQ_TRC_SZ) == 2);
+	CHECK(rec[0].evnt == USB_CTL_REQ_TRC_STP && !memcmp(rec[0].stp, stp, 8));
+	CHECK(rec[1].evnt == USB_CTL_REQ_TRC_STALL && rec[1].arg == USB_CTL_REQ_TRC_REJECTED);
+	CHECK(fmt_usb_ctl_req_trc(&rec[1], txt, sizeof(txt)) > 0 && strstr(txt, "stall rejected"));
+	// Full trace drops new records and keeps old ones.
+	drop = get_usb_ctl_req_stats(dev)->trc_drop_cnt;
+	sim_udp_stp(stp, VND_OUT, REQ_NO_DATA, 0, 0, 0);
+	for (i = 0; i < USB_CTL_REQ_TRC_SZ; i++) {
+		CHECK(sim_udp_ctl(sim, stp, NULL) == 0);
+	}
+	CHECK(get_usb_ctl_req_stats(dev)->trc_drop_cnt != drop);
+	CHECK(drain_usb_ctl_req_trc(dev, rec, USB_CTL_REQ_TRC_SZ) == USB_CTL_REQ_TRC_SZ);
+	CHECK(rec[0].evnt == USB_CTL_REQ_TRC_STP && rec[0].stp[1] == REQ_NO_DATA);
+	CHECK(drain_usb_ctl_req_trc(dev, rec, USB_CTL_REQ_TRC_SZ) == 0);
+	// Pending request cut by SETUP.
+	drop = get_usb_ctl_req_stats(dev)->cancel_cnt;
+	sim_udp_stp(stp, VND_OUT, REQ_PEND, 0, 0, 0);
+	CHECK(sim_udp_ctl(sim, stp, NULL) == SIM_UDP_NAK);
+	sim_udp_stp(stp, VND_OUT, REQ_NO_DATA, 0, 0, 0);
+	CHECK(sim_udp_ctl(sim, stp, NULL) == 0);
+	CHECK(get_usb_ctl_req_stats(dev)->cancel_cnt == drop + 1);
+	n = drain_usb_ctl_req_trc(dev, rec, USB_CTL_REQ_TRC_SZ);
+	for (i = 0; i < n && rec[i].evnt != USB_CTL_REQ_TRC_ABORT; i++) {
+		;
+	}
+	CHECK(i + 1 < n && rec[i + 1].evnt == USB_CTL_REQ_TRC_STP && rec[i + 1].stp[1] == REQ_NO_DATA);
+	CHECK(fmt_usb_ctl_req_trc(&rec[i], txt, sizeof(txt)) > 0 && strstr(txt, "abort"));
+}
+#endif
+
+#if USB_CTL_REQ_INSTR == 1
+/**
+ * test_instr
+ */
+static void test_instr(struct usb_ctl_req_dev *dev, struct sim_udp *sim)
+{
+	static struct usb_ctl_req_instr a, b;
+	struct usb_ctl_req_stats stats;
+	struct usb_ctl_req_req_instr *p, *q;
+	uint8_t stp[8];
+	uint32_t n;
+	int i;
+
+	sim_udp_stp(stp, VND_OUT, REQ_NO_DATA, 0, 0, 0);
+	CHECK(sim_udp_ctl(sim, stp, NULL) == 0);
+	sim_udp_stp(stp, VND_OUT, REQ_STALL, 0, 0, 0);
+	CHECK(sim_udp_ctl(sim, stp, NULL) == SIM_UDP_STALL);
+	snap_usb_ctl_req_instr(dev, &a);
+	for (i = 0; i < 5; i++) {
+		sim_udp_stp(stp, VND_OUT, REQ_NO_DATA, 0, 0, 0);
+		CHECK(sim_udp_ctl(sim, stp, NULL) == 0);
+	}
+	for (i = 0; i < 3; i++) {
+		sim_udp_stp(stp, VND_OUT, REQ_STALL, 0, 0, 0);
+		CHECK(sim_udp_ctl(sim, stp, NULL) == SIM_UDP_STALL);
+	}
+	snap_usb_ctl_req_instr(dev, &b);
+	CHECK(b.isr[USB_CTL_REQ_RXSTP_ISR].cnt - a.isr[USB_CTL_REQ_RXSTP_ISR].cnt == 8);
+	CHECK(b.isr[USB_CTL_REQ_RXSTP_ISR].max >= a.isr[USB_CTL_REQ_RXSTP_ISR].max);
+	p = find_instr(&a, REQ_NO_DATA);
+	q = find_instr(&b, REQ_NO_DATA);
+	CHECK(p && q && q->cnt - p->cnt == 5 && q->stall_cnt == p->stall_cnt);
+	for (n = 0, i = 0; i < USB_CTL_REQ_INSTR_HIST_NMB; i++) {
+		n += q->hist[i] - p->hist[i];
+	}
+	CHECK(n == 5);
+	p = find_instr(&a, REQ_STALL);
+	q = find_instr(&b, REQ_STALL);
+	CHECK(p && q && q->cnt - p->cnt == 3 && q->stall_cnt - p->stall_cnt == 3);
+	for (i = 0; i < USB_CTL_REQ_INSTR_HIST_NMB; i++) {
+		CHECK(q->hist[i] == p->hist[i]);
+	}
+	snap_usb_ctl_req_stats(dev, &stats);
+	CHECK(!memcmp(&stats, get_usb_ctl_req_stats(dev), sizeof(stats)));
+}
+
+/**
+ * find_instr
+ */
+static struct usb_ctl_req_req_instr *find_instr(struct usb_ctl_req_instr *instr, int req)
+{
+	int i;
+
+	for (i = 0; i < USB_CTL_REQ_INSTR_REQ_NMB; i++) {
+		if (instr->req[i].key == (((VND_OUT & 0x60) << 3) | req)) {
+			return (&instr->req[i]);
+		}
+	}
+	return (NULL);
+}
+#endif
+
+/**
+ * test_fn
+ */
+static void test_fn(struct usb_ctl_req_dev *dev, struct sim_udp *sim)
+{
+	static const struct {
+		int recp;
+		int idx;
+		int hit;
+	} tbl[] = {
+		{USB_IFACE_RECIPIENT, 0, 3},
+		{USB_IFACE_RECIPIENT, 1, 3},
+		{USB_IFACE_RECIPIENT, 2, 4},
+		{USB_IFACE_RECIPIENT, 3, 0},
+		{USB_IFACE_RECIPIENT, 200, 0},
+		{USB_ENDP_RECIPIENT, 0x81, 3},
+		{USB_ENDP_RECIPIENT, 0x02, 4},
+		{USB_ENDP_RECIPIENT, 0x82, 0},
+		{USB_DEVICE_RECIPIENT, 0, 0}
+	};
+	uint8_t stp[8];
+	int i, n;
+
+	set_usb_ctl_req_fn_conf(dev, &fn_idx);
+	for (i = 0; i < (int) (sizeof(tbl) / sizeof(tbl[0])); i++) {
+		hndlr_hit = 0;
+		sim_udp_stp(stp, CLS_OUT | tbl[i].recp, 1, 0, tbl[i].idx, 0);
+		n = sim_udp_ctl(sim, stp, NULL);
+		// Requests no function owns go to (missing) cls callbacks.
+		CHECK(n == ((tbl[i].hit) ? 0 : SIM_UDP_STALL) && hndlr_hit == tbl[i].hit);
+	}
+	// Device is not configured.
+	set_usb_ctl_req_fn_conf(dev, NULL);
+	sim_udp_stp(stp, CLS_OUT | USB_IFACE_RECIPIENT, 1, 0, 0, 0);
+	CHECK(sim_udp_ctl(sim, stp, NULL) == SIM_UDP_STALL);
+}
+
+/**
+ * fn_a_stp
+ */
+static struct usb_ctl_req fn_a_stp(struct usb_ctl_req_dev *dev, struct usb_stp_pkt *stp)
+{
+	struct usb_ctl_req req = {0};
+
+	hndlr_hit = 3;
+	req.valid = TRUE;
+	req.trans_dir = UDP_CTL_TRANS_OUT;
+	return (req);
+}
+
+/**
+ * fn_b_stp
+ */
+static struct usb_ctl_req fn_b_stp(struct usb_ctl_req_dev *dev, struct usb_stp_pkt *stp)
+{
+	struct usb_ctl_req req = {0};
+
+	hndlr_hit = 4;
+	req.valid = TRUE;
+	req.trans_dir = UDP_CTL_TRANS_OUT;
+	return (req);
+}
+
+/**
+ * vnd_stp
+ *
+ * wValue of IN requests is number of bytes device has, nonzero wValue of
+ * OUT request limits accepted bytes.
+ */
+static struct usb_ctl_req vnd_stp(struct usb_ctl_req_dev *dev, struct usb_stp_pkt *stp)
+{
+	struct usb_ctl_req req = {0};
+	int len = (stp->w_value < stp->w_length) ? stp->w_value : stp->w_length;
+	int i, n;
+
+	last_req = stp->b_request;
+	switch (stp->b_request) {
+	case REQ_DEFER_IN :
+		defer_cnt++;
+		/* FALLTHRU */
+	case REQ_IN :
+		req.buf = in_data;
+		break;
+	case REQ_FRAG :
+		// Uneven fragments.
+		for (i = 0, n = 0; i < 4; i++) {
+			frag[i].buf = in_data + n;
+			frag[i].nmb = (i < 3) ? ((len - n) * (i + 1)) / 5 : len - n;
+			n += frag[i].nmb;
+		}
+		req.frag = frag;
+		break;
+	case REQ_IN_PKT :
+		out_offs = 0;
+		req.buf = pkt_buf;
+		req.in_pkt_clbk = in_pkt;
+		break;
+	case REQ_OUT :
+	case REQ_DEFER_OUT :
+	case REQ_PEND :
+		if (stp->b_request == REQ_PEND && stp->w_length == 0) {
+			pend_tag = pend_usb_ctl_req(dev);
+			req.valid = TRUE;
+			req.trans_dir = UDP_CTL_TRANS_OUT;
+			return (req);
+		}
+		req.buf = out_data;
+		req.nmb = (stp->w_value == 0) ? stp->w_length : stp->w_value;
+		req.trans_dir = UDP_CTL_TRANS_OUT;
+		req.valid = TRUE;
+		return (req);
+	case REQ_OUT_PKT :
+		out_offs = 0;
+		out_lim = (stp->w_value) ? stp->w_value : stp->w_length;
+		req.valid = TRUE;
+		req.buf = pkt_buf;
+		req.nmb = stp->w_length;
+		req.out_pkt_clbk = out_pkt;
+		req.trans_dir = UDP_CTL_TRANS_OUT;
+		return (req);
+	case REQ_DEFER_NO_DATA :
+		defer_cnt++;
+		/* FALLTHRU */
+	case REQ_NO_DATA :
+		req.valid = TRUE;
+		req.trans_dir = UDP_CTL_TRANS_OUT;
+		return (req);
+	case REQ_DEFER_PEND :
+		if (stp->w_value) {
+			// Host sends new pending request meanwhile.
+			sim_udp_stp(pkt_buf, VND_OUT, REQ_PEND, 0, 0, 0);
+			in_defer_stp = TRUE;
+			CHECK(sim_udp_ctl(cur_sim, pkt_buf, NULL) == SIM_UDP_NAK);
+			in_defer_stp = FALSE;
+			preempt_tag = pend_tag;
+		}
+		pend_tag = pend_usb_ctl_req(dev);
+		req.valid = TRUE;
+		req.trans_dir = UDP_CTL_TRANS_OUT;
+		return (req);
+	default :
+		return (req);
+	}
+	if (!(stp->bm_request_type & 0x80) || stp->w_length == 0) {
+		return (req);
+	}
+	req.valid = TRUE;
+	req.nmb = len;
+	req.trans_nmb = stp->w_length;
+	req.trans_dir = UDP_CTL_TRANS_IN;
+	return (req);
+}
+
+/**
+ * in_ack
+ */
+static void in_ack(struct usb_ctl_req_dev *dev)
+{
+	in_ack_cnt++;
+}
+
+/**
+ * out_rec
+ */
+static boolean_t out_rec(struct usb_ctl_req_dev *dev)
+{
+	if (last_req == REQ_DEFER_OUT) {
+		defer_cnt++;
+	} else if (last_req == REQ_PEND) {
+		pend_tag = pend_usb_ctl_req(dev);
+	}
+	out_rec_cnt++;
+	return (TRUE);
+}
+
+/**
+ * out_ack
+ */
+static void out_ack(struct usb_ctl_req_dev *dev)
+{
+	out_ack_cnt++;
+}
+
+/**
+ * abort_req
+ */
+static void abort_req(struct usb_ctl_req_dev *dev)
+{
+	abort_cnt++;
+	abort_in_defer_stp = in_defer_stp;
+	abort_arg = usb_ctl_req_get_arg(dev);
+}
+
+/**
+ * in_pkt
+ */
+static void in_pkt(void *arg, uint8_t *pkt, int nmb, int rem)
+{
+	memcpy(pkt, in_data + out_offs, nmb);
+	out_offs += nmb;
+}
+
+/**
+ * out_pkt
+ *
+ * Rejects data beyond out_lim, no buffer is returned after last packet.
+ */
+static uint8_t *out_pkt(void *arg, uint8_t *pkt, int nmb)
+{
+	memcpy(out_data + out_offs, pkt, nmb);
+	out_offs += nmb;
+	return ((out_offs < out_lim) ? pkt_buf : NULL);
+}
+
+/**
+ * fill
+ */
+static void fill(uint8_t *buf, int nmb, int seed)
+{
+	int i;
+
+	for (i = 0; i < nmb; i++) {
+		buf[i] = i * 7 + seed;
+	}
+}
+
+/**
+ * fail
+ */
+static void fail(int line, const char *cond)
+{
+	fprintf(stderr, "test_ctl_req.c:%d: %s\n", line, cond);
+	exit(1);
+}
@@ -0,0 +1,155 @@
+/*
+ * test_ctl_req_mt.c
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <gentyp.h>
+#include "sysconf.h"
+#include "criterr.h"
+#include "udp.h"
+#include "usb_std_def.h"
+#include "usb_ctl_req_trc.h"
+#include "usb_ctl_req.h"
+#include "sim_os.h"
+#include "sim_udp.h"
+
+// Simulated devices run in parallel threads, each engine instance with
+// own deferred task, half of them with two IN banks. Vendor request 1
+// echoes data of last OUT request 2.
+
+#define CHECK(c) do {if (!(c)) {fail(__LINE__, #c);}} while (0)
+
+#define THR_NMB 8
+#define TRANS_NMB 20000
+#define BUF_SZ 512
+
+struct thr {
+	pthread_t id;
+	struct usb_ctl_req_dev dev;
+	struct sim_udp sim;
+	struct usb_ctl_req_clbks clbks;
+	uint8_t buf[BUF_SZ];
+	int len;
+	unsigned int seed;
+};
+
+static void fail(int line, const char *cond);
+static void *thr_fn(void *p);
+static struct usb_ctl_req echo_stp(struct usb_ctl_req_dev *dev, struct usb_stp_pkt *stp);
+static boolean_t echo_rec(struct usb_ctl_req_dev *dev);
+static void echo_ack(struct usb_ctl_req_dev *dev);
+
+static struct thr thrs[THR_NMB];
+
+int main(void)
+{
+	int i;
+
+	for (i = 0; i < THR_NMB; i++) {
+		thrs[i].seed = i + 1;
+		CHECK(!pthread_create(&thrs[i].id, NULL, thr_fn, &thrs[i]));
+	}
+	for (i = 0; i < THR_NMB; i++) {
+		CHECK(!pthread_join(thrs[i].id, NULL));
+		CHECK(get_usb_ctl_req_stats(&thrs[i].dev)->unexp_udp_evnt_cnt == 0);
+	}
+	printf("test_ctl_req_mt: ok\n");
+	return (0);
+}
+
+/**
+ * thr_fn
+ */
+static void *thr_fn(void *p)
+{
+	struct thr *t = p;
+	uint8_t stp[8], out[BUF_SZ], in[BUF_SZ];
+	int i, j, len;
+
+	t->sim.mps = 8 << (t->seed % 4);
+	t->sim.dev = &t->dev;
+	t->clbks.stp_clbk = echo_stp;
+	t->clbks.in_req_ack_clbk = echo_ack;
+	t->clbks.out_req_rec_clbk = echo_rec;
+	t->clbks.out_req_ack_clbk = echo_ack;
+	t->clbks.defer = (USB_CTL_REQ_DEFER == 1) ? t->seed & 1 : FALSE;
+	t->clbks.arg = t;
+	init_usb_ctl_req(&t->dev, (t->seed & 2) ? &sim_udp_bat_drv : &sim_udp_drv, &t->sim);
+	add_usb_ctl_req_vnd_clbks(&t->dev, &t->clbks);
+	for (i = 0; i < TRANS_NMB; i++) {
+		len = 1 + rand_r(&t->seed) % BUF_SZ;
+		for (j = 0; j < len; j++) {
+			out[j] = rand_r(&t->seed);
+		}
+		sim_udp_stp(stp, 0x40, 2, 0, 0, len);
+		CHECK(sim_udp_ctl(&t->sim, stp, out) == len);
+		sim_udp_stp(stp, 0xC0, 1, 0, 0, BUF_SZ);
+		CHECK(sim_udp_ctl(&t->sim, stp, in) == len);
+		CHECK(!memcmp(in, out, len));
+	}
+	return (NULL);
+}
+
+/**
+ * echo_stp
+ */
+static struct usb_ctl_req echo_stp(struct usb_ctl_req_dev *dev, struct usb_stp_pkt *stp)
+{
+	struct thr *t = usb_ctl_req_get_arg(dev);
+	struct usb_ctl_req req = {0};
+
+	req.valid = TRUE;
+	req.buf = t->buf;
+	if (stp->bm_request_type & 0x80) {
+		req.nmb = (t->len < stp->w_length) ? t->len : stp->w_length;
+		req.trans_nmb = stp->w_length;
+		req.trans_dir = UDP_CTL_TRANS_IN;
+	} else {
+		t->len = req.nmb = stp->w_length;
+		req.trans_dir = UDP_CTL_TRANS_OUT;
+	}
+	return (req);
+}
+
+/**
+ * echo_rec
+ */
+static boolean_t echo_rec(struct usb_ctl_req_dev *dev)
+{
+	return (TRUE);
+}
+
+/**
+ * echo_ack
+ */
+static void echo_ack(struct usb_ctl_req_dev *dev)
+{
+}
+
+/**
+ * fail
+ */
+static void fail(int line, const char *cond)
+{
+	fprintf(stderr, "test_ctl_req_mt.c:%d: %s\n", line, cond);
+	exit(1);
+}
@@ -0,0 +1,267 @@
+/*
+ * test_desc.c
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <gentyp.h>
+#include "sysconf.h"
+#include "udp.h"
+#include "usb_std_def.h"
+#include "usb_cdc_def.h"
+#include "usb_desc_bld.h"
+#include "usb_ctl_req_trc.h"
+#include "usb_ctl_req.h"
+#include "usb_str_desc.h"
+
+#define CHECK(c) do {if (!(c)) {fail(__LINE__, #c);}} while (0)
+
+static void fail(int line, const char *cond);
+static void test_idx(void);
+static void test_bad(void);
+static void test_bld(void);
+static void test_str(void);
+static int get_str_desc(struct usb_str_desc *sd, int idx, uint16_t langid, int len, uint8_t *buf);
+static const char *get_str(uint16_t langid, int idx);
+
+// Interface 0 (class-specific descriptor, interrupt IN 0x81) and interface
+// 1 with alternate settings 0 (bulk OUT 0x02) and 1 (bulk IN 0x82), both
+// in one function.
+static const uint8_t conf[] = {
+	9, USB_CONF_DESC, 70, 0, 2, 1, 0, USB_STD_BUS_POWER_NO_RWAKE, 50,
+	8, USB_IFACE_ASSOC_DESC, 0, 2, 0xFF, 0, 0, 0,
+	9, USB_IFACE_DESC, 0, 0, 1, 0xFF, 0, 0, 0,
+	5, 0x24, 0, 0x10, 0x01,
+	7, USB_ENDP_DESC, 0x81, USB_STD_TRANS_INTERRUPT, 8, 0, 10,
+	9, USB_IFACE_DESC, 1, 0, 1, 0xFF, 0, 0, 0,
+	7, USB_ENDP_DESC, 0x02, USB_STD_TRANS_BULK, 64, 0, 0,
+	9, USB_IFACE_DESC, 1, 1, 1, 0xFF, 0, 0, 0,
+	7, USB_ENDP_DESC, 0x82, USB_STD_TRANS_BULK, 64, 0, 0
+};
+
+// Same configuration emitted by usb_desc_bld.h.
+#define COMM_CS(CS) \
+	CS(struct usb_cdc_head_desc, head, usb_cdc_head_desc_init(USB_CDC_CDC1_10_VER_BCD))
+#define COMM_EP(EP) \
+	EP(ntf, usb_std_endp_addr(1, USB_STD_IN_ENDP), USB_STD_TRANS_INTERRUPT, 8, 10)
+#define DATA0_EP(EP) \
+	EP(out, usb_std_endp_addr(2, USB_STD_OUT_ENDP), USB_STD_TRANS_BULK, 64, 0)
+#define DATA1_EP(EP) \
+	EP(in, usb_std_endp_addr(2, USB_STD_IN_ENDP), USB_STD_TRANS_BULK, 64, 0)
+#define CONF(IAD, IFACE) \
+	IAD(iad, 0, 2, 0xFF, 0, 0, 0) \
+	IFACE(comm, 0, 0, 0xFF, 0, 0, 0, COMM_CS, COMM_EP) \
+	IFACE(data0, 1, 0, 0xFF, 0, 0, 0, USB_DESC_BLD_NONE, DATA0_EP) \
+	IFACE(data1, 1, 1, 0xFF, 0, 0, 0, USB_DESC_BLD_NONE, DATA1_EP)
+
+USB_DESC_BLD_CONF(bld_conf, CONF, 1, 0, USB_STD_BUS_POWER_NO_RWAKE, 50);
+USB_DESC_BLD_STR(bld_str, u"Sim");
+USB_DESC_BLD_LANGID(bld_langid, USB_STD_LANGID_EN_US);
+
+int main(void)
+{
+	test_idx();
+	test_bad();
+	test_bld();
+	test_str();
+	printf("test_desc: ok\n");
+	return (0);
+}
+
+/**
+ * test_idx
+ */
+static void test_idx(void)
+{
+	struct usb_desc_idx idx;
+	struct usb_desc_iter iter;
+	const struct usb_gen_desc *d;
+	int n;
+
+	CHECK(sizeof(conf) == 70);
+	CHECK(init_usb_desc_idx(&idx, conf, sizeof(conf)));
+	CHECK(idx.iad_nmb == 1 && idx.iad[0]->b_interface_count == 2);
+	CHECK(usb_desc_idx_get_alt_nmb(&idx, 0) == 1);
+	CHECK(usb_desc_idx_get_alt_nmb(&idx, 1) == 2);
+	CHECK(usb_desc_idx_get_alt_nmb(&idx, 2) == 0);
+	CHECK(usb_desc_idx_get_alt_nmb(&idx, -1) == 0);
+	CHECK(usb_desc_idx_get_iface(&idx, 1, 1)->b_alternate_setting == 1);
+	CHECK(usb_desc_idx_get_iface(&idx, 1, 2) == NULL);
+	CHECK(usb_desc_idx_get_iface(&idx, 1, -1) == NULL);
+	CHECK(usb_desc_idx_get_endp(&idx, 0x81)->bm_attributes == USB_STD_TRANS_INTERRUPT);
+	CHECK(usb_desc_idx_get_endp(&idx, 0x01) == NULL);
+	CHECK(usb_desc_idx_get_endp_iface(&idx, 0x81) == 0);
+	CHECK(usb_desc_idx_get_endp_iface(&idx, 0x02) == 1);
+	CHECK(usb_desc_idx_get_endp_iface(&idx, 0x82) == 1);
+	CHECK(usb_desc_idx_get_endp_iface(&idx, 0x03) == -1);
+	// Class-specific descriptors end at first endpoint.
+	CHECK(usb_desc_idx_get_cs(&idx, 0, 0, &iter));
+	d = usb_desc_iter_next(&iter, 0);
+	CHECK(d && d->type == 0x24);
+	CHECK(usb_desc_iter_next(&iter, 0) == NULL);
+	CHECK(usb_desc_idx_get_cs(&idx, 1, 0, &iter));
+	CHECK(usb_desc_iter_next(&iter, 0) == NULL);
+	// Interface walk ends at next interface.
+	CHECK(usb_desc_idx_get_iface_iter(&idx, 1, 0, &iter));
+	d = usb_desc_iter_next(&iter, USB_ENDP_DESC);
+	CHECK(d && ((const struct usb_endp_desc *) d)->b_endpoint_address == 0x02);
+	CHECK(usb_desc_iter_next(&iter, USB_ENDP_DESC) == NULL);
+	CHECK(!usb_desc_idx_get_iface_iter(&idx, 3, 0, &iter));
+	// Whole blob walk.
+	init_usb_desc_iter(&iter, conf, sizeof(conf));
+	for (n = 0; usb_desc_iter_next(&iter, USB_ENDP_DESC); n++) {
+	}
+	CHECK(n == 3);
+}
+
+/**
+ * test_bad
+ *
+ * Truncated and malformed blobs.
+ */
+static void test_bad(void)
+{
+	static const uint8_t zero_len[] = {9, USB_CONF_DESC, 11, 0, 0, 1, 0, 0x80, 50, 0, 0};
+	static const uint8_t alt_gap[] = {
+		9, USB_IFACE_DESC, 0, 0, 0, 0xFF, 0, 0, 0,
+		9, USB_IFACE_DESC, 0, 2, 0, 0xFF, 0, 0, 0
+	};
+	static const uint8_t dup_alt0[] = {
+		9, USB_IFACE_DESC, 0, 0, 0, 0xFF, 0, 0, 0,
+		9, USB_IFACE_DESC, 0, 0, 0, 0xFF, 0, 0, 0
+	};
+	struct usb_desc_idx idx;
+	struct usb_desc_iter iter;
+
+	CHECK(!init_usb_desc_idx(&idx, conf, sizeof(conf) - 1));
+	CHECK(!init_usb_desc_idx(&idx, zero_len, sizeof(zero_len)));
+	CHECK(!init_usb_desc_idx(&idx, alt_gap, sizeof(alt_gap)));
+	CHECK(!init_usb_desc_idx(&idx, dup_alt0, sizeof(dup_alt0)));
+	init_usb_desc_iter(&iter, conf, sizeof(conf) - 1);
+	while (usb_desc_iter_next(&iter, 0)) {
+	}
+	CHECK(iter.dsc == iter.end);
+}
+
+/**
+ * test_bld
+ */
+static void test_bld(void)
+{
+	static const uint8_t str[] = {8, USB_STR_DESC, usb_std_unicode('S'), usb_std_unicode('i'),
+	                              usb_std_unicode('m')};
+	static const uint8_t langid[] = {4, USB_STR_DESC, USB_STD_EN_US_CODE};
+
+	CHECK(sizeof(bld_conf) == sizeof(conf) && !memcmp(&bld_conf, conf, sizeof(conf)));
+	CHECK(sizeof(bld_str) == sizeof(str) && !memcmp(&bld_str, str, sizeof(str)));
+	CHECK(sizeof(bld_langid) == sizeof(langid) && !memcmp(&bld_langid, langid, sizeof(langid)));
+}
+
+/**
+ * test_str
+ *
+ * UTF-8 to UTF-16LE encoding across 8 byte packets.
+ */
+static void test_str(void)
+{
+	// "Sim", U+017D, U+20AC, U+1F600 (surrogate pair), invalid byte.
+	static const char *const en[] = {"Sim", "\xC5\xBD\xE2\x82\xAC\xF0\x9F\x98\x80\xFF", NULL};
+	static const char *const sk[] = {"Sk"};
+	static const struct usb_str_desc_tbl tbl[] = {
+		{USB_STD_LANGID_EN_US, 3, en},
+		{USB_STD_LANGID_SK_SK, 1, sk}
+	};
+	static const uint8_t langid[] = {6, USB_STR_DESC, USB_STD_EN_US_CODE, 0x1B, 0x04};
+	static const uint8_t sim[] = {8, USB_STR_DESC, usb_std_unicode('S'), usb_std_unicode('i'),
+	                              usb_std_unicode('m')};
+	static const uint8_t utf[] = {12, USB_STR_DESC, 0x7D, 0x01, 0xAC, 0x20, 0x3D, 0xD8, 0x00, 0xDE,
+	                              0xFD, 0xFF};
+	struct usb_str_desc sd;
+	uint8_t buf[256];
+	char lng[200];
+	const char *lng_str[] = {lng};
+	struct usb_str_desc_tbl lng_tbl = {USB_STD_LANGID_EN_US, 1, lng_str};
+
+	init_usb_str_desc(&sd, tbl, 2, get_str);
+	CHECK(get_str_desc(&sd, 0, 0, 255, buf) == sizeof(langid) && !memcmp(buf, langid, sizeof(langid)));
+	CHECK(get_str_desc(&sd, 1, USB_STD_LANGID_EN_US, 255, buf) == sizeof(sim) &&
+	      !memcmp(buf, sim, sizeof(sim)));
+	CHECK(get_str_desc(&sd, 2, USB_STD_LANGID_EN_US, 255, buf) == sizeof(utf) &&
+	      !memcmp(buf, utf, sizeof(utf)));
+	// Truncated to wLength in the middle of surrogate pair.
+	CHECK(get_str_desc(&sd, 2, USB_STD_LANGID_EN_US, 7, buf) == 7 && !memcmp(buf, utf, 7));
+	// Unknown LANGID falls back to first table.
+	CHECK(get_str_desc(&sd, 1, USB_STD_LANGID_DE_DE, 255, buf) == sizeof(sim));
+	CHECK(get_str_desc(&sd, 1, USB_STD_LANGID_SK_SK, 255, buf) == 6 && buf[0] == 6 && buf[2] == 'S');
+	// NULL table entry and index above table go to get_str.
+	CHECK(get_str_desc(&sd, 3, USB_STD_LANGID_EN_US, 255, buf) == 4 && buf[2] == '3');
+	CHECK(get_str_desc(&sd, 2, USB_STD_LANGID_SK_SK, 255, buf) == 4 && buf[2] == '2');
+	CHECK(get_str_desc(&sd, 9, USB_STD_LANGID_EN_US, 255, buf) == -1);
+	// Limit of 126 characters.
+	memset(lng, 'x', sizeof(lng) - 1);
+	lng[sizeof(lng) - 1] = '\0';
+	init_usb_str_desc(&sd, &lng_tbl, 1, NULL);
+	CHECK(get_str_desc(&sd, 2, USB_STD_LANGID_EN_US, 255, buf) == -1);
+	CHECK(get_str_desc(&sd, 1, USB_STD_LANGID_EN_US, 255, buf) == 254 && buf[0] == 254 &&
+	      buf[252] == 'x' && buf[253] == 0);
+}
+
+/**
+ * get_str_desc
+ *
+ * Returns descriptor size or -1 if string is not defined.
+ */
+static int get_str_desc(struct usb_str_desc *sd, int idx, uint16_t langid, int len, uint8_t *buf)
+{
+	struct usb_stp_pkt stp = {0x80, USB_GET_DESCRIPTOR, (USB_STR_DESC << 8) | idx, langid, len};
+	struct usb_ctl_req req;
+	int i, n;
+
+	req = usb_str_desc_req(sd, &stp);
+	if (!req.valid) {
+		return (-1);
+	}
+	CHECK(req.trans_dir == UDP_CTL_TRANS_IN && req.trans_nmb == len && req.nmb <= len);
+	for (i = 0; i < req.nmb; i += n) {
+		n = (req.nmb - i < 8) ? req.nmb - i : 8;
+		req.in_pkt_clbk(req.arg, req.buf, n, req.nmb - i - n);
+		memcpy(buf + i, req.buf, n);
+	}
+	return (req.nmb);
+}
+
+/**
+ * get_str
+ */
+static const char *get_str(uint16_t langid, int idx)
+{
+	static const char *const s[] = {"0", "1", "2", "3"};
+
+	return ((idx < 4) ? s[idx] : NULL);
+}
+
+/**
+ * fail
+ */
+static void fail(int line, const char *cond)
+{
+	fprintf(stderr, "test_desc.c:%d: %s\n", line, cond);
+	exit(1);
+}
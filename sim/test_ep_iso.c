@@ -0,0 +1,212 @@
+/*
+ * test_ep_iso.c
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <gentyp.h>
+#include "sysconf.h"
+#include "criterr.h"
+#include "udp.h"
+#include "usb_std_def.h"
+#include "usb_ep_ring.h"
+#include "usb_ep_iso.h"
+
+// Host sends OUT stream sized by last feedback packet, device drains it
+// with clock off by ppm. Fill level must stay near half of ring without
+// underrun, overrun or lost samples.
+
+#define CHECK(c) do {if (!(c)) {fail(__LINE__, #c);}} while (0)
+
+#define RATE 48000
+#define FRAME_SZ 4
+#define OUT_ADDR 0x01
+#define FB_ADDR 0x81
+#define SETTLE_S 5
+#define RUN_S 30
+
+struct fake_hw {
+	const uint8_t *pkt;
+	int pkt_offs;
+	uint8_t fb[4];
+	int fb_nmb;
+	int fb_rdy;
+};
+
+static void fail(int line, const char *cond);
+static void test_drift(int fps, int mps, int sz, int ppm);
+static void write_fifo(void *hw, int addr, const void *buf, int nmb);
+static void tx_pkt_rdy(void *hw, int addr);
+static void read_fifo(void *hw, int addr, void *buf, int nmb);
+static void rx_done(void *hw, int addr);
+
+static const struct usb_ep_ring_drv fake_drv = {
+	.write_fifo = write_fifo,
+	.tx_pkt_rdy = tx_pkt_rdy,
+	.read_fifo = read_fifo,
+	.rx_done = rx_done
+};
+
+static const int ppm_tbl[] = {0, 100, -100, 500, -500, 1000, -1000};
+
+int main(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(ppm_tbl) / sizeof(ppm_tbl[0]); i++) {
+		test_drift(1000, 256, 1024, ppm_tbl[i]);
+		test_drift(8000, 64, 512, ppm_tbl[i]);
+	}
+	printf("test_ep_iso: ok\n");
+	return (0);
+}
+
+/**
+ * test_drift
+ *
+ * Each (micro)frame: SOF, feedback packet sent, host OUT packet received,
+ * device consumes samples of its own clock. Playback starts at half fill.
+ */
+static void test_drift(int fps, int mps, int sz, int ppm)
+{
+	static struct usb_ep_iso iso;
+	static uint8_t buf[32768];
+	struct fake_hw hw;
+	struct usb_ep_iso_stats stats;
+	struct usb_endp_desc desc;
+	uint32_t host_fb, host_acc = 0, dev_acc = 0, dev_nom, host_smp = 0, dev_smp = 0, v;
+	uint32_t pkt[64], rd[64];
+	int64_t fb_sum = 0;
+	int frame, n, i, avail, half = sz / 2, min = sz, max = 0;
+	boolean_t play = FALSE;
+
+	memset(&hw, 0, sizeof(hw));
+	memset(&desc, 0, sizeof(desc));
+	desc.b_endpoint_address = OUT_ADDR;
+	desc.bm_attributes = USB_STD_TRANS_ISOCHRONOUS | USB_STD_ISOCH_ASYNCHRO;
+	desc.w_max_packet_size = mps;
+	memset(&iso, 0, sizeof(iso));
+	iso.fb_addr = FB_ADDR;
+	iso.fps = fps;
+	iso.frame_sz = FRAME_SZ;
+	iso.rate = RATE;
+	init_usb_ep_iso(&iso, &fake_drv, &hw, &desc, buf, sz);
+	// Reset primes feedback endpoint with nominal rate.
+	CHECK(hw.fb_rdy == 1 && hw.fb_nmb == ((fps == 1000) ? 3 : 4));
+	dev_nom = ((uint64_t) RATE << 16) * (1000000 + ppm) / 1000000 / fps;
+	for (frame = 0; frame < RUN_S * fps; frame++) {
+		usb_ep_iso_sof(&iso);
+		// Host picks up feedback packet, driver reports it sent.
+		v = hw.fb[0] | hw.fb[1] << 8 | hw.fb[2] << 16 | (uint32_t) hw.fb[3] << 24;
+		host_fb = (fps == 1000) ? v << 2 : v;
+		CHECK(hw.fb_rdy == 1);
+		hw.fb_rdy = 0;
+		usb_ep_iso_fb_done(&iso);
+		host_acc += host_fb;
+		n = host_acc >> 16;
+		host_acc &= 0xFFFF;
+		CHECK(n * FRAME_SZ <= mps);
+		for (i = 0; i < n; i++) {
+			pkt[i] = host_smp++;
+		}
+		hw.pkt = (const uint8_t *) pkt;
+		hw.pkt_offs = 0;
+		usb_ep_iso_out_rcv(&iso, n * FRAME_SZ);
+		CHECK(hw.pkt_offs == n * FRAME_SZ);
+		if (!play && usb_ep_iso_avail(&iso) >= half) {
+			play = TRUE;
+		}
+		if (play) {
+			dev_acc += dev_nom;
+			n = dev_acc >> 16;
+			dev_acc &= 0xFFFF;
+			usb_ep_iso_read(&iso, rd, n * FRAME_SZ);
+			for (i = 0; i < n; i++) {
+				CHECK(rd[i] == dev_smp);
+				dev_smp++;
+			}
+		}
+		avail = usb_ep_iso_avail(&iso);
+		if (frame >= SETTLE_S * fps) {
+			min = (avail < min) ? avail : min;
+			max = (avail > max) ? avail : max;
+			fb_sum += usb_ep_iso_get_fb(&iso);
+		}
+	}
+	usb_ep_iso_get_stats(&iso, &stats);
+	CHECK(stats.underrun_cnt == 0 && stats.overrun_cnt == 0);
+	// Fill level held within one max packet of half ring.
+	CHECK(min >= half - mps && max <= half + mps);
+	// Mean feedback tracks device clock within 10 ppm.
+	fb_sum = fb_sum / ((RUN_S - SETTLE_S) * fps) * 1000000 * fps / ((int64_t) RATE << 16);
+	CHECK(llabs(fb_sum - (1000000 + ppm)) <= 10);
+}
+
+/**
+ * write_fifo
+ */
+static void write_fifo(void *hw, int addr, const void *buf, int nmb)
+{
+	struct fake_hw *h = hw;
+
+	CHECK(addr == FB_ADDR && nmb <= 4 && !h->fb_rdy);
+	memcpy(h->fb, buf, nmb);
+	h->fb_nmb = nmb;
+}
+
+/**
+ * tx_pkt_rdy
+ */
+static void tx_pkt_rdy(void *hw, int addr)
+{
+	struct fake_hw *h = hw;
+
+	CHECK(addr == FB_ADDR);
+	h->fb_rdy++;
+}
+
+/**
+ * read_fifo
+ */
+static void read_fifo(void *hw, int addr, void *buf, int nmb)
+{
+	struct fake_hw *h = hw;
+
+	CHECK(addr == OUT_ADDR);
+	memcpy(buf, h->pkt + h->pkt_offs, nmb);
+	h->pkt_offs += nmb;
+}
+
+/**
+ * rx_done
+ */
+static void rx_done(void *hw, int addr)
+{
+	CHECK(addr == OUT_ADDR);
+}
+
+/**
+ * fail
+ */
+static void fail(int line, const char *cond)
+{
+	fprintf(stderr, "test_ep_iso.c:%d: %s\n", line, cond);
+	exit(1);
+}
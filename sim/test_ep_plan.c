@@ -0,0 +1,153 @@
+/*
+ * test_ep_plan.c
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <FreeRTOS.h>
+#include <gentyp.h>
+#include "sysconf.h"
+#include "udp.h"
+#include "usb_std_def.h"
+#include "usb_ep_plan.h"
+
+#define CHECK(c) do {if (!(c)) {fail(__LINE__, #c);}} while (0)
+
+#define BIT(addr) (1UL << usb_desc_idx_endp_ix(addr))
+
+// Last config() call of driver.
+struct hw {
+	int cnt;
+	uint32_t dis_msk;
+	const struct usb_ep_plan_ep *ep;
+	int nmb;
+};
+
+static void fail(int line, const char *cond);
+static void test_layout(void);
+static void test_set(void);
+static void config(void *hw_p, uint32_t dis_msk, const struct usb_ep_plan_ep *ep, int nmb);
+
+// Interface 0 (interrupt IN 0x81) and interface 1 with alternate settings
+// 0 (bulk OUT 0x02) and 1 (bulk IN 0x82, interrupt IN 0x83).
+static const uint8_t conf[] = {
+	9, USB_CONF_DESC, 55, 0, 2, 1, 0, USB_STD_BUS_POWER_NO_RWAKE, 50,
+	9, USB_IFACE_DESC, 0, 0, 1, 0xFF, 0, 0, 0,
+	7, USB_ENDP_DESC, 0x81, USB_STD_TRANS_INTERRUPT, 8, 0, 10,
+	9, USB_IFACE_DESC, 1, 0, 1, 0xFF, 0, 0, 0,
+	7, USB_ENDP_DESC, 0x02, USB_STD_TRANS_BULK, 64, 0, 0,
+	9, USB_IFACE_DESC, 1, 1, 2, 0xFF, 0, 0, 0,
+	7, USB_ENDP_DESC, 0x82, USB_STD_TRANS_BULK, 64, 0, 0,
+	7, USB_ENDP_DESC, 0x83, USB_STD_TRANS_INTERRUPT, 10, 0, 4
+};
+
+static const struct usb_ep_plan_drv drv = {
+	.config = config
+};
+
+static struct usb_desc_idx idx, idx2;
+static struct usb_ep_plan plan;
+static struct hw hw;
+
+int main(void)
+{
+	CHECK(init_usb_desc_idx(&idx, conf, sizeof(conf)));
+	CHECK(init_usb_desc_idx(&idx2, conf, sizeof(conf)));
+	test_layout();
+	test_set();
+	printf("test_ep_plan: ok\n");
+	return (0);
+}
+
+/**
+ * test_layout
+ *
+ * Two banks, 8 byte alignment. Interface 1 region is sized by alternate
+ * setting 1 (128 + 24 bytes) and starts after interface 0 (16 bytes).
+ */
+static void test_layout(void)
+{
+	const struct usb_ep_plan_conf *c;
+
+	init_usb_ep_plan(&plan, &drv, &hw, 168, 2);
+	c = add_usb_ep_plan_conf(&plan, &idx);
+	CHECK(c->ram_sz == 168 && c->ep_nmb == 4 && c->alt0_nmb == 2);
+	CHECK(c->ep[0].addr == 0x81 && c->ep[0].iface == 0 && c->ep[0].ram_offs == 0 &&
+	      c->ep[0].ram_sz == 16 && c->ep[0].mps == 8 && c->ep[0].ival == 10);
+	CHECK(c->ep[1].addr == 0x02 && c->ep[1].iface == 1 && c->ep[1].ram_offs == 16 &&
+	      c->ep[1].ram_sz == 128);
+	CHECK(c->ep[2].addr == 0x82 && c->ep[2].ram_offs == 16 && c->ep[2].ram_sz == 128);
+	CHECK(c->ep[3].addr == 0x83 && c->ep[3].ram_offs == 144 && c->ep[3].ram_sz == 24 &&
+	      c->ep[3].type == UDP_INT_IN_ENDP);
+	CHECK(c->alt[idx.iface_alt0[1] + 1].first == 2 && c->alt[idx.iface_alt0[1] + 1].nmb == 2);
+}
+
+/**
+ * test_set
+ *
+ * Endpoints replaced by SET_CONFIGURATION and SET_INTERFACE are disabled
+ * in the same config() call.
+ */
+static void test_set(void)
+{
+	CHECK(!usb_ep_plan_set_conf(&plan, &idx2));
+	CHECK(hw.cnt == 0);
+	CHECK(usb_ep_plan_set_conf(&plan, &idx));
+	CHECK(hw.cnt == 1 && hw.dis_msk == 0 && hw.nmb == 2 && hw.ep[0].addr == 0x81 &&
+	      hw.ep[1].addr == 0x02);
+	CHECK(usb_ep_plan_set_iface(&plan, 1, 1));
+	CHECK(hw.cnt == 2 && hw.dis_msk == BIT(0x02) && hw.nmb == 2 && hw.ep[0].addr == 0x82 &&
+	      hw.ep[1].addr == 0x83);
+	CHECK(!usb_ep_plan_set_iface(&plan, 1, 2));
+	CHECK(!usb_ep_plan_set_iface(&plan, 1, -1));
+	CHECK(!usb_ep_plan_set_iface(&plan, 2, 0));
+	CHECK(hw.cnt == 2);
+	CHECK(usb_ep_plan_set_iface(&plan, 0, 0));
+	CHECK(hw.cnt == 3 && hw.dis_msk == BIT(0x81) && hw.nmb == 1 && hw.ep[0].addr == 0x81);
+	CHECK(usb_ep_plan_set_iface(&plan, 1, 0));
+	CHECK(hw.cnt == 4 && hw.dis_msk == (BIT(0x82) | BIT(0x83)) && hw.nmb == 1 &&
+	      hw.ep[0].addr == 0x02);
+	CHECK(usb_ep_plan_set_iface(&plan, 1, 1));
+	CHECK(usb_ep_plan_set_conf(&plan, NULL));
+	CHECK(hw.cnt == 6 && hw.dis_msk == (BIT(0x81) | BIT(0x82) | BIT(0x83)) && hw.nmb == 0);
+	CHECK(!usb_ep_plan_set_iface(&plan, 0, 0));
+	CHECK(usb_ep_plan_set_conf(&plan, &idx));
+	CHECK(hw.cnt == 7 && hw.dis_msk == 0 && hw.nmb == 2);
+}
+
+/**
+ * config
+ */
+static void config(void *hw_p, uint32_t dis_msk, const struct usb_ep_plan_ep *ep, int nmb)
+{
+	struct hw *h = hw_p;
+
+	h->cnt++;
+	h->dis_msk = dis_msk;
+	h->ep = ep;
+	h->nmb = nmb;
+}
+
+/**
+ * fail
+ */
+static void fail(int line, const char *cond)
+{
+	fprintf(stderr, "test_ep_plan.c:%d: %s\n", line, cond);
+	exit(1);
+}
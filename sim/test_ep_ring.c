@@ -0,0 +1,360 @@
+/*
+ * test_ep_ring.c
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <gentyp.h>
+#include "sysconf.h"
+#include "udp.h"
+#include "usb_std_def.h"
+#include "usb_ep_ring.h"
+
+#define CHECK(c) do {if (!(c)) {fail(__LINE__, #c);}} while (0)
+
+#define MPS 16
+#define PKT_NMB 16
+
+// Simulated endpoint FIFO. IN packets sent by ring are recorded, OUT
+// packet is read from rx.
+struct hw {
+	uint8_t fifo[MPS];
+	int fifo_nmb;
+	uint8_t pkt[PKT_NMB][MPS];
+	int pkt_sz[PKT_NMB];
+	int pkt_nmb;
+	const uint8_t *rx;
+	int rx_done_cnt;
+	int clbk_cnt;
+};
+
+static void fail(int line, const char *cond);
+static void test_in(void);
+static void test_zlp(void);
+static void test_out(void);
+static void test_end(void);
+static void test_coal(void);
+static void init_ep(struct usb_ep_ring *ep, int addr, int sz);
+static int in_done(struct usb_ep_ring *ep);
+static void fill(uint8_t *buf, int nmb, int seed);
+static void write_fifo(void *hw_p, int addr, const void *buf, int nmb);
+static void tx_pkt_rdy(void *hw_p, int addr);
+static void read_fifo(void *hw_p, int addr, void *buf, int nmb);
+static void rx_done(void *hw_p, int addr);
+static void clbk(struct usb_ep_ring *ep);
+
+static const struct usb_ep_ring_drv drv = {
+	.write_fifo = write_fifo,
+	.tx_pkt_rdy = tx_pkt_rdy,
+	.read_fifo = read_fifo,
+	.rx_done = rx_done
+};
+
+static struct hw hw;
+static uint8_t ring_buf[64];
+
+int main(void)
+{
+	test_in();
+	test_zlp();
+	test_out();
+	test_end();
+	test_coal();
+	printf("test_ep_ring: ok\n");
+	return (0);
+}
+
+/**
+ * test_in
+ *
+ * Packets are cut from ring across wrap, clbk reports drained ring.
+ */
+static void test_in(void)
+{
+	struct usb_ep_ring ep;
+	uint8_t data[128], *p;
+	int n;
+
+	init_ep(&ep, 0x81, 64);
+	fill(data, sizeof(data), 1);
+	CHECK(usb_ep_ring_write(&ep, data, 40) == 40);
+	// First packet is sent at once, rest waits for in_done.
+	CHECK(hw.pkt_nmb == 1 && hw.pkt_sz[0] == MPS && usb_ep_ring_avail(&ep) == 24);
+	CHECK(in_done(&ep) == MPS && in_done(&ep) == 8 && hw.clbk_cnt == 0);
+	CHECK(in_done(&ep) == -1 && hw.clbk_cnt == 1);
+	CHECK(!memcmp(hw.pkt[0], data, MPS) && !memcmp(hw.pkt[1], data + 16, MPS) &&
+	      !memcmp(hw.pkt[2], data + 32, 8));
+	// In place write ends at end of buffer.
+	p = usb_ep_ring_reserve(&ep, &n);
+	CHECK(p == ring_buf + 40 && n == 24);
+	// Second packet wraps.
+	hw.pkt_nmb = 0;
+	CHECK(usb_ep_ring_write(&ep, data + 40, 48) == 48);
+	CHECK(in_done(&ep) == MPS && in_done(&ep) == MPS && in_done(&ep) == -1);
+	CHECK(hw.pkt_nmb == 3 && !memcmp(hw.pkt[0], data + 40, MPS) &&
+	      !memcmp(hw.pkt[1], data + 56, MPS) && !memcmp(hw.pkt[2], data + 72, MPS));
+	// Full ring takes no more data.
+	CHECK(usb_ep_ring_write(&ep, data, 128) == 64);
+	CHECK(usb_ep_ring_free(&ep) == MPS && usb_ep_ring_write(&ep, data, 128) == MPS);
+	CHECK(usb_ep_ring_free(&ep) == 0 && usb_ep_ring_write(&ep, data, 1) == 0);
+	reset_usb_ep_ring(&ep);
+	CHECK(usb_ep_ring_avail(&ep) == 0 && usb_ep_ring_free(&ep) == 64);
+}
+
+/**
+ * test_zlp
+ */
+static void test_zlp(void)
+{
+	struct usb_ep_ring ep;
+	uint8_t data[32];
+
+	fill(data, sizeof(data), 2);
+	init_ep(&ep, 0x81, 64);
+	ep.zlp = TRUE;
+	CHECK(usb_ep_ring_write(&ep, data, 32) == 32);
+	CHECK(in_done(&ep) == MPS && in_done(&ep) == 0 && in_done(&ep) == -1);
+	CHECK(hw.pkt_nmb == 3 && hw.clbk_cnt == 1);
+	// Short last packet needs no ZLP.
+	hw.pkt_nmb = 0;
+	CHECK(usb_ep_ring_write(&ep, data, 20) == 20);
+	CHECK(in_done(&ep) == 4 && in_done(&ep) == -1 && hw.pkt_nmb == 2);
+	// Without zlp transfer ends with full packet.
+	init_ep(&ep, 0x81, 64);
+	CHECK(usb_ep_ring_write(&ep, data, 32) == 32);
+	CHECK(in_done(&ep) == MPS && in_done(&ep) == -1 && hw.pkt_nmb == 2);
+}
+
+/**
+ * test_out
+ *
+ * Packet which does not fit stays in controller until consumer frees
+ * space.
+ */
+static void test_out(void)
+{
+	struct usb_ep_ring ep;
+	uint8_t data[64], buf[64];
+	const uint8_t *p;
+	int n;
+
+	fill(data, sizeof(data), 3);
+	init_ep(&ep, 0x02, 32);
+	hw.rx = data;
+	usb_ep_ring_out_rcv(&ep, MPS);
+	hw.rx = data + 16;
+	usb_ep_ring_out_rcv(&ep, 10);
+	CHECK(hw.rx_done_cnt == 2 && hw.clbk_cnt == 2 && usb_ep_ring_avail(&ep) == 26);
+	hw.rx = data + 26;
+	usb_ep_ring_out_rcv(&ep, MPS);
+	CHECK(hw.rx_done_cnt == 2 && hw.clbk_cnt == 2);
+	p = usb_ep_ring_peek(&ep, &n);
+	CHECK(p == ring_buf && n == 26);
+	usb_ep_ring_consume(&ep, 5);
+	CHECK(hw.rx_done_cnt == 2);
+	CHECK(usb_ep_ring_read(&ep, buf, 5) == 5 && !memcmp(buf, data + 5, 5));
+	// Held packet is read across wrap.
+	CHECK(hw.rx_done_cnt == 3 && hw.clbk_cnt == 2 && usb_ep_ring_avail(&ep) == 32);
+	CHECK(usb_ep_ring_read(&ep, buf, sizeof(buf)) == 32 && !memcmp(buf, data + 10, 32));
+	CHECK(usb_ep_ring_read(&ep, buf, sizeof(buf)) == 0);
+}
+
+/**
+ * test_end
+ *
+ * Short packets (including zero length packet) end OUT transfers.
+ */
+static void test_end(void)
+{
+	struct usb_ep_ring ep;
+	uint8_t data[64], buf[64];
+	int i;
+
+	fill(data, sizeof(data), 4);
+	init_ep(&ep, 0x02, 64);
+	hw.rx = data;
+	usb_ep_ring_out_rcv(&ep, MPS);
+	CHECK(usb_ep_ring_out_end(&ep) == -1);
+	usb_ep_ring_out_rcv(&ep, 5);
+	CHECK(usb_ep_ring_out_end(&ep) == 21);
+	usb_ep_ring_out_rcv(&ep, MPS);
+	usb_ep_ring_out_rcv(&ep, 0);
+	CHECK(usb_ep_ring_out_end(&ep) == 21);
+	// End at first unread byte is dropped when data past it is read.
+	CHECK(usb_ep_ring_read(&ep, buf, 21) == 21 && usb_ep_ring_out_end(&ep) == 0);
+	CHECK(usb_ep_ring_read(&ep, buf, 10) == 10 && usb_ep_ring_out_end(&ep) == 6);
+	CHECK(usb_ep_ring_read(&ep, buf, 6) == 6 && usb_ep_ring_out_end(&ep) == 0);
+	usb_ep_ring_out_rcv(&ep, 3);
+	CHECK(usb_ep_ring_read(&ep, buf, 1) == 1 && usb_ep_ring_out_end(&ep) == 2);
+	// Ends not fitting into queue are lost.
+	init_ep(&ep, 0x02, 64);
+	hw.rx = data;
+	for (i = 0; i < USB_EP_RING_END_NMB + 1; i++) {
+		usb_ep_ring_out_rcv(&ep, 1);
+	}
+	CHECK(usb_ep_ring_out_end(&ep) == 1);
+	CHECK(usb_ep_ring_read(&ep, buf, USB_EP_RING_END_NMB + 1) == USB_EP_RING_END_NMB + 1);
+	CHECK(usb_ep_ring_out_end(&ep) == -1);
+}
+
+/**
+ * test_coal
+ *
+ * Coalescing ring sends full packets only until flush.
+ */
+static void test_coal(void)
+{
+	struct usb_ep_ring ep;
+	uint8_t data[32];
+
+	fill(data, sizeof(data), 4);
+	init_ep(&ep, 0x81, 64);
+	ep.coal = TRUE;
+	CHECK(usb_ep_ring_write(&ep, data, 10) == 10 && hw.pkt_nmb == 0);
+	CHECK(usb_ep_ring_write(&ep, data + 10, 10) == 10 && hw.pkt_nmb == 1 && hw.pkt_sz[0] == MPS);
+	CHECK(in_done(&ep) == -1 && hw.clbk_cnt == 0 && usb_ep_ring_avail(&ep) == 4);
+	usb_ep_ring_flush(&ep);
+	CHECK(hw.pkt_nmb == 2 && hw.pkt_sz[1] == 4 && !memcmp(hw.pkt[1], data + 16, 4));
+	CHECK(in_done(&ep) == -1 && hw.clbk_cnt == 1);
+	// Flush of busy endpoint applies to next short packet.
+	hw.pkt_nmb = 0;
+	CHECK(usb_ep_ring_write(&ep, data, 20) == 20 && hw.pkt_nmb == 1);
+	usb_ep_ring_flush(&ep);
+	CHECK(hw.pkt_nmb == 1 && in_done(&ep) == 4 && in_done(&ep) == -1);
+	// Flush of empty ring is not remembered.
+	usb_ep_ring_flush(&ep);
+	CHECK(usb_ep_ring_write(&ep, data, 4) == 4 && hw.pkt_nmb == 2);
+	usb_ep_ring_flush(&ep);
+	CHECK(hw.pkt_nmb == 3 && in_done(&ep) == -1);
+	// ZLP is held as short packet.
+	init_ep(&ep, 0x81, 64);
+	ep.coal = TRUE;
+	ep.zlp = TRUE;
+	CHECK(usb_ep_ring_write(&ep, data, 32) == 32);
+	CHECK(in_done(&ep) == MPS && in_done(&ep) == -1 && hw.pkt_nmb == 2);
+	usb_ep_ring_flush(&ep);
+	CHECK(hw.pkt_nmb == 3 && hw.pkt_sz[2] == 0);
+}
+
+/**
+ * init_ep
+ */
+static void init_ep(struct usb_ep_ring *ep, int addr, int sz)
+{
+	struct usb_endp_desc desc = {
+		.size = sizeof(struct usb_endp_desc),
+		.type = USB_ENDP_DESC,
+		.b_endpoint_address = addr,
+		.bm_attributes = USB_STD_TRANS_BULK,
+		.w_max_packet_size = MPS
+	};
+
+	memset(&hw, 0, sizeof(hw));
+	memset(ep, 0, sizeof(*ep));
+	ep->clbk = clbk;
+	init_usb_ep_ring(ep, &drv, &hw, &desc, ring_buf, sz);
+}
+
+/**
+ * in_done
+ *
+ * Completes sent packet. Returns size of next packet or -1.
+ */
+static int in_done(struct usb_ep_ring *ep)
+{
+	int n = hw.pkt_nmb;
+
+	usb_ep_ring_in_done(ep);
+	return ((hw.pkt_nmb == n) ? -1 : hw.pkt_sz[n]);
+}
+
+/**
+ * fill
+ */
+static void fill(uint8_t *buf, int nmb, int seed)
+{
+	int i;
+
+	for (i = 0; i < nmb; i++) {
+		buf[i] = seed * 31 + i;
+	}
+}
+
+/**
+ * write_fifo
+ */
+static void write_fifo(void *hw_p, int addr, const void *buf, int nmb)
+{
+	struct hw *h = hw_p;
+
+	CHECK(addr & 0x80 && h->fifo_nmb + nmb <= MPS);
+	memcpy(h->fifo + h->fifo_nmb, buf, nmb);
+	h->fifo_nmb += nmb;
+}
+
+/**
+ * tx_pkt_rdy
+ */
+static void tx_pkt_rdy(void *hw_p, int addr)
+{
+	struct hw *h = hw_p;
+
+	CHECK(h->pkt_nmb < PKT_NMB);
+	memcpy(h->pkt[h->pkt_nmb], h->fifo, h->fifo_nmb);
+	h->pkt_sz[h->pkt_nmb++] = h->fifo_nmb;
+	h->fifo_nmb = 0;
+}
+
+/**
+ * read_fifo
+ */
+static void read_fifo(void *hw_p, int addr, void *buf, int nmb)
+{
+	struct hw *h = hw_p;
+
+	CHECK(!(addr & 0x80));
+	memcpy(buf, h->rx, nmb);
+	h->rx += nmb;
+}
+
+/**
+ * rx_done
+ */
+static void rx_done(void *hw_p, int addr)
+{
+	((struct hw *) hw_p)->rx_done_cnt++;
+}
+
+/**
+ * clbk
+ */
+static void clbk(struct usb_ep_ring *ep)
+{
+	hw.clbk_cnt++;
+}
+
+/**
+ * fail
+ */
+static void fail(int line, const char *cond)
+{
+	fprintf(stderr, "test_ep_ring.c:%d: %s\n", line, cond);
+	exit(1);
+}
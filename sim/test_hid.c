@@ -0,0 +1,233 @@
+/*
+ * test_hid.c
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <gentyp.h>
+#include "sysconf.h"
+#include "udp.h"
+#include "usb_std_def.h"
+#include "usb_hid_def.h"
+#include "usb_ctl_req_trc.h"
+#include "usb_ctl_req.h"
+#include "usb_ep_ring.h"
+#include "usb_hid.h"
+#include "sim_udp.h"
+
+// HID function with report 1 (changes only) and report 2 (idle rate 8 ms)
+// sending through interrupt IN ring of simulated endpoint.
+
+#define CHECK(c) do {if (!(c)) {fail(__LINE__, #c);}} while (0)
+
+#define MPS 8
+#define PKT_NMB 8
+
+// Sent IN packets.
+struct hw {
+	uint8_t fifo[MPS];
+	int fifo_nmb;
+	uint8_t pkt[PKT_NMB][MPS];
+	int pkt_sz[PKT_NMB];
+	int pkt_nmb;
+};
+
+static void fail(int line, const char *cond);
+static void test_sched(void);
+static void test_idle(void);
+static int ctl(int type, int req, int val, int len, uint8_t *buf);
+static void write_fifo(void *hw_p, int addr, const void *buf, int nmb);
+static void tx_pkt_rdy(void *hw_p, int addr);
+static void read_fifo(void *hw_p, int addr, void *buf, int nmb);
+static void rx_done(void *hw_p, int addr);
+
+static const uint8_t conf[] = {
+	9, USB_CONF_DESC, 25, 0, 1, 1, 0, USB_STD_BUS_POWER_NO_RWAKE, 50,
+	9, USB_IFACE_DESC, 0, 0, 1, 3, 0, 0, 0,
+	7, USB_ENDP_DESC, 0x81, USB_STD_TRANS_INTERRUPT, MPS, 0, 1
+};
+
+static const uint8_t rep_desc[] = {0x06, 0x00, 0xFF, 0x09, 0x01, 0xA1, 0x01, 0xC0};
+
+static const struct usb_ep_ring_drv drv = {
+	.write_fifo = write_fifo,
+	.tx_pkt_rdy = tx_pkt_rdy,
+	.read_fifo = read_fifo,
+	.rx_done = rx_done
+};
+
+static struct usb_ctl_req_dev dev;
+static struct sim_udp sim;
+static struct usb_desc_idx idx;
+static struct usb_ep_ring in;
+static uint8_t ring_buf[64];
+static uint8_t rep1_buf[3], rep2_buf[2];
+static struct usb_hid_rep rep[] = {
+	{.id = 1, .idle = 0, .sz = sizeof(rep1_buf), .buf = rep1_buf},
+	{.id = 2, .idle = 2, .sz = sizeof(rep2_buf), .buf = rep2_buf}
+};
+static struct usb_hid hid;
+static struct hw hw;
+
+int main(void)
+{
+	struct usb_endp_desc desc = {
+		.size = sizeof(struct usb_endp_desc),
+		.type = USB_ENDP_DESC,
+		.b_endpoint_address = 0x81,
+		.bm_attributes = USB_STD_TRANS_INTERRUPT,
+		.w_max_packet_size = MPS
+	};
+
+	sim.mps = 8;
+	sim.dev = &dev;
+	init_usb_ctl_req(&dev, &sim_udp_drv, &sim);
+	init_usb_ep_ring(&in, &drv, &hw, &desc, ring_buf, sizeof(ring_buf));
+	hid.in = &in;
+	hid.iface = 0;
+	hid.rep = rep;
+	hid.rep_nmb = 2;
+	hid.rep_desc = rep_desc;
+	hid.rep_desc_sz = sizeof(rep_desc);
+	init_usb_hid(&hid, &dev);
+	CHECK(init_usb_desc_idx(&idx, conf, sizeof(conf)));
+	set_usb_ctl_req_fn_conf(&dev, &idx);
+	test_sched();
+	test_idle();
+	printf("test_hid: ok\n");
+	return (0);
+}
+
+/**
+ * test_sched
+ *
+ * Changed report goes out at once, changes made while endpoint is busy
+ * are sent once with latest data. Unchanged report waits for idle period.
+ */
+static void test_sched(void)
+{
+	static const uint8_t a[] = {0x11, 0x12}, b[] = {0x21, 0x22}, c[] = {0x31, 0x32};
+
+	CHECK(usb_hid_write(&hid, 1, a));
+	CHECK(hw.pkt_nmb == 1 && hw.pkt_sz[0] == 3 && !memcmp(hw.pkt[0], "\x01\x11\x12", 3));
+	CHECK(!usb_hid_write(&hid, 1, a));
+	CHECK(usb_hid_write(&hid, 1, b) && usb_hid_write(&hid, 1, c));
+	CHECK(hw.pkt_nmb == 1);
+	usb_ep_ring_in_done(&in);
+	CHECK(hw.pkt_nmb == 2 && !memcmp(hw.pkt[1], "\x01\x31\x32", 3));
+	usb_ep_ring_in_done(&in);
+	CHECK(hw.pkt_nmb == 2);
+	// Report 2 (8 ms idle rate), report 1 has infinite idle rate.
+	usb_hid_tick(&hid, 4);
+	CHECK(hw.pkt_nmb == 2);
+	usb_hid_tick(&hid, 4);
+	CHECK(hw.pkt_nmb == 3 && hw.pkt_sz[2] == 2 && hw.pkt[2][0] == 2);
+	usb_ep_ring_in_done(&in);
+	usb_hid_tick(&hid, 7);
+	CHECK(hw.pkt_nmb == 3);
+	usb_hid_tick(&hid, 1);
+	CHECK(hw.pkt_nmb == 4);
+	usb_ep_ring_in_done(&in);
+}
+
+/**
+ * test_idle
+ *
+ * SET_IDLE changes idle rate of one or (report ID 0) all reports, reset
+ * restores initial rates.
+ */
+static void test_idle(void)
+{
+	uint8_t buf[1];
+
+	CHECK(ctl(0x21, USB_HID_SET_IDLE, (5 << 8) | 2, 0, NULL) == 0);
+	CHECK(ctl(0xA1, USB_HID_GET_IDLE, 2, 1, buf) == 1 && buf[0] == 5);
+	CHECK(ctl(0xA1, USB_HID_GET_IDLE, 1, 1, buf) == 1 && buf[0] == 0);
+	CHECK(ctl(0x21, USB_HID_SET_IDLE, (10 << 8) | 0, 0, NULL) == 0);
+	CHECK(ctl(0xA1, USB_HID_GET_IDLE, 1, 1, buf) == 1 && buf[0] == 10);
+	CHECK(ctl(0xA1, USB_HID_GET_IDLE, 3, 1, buf) == SIM_UDP_STALL);
+	reset_usb_hid(&hid);
+	reset_usb_ep_ring(&in);
+	CHECK(ctl(0xA1, USB_HID_GET_IDLE, 1, 1, buf) == 1 && buf[0] == 0);
+	CHECK(ctl(0xA1, USB_HID_GET_IDLE, 2, 1, buf) == 1 && buf[0] == 2);
+	// Restored rate is used by scheduler.
+	hw.pkt_nmb = 0;
+	usb_hid_tick(&hid, 40);
+	CHECK(hw.pkt_nmb == 1 && hw.pkt[0][0] == 2);
+}
+
+/**
+ * ctl
+ */
+static int ctl(int type, int req, int val, int len, uint8_t *buf)
+{
+	uint8_t stp[8];
+
+	sim_udp_stp(stp, type, req, val, 0, len);
+	return (sim_udp_ctl(&sim, stp, buf));
+}
+
+/**
+ * write_fifo
+ */
+static void write_fifo(void *hw_p, int addr, const void *buf, int nmb)
+{
+	struct hw *h = hw_p;
+
+	CHECK(h->fifo_nmb + nmb <= MPS);
+	memcpy(h->fifo + h->fifo_nmb, buf, nmb);
+	h->fifo_nmb += nmb;
+}
+
+/**
+ * tx_pkt_rdy
+ */
+static void tx_pkt_rdy(void *hw_p, int addr)
+{
+	struct hw *h = hw_p;
+
+	CHECK(h->pkt_nmb < PKT_NMB);
+	memcpy(h->pkt[h->pkt_nmb], h->fifo, h->fifo_nmb);
+	h->pkt_sz[h->pkt_nmb++] = h->fifo_nmb;
+	h->fifo_nmb = 0;
+}
+
+/**
+ * read_fifo
+ */
+static void read_fifo(void *hw_p, int addr, void *buf, int nmb)
+{
+}
+
+/**
+ * rx_done
+ */
+static void rx_done(void *hw_p, int addr)
+{
+}
+
+/**
+ * fail
+ */
+static void fail(int line, const char *cond)
+{
+	fprintf(stderr, "test_hid.c:%d: %s\n", line, cond);
+	exit(1);
+}
@@ -0,0 +1,172 @@
+/*
+ * test_hid_rep.c
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "usb_hid_def.h"
+#include "usb_hid_rep_bld.h"
+
+// Report 3 crosses byte boundaries with every field: btn bits 0-2, x bits
+// 3-14, cnt bits 15-46, v bits 47-58 (three 4 bit elements), pad 59-63.
+// Mouse report has no ID byte.
+
+#define CHECK(c) do {if (!(c)) {fail(__LINE__, #c);}} while (0)
+
+#define F_ITEMS_SZ 25
+#define P_ITEMS_SZ 6
+
+#define T_FIELDS(F, P) \
+	F(btn, USB_HID_PAGE_BUTTON, 1, 3, 0, 1, 1, 3, USB_HID_DATA | USB_HID_VAR) \
+	F(x, USB_HID_PAGE_GENERIC_DESKTOP, USB_HID_USAGE_X, USB_HID_USAGE_X, -2048, 2047, 12, 1, \
+	  USB_HID_DATA | USB_HID_VAR | USB_HID_REL) \
+	F(cnt, USB_HID_PAGE_VENDOR, 1, 1, 0, 0x7FFFFFFF, 32, 1, USB_HID_DATA | USB_HID_VAR) \
+	F(v, USB_HID_PAGE_VENDOR, 2, 4, -8, 7, 4, 3, USB_HID_DATA | USB_HID_VAR) \
+	P(pad, 5)
+#define T_REPS(R) \
+	R(t_in, 3, INPUT, T_FIELDS)
+#define T_TREE(APP) \
+	APP(USB_HID_PAGE_VENDOR, 1, T_REPS)
+
+#define MOUSE_FIELDS(F, P) \
+	F(btn, USB_HID_PAGE_BUTTON, 1, 3, 0, 1, 1, 3, USB_HID_DATA | USB_HID_VAR) \
+	P(btn_pad, 5) \
+	F(xy, USB_HID_PAGE_GENERIC_DESKTOP, USB_HID_USAGE_X, USB_HID_USAGE_Y, -127, 127, 8, 2, \
+	  USB_HID_DATA | USB_HID_VAR | USB_HID_REL)
+#define MOUSE_REPS(R) \
+	R(mouse_in, 0, INPUT, MOUSE_FIELDS)
+#define MOUSE_TREE(APP) \
+	APP(USB_HID_PAGE_GENERIC_DESKTOP, USB_HID_USAGE_MOUSE, MOUSE_REPS)
+
+static void fail(int line, const char *cond);
+static void test_desc(void);
+static void test_unaligned(void);
+static void test_sign(void);
+static void test_no_id(void);
+
+USB_HID_REP_BLD_DESC(t_desc, T_TREE);
+USB_HID_REP_BLD_DESC(mouse_desc, MOUSE_TREE);
+
+int main(void)
+{
+	test_desc();
+	test_unaligned();
+	test_sign();
+	test_no_id();
+	printf("test_hid_rep: ok\n");
+	return (0);
+}
+
+/**
+ * test_desc
+ */
+static void test_desc(void)
+{
+	CHECK(t_in_id == 3 && t_in_sz == 9 && mouse_in_id == 0 && mouse_in_sz == 3);
+	CHECK(sizeof(t_desc) == 8 + 2 + 4 * F_ITEMS_SZ + P_ITEMS_SZ + 1);
+	CHECK(sizeof(mouse_desc) == 8 + 2 + 2 * F_ITEMS_SZ + P_ITEMS_SZ + 1);
+	CHECK(t_desc[8] == 0x85 && t_desc[9] == 3);
+	// Report size and count items of x.
+	CHECK(t_desc[10 + F_ITEMS_SZ + 19] == 0x75 && t_desc[10 + F_ITEMS_SZ + 20] == 12 &&
+	      t_desc[10 + F_ITEMS_SZ + 21] == 0x95 && t_desc[10 + F_ITEMS_SZ + 22] == 1);
+	// Logical minimum of x is 4 byte little endian.
+	CHECK(t_desc[10 + F_ITEMS_SZ + 9] == 0x17 && t_desc[10 + F_ITEMS_SZ + 10] == 0x00 &&
+	      t_desc[10 + F_ITEMS_SZ + 11] == 0xF8 && t_desc[10 + F_ITEMS_SZ + 13] == 0xFF);
+	CHECK(mouse_desc[8] == 0xA4 && mouse_desc[9] == 0xB4 && mouse_desc[sizeof(mouse_desc) - 1] == 0xC0);
+}
+
+/**
+ * test_unaligned
+ *
+ * Fields are written without touching neighbouring bits and ID byte.
+ */
+static void test_unaligned(void)
+{
+	uint8_t buf[t_in_sz];
+
+	memset(buf, 0xFF, sizeof(buf));
+	USB_HID_REP_SET(t_in, x, buf, 0, 0);
+	CHECK(buf[0] == 0xFF && buf[1] == 0x07 && buf[2] == 0x80 && buf[3] == 0xFF);
+	USB_HID_REP_SET(t_in, btn, buf, 1, 0);
+	CHECK(buf[1] == 0x05);
+	memset(buf, 0, sizeof(buf));
+	USB_HID_REP_SET(t_in, cnt, buf, 0, 0xFFFFFFFF);
+	CHECK(buf[0] == 0 && buf[1] == 0 && buf[2] == 0x80 && buf[3] == 0xFF && buf[4] == 0xFF &&
+	      buf[5] == 0xFF && buf[6] == 0x7F && buf[7] == 0);
+	CHECK((uint32_t) USB_HID_REP_GET(t_in, cnt, buf, 0) == 0xFFFFFFFF);
+	USB_HID_REP_SET(t_in, cnt, buf, 0, 0x80000001);
+	CHECK((uint32_t) USB_HID_REP_GET(t_in, cnt, buf, 0) == 0x80000001);
+	CHECK(USB_HID_REP_GET(t_in, x, buf, 0) == 0 && USB_HID_REP_GET(t_in, v, buf, 0) == 0);
+	USB_HID_REP_SET(t_in, x, buf, 0, 0x5A5);
+	USB_HID_REP_SET(t_in, btn, buf, 2, 1);
+	USB_HID_REP_SET(t_in, v, buf, 1, 5);
+	CHECK(USB_HID_REP_GET(t_in, x, buf, 0) == 0x5A5 && USB_HID_REP_GET(t_in, btn, buf, 2) == 1 &&
+	      USB_HID_REP_GET(t_in, btn, buf, 1) == 0 && USB_HID_REP_GET(t_in, v, buf, 1) == 5);
+	CHECK((uint32_t) USB_HID_REP_GET(t_in, cnt, buf, 0) == 0x80000001);
+	CHECK(USB_HID_REP_GET(t_in, v, buf, 0) == 0 && USB_HID_REP_GET(t_in, v, buf, 2) == 0);
+	CHECK(buf[0] == 0 && (buf[8] & 0xF8) == 0);
+}
+
+/**
+ * test_sign
+ *
+ * Field with negative logical minimum is sign extended, others are not.
+ */
+static void test_sign(void)
+{
+	uint8_t buf[t_in_sz];
+
+	memset(buf, 0, sizeof(buf));
+	USB_HID_REP_SET(t_in, x, buf, 0, -1);
+	USB_HID_REP_SET(t_in, v, buf, 2, -8);
+	USB_HID_REP_SET(t_in, v, buf, 0, 7);
+	CHECK(USB_HID_REP_GET(t_in, x, buf, 0) == -1 && USB_HID_REP_GET(t_in, v, buf, 2) == -8 &&
+	      USB_HID_REP_GET(t_in, v, buf, 0) == 7 && USB_HID_REP_GET(t_in, v, buf, 1) == 0);
+	USB_HID_REP_SET(t_in, x, buf, 0, -2048);
+	CHECK(USB_HID_REP_GET(t_in, x, buf, 0) == -2048);
+	USB_HID_REP_SET(t_in, btn, buf, 0, 1);
+	CHECK(USB_HID_REP_GET(t_in, btn, buf, 0) == 1);
+	// 32 bit field keeps all bits.
+	USB_HID_REP_SET(t_in, cnt, buf, 0, 0x80000000);
+	CHECK(USB_HID_REP_GET(t_in, cnt, buf, 0) == (int32_t) 0x80000000);
+	CHECK(USB_HID_REP_GET(t_in, x, buf, 0) == -2048 && USB_HID_REP_GET(t_in, v, buf, 2) == -8);
+}
+
+/**
+ * test_no_id
+ */
+static void test_no_id(void)
+{
+	uint8_t buf[mouse_in_sz];
+
+	memset(buf, 0, sizeof(buf));
+	USB_HID_REP_SET(mouse_in, btn, buf, 0, 1);
+	USB_HID_REP_SET(mouse_in, xy, buf, 1, -3);
+	CHECK(buf[0] == 1 && buf[1] == 0 && buf[2] == 0xFD);
+	CHECK(USB_HID_REP_GET(mouse_in, xy, buf, 1) == -3 && USB_HID_REP_GET(mouse_in, xy, buf, 0) == 0);
+}
+
+/**
+ * fail
+ */
+static void fail(int line, const char *cond)
+{
+	fprintf(stderr, "test_hid_rep.c:%d: %s\n", line, cond);
+	exit(1);
+}
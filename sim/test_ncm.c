@@ -0,0 +1,314 @@
+/*
+ * test_ncm.c
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <gentyp.h>
+#include "sysconf.h"
+#include "udp.h"
+#include "usb_std_def.h"
+#include "usb_ctl_req_trc.h"
+#include "usb_ctl_req.h"
+#include "usb_cdc_def.h"
+#include "usb_ep_ring.h"
+#include "usb_cdc_ncm_ntb.h"
+#include "usb_cdc_ncm.h"
+#include "sim_udp.h"
+
+// NTBs are received through bulk OUT ring fed by simulated controller in
+// MPS packets, transfer is ended by short packet.
+
+#define CHECK(c) do {if (!(c)) {fail(__LINE__, #c);}} while (0)
+
+#define MPS 64
+#define NTB_MAX 2048
+#define MAX_DGRAM 1514
+#define RCV_NMB 8
+
+static void fail(int line, const char *cond);
+static void test_blk(void);
+static void test_eot(void);
+static void test_eot_long(void);
+static void test_drop(void);
+static void init(void);
+static uint32_t build(uint8_t *buf, const int *len, int nmb, int seed);
+static void send(const uint8_t *buf, uint32_t len, boolean_t end);
+static void write_fifo(void *hw_p, int addr, const void *buf, int nmb);
+static void tx_pkt_rdy(void *hw_p, int addr);
+static void read_fifo(void *hw_p, int addr, void *buf, int nmb);
+static void rx_done(void *hw_p, int addr);
+static void rcv_clbk(struct usb_cdc_ncm *ncm, const uint8_t *dgram, int nmb);
+
+static const struct usb_ep_ring_drv drv = {
+	.write_fifo = write_fifo,
+	.tx_pkt_rdy = tx_pkt_rdy,
+	.read_fifo = read_fifo,
+	.rx_done = rx_done
+};
+
+static struct usb_ctl_req_dev dev;
+static struct sim_udp sim;
+static struct usb_cdc_ncm ncm;
+static struct usb_ep_ring in, out;
+static uint8_t in_ring[4096], out_ring[8192];
+static uint8_t in_buf[NTB_MAX], out_buf[NTB_MAX];
+static const uint8_t *rx;
+static int rcv_nmb;
+static int rcv_len[RCV_NMB];
+static uint8_t rcv_first[RCV_NMB];
+
+int main(void)
+{
+	sim.mps = 8;
+	sim.dev = &dev;
+	init_usb_ctl_req(&dev, &sim_udp_drv, &sim);
+	init();
+	test_blk();
+	test_eot();
+	test_eot_long();
+	test_drop();
+	printf("test_ncm: ok\n");
+	return (0);
+}
+
+/**
+ * test_blk
+ *
+ * NTB is delimited by block length, next one may follow in same transfer.
+ */
+static void test_blk(void)
+{
+	static const int len[] = {60, 100};
+	uint8_t buf[2 * NTB_MAX];
+	uint32_t n, m;
+
+	rcv_nmb = 0;
+	n = build(buf, len, 2, 1);
+	m = build(buf + n, len, 1, 2);
+	send(buf, n + m, TRUE);
+	usb_cdc_ncm_poll(&ncm);
+	CHECK(rcv_nmb == 3 && rcv_len[0] == 60 && rcv_len[1] == 100 && rcv_len[2] == 60);
+	CHECK(rcv_first[0] == 1 && rcv_first[1] == 2 && rcv_first[2] == 2);
+	CHECK(ncm.out_err_cnt == 0 && usb_ep_ring_avail(&out) == 0);
+}
+
+/**
+ * test_eot
+ *
+ * NTB16 with zero block length ends with transfer. Transfer of MPS
+ * multiple ends with zero length packet.
+ */
+static void test_eot(void)
+{
+	static const int len[] = {60, 100, 7};
+	uint8_t buf[NTB_MAX], buf2[NTB_MAX];
+	uint32_t n, m;
+
+	rcv_nmb = 0;
+	n = build(buf, len, 3, 3);
+	buf[8] = buf[9] = 0;
+	CHECK(n % MPS);
+	m = build(buf2, len, 1, 4);
+	send(buf, n, TRUE);
+	send(buf2, m, TRUE);
+	usb_cdc_ncm_poll(&ncm);
+	CHECK(rcv_nmb == 4 && rcv_len[2] == 7 && rcv_first[2] == 5 && rcv_first[3] == 4);
+	// Block of two packets, transfer goes on after first one.
+	n = build(buf, len, 1, 6);
+	CHECK(n <= 2 * MPS);
+	memset(buf + n, 0, 2 * MPS - n);
+	buf[8] = buf[9] = 0;
+	rcv_nmb = 0;
+	send(buf, MPS, FALSE);
+	usb_cdc_ncm_poll(&ncm);
+	CHECK(rcv_nmb == 0 && usb_ep_ring_avail(&out) == 0);
+	send(buf + MPS, MPS, TRUE);
+	usb_cdc_ncm_poll(&ncm);
+	CHECK(rcv_nmb == 1 && rcv_len[0] == 60 && rcv_first[0] == 6);
+	CHECK(ncm.out_err_cnt == 0 && usb_ep_ring_avail(&out) == 0);
+}
+
+/**
+ * test_eot_long
+ *
+ * NTB ending with transfer which does not fit into out_buf is dropped up
+ * to transfer end, following NTB is received.
+ */
+static void test_eot_long(void)
+{
+	static const int len[] = {60};
+	static uint8_t buf[NTB_MAX + 1000];
+	uint8_t buf2[NTB_MAX];
+	uint32_t m;
+
+	rcv_nmb = 0;
+	build(buf, len, 1, 7);
+	buf[8] = buf[9] = 0;
+	m = build(buf2, len, 1, 8);
+	send(buf, NTB_MAX, FALSE);
+	usb_cdc_ncm_poll(&ncm);
+	send(buf + NTB_MAX, 1000, TRUE);
+	send(buf2, m, TRUE);
+	usb_cdc_ncm_poll(&ncm);
+	CHECK(rcv_nmb == 1 && rcv_first[0] == 8 && ncm.out_err_cnt == 1);
+	CHECK(usb_ep_ring_avail(&out) == 0);
+	ncm.out_err_cnt = 0;
+}
+
+/**
+ * test_drop
+ *
+ * Datagram longer than negotiated maximum is counted.
+ */
+static void test_drop(void)
+{
+	static const int len[] = {MAX_DGRAM + 1, 60};
+	uint8_t buf[NTB_MAX];
+	uint32_t n;
+
+	rcv_nmb = 0;
+	n = build(buf, len, 2, 9);
+	send(buf, n, TRUE);
+	usb_cdc_ncm_poll(&ncm);
+	CHECK(rcv_nmb == 1 && rcv_len[0] == 60 && ncm.out_drop_cnt == 1 && ncm.out_err_cnt == 0);
+}
+
+/**
+ * init
+ */
+static void init(void)
+{
+	struct usb_endp_desc desc = {
+		.size = sizeof(struct usb_endp_desc),
+		.type = USB_ENDP_DESC,
+		.bm_attributes = USB_STD_TRANS_BULK,
+		.w_max_packet_size = MPS
+	};
+
+	desc.b_endpoint_address = 0x81;
+	init_usb_ep_ring(&in, &drv, NULL, &desc, in_ring, sizeof(in_ring));
+	desc.b_endpoint_address = 0x02;
+	init_usb_ep_ring(&out, &drv, NULL, &desc, out_ring, sizeof(out_ring));
+	ncm.in = &in;
+	ncm.out = &out;
+	ncm.in_buf = in_buf;
+	ncm.in_max = NTB_MAX;
+	ncm.out_buf = out_buf;
+	ncm.out_max = NTB_MAX;
+	ncm.max_dgram = MAX_DGRAM;
+	ncm.rcv_clbk = rcv_clbk;
+	init_usb_cdc_ncm(&ncm, &dev);
+}
+
+/**
+ * build
+ *
+ * Builds NTB16 with nmb datagrams, first byte of datagram is seed.
+ */
+static uint32_t build(uint8_t *buf, const int *len, int nmb, int seed)
+{
+	struct usb_cdc_ncm_ntb_bld bld;
+	uint8_t *p;
+	int i;
+
+	init_usb_cdc_ncm_ntb_bld(&bld, buf, NTB_MAX, 0, 4, 0, seed);
+	for (i = 0; i < nmb; i++) {
+		p = usb_cdc_ncm_ntb_bld_reserve(&bld, len[i]);
+		CHECK(p);
+		memset(p, seed + i, len[i]);
+		usb_cdc_ncm_ntb_bld_add(&bld, len[i]);
+	}
+	return (usb_cdc_ncm_ntb_bld_end(&bld));
+}
+
+/**
+ * send
+ *
+ * Receives len bytes in MPS packets. If end is TRUE, transfer is ended
+ * by short packet (zero length packet after full one).
+ */
+static void send(const uint8_t *buf, uint32_t len, boolean_t end)
+{
+	int n;
+
+	rx = buf;
+	while (len) {
+		n = (len < MPS) ? len : MPS;
+		usb_ep_ring_out_rcv(&out, n);
+		CHECK(out.out_pend == 0);
+		len -= n;
+		if (n < MPS) {
+			return;
+		}
+	}
+	if (end) {
+		usb_ep_ring_out_rcv(&out, 0);
+	}
+}
+
+/**
+ * write_fifo
+ */
+static void write_fifo(void *hw_p, int addr, const void *buf, int nmb)
+{
+}
+
+/**
+ * tx_pkt_rdy
+ */
+static void tx_pkt_rdy(void *hw_p, int addr)
+{
+}
+
+/**
+ * read_fifo
+ */
+static void read_fifo(void *hw_p, int addr, void *buf, int nmb)
+{
+	memcpy(buf, rx, nmb);
+	rx += nmb;
+}
+
+/**
+ * rx_done
+ */
+static void rx_done(void *hw_p, int addr)
+{
+}
+
+/**
+ * rcv_clbk
+ */
+static void rcv_clbk(struct usb_cdc_ncm *n, const uint8_t *dgram, int nmb)
+{
+	CHECK(rcv_nmb < RCV_NMB);
+	rcv_len[rcv_nmb] = nmb;
+	rcv_first[rcv_nmb++] = dgram[0];
+}
+
+/**
+ * fail
+ */
+static void fail(int line, const char *cond)
+{
+	fprintf(stderr, "test_ncm.c:%d: %s\n", line, cond);
+	exit(1);
+}
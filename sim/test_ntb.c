@@ -0,0 +1,261 @@
+/*
+ * test_ntb.c
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "usb_cdc_ncm_ntb.h"
+
+// NTB16 and NTB32 built by builder are parsed back. Malformed blocks
+// must end parsing with err set.
+
+#define CHECK(c) do {if (!(c)) {fail(__LINE__, #c);}} while (0)
+
+#define NTB_SZ 2048
+#define DGRAM_NMB 5
+
+static void fail(int line, const char *cond);
+static uint32_t build(uint8_t *buf, int ntb32);
+static int parse(const uint8_t *buf, uint32_t len, int *err);
+static void test_round_trip(int ntb32);
+static void test_chain(void);
+static void test_malformed(int ntb32);
+static void put16(uint8_t *p, uint32_t v);
+static void put32(uint8_t *p, uint32_t v);
+static uint32_t get16(const uint8_t *p);
+static uint32_t get32(const uint8_t *p);
+
+static const uint32_t dgram_len[DGRAM_NMB] = {60, 1514, 1, 97, 64};
+static uint8_t dgram[DGRAM_NMB][1514];
+
+int main(void)
+{
+	int i, j;
+
+	for (i = 0; i < DGRAM_NMB; i++) {
+		for (j = 0; j < 1514; j++) {
+			dgram[i][j] = i * 31 + j;
+		}
+	}
+	test_round_trip(0);
+	test_round_trip(1);
+	test_chain();
+	test_malformed(0);
+	test_malformed(1);
+	printf("test_ntb: ok\n");
+	return (0);
+}
+
+/**
+ * test_round_trip
+ */
+static void test_round_trip(int ntb32)
+{
+	uint8_t buf[NTB_SZ];
+	uint32_t len;
+	int err;
+
+	len = build(buf, ntb32);
+	CHECK(len && len <= NTB_SZ);
+	CHECK(usb_cdc_ncm_ntb_blk_len(buf) == len);
+	CHECK(parse(buf, len, &err) == DGRAM_NMB - 1);
+	CHECK(!err);
+	// Transfer longer than block.
+	CHECK(parse(buf, NTB_SZ, &err) == DGRAM_NMB - 1);
+	CHECK(!err);
+	// Truncated transfer.
+	CHECK(parse(buf, len - 1, &err) < 0);
+}
+
+/**
+ * test_chain
+ *
+ * NTB16 with second NDP appended after first one.
+ */
+static void test_chain(void)
+{
+	uint8_t buf[NTB_SZ];
+	uint32_t len, ndp, ndp2;
+	int err;
+
+	len = build(buf, 0);
+	ndp = get16(buf + 10);
+	ndp2 = (len + 3) & ~3UL;
+	memcpy(buf + ndp2, buf + ndp, 8 + 4 * 2);
+	put16(buf + ndp2 + 4, 8 + 4 * 2);
+	put16(buf + ndp2 + 8 + 4, 0);
+	put16(buf + ndp2 + 8 + 6, 0);
+	put16(buf + ndp + 6, ndp2);
+	put16(buf + 8, ndp2 + 8 + 4 * 2);
+	CHECK(parse(buf, ndp2 + 8 + 4 * 2, &err) == DGRAM_NMB);
+	CHECK(!err);
+	// Next NDP pointing back.
+	put16(buf + ndp2 + 6, ndp);
+	CHECK(parse(buf, ndp2 + 8 + 4 * 2, &err) == DGRAM_NMB);
+	CHECK(err);
+}
+
+/**
+ * test_malformed
+ */
+static void test_malformed(int ntb32)
+{
+	uint8_t buf[NTB_SZ], org[NTB_SZ];
+	uint32_t len, ndp, sz, ent;
+	int err;
+
+	len = build(org, ntb32);
+	ndp = (ntb32) ? get32(org + 12) : get16(org + 10);
+	sz = get16(org + ndp + 4);
+	ent = ndp + ((ntb32) ? 16 : 8);
+	// Self referencing NDP.
+	memcpy(buf, org, len);
+	if (ntb32) {
+		put32(buf + ndp + 8, ndp);
+	} else {
+		put16(buf + ndp + 6, ndp);
+	}
+	CHECK(parse(buf, len, &err) == DGRAM_NMB - 1);
+	CHECK(err);
+	// NDP without terminating entry.
+	memcpy(buf, org, len);
+	put16(buf + ndp + 4, sz - ((ntb32) ? 8 : 4));
+	CHECK(parse(buf, len, &err) == DGRAM_NMB - 1);
+	CHECK(err);
+	// NDP too short for single entry.
+	memcpy(buf, org, len);
+	put16(buf + ndp + 4, (ntb32) ? 16 : 8);
+	CHECK(parse(buf, len, &err) < 0);
+	// Datagram index out of block.
+	memcpy(buf, org, len);
+	if (ntb32) {
+		put32(buf + ent + 8, len);
+	} else {
+		put16(buf + ent + 4, len);
+	}
+	CHECK(parse(buf, len, &err) == 1);
+	CHECK(err);
+	// Datagram crossing end of block.
+	memcpy(buf, org, len);
+	if (ntb32) {
+		put32(buf + ent + 4, len);
+	} else {
+		put16(buf + ent + 2, len);
+	}
+	CHECK(parse(buf, len, &err) == 0);
+	CHECK(err);
+	// Bad NDP signature.
+	memcpy(buf, org, len);
+	buf[ndp] ^= 1;
+	CHECK(parse(buf, len, &err) < 0);
+}
+
+/**
+ * build
+ *
+ * Builds NTB of datagrams 0..DGRAM_NMB-2 (last one does not fit).
+ */
+static uint32_t build(uint8_t *buf, int ntb32)
+{
+	struct usb_cdc_ncm_ntb_bld bld;
+	uint8_t *p;
+	int i;
+
+	memset(buf, 0, NTB_SZ);
+	init_usb_cdc_ncm_ntb_bld(&bld, buf, 1760, ntb32, 4, 2, 7);
+	for (i = 0; i < DGRAM_NMB; i++) {
+		if (!(p = usb_cdc_ncm_ntb_bld_reserve(&bld, dgram_len[i]))) {
+			CHECK(i == DGRAM_NMB - 1);
+			break;
+		}
+		CHECK((p - buf) % 4 == 2);
+		memcpy(p, dgram[i], dgram_len[i]);
+		usb_cdc_ncm_ntb_bld_add(&bld, dgram_len[i]);
+	}
+	return (usb_cdc_ncm_ntb_bld_end(&bld));
+}
+
+/**
+ * parse
+ *
+ * Returns number of datagrams matching built ones (repeating from first
+ * after DGRAM_NMB - 1) or -1 if NTH or first NDP is rejected.
+ */
+static int parse(const uint8_t *buf, uint32_t len, int *err)
+{
+	struct usb_cdc_ncm_ntb_prs prs;
+	const uint8_t *p;
+	uint32_t n;
+	int i = 0;
+
+	if (init_usb_cdc_ncm_ntb_prs(&prs, buf, len) < 0) {
+		return (-1);
+	}
+	while ((p = usb_cdc_ncm_ntb_prs_next(&prs, &n))) {
+		CHECK(i < 4 * DGRAM_NMB);
+		CHECK(n == dgram_len[i % (DGRAM_NMB - 1)]);
+		CHECK(!memcmp(p, dgram[i % (DGRAM_NMB - 1)], n));
+		i++;
+	}
+	*err = prs.err;
+	return (i);
+}
+
+/**
+ * put16
+ */
+static void put16(uint8_t *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+/**
+ * put32
+ */
+static void put32(uint8_t *p, uint32_t v)
+{
+	put16(p, v);
+	put16(p + 2, v >> 16);
+}
+
+/**
+ * get16
+ */
+static uint32_t get16(const uint8_t *p)
+{
+	return (p[0] | (p[1] << 8));
+}
+
+/**
+ * get32
+ */
+static uint32_t get32(const uint8_t *p)
+{
+	return (get16(p) | (get16(p + 2) << 16));
+}
+
+/**
+ * fail
+ */
+static void fail(int line, const char *cond)
+{
+	fprintf(stderr, "test_ntb.c:%d: %s\n", line, cond);
+	exit(1);
+}
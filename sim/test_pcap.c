@@ -0,0 +1,179 @@
+/*
+ * test_pcap.c
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <gentyp.h>
+#include "sysconf.h"
+#include "criterr.h"
+#include "udp.h"
+#include "usb_std_def.h"
+#include "usb_ctl_req_trc.h"
+#include "usb_ctl_req.h"
+#include "usb_pcap.h"
+#include "usb_pcap_rply.h"
+#include "sim_udp.h"
+#include "pcap_dev.h"
+
+// Enumeration of sample device is written as usbmon capture, read back
+// and replayed. Transfers performed by engine are exported and must read
+// back unchanged.
+
+#define CHECK(c) do {if (!(c)) {fail(__LINE__, #c);}} while (0)
+
+#define STD_IN 0x80
+#define STD_OUT 0x00
+#define VND_OUT 0x40
+#define CTL_NMB 12
+
+static void fail(int line, const char *cond);
+static void add_ctl(int type, int req, int val, int idx, int len, int32_t status, const void *data, int nmb,
+		    enum usb_pcap_rply_res exp);
+static void test_rply(int mps);
+
+static struct usb_pcap_ctl cap[CTL_NMB];
+static enum usb_pcap_rply_res cap_exp[CTL_NMB];
+static int cap_nmb;
+static struct usb_pcap_ctl ctl, res[CTL_NMB];
+static struct usb_pcap_rd rd;
+static struct usb_pcap_wr wr;
+
+static const uint8_t lang_desc[] = {4, USB_STR_DESC, USB_STD_EN_US_CODE};
+
+int main(void)
+{
+	uint8_t bad[sizeof(struct usb_dev_desc)];
+	uint8_t out[PCAP_DEV_OUT_SZ];
+	int i;
+
+	for (i = 0; i < PCAP_DEV_OUT_SZ; i++) {
+		out[i] = i + 1;
+	}
+	memcpy(bad, &pcap_dev_desc, sizeof(bad));
+	bad[sizeof(bad) - 1] ^= 1;
+	add_ctl(STD_IN, USB_GET_DESCRIPTOR, USB_DEV_DESC << 8, 0, 64, USB_PCAP_STATUS_OK, &pcap_dev_desc,
+		sizeof(struct usb_dev_desc), USB_PCAP_RPLY_MATCH);
+	add_ctl(STD_OUT, USB_SET_ADDRESS, 5, 0, 0, USB_PCAP_STATUS_OK, NULL, 0, USB_PCAP_RPLY_MATCH);
+	add_ctl(STD_IN, USB_GET_DESCRIPTOR, USB_CONF_DESC << 8, 0, 9, USB_PCAP_STATUS_OK, pcap_dev_conf, 9,
+		USB_PCAP_RPLY_MATCH);
+	add_ctl(STD_IN, USB_GET_DESCRIPTOR, USB_CONF_DESC << 8, 0, 255, USB_PCAP_STATUS_OK, pcap_dev_conf,
+		pcap_dev_conf_sz, USB_PCAP_RPLY_MATCH);
+	add_ctl(STD_IN, USB_GET_DESCRIPTOR, USB_STR_DESC << 8, 0, 255, USB_PCAP_STATUS_OK, lang_desc,
+		sizeof(lang_desc), USB_PCAP_RPLY_MATCH);
+	add_ctl(STD_OUT, USB_SET_CONFIGURATION, 1, 0, 0, USB_PCAP_STATUS_OK, NULL, 0, USB_PCAP_RPLY_MATCH);
+	// Configuration 2 does not exist.
+	add_ctl(STD_OUT, USB_SET_CONFIGURATION, 2, 0, 0, USB_PCAP_STATUS_STALL, NULL, 0, USB_PCAP_RPLY_MATCH);
+	add_ctl(STD_IN, USB_GET_DESCRIPTOR, USB_DEV_DESC << 8, 0, 18, USB_PCAP_STATUS_OK, bad, sizeof(bad),
+		USB_PCAP_RPLY_DATA_DIFF);
+	add_ctl(STD_IN, USB_GET_CONFIGURATION, 0, 0, 1, USB_PCAP_STATUS_STALL, NULL, 0, USB_PCAP_RPLY_STALL_DIFF);
+	add_ctl(VND_OUT, PCAP_DEV_REQ_OUT, 0, 0, 20, USB_PCAP_STATUS_OK, out, 20, USB_PCAP_RPLY_MATCH);
+	// OUT data stage truncated by snap length, rest is sent as zeros.
+	add_ctl(VND_OUT, PCAP_DEV_REQ_OUT, 0, 0, 40, USB_PCAP_STATUS_OK, out, 10, USB_PCAP_RPLY_SKIP);
+	cap[cap_nmb - 1].len = 40;
+	add_ctl(STD_IN, USB_GET_DESCRIPTOR, USB_DEV_DESC << 8, 0, 64, USB_PCAP_STATUS_RESET, NULL, 0,
+		USB_PCAP_RPLY_SKIP);
+	test_rply(8);
+	test_rply(64);
+	printf("test_pcap: ok\n");
+	return (0);
+}
+
+/**
+ * test_rply
+ */
+static void test_rply(int mps)
+{
+	static struct usb_ctl_req_dev devs[2];
+	static struct usb_pcap_rply rplys[2];
+	struct usb_ctl_req_dev *dev = &devs[(mps == 8) ? 0 : 1];
+	struct usb_pcap_rply *rply = &rplys[(mps == 8) ? 0 : 1];
+	FILE *f, *out;
+	int i;
+
+	CHECK((f = tmpfile()) && (out = tmpfile()));
+	CHECK(!init_usb_pcap_wr(&wr, f));
+	for (i = 0; i < cap_nmb; i++) {
+		CHECK(!usb_pcap_wr_ctl(&wr, &cap[i]));
+	}
+	rewind(f);
+	rply->mps = mps;
+	init_usb_ctl_req(dev, &usb_pcap_rply_drv, rply);
+	init_usb_pcap_rply(rply, dev);
+	init_pcap_dev(dev);
+	CHECK(!init_usb_pcap_rd(&rd, f));
+	CHECK(!init_usb_pcap_wr(&wr, out));
+	for (i = 0; i < cap_nmb; i++) {
+		CHECK(usb_pcap_rd_ctl(&rd, &ctl) == 1);
+		CHECK(!memcmp(ctl.stp, cap[i].stp, sizeof(ctl.stp)) && ctl.status == cap[i].status);
+		CHECK(usb_pcap_rply_ctl(rply, &ctl, &res[i]) == cap_exp[i]);
+		CHECK(!usb_pcap_wr_ctl(&wr, &res[i]));
+	}
+	CHECK(usb_pcap_rd_ctl(&rd, &ctl) == 0);
+	CHECK(rply->stats.cnt[USB_PCAP_RPLY_MATCH] == 8 && rply->stats.cnt[USB_PCAP_RPLY_DATA_DIFF] == 1 &&
+	      rply->stats.cnt[USB_PCAP_RPLY_STALL_DIFF] == 1 && rply->stats.cnt[USB_PCAP_RPLY_SKIP] == 2 &&
+	      rply->stats.cnt[USB_PCAP_RPLY_NO_STATUS] == 0);
+	CHECK(pcap_dev_out[0] == 1 && pcap_dev_out[9] == 10 && pcap_dev_out[10] == 0 && pcap_dev_out[39] == 0 &&
+	      pcap_dev_out[40] == 0);
+	// Export of replay.
+	rewind(out);
+	CHECK(!init_usb_pcap_rd(&rd, out));
+	for (i = 0; i < cap_nmb; i++) {
+		CHECK(usb_pcap_rd_ctl(&rd, &ctl) == 1);
+		CHECK(!memcmp(ctl.stp, res[i].stp, sizeof(ctl.stp)) && ctl.status == res[i].status);
+		CHECK(ctl.len == res[i].len && ctl.nmb == res[i].nmb && !memcmp(ctl.data, res[i].data, ctl.nmb));
+	}
+	CHECK(usb_pcap_rd_ctl(&rd, &ctl) == 0);
+	fclose(f);
+	fclose(out);
+}
+
+/**
+ * add_ctl
+ *
+ * Adds transfer to capture, exp is expected result of replay.
+ */
+static void add_ctl(int type, int req, int val, int idx, int len, int32_t status, const void *data, int nmb,
+		    enum usb_pcap_rply_res exp)
+{
+	struct usb_pcap_ctl *c = &cap[cap_nmb];
+
+	memset(c, 0, sizeof(*c));
+	c->bus = 1;
+	c->dev = 3;
+	sim_udp_stp(c->stp, type, req, val, idx, len);
+	c->status = status;
+	c->sec = cap_nmb;
+	c->len = nmb;
+	c->nmb = nmb;
+	if (nmb) {
+		memcpy(c->data, data, nmb);
+	}
+	cap_exp[cap_nmb++] = exp;
+}
+
+/**
+ * fail
+ */
+static void fail(int line, const char *cond)
+{
+	fprintf(stderr, "test_pcap.c:%d: %s\n", line, cond);
+	exit(1);
+}
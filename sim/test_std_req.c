@@ -0,0 +1,290 @@
+/*
+ * test_std_req.c
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <gentyp.h>
+#include "sysconf.h"
+#include "udp.h"
+#include "usb_std_def.h"
+#include "usb_ctl_req_trc.h"
+#include "usb_ctl_req.h"
+#include "usb_str_desc.h"
+#include "usb_std_req.h"
+#include "sim_udp.h"
+
+// Two devices with own standard request engines, hooks log calls of the
+// device they belong to.
+
+#define CHECK(c) do {if (!(c)) {fail(__LINE__, #c);}} while (0)
+
+#define DEV_NMB 2
+
+struct dev {
+	struct usb_ctl_req_dev dev;
+	struct sim_udp sim;
+	struct usb_std_req sr;
+	struct usb_desc_idx idx;
+	struct usb_std_req_conf conf;
+	int addr;
+	int conf_val;
+	int iface;
+	int alt;
+	uint32_t halt_set;
+	uint32_t halt_clr;
+};
+
+static void fail(int line, const char *cond);
+static void test_addr(struct dev *d);
+static void test_conf(struct dev *d);
+static void test_feat(struct dev *d);
+static void test_iface(struct dev *d);
+static int ctl(struct dev *d, int type, int req, int val, int idx, int len, uint8_t *buf);
+static void set_addr(struct usb_std_req *sr, int addr);
+static boolean_t set_conf(struct usb_std_req *sr, const struct usb_desc_idx *idx);
+static boolean_t set_iface(struct usb_std_req *sr, int iface, int alt);
+static void set_endp_halt(struct usb_std_req *sr, int addr, boolean_t halt);
+
+// Interface 0 (interrupt IN 0x81) and interface 1 with alternate settings
+// 0 (bulk OUT 0x02) and 1 (bulk IN 0x82).
+static const uint8_t conf[] = {
+	9, USB_CONF_DESC, 48, 0, 2, 1, 0, USB_STD_BUS_POWER_NO_RWAKE, 50,
+	9, USB_IFACE_DESC, 0, 0, 1, 0xFF, 0, 0, 0,
+	7, USB_ENDP_DESC, 0x81, USB_STD_TRANS_INTERRUPT, 8, 0, 10,
+	9, USB_IFACE_DESC, 1, 0, 1, 0xFF, 0, 0, 0,
+	7, USB_ENDP_DESC, 0x02, USB_STD_TRANS_BULK, 64, 0, 0,
+	9, USB_IFACE_DESC, 1, 1, 1, 0xFF, 0, 0, 0,
+	7, USB_ENDP_DESC, 0x82, USB_STD_TRANS_BULK, 64, 0, 0
+};
+
+static const struct usb_dev_desc dev_desc = {
+	.size = sizeof(struct usb_dev_desc),
+	.type = USB_DEV_DESC,
+	.bcd_usb = 0x0200,
+	.b_max_packet_size0 = 8,
+	.id_vendor = 0x1234,
+	.id_product = 0x5678,
+	.b_num_configurations = 1
+};
+
+static const struct usb_std_req_hooks hooks = {
+	.set_addr = set_addr,
+	.set_conf = set_conf,
+	.set_iface = set_iface,
+	.set_endp_halt = set_endp_halt
+};
+
+static struct dev devs[DEV_NMB];
+
+int main(void)
+{
+	struct dev *d;
+	int i;
+
+	for (i = 0; i < DEV_NMB; i++) {
+		d = &devs[i];
+		d->sim.mps = 8 << i;
+		d->sim.dev = &d->dev;
+		d->conf.desc = conf;
+		d->conf.desc_sz = sizeof(conf);
+		d->conf.idx = &d->idx;
+		d->sr.dev_desc = &dev_desc;
+		d->sr.conf = &d->conf;
+		d->sr.conf_nmb = 1;
+		d->sr.hooks = &hooks;
+		d->sr.arg = d;
+		init_usb_ctl_req(&d->dev, &sim_udp_drv, &d->sim);
+		init_usb_std_req(&d->sr, &d->dev);
+	}
+	for (i = 0; i < DEV_NMB; i++) {
+		test_addr(&devs[i]);
+	}
+	for (i = 0; i < DEV_NMB; i++) {
+		test_conf(&devs[i]);
+		test_feat(&devs[i]);
+		test_iface(&devs[i]);
+	}
+	printf("test_std_req: ok\n");
+	return (0);
+}
+
+/**
+ * test_addr
+ */
+static void test_addr(struct dev *d)
+{
+	uint8_t buf[64];
+	int addr = 5 + (d - devs);
+
+	CHECK(ctl(d, 0x80, USB_GET_DESCRIPTOR, USB_DEV_DESC << 8, 0, 64, buf) == sizeof(dev_desc));
+	CHECK(!memcmp(buf, &dev_desc, sizeof(dev_desc)));
+	CHECK(ctl(d, 0x80, USB_GET_DESCRIPTOR, USB_CONF_DESC << 8, 0, 9, buf) == 9 && buf[2] == 48);
+	CHECK(ctl(d, 0x80, USB_GET_DESCRIPTOR, USB_CONF_DESC << 8, 0, 64, buf) == sizeof(conf));
+	CHECK(!memcmp(buf, conf, sizeof(conf)));
+	CHECK(ctl(d, 0x80, USB_GET_DESCRIPTOR, (USB_CONF_DESC << 8) | 1, 0, 64, buf) == SIM_UDP_STALL);
+	CHECK(ctl(d, 0x80, USB_GET_DESCRIPTOR, USB_STR_DESC << 8, 0, 64, buf) == SIM_UDP_STALL);
+	// Not configurable in default state.
+	CHECK(ctl(d, 0x00, USB_SET_CONFIGURATION, 1, 0, 0, NULL) == SIM_UDP_STALL);
+	CHECK(ctl(d, 0x00, USB_SET_ADDRESS, addr, 0, 0, NULL) == 0);
+	CHECK(d->addr == addr && d->sr.state.addr == addr);
+	CHECK(ctl(d, 0x80, USB_GET_CONFIGURATION, 0, 0, 1, buf) == 1 && buf[0] == 0);
+}
+
+/**
+ * test_conf
+ */
+static void test_conf(struct dev *d)
+{
+	uint8_t buf[2];
+
+	CHECK(ctl(d, 0x00, USB_SET_CONFIGURATION, 2, 0, 0, NULL) == SIM_UDP_STALL);
+	CHECK(ctl(d, 0x00, USB_SET_CONFIGURATION, 1, 0, 0, NULL) == 0);
+	CHECK(d->conf_val == 1 && usb_std_req_get_idx(&d->sr) == &d->idx);
+	CHECK(ctl(d, 0x80, USB_GET_CONFIGURATION, 0, 0, 1, buf) == 1 && buf[0] == 1);
+	// Address can not change in configured state.
+	CHECK(ctl(d, 0x00, USB_SET_ADDRESS, 9, 0, 0, NULL) == SIM_UDP_STALL);
+	CHECK(ctl(d, 0x80, USB_GET_STATUS, 0, 0, 2, buf) == 2 && buf[0] == 0 && buf[1] == 0);
+	CHECK(ctl(d, 0x81, USB_GET_STATUS, 0, 1, 2, buf) == 2 && buf[0] == 0);
+	CHECK(ctl(d, 0x81, USB_GET_STATUS, 0, 2, 2, buf) == SIM_UDP_STALL);
+	CHECK(ctl(d, 0x81, USB_GET_INTERFACE, 0, 1, 1, buf) == 1 && buf[0] == 0);
+}
+
+/**
+ * test_feat
+ */
+static void test_feat(struct dev *d)
+{
+	uint8_t buf[2];
+
+	CHECK(ctl(d, 0x00, USB_SET_FEATURE, USB_DEV_REM_WKUP_FEAT, 0, 0, NULL) == 0);
+	CHECK(ctl(d, 0x80, USB_GET_STATUS, 0, 0, 2, buf) == 2 && buf[0] == 2);
+	CHECK(ctl(d, 0x00, USB_CLEAR_FEATURE, USB_DEV_REM_WKUP_FEAT, 0, 0, NULL) == 0);
+	CHECK(ctl(d, 0x80, USB_GET_STATUS, 0, 0, 2, buf) == 2 && buf[0] == 0);
+	CHECK(ctl(d, 0x00, USB_SET_FEATURE, USB_TEST_MODE_FEAT, 0, 0, NULL) == SIM_UDP_STALL);
+	CHECK(ctl(d, 0x02, USB_SET_FEATURE, USB_ENDP_HALT_FEAT, 0x81, 0, NULL) == 0);
+	CHECK(d->halt_set == 1UL << usb_desc_idx_endp_ix(0x81));
+	CHECK(ctl(d, 0x82, USB_GET_STATUS, 0, 0x81, 2, buf) == 2 && buf[0] == 1);
+	CHECK(ctl(d, 0x82, USB_GET_STATUS, 0, 0x01, 2, buf) == SIM_UDP_STALL);
+	CHECK(ctl(d, 0x02, USB_SET_FEATURE, USB_ENDP_HALT_FEAT, 0x03, 0, NULL) == SIM_UDP_STALL);
+	CHECK(ctl(d, 0x02, USB_CLEAR_FEATURE, USB_ENDP_HALT_FEAT, 0x81, 0, NULL) == 0);
+	CHECK(d->halt_clr == 1UL << usb_desc_idx_endp_ix(0x81));
+	CHECK(ctl(d, 0x82, USB_GET_STATUS, 0, 0x81, 2, buf) == 2 && buf[0] == 0);
+	// Endpoint 0 status.
+	CHECK(ctl(d, 0x82, USB_GET_STATUS, 0, 0x80, 2, buf) == 2 && buf[0] == 0);
+}
+
+/**
+ * test_iface
+ *
+ * SET_INTERFACE clears halt of interface endpoints in controller.
+ */
+static void test_iface(struct dev *d)
+{
+	uint8_t buf[2];
+	uint32_t msk = (1UL << usb_desc_idx_endp_ix(0x02)) | (1UL << usb_desc_idx_endp_ix(0x82));
+
+	CHECK(ctl(d, 0x02, USB_SET_FEATURE, USB_ENDP_HALT_FEAT, 0x02, 0, NULL) == 0);
+	CHECK(ctl(d, 0x02, USB_SET_FEATURE, USB_ENDP_HALT_FEAT, 0x81, 0, NULL) == 0);
+	d->halt_clr = 0;
+	CHECK(ctl(d, 0x01, USB_SET_INTERFACE, 2, 1, 0, NULL) == SIM_UDP_STALL);
+	CHECK(ctl(d, 0x01, USB_SET_INTERFACE, 1, 1, 0, NULL) == 0);
+	CHECK(d->iface == 1 && d->alt == 1);
+	CHECK(d->halt_clr == msk);
+	CHECK(ctl(d, 0x82, USB_GET_STATUS, 0, 0x02, 2, buf) == 2 && buf[0] == 0);
+	CHECK(ctl(d, 0x82, USB_GET_STATUS, 0, 0x81, 2, buf) == 2 && buf[0] == 1);
+	CHECK(ctl(d, 0x81, USB_GET_INTERFACE, 0, 1, 1, buf) == 1 && buf[0] == 1);
+	// Deconfigured device has no endpoints.
+	CHECK(ctl(d, 0x00, USB_SET_CONFIGURATION, 0, 0, 0, NULL) == 0);
+	CHECK(d->conf_val == 0 && usb_std_req_get_idx(&d->sr) == NULL);
+	CHECK(ctl(d, 0x82, USB_GET_STATUS, 0, 0x81, 2, buf) == SIM_UDP_STALL);
+	CHECK(ctl(d, 0x81, USB_GET_INTERFACE, 0, 1, 1, buf) == SIM_UDP_STALL);
+}
+
+/**
+ * ctl
+ */
+static int ctl(struct dev *d, int type, int req, int val, int idx, int len, uint8_t *buf)
+{
+	uint8_t stp[8];
+
+	sim_udp_stp(stp, type, req, val, idx, len);
+	return (sim_udp_ctl(&d->sim, stp, buf));
+}
+
+/**
+ * set_addr
+ */
+static void set_addr(struct usb_std_req *sr, int addr)
+{
+	struct dev *d = sr->arg;
+
+	CHECK(sr == &d->sr);
+	d->addr = addr;
+}
+
+/**
+ * set_conf
+ */
+static boolean_t set_conf(struct usb_std_req *sr, const struct usb_desc_idx *idx)
+{
+	struct dev *d = sr->arg;
+
+	CHECK(sr == &d->sr);
+	d->conf_val = (idx) ? idx->conf->b_configuration_value : 0;
+	return (TRUE);
+}
+
+/**
+ * set_iface
+ */
+static boolean_t set_iface(struct usb_std_req *sr, int iface, int alt)
+{
+	struct dev *d = sr->arg;
+
+	CHECK(sr == &d->sr);
+	d->iface = iface;
+	d->alt = alt;
+	return (TRUE);
+}
+
+/**
+ * set_endp_halt
+ */
+static void set_endp_halt(struct usb_std_req *sr, int addr, boolean_t halt)
+{
+	struct dev *d = sr->arg;
+
+	CHECK(sr == &d->sr);
+	if (halt) {
+		d->halt_set |= 1UL << usb_desc_idx_endp_ix(addr);
+	} else {
+		d->halt_clr |= 1UL << usb_desc_idx_endp_ix(addr);
+	}
+}
+
+/**
+ * fail
+ */
+static void fail(int line, const char *cond)
+{
+	fprintf(stderr, "test_std_req.c:%d: %s\n", line, cond);
+	exit(1);
+}
@@ -0,0 +1,226 @@
+/*
+ * usb_cdc_acm.c
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <timers.h>
+#include <gentyp.h>
+#include "sysconf.h"
+#include "criterr.h"
+#include "udp.h"
+#include "usb_std_def.h"
+#include "usb_cdc_def.h"
+#include "usb_ctl_req_trc.h"
+#include "usb_ctl_req.h"
+#include "usb_ep_ring.h"
+#include "usb_cdc_acm.h"
+
+static struct usb_ctl_req stp_clbk(struct usb_ctl_req_dev *dev, struct usb_stp_pkt *stp);
+static void in_req_ack_clbk(struct usb_ctl_req_dev *dev);
+static boolean_t out_req_rec_clbk(struct usb_ctl_req_dev *dev);
+static void out_req_ack_clbk(struct usb_ctl_req_dev *dev);
+static void tmr_clbk(TimerHandle_t tmr);
+
+/**
+ * init_usb_cdc_acm
+ */
+void init_usb_cdc_acm(struct usb_cdc_acm *acm, struct usb_ctl_req_dev *dev)
+{
+	if (!acm->in || !acm->out) {
+		crit_err_exit(BAD_PARAMETER);
+	}
+	acm->lc.dw_dte_rate = 115200;
+	acm->lc.b_char_format = USB_CDC_LN_CHAR_FMT_1_STOP_BIT;
+	acm->lc.b_parity_type = USB_CDC_LN_PAR_TYPE_NONE;
+	acm->lc.b_data_bits = USB_CDC_LN_DATA_BITS_8;
+	acm->ctl_line = 0;
+	acm->serial_state = 0;
+	if (acm->flush_tmo) {
+		acm->in->coal = TRUE;
+		if (!(acm->tmr = xTimerCreate("ACM", acm->flush_tmo, pdFALSE, acm, tmr_clbk))) {
+			crit_err_exit(MALLOC_ERROR);
+		}
+	}
+	acm->clbks.stp_clbk = stp_clbk;
+	acm->clbks.in_req_ack_clbk = in_req_ack_clbk;
+	acm->clbks.out_req_rec_clbk = out_req_rec_clbk;
+	acm->clbks.out_req_ack_clbk = out_req_ack_clbk;
+	acm->clbks.arg = acm;
+	acm->fn.first_iface = acm->comm_iface;
+	acm->fn.clbks = &acm->clbks;
+	add_usb_ctl_req_fn_clbks(dev, &acm->fn);
+}
+
+/**
+ * usb_cdc_acm_write
+ */
+int usb_cdc_acm_write(struct usb_cdc_acm *acm, const void *buf, int nmb)
+{
+	int n;
+
+	n = usb_ep_ring_write(acm->in, buf, nmb);
+	if (acm->tmr && usb_ep_ring_avail(acm->in) && xTimerIsTimerActive(acm->tmr) == pdFALSE) {
+		// Timeout runs from oldest held byte, continuous writes can not
+		// postpone it.
+		xTimerStart(acm->tmr, 0);
+	}
+	return (n);
+}
+
+/**
+ * usb_cdc_acm_flush
+ */
+void usb_cdc_acm_flush(struct usb_cdc_acm *acm)
+{
+	usb_ep_ring_flush(acm->in);
+}
+
+/**
+ * tmr_clbk
+ */
+static void tmr_clbk(TimerHandle_t tmr)
+{
+	usb_cdc_acm_flush(pvTimerGetTimerID(tmr));
+}
+
+/**
+ * usb_cdc_acm_read
+ */
+int usb_cdc_acm_read(struct usb_cdc_acm *acm, void *buf, int nmb)
+{
+	return (usb_ep_ring_read(acm->out, buf, nmb));
+}
+
+/**
+ * usb_cdc_acm_set_serial_state
+ */
+boolean_t usb_cdc_acm_set_serial_state(struct usb_cdc_acm *acm, int state)
+{
+	struct {
+		struct usb_cdc_ntf hdr;
+		uint16_t state;
+	} __attribute__ ((packed)) ntf;
+
+	if (state == acm->serial_state || !acm->ntf) {
+		return (TRUE);
+	}
+	if (usb_ep_ring_free(acm->ntf) < (int) sizeof(ntf)) {
+		return (FALSE);
+	}
+	ntf.hdr.bm_request_type = USB_CDC_NTF_REQUEST_TYPE;
+	ntf.hdr.b_notification = USB_CDC_NTF_SERIAL_STATE;
+	ntf.hdr.w_value = 0;
+	ntf.hdr.w_index = acm->comm_iface;
+	ntf.hdr.w_length = sizeof(ntf.state);
+	ntf.state = state;
+	usb_ep_ring_write(acm->ntf, &ntf, sizeof(ntf));
+	// Irregular signals (break, ring, errors) are reported once.
+	acm->serial_state = state & (USB_CDC_SERIAL_STATE_DCD | USB_CDC_SERIAL_STATE_DSR);
+	return (TRUE);
+}
+
+/**
+ * usb_cdc_acm_get_line_coding
+ */
+void usb_cdc_acm_get_line_coding(struct usb_cdc_acm *acm, struct usb_cdc_line_coding *lc)
+{
+	taskENTER_CRITICAL();
+	*lc = acm->lc;
+	taskEXIT_CRITICAL();
+}
+
+/**
+ * usb_cdc_acm_get_ctl_line
+ */
+int usb_cdc_acm_get_ctl_line(struct usb_cdc_acm *acm)
+{
+	return (acm->ctl_line);
+}
+
+/**
+ * stp_clbk
+ */
+static struct usb_ctl_req stp_clbk(struct usb_ctl_req_dev *dev, struct usb_stp_pkt *stp)
+{
+	struct usb_cdc_acm *acm = usb_ctl_req_get_arg(dev);
+	struct usb_ctl_req req;
+
+	memset(&req, 0, sizeof(req));
+	if ((stp->bm_request_type & 0x1F) != USB_IFACE_RECIPIENT || (stp->w_index & 0xFF) != acm->comm_iface) {
+		return (req);
+	}
+	acm->req = stp->b_request;
+	switch (stp->b_request) {
+	case USB_CDC_MNGM_SET_LINE_CODING :
+		if (stp->w_length == sizeof(struct usb_cdc_line_coding)) {
+			req.valid = TRUE;
+			req.trans_dir = UDP_CTL_TRANS_OUT;
+			req.buf = (uint8_t *) &acm->lc_rcv;
+			req.nmb = req.trans_nmb = sizeof(struct usb_cdc_line_coding);
+		}
+		break;
+	case USB_CDC_MNGM_GET_LINE_CODING :
+		req.valid = TRUE;
+		req.trans_dir = UDP_CTL_TRANS_IN;
+		req.buf = (uint8_t *) &acm->lc;
+		req.trans_nmb = stp->w_length;
+		req.nmb = (stp->w_length < sizeof(struct usb_cdc_line_coding)) ? stp->w_length :
+		          sizeof(struct usb_cdc_line_coding);
+		break;
+	case USB_CDC_MNGM_SET_CONTROL_LINE_STATE :
+		acm->ctl_line = stp->w_value;
+		if (acm->ctl_line_clbk) {
+			acm->ctl_line_clbk(acm, stp->w_value);
+		}
+		req.valid = TRUE;
+		req.trans_dir = UDP_CTL_TRANS_OUT;
+		break;
+	}
+	return (req);
+}
+
+/**
+ * in_req_ack_clbk
+ */
+static void in_req_ack_clbk(struct usb_ctl_req_dev *dev)
+{
+}
+
+/**
+ * out_req_rec_clbk
+ */
+static boolean_t out_req_rec_clbk(struct usb_ctl_req_dev *dev)
+{
+	struct usb_cdc_acm *acm = usb_ctl_req_get_arg(dev);
+
+	if (acm->req == USB_CDC_MNGM_SET_LINE_CODING) {
+		acm->lc = acm->lc_rcv;
+		if (acm->line_coding_clbk) {
+			acm->line_coding_clbk(acm, &acm->lc);
+		}
+	}
+	return (TRUE);
+}
+
+/**
+ * out_req_ack_clbk
+ */
+static void out_req_ack_clbk(struct usb_ctl_req_dev *dev)
+{
+}
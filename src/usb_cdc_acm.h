@@ -0,0 +1,92 @@
+/*
+ * usb_cdc_acm.h
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef USB_CDC_ACM_H
+#define USB_CDC_ACM_H
+
+// CDC ACM function. in, out (bulk) and ntf (interrupt IN) rings are
+// initialized by application (in->coal is set by init_usb_cdc_acm()).
+// Writes shorter than max packet size are coalesced for up to flush_tmo
+// ticks (0 sends them at once). Hooks run in interrupt and can be NULL.
+// Members after arg are private.
+struct usb_cdc_acm {
+	struct usb_ep_ring *in;
+	struct usb_ep_ring *out;
+	struct usb_ep_ring *ntf;
+	uint8_t comm_iface;
+	TickType_t flush_tmo;
+	void (*line_coding_clbk)(struct usb_cdc_acm *acm, const struct usb_cdc_line_coding *lc);
+	void (*ctl_line_clbk)(struct usb_cdc_acm *acm, int state);
+	void *arg; // Free for application.
+	struct usb_cdc_line_coding lc;
+	struct usb_cdc_line_coding lc_rcv;
+	uint16_t ctl_line;
+	uint16_t serial_state;
+	uint8_t req;
+	struct usb_ctl_req_clbks clbks;
+	struct usb_ctl_req_fn fn;
+	TimerHandle_t tmr;
+};
+
+/**
+ * init_usb_cdc_acm
+ *
+ * Registers class requests of function to engine instance dev.
+ */
+void init_usb_cdc_acm(struct usb_cdc_acm *acm, struct usb_ctl_req_dev *dev);
+
+/**
+ * usb_cdc_acm_write
+ *
+ * Queues up to nmb bytes to bulk IN ring. Returns number of bytes queued.
+ */
+int usb_cdc_acm_write(struct usb_cdc_acm *acm, const void *buf, int nmb);
+
+/**
+ * usb_cdc_acm_flush
+ */
+void usb_cdc_acm_flush(struct usb_cdc_acm *acm);
+
+/**
+ * usb_cdc_acm_read
+ *
+ * Moves up to nmb received bytes to buf. Returns number of bytes.
+ */
+int usb_cdc_acm_read(struct usb_cdc_acm *acm, void *buf, int nmb);
+
+/**
+ * usb_cdc_acm_set_serial_state
+ *
+ * Sends SERIAL_STATE notification if state (USB_CDC_SERIAL_STATE_xxx
+ * bits) changed. Returns FALSE if notification ring is full.
+ */
+boolean_t usb_cdc_acm_set_serial_state(struct usb_cdc_acm *acm, int state);
+
+/**
+ * usb_cdc_acm_get_line_coding
+ */
+void usb_cdc_acm_get_line_coding(struct usb_cdc_acm *acm, struct usb_cdc_line_coding *lc);
+
+/**
+ * usb_cdc_acm_get_ctl_line
+ *
+ * Returns USB_CDC_CTL_LINE_xxx bits.
+ */
+int usb_cdc_acm_get_ctl_line(struct usb_cdc_acm *acm);
+
+#endif
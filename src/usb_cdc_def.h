@@ -31,9 +31,12 @@
 #define USB_CDC_COMM_IFACE_NO_PROTOCOL 0x00
 #define USB_CDC_COMM_IFACE_ITU_T_V_250 0x01
 
+#define USB_CDC_COMM_IFACE_NCM_MODEL 0x0D
+
 #define USB_CDC_DATA_IFACE_CLASS 0x0A
 #define USB_CDC_DATA_IFACE_SUBCLASS 0x00
 #define USB_CDC_DATA_IFACE_NO_PROTOCOL 0x00
+#define USB_CDC_DATA_IFACE_NTB_PROTOCOL 0x01
 
 #define USB_CDC_CS_IFACE 0x24
 #define USB_CDC_CS_ENDP 0x25
@@ -53,7 +56,9 @@ enum usb_cdc_desc_subtype {
 	USB_CDC_HEAD_DESC = 0x00,
 	USB_CDC_CALL_MNG_DESC = 0x01,
 	USB_CDC_ABST_CTL_MNG_DESC = 0x02,
-	USB_CDC_UNION_DESC = 0x06
+	USB_CDC_UNION_DESC = 0x06,
+	USB_CDC_ETH_DESC = 0x0F,
+	USB_CDC_NCM_DESC = 0x1A
 };
 
 // CDC header descriptor.
@@ -90,6 +95,50 @@ struct usb_cdc_union_desc {
     uint8_t b_slave_interface0;
 } __attribute__ ((packed));
 
+// CDC Ethernet networking functional descriptor.
+struct usb_cdc_eth_desc {
+    uint8_t size;
+    uint8_t type;
+    uint8_t subtype;
+    uint8_t i_mac_address;
+    uint32_t bm_ethernet_statistics;
+    uint16_t w_max_segment_size;
+    uint16_t w_number_mc_filters;
+    uint8_t b_number_power_filters;
+} __attribute__ ((packed));
+
+// CDC NCM functional descriptor.
+struct usb_cdc_ncm_desc {
+    uint8_t size;
+    uint8_t type;
+    uint8_t subtype;
+    uint16_t bcd_ncm_version;
+    uint8_t bm_network_capabilities;
+} __attribute__ ((packed));
+
+#define USB_CDC_NCM1_00_VER_BCD 0x0100
+
+// NCM functional descriptor bm_network_capabilities bits.
+#define USB_CDC_NCM_CAP_PACKET_FILTER (1 << 0)
+#define USB_CDC_NCM_CAP_NET_ADDRESS (1 << 1)
+#define USB_CDC_NCM_CAP_ENCAPSULATED (1 << 2)
+#define USB_CDC_NCM_CAP_MAX_DATAGRAM_SIZE (1 << 3)
+#define USB_CDC_NCM_CAP_CRC_MODE (1 << 4)
+#define USB_CDC_NCM_CAP_NTB_INPUT_SIZE_8 (1 << 5)
+
+#define usb_cdc_head_desc_init(bcd) \
+	{sizeof(struct usb_cdc_head_desc), USB_CDC_CS_IFACE, USB_CDC_HEAD_DESC, (bcd)}
+#define usb_cdc_call_mng_desc_init(cap, data_iface) \
+	{sizeof(struct usb_cdc_call_mng_desc), USB_CDC_CS_IFACE, USB_CDC_CALL_MNG_DESC, (cap), (data_iface)}
+#define usb_cdc_abst_ctl_mng_desc_init(cap) \
+	{sizeof(struct usb_cdc_abst_ctl_mng_desc), USB_CDC_CS_IFACE, USB_CDC_ABST_CTL_MNG_DESC, (cap)}
+#define usb_cdc_union_desc_init(master, slave) \
+	{sizeof(struct usb_cdc_union_desc), USB_CDC_CS_IFACE, USB_CDC_UNION_DESC, (master), (slave)}
+#define usb_cdc_eth_desc_init(i_mac, seg_sz) \
+	{sizeof(struct usb_cdc_eth_desc), USB_CDC_CS_IFACE, USB_CDC_ETH_DESC, (i_mac), 0, (seg_sz), 0, 0}
+#define usb_cdc_ncm_desc_init(cap) \
+	{sizeof(struct usb_cdc_ncm_desc), USB_CDC_CS_IFACE, USB_CDC_NCM_DESC, USB_CDC_NCM1_00_VER_BCD, (cap)}
+
 enum usb_cdc_mngm_req_code {
 	USB_CDC_MNGM_SEND_ENCAPSULATED_COMMAND = 0x00,
 	USB_CDC_MNGM_GET_ENCAPSULATED_RESPONSE = 0x01,
@@ -139,6 +188,68 @@ enum usb_cdc_mngm_req_code {
 	USB_CDC_MNGM_SET_CRC_MODE = 0x8A
 };
 
+enum usb_cdc_ntf_code {
+	USB_CDC_NTF_NETWORK_CONNECTION = 0x00,
+	USB_CDC_NTF_RESPONSE_AVAILABLE = 0x01,
+	USB_CDC_NTF_SERIAL_STATE = 0x20,
+	USB_CDC_NTF_CONNECTION_SPEED_CHANGE = 0x2A
+};
+
+// Notification header.
+struct usb_cdc_ntf {
+	uint8_t bm_request_type;
+	uint8_t b_notification;
+	uint16_t w_value;
+	uint16_t w_index;
+	uint16_t w_length;
+} __attribute__ ((packed));
+
+#define USB_CDC_NTF_REQUEST_TYPE 0xA1
+
+// GET_NTB_PARAMETERS response.
+struct usb_cdc_ncm_ntb_param {
+	uint16_t w_length;
+	uint16_t bm_ntb_formats_supported;
+	uint32_t dw_ntb_in_max_size;
+	uint16_t w_ndp_in_divisor;
+	uint16_t w_ndp_in_payload_remainder;
+	uint16_t w_ndp_in_alignment;
+	uint16_t reserved;
+	uint32_t dw_ntb_out_max_size;
+	uint16_t w_ndp_out_divisor;
+	uint16_t w_ndp_out_payload_remainder;
+	uint16_t w_ndp_out_alignment;
+	uint16_t w_ntb_out_max_datagrams;
+} __attribute__ ((packed));
+
+#define USB_CDC_NCM_NTB16_SUPPORTED (1 << 0)
+#define USB_CDC_NCM_NTB32_SUPPORTED (1 << 1)
+
+enum usb_cdc_ncm_ntb_fmt {
+	USB_CDC_NCM_NTB16_FMT,
+	USB_CDC_NCM_NTB32_FMT
+};
+
+// SET_ETH_PACKET_FILTER bits.
+#define USB_CDC_PACKET_TYPE_PROMISCUOUS (1 << 0)
+#define USB_CDC_PACKET_TYPE_ALL_MULTICAST (1 << 1)
+#define USB_CDC_PACKET_TYPE_DIRECTED (1 << 2)
+#define USB_CDC_PACKET_TYPE_BROADCAST (1 << 3)
+#define USB_CDC_PACKET_TYPE_MULTICAST (1 << 4)
+
+// SET_CONTROL_LINE_STATE bits.
+#define USB_CDC_CTL_LINE_DTR (1 << 0)
+#define USB_CDC_CTL_LINE_RTS (1 << 1)
+
+// SERIAL_STATE bits.
+#define USB_CDC_SERIAL_STATE_DCD (1 << 0)
+#define USB_CDC_SERIAL_STATE_DSR (1 << 1)
+#define USB_CDC_SERIAL_STATE_BREAK (1 << 2)
+#define USB_CDC_SERIAL_STATE_RING (1 << 3)
+#define USB_CDC_SERIAL_STATE_FRAMING (1 << 4)
+#define USB_CDC_SERIAL_STATE_PARITY (1 << 5)
+#define USB_CDC_SERIAL_STATE_OVERRUN (1 << 6)
+
 // Line Coding.
 enum usb_cdc_ln_char_fmt {
 	USB_CDC_LN_CHAR_FMT_1_STOP_BIT,
@@ -0,0 +1,510 @@
+/*
+ * usb_cdc_ncm.c
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <gentyp.h>
+#include "sysconf.h"
+#include "criterr.h"
+#include "udp.h"
+#include "usb_std_def.h"
+#include "usb_cdc_def.h"
+#include "usb_ctl_req_trc.h"
+#include "usb_ctl_req.h"
+#include "usb_ep_ring.h"
+#include "usb_cdc_ncm_ntb.h"
+#include "usb_cdc_ncm.h"
+
+#define NTB_MIN_IN_SZ 2048
+#define NDP_DIVISOR 4
+#define NDP_ALIGNMENT 4
+#define NTB16_MAX_SZ 0xFFFF
+
+static void new_ntb(struct usb_cdc_ncm *ncm);
+static void send_ntb(struct usb_cdc_ncm *ncm);
+static void rcv_ntb(struct usb_cdc_ncm *ncm);
+static boolean_t rcv_eot(struct usb_cdc_ncm *ncm);
+static void dlvr_ntb(struct usb_cdc_ncm *ncm, uint32_t blk);
+static void in_clbk(struct usb_ep_ring *ep);
+static void out_clbk(struct usb_ep_ring *ep);
+static struct usb_ctl_req stp_clbk(struct usb_ctl_req_dev *dev, struct usb_stp_pkt *stp);
+static void in_req_ack_clbk(struct usb_ctl_req_dev *dev);
+static boolean_t out_req_rec_clbk(struct usb_ctl_req_dev *dev);
+static void out_req_ack_clbk(struct usb_ctl_req_dev *dev);
+
+/**
+ * init_usb_cdc_ncm
+ */
+void init_usb_cdc_ncm(struct usb_cdc_ncm *ncm, struct usb_ctl_req_dev *dev)
+{
+	if (!ncm->in || !ncm->out || !ncm->rcv_clbk || !ncm->in_buf || !ncm->out_buf ||
+	    ncm->in_max < NTB_MIN_IN_SZ || ncm->out_max < NTB_MIN_IN_SZ || ncm->max_dgram == 0 ||
+	    (ncm->in_max > NTB16_MAX_SZ && !ncm->ntb32) || usb_ep_ring_free(ncm->in) < (int) ncm->in_max) {
+		crit_err_exit(BAD_PARAMETER);
+	}
+	ncm->param.w_length = sizeof(struct usb_cdc_ncm_ntb_param);
+	ncm->param.bm_ntb_formats_supported = USB_CDC_NCM_NTB16_SUPPORTED;
+	if (ncm->ntb32) {
+		ncm->param.bm_ntb_formats_supported |= USB_CDC_NCM_NTB32_SUPPORTED;
+	}
+	ncm->param.dw_ntb_in_max_size = ncm->in_max;
+	ncm->param.w_ndp_in_divisor = NDP_DIVISOR;
+	ncm->param.w_ndp_in_payload_remainder = 0;
+	ncm->param.w_ndp_in_alignment = NDP_ALIGNMENT;
+	ncm->param.reserved = 0;
+	ncm->param.dw_ntb_out_max_size = ncm->out_max;
+	ncm->param.w_ndp_out_divisor = NDP_DIVISOR;
+	ncm->param.w_ndp_out_payload_remainder = 0;
+	ncm->param.w_ndp_out_alignment = NDP_ALIGNMENT;
+	ncm->param.w_ntb_out_max_datagrams = 0;
+	ncm->in->coal = TRUE;
+	ncm->in->clbk = in_clbk;
+	ncm->in->arg = ncm;
+	ncm->out->clbk = out_clbk;
+	ncm->out->arg = ncm;
+	ncm->pkt_filter = USB_CDC_PACKET_TYPE_DIRECTED | USB_CDC_PACKET_TYPE_BROADCAST |
+			  USB_CDC_PACKET_TYPE_MULTICAST;
+	ncm->seq = 0;
+	ncm->out_err_cnt = 0;
+	ncm->out_drop_cnt = 0;
+	ncm->in_drop_cnt = 0;
+	reset_usb_cdc_ncm(ncm);
+	ncm->clbks.stp_clbk = stp_clbk;
+	ncm->clbks.in_req_ack_clbk = in_req_ack_clbk;
+	ncm->clbks.out_req_rec_clbk = out_req_rec_clbk;
+	ncm->clbks.out_req_ack_clbk = out_req_ack_clbk;
+	ncm->clbks.arg = ncm;
+	ncm->fn.first_iface = ncm->comm_iface;
+	ncm->fn.clbks = &ncm->clbks;
+	add_usb_ctl_req_fn_clbks(dev, &ncm->fn);
+}
+
+/**
+ * reset_usb_cdc_ncm
+ */
+void reset_usb_cdc_ncm(struct usb_cdc_ncm *ncm)
+{
+	ncm->fmt = USB_CDC_NCM_NTB16_FMT;
+	ncm->in_sz = ncm->in_max;
+	ncm->in_dgram = 0;
+	ncm->dgram_sz = ncm->max_dgram;
+	ncm->crc_mode = 0;
+	ncm->in_busy = FALSE;
+	ncm->out_nmb = 0;
+	ncm->out_blk = 0;
+	ncm->out_eot = FALSE;
+	ncm->out_skip = FALSE;
+	new_ntb(ncm);
+}
+
+/**
+ * usb_cdc_ncm_write
+ */
+boolean_t usb_cdc_ncm_write(struct usb_cdc_ncm *ncm, const void *dgram, int nmb)
+{
+	uint8_t *p;
+
+	if (nmb > ncm->dgram_sz) {
+		ncm->in_drop_cnt++;
+		return (TRUE);
+	}
+	if (ncm->bld.nmb == 0) {
+		// Negotiated size and format apply from next NTB.
+		new_ntb(ncm);
+	}
+	if (!(p = usb_cdc_ncm_ntb_bld_reserve(&ncm->bld, nmb))) {
+		if (ncm->bld.nmb == 0) {
+			// Does not fit into empty NTB, dropped.
+			ncm->in_drop_cnt++;
+			return (TRUE);
+		}
+		send_ntb(ncm);
+		if (ncm->bld.nmb) {
+			return (FALSE);
+		}
+		if (!(p = usb_cdc_ncm_ntb_bld_reserve(&ncm->bld, nmb))) {
+			ncm->in_drop_cnt++;
+			return (TRUE);
+		}
+	}
+	memcpy(p, dgram, nmb);
+	usb_cdc_ncm_ntb_bld_add(&ncm->bld, nmb);
+	send_ntb(ncm);
+	return (TRUE);
+}
+
+/**
+ * usb_cdc_ncm_poll
+ */
+void usb_cdc_ncm_poll(struct usb_cdc_ncm *ncm)
+{
+	send_ntb(ncm);
+	rcv_ntb(ncm);
+}
+
+/**
+ * new_ntb
+ */
+static void new_ntb(struct usb_cdc_ncm *ncm)
+{
+	uint32_t sz = ncm->in_sz;
+
+	// NTB16 block length and indexes are 16 bit.
+	if (ncm->fmt == USB_CDC_NCM_NTB16_FMT && sz > NTB16_MAX_SZ) {
+		sz = NTB16_MAX_SZ;
+	}
+	init_usb_cdc_ncm_ntb_bld(&ncm->bld, ncm->in_buf, sz, ncm->fmt == USB_CDC_NCM_NTB32_FMT,
+				 NDP_DIVISOR, 0, ncm->seq);
+	if (ncm->in_dgram && ncm->in_dgram < ncm->bld.max) {
+		ncm->bld.max = ncm->in_dgram;
+	}
+}
+
+/**
+ * send_ntb
+ *
+ * NTB must be single transfer, it is written to ring only when previous
+ * one (including zero length packet) was sent. Datagrams written in the
+ * meantime are aggregated.
+ */
+static void send_ntb(struct usb_cdc_ncm *ncm)
+{
+	uint32_t blk;
+
+	if (ncm->in_busy || ncm->bld.nmb == 0) {
+		return;
+	}
+	blk = usb_cdc_ncm_ntb_bld_end(&ncm->bld);
+	// NTB of negotiated size ends transfer without zero length packet.
+	ncm->in->zlp = (blk < ncm->in_sz) ? TRUE : FALSE;
+	ncm->in_busy = TRUE;
+	usb_ep_ring_write(ncm->in, ncm->in_buf, blk);
+	usb_ep_ring_flush(ncm->in);
+	ncm->seq++;
+	new_ntb(ncm);
+}
+
+/**
+ * rcv_ntb
+ *
+ * NTB is delimited by block length from NTH. First USB_CDC_NCM_NTH32_SZ
+ * bytes are collected (every valid NTB is longer), then rest of block.
+ * NTB16 with zero block length ends with transfer (short packet).
+ */
+static void rcv_ntb(struct usb_cdc_ncm *ncm)
+{
+	uint32_t need, len;
+
+	while (TRUE) {
+		if (ncm->out_eot) {
+			if (!rcv_eot(ncm)) {
+				break;
+			}
+			continue;
+		}
+		need = (ncm->out_blk) ? ncm->out_blk : USB_CDC_NCM_NTH32_SZ;
+		ncm->out_nmb += usb_ep_ring_read(ncm->out, ncm->out_buf + ncm->out_nmb, need - ncm->out_nmb);
+		if (ncm->out_nmb < need) {
+			break;
+		}
+		if (!ncm->out_blk) {
+			len = usb_cdc_ncm_ntb_blk_len(ncm->out_buf);
+			if (len == 0 && usb_cdc_ncm_ntb_blk_eot(ncm->out_buf)) {
+				ncm->out_eot = TRUE;
+				continue;
+			}
+			if (len <= USB_CDC_NCM_NTH32_SZ || len > ncm->out_max) {
+				// Lost synchronization, drop received data.
+				ncm->out_err_cnt++;
+				usb_ep_ring_consume(ncm->out, usb_ep_ring_avail(ncm->out));
+				ncm->out_nmb = 0;
+				break;
+			}
+			ncm->out_blk = len;
+			continue;
+		}
+		dlvr_ntb(ncm, ncm->out_blk);
+	}
+}
+
+/**
+ * rcv_eot
+ *
+ * Collects NTB ending with transfer. NTB longer than out_buf is dropped
+ * up to transfer end. Returns FALSE if transfer goes on.
+ */
+static boolean_t rcv_eot(struct usb_cdc_ncm *ncm)
+{
+	int n;
+
+	if ((n = usb_ep_ring_out_end(ncm->out)) < 0) {
+		n = usb_ep_ring_avail(ncm->out);
+		if (!ncm->out_skip && n <= (int) (ncm->out_max - ncm->out_nmb)) {
+			// Transfer end is not known yet, keep ring free.
+			ncm->out_nmb += usb_ep_ring_read(ncm->out, ncm->out_buf + ncm->out_nmb, n);
+			return (FALSE);
+		}
+		if (!ncm->out_skip) {
+			ncm->out_skip = TRUE;
+			ncm->out_err_cnt++;
+		}
+		// Ends queued meanwhile lie behind n.
+		usb_ep_ring_consume(ncm->out, n);
+		return (FALSE);
+	}
+	if (!ncm->out_skip && n <= (int) (ncm->out_max - ncm->out_nmb)) {
+		ncm->out_nmb += usb_ep_ring_read(ncm->out, ncm->out_buf + ncm->out_nmb, n);
+		dlvr_ntb(ncm, ncm->out_nmb);
+	} else {
+		if (!ncm->out_skip) {
+			ncm->out_err_cnt++;
+		}
+		usb_ep_ring_consume(ncm->out, n);
+		ncm->out_nmb = 0;
+	}
+	ncm->out_eot = FALSE;
+	ncm->out_skip = FALSE;
+	return (TRUE);
+}
+
+/**
+ * dlvr_ntb
+ *
+ * Passes datagrams of NTB (blk bytes in out_buf) to rcv_clbk.
+ */
+static void dlvr_ntb(struct usb_cdc_ncm *ncm, uint32_t blk)
+{
+	struct usb_cdc_ncm_ntb_prs prs, chk;
+	const uint8_t *p;
+	uint32_t len;
+
+	if (init_usb_cdc_ncm_ntb_prs(&prs, ncm->out_buf, blk) < 0) {
+		ncm->out_err_cnt++;
+	} else {
+		// Malformed NTB is dropped whole, its NDP chain is walked first.
+		chk = prs;
+		do {
+			p = usb_cdc_ncm_ntb_prs_next(&chk, &len);
+		} while (p);
+		if (chk.err) {
+			ncm->out_err_cnt++;
+			prs.ndp = 0;
+		}
+		while ((p = usb_cdc_ncm_ntb_prs_next(&prs, &len))) {
+			if (len <= ncm->dgram_sz) {
+				ncm->rcv_clbk(ncm, p, len);
+			} else {
+				ncm->out_drop_cnt++;
+			}
+		}
+	}
+	ncm->out_nmb = 0;
+	ncm->out_blk = 0;
+}
+
+/**
+ * in_clbk
+ */
+static void in_clbk(struct usb_ep_ring *ep)
+{
+	struct usb_cdc_ncm *ncm = ep->arg;
+
+	ncm->in_busy = FALSE;
+	if (ncm->evnt_clbk) {
+		ncm->evnt_clbk(ncm);
+	}
+}
+
+/**
+ * out_clbk
+ */
+static void out_clbk(struct usb_ep_ring *ep)
+{
+	struct usb_cdc_ncm *ncm = ep->arg;
+
+	if (ncm->evnt_clbk) {
+		ncm->evnt_clbk(ncm);
+	}
+}
+
+/**
+ * usb_cdc_ncm_set_link
+ */
+boolean_t usb_cdc_ncm_set_link(struct usb_cdc_ncm *ncm, boolean_t up, uint32_t bit_rate)
+{
+	struct {
+		struct usb_cdc_ntf hdr;
+		uint32_t dl_bit_rate;
+		uint32_t ul_bit_rate;
+	} __attribute__ ((packed)) spd;
+	struct usb_cdc_ntf con;
+
+	if (!ncm->ntf) {
+		return (TRUE);
+	}
+	if (usb_ep_ring_free(ncm->ntf) < (int) (sizeof(spd) + sizeof(con))) {
+		return (FALSE);
+	}
+	if (up) {
+		spd.hdr.bm_request_type = USB_CDC_NTF_REQUEST_TYPE;
+		spd.hdr.b_notification = USB_CDC_NTF_CONNECTION_SPEED_CHANGE;
+		spd.hdr.w_value = 0;
+		spd.hdr.w_index = ncm->comm_iface;
+		spd.hdr.w_length = 2 * sizeof(uint32_t);
+		spd.dl_bit_rate = spd.ul_bit_rate = bit_rate;
+		usb_ep_ring_write(ncm->ntf, &spd, sizeof(spd));
+	}
+	con.bm_request_type = USB_CDC_NTF_REQUEST_TYPE;
+	con.b_notification = USB_CDC_NTF_NETWORK_CONNECTION;
+	con.w_value = (up) ? 1 : 0;
+	con.w_index = ncm->comm_iface;
+	con.w_length = 0;
+	usb_ep_ring_write(ncm->ntf, &con, sizeof(con));
+	return (TRUE);
+}
+
+/**
+ * stp_clbk
+ */
+static struct usb_ctl_req stp_clbk(struct usb_ctl_req_dev *dev, struct usb_stp_pkt *stp)
+{
+	struct usb_cdc_ncm *ncm = usb_ctl_req_get_arg(dev);
+	struct usb_ctl_req req;
+
+	memset(&req, 0, sizeof(req));
+	if ((stp->bm_request_type & 0x1F) != USB_IFACE_RECIPIENT || (stp->w_index & 0xFF) != ncm->comm_iface) {
+		return (req);
+	}
+	ncm->req = stp->b_request;
+	switch (stp->b_request) {
+	case USB_CDC_MNGM_GET_NTB_PARAMETERS :
+		req.buf = (uint8_t *) &ncm->param;
+		req.nmb = sizeof(struct usb_cdc_ncm_ntb_param);
+		break;
+	case USB_CDC_MNGM_GET_NTB_FORMAT :
+		req.buf = (uint8_t *) &ncm->fmt;
+		req.nmb = sizeof(ncm->fmt);
+		break;
+	case USB_CDC_MNGM_SET_NTB_FORMAT :
+		if (stp->w_length == 0 && (stp->w_value == USB_CDC_NCM_NTB16_FMT ||
+		    (stp->w_value == USB_CDC_NCM_NTB32_FMT && ncm->ntb32))) {
+			ncm->fmt = stp->w_value;
+			req.valid = TRUE;
+			req.trans_dir = UDP_CTL_TRANS_OUT;
+		}
+		return (req);
+	case USB_CDC_MNGM_GET_NTB_INPUT_SIZE :
+		ncm->rcv[0] = ncm->in_sz;
+		ncm->rcv[1] = ncm->in_dgram;
+		req.buf = (uint8_t *) ncm->rcv;
+		req.nmb = sizeof(ncm->rcv);
+		break;
+	case USB_CDC_MNGM_GET_MAX_DATAGRAM_SIZE :
+		req.buf = (uint8_t *) &ncm->dgram_sz;
+		req.nmb = sizeof(ncm->dgram_sz);
+		break;
+	case USB_CDC_MNGM_GET_CRC_MODE :
+		req.buf = (uint8_t *) &ncm->crc_mode;
+		req.nmb = sizeof(ncm->crc_mode);
+		break;
+	case USB_CDC_MNGM_SET_NTB_INPUT_SIZE :
+		if (stp->w_length == sizeof(uint32_t) || stp->w_length == sizeof(ncm->rcv)) {
+			req.valid = TRUE;
+			req.trans_dir = UDP_CTL_TRANS_OUT;
+			ncm->rcv[1] = 0;
+			req.buf = (uint8_t *) ncm->rcv;
+			req.nmb = req.trans_nmb = stp->w_length;
+		}
+		return (req);
+	case USB_CDC_MNGM_SET_MAX_DATAGRAM_SIZE :
+		if (stp->w_length == sizeof(uint16_t)) {
+			req.valid = TRUE;
+			req.trans_dir = UDP_CTL_TRANS_OUT;
+			req.buf = (uint8_t *) ncm->rcv;
+			req.nmb = req.trans_nmb = stp->w_length;
+		}
+		return (req);
+	case USB_CDC_MNGM_SET_CRC_MODE :
+		// Datagrams are sent without CRC only.
+		if (stp->w_length == 0 && stp->w_value == 0) {
+			req.valid = TRUE;
+			req.trans_dir = UDP_CTL_TRANS_OUT;
+		}
+		return (req);
+	case USB_CDC_MNGM_SET_ETH_PACKET_FILTER :
+		ncm->pkt_filter = stp->w_value;
+		if (ncm->pkt_filter_clbk) {
+			ncm->pkt_filter_clbk(ncm, stp->w_value);
+		}
+		req.valid = TRUE;
+		req.trans_dir = UDP_CTL_TRANS_OUT;
+		return (req);
+	default :
+		return (req);
+	}
+	// Control read.
+	req.valid = TRUE;
+	req.trans_dir = UDP_CTL_TRANS_IN;
+	req.trans_nmb = stp->w_length;
+	if (stp->w_length < req.nmb) {
+		req.nmb = stp->w_length;
+	}
+	return (req);
+}
+
+/**
+ * in_req_ack_clbk
+ */
+static void in_req_ack_clbk(struct usb_ctl_req_dev *dev)
+{
+}
+
+/**
+ * out_req_rec_clbk
+ */
+static boolean_t out_req_rec_clbk(struct usb_ctl_req_dev *dev)
+{
+	struct usb_cdc_ncm *ncm = usb_ctl_req_get_arg(dev);
+	uint16_t sz;
+
+	switch (ncm->req) {
+	case USB_CDC_MNGM_SET_NTB_INPUT_SIZE :
+		if (ncm->rcv[0] < NTB_MIN_IN_SZ || ncm->rcv[0] > ncm->in_max) {
+			return (FALSE);
+		}
+		ncm->in_sz = ncm->rcv[0];
+		ncm->in_dgram = ncm->rcv[1];
+		break;
+	case USB_CDC_MNGM_SET_MAX_DATAGRAM_SIZE :
+		memcpy(&sz, ncm->rcv, sizeof(sz));
+		if (sz > ncm->max_dgram) {
+			return (FALSE);
+		}
+		ncm->dgram_sz = sz;
+		break;
+	}
+	return (TRUE);
+}
+
+/**
+ * out_req_ack_clbk
+ */
+static void out_req_ack_clbk(struct usb_ctl_req_dev *dev)
+{
+}
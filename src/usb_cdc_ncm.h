@@ -0,0 +1,112 @@
+/*
+ * usb_cdc_ncm.h
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef USB_CDC_NCM_H
+#define USB_CDC_NCM_H
+
+// CDC NCM function. in, out (bulk) and ntf (interrupt IN) rings are
+// initialized by application, in ring must hold in_max bytes. Datagrams
+// written while IN transfer runs are aggregated in in_buf (in_max bytes)
+// and sent as one NTB when transfer completes. Received NTBs are collected
+// in out_buf (out_max bytes) and their datagrams are passed to rcv_clbk
+// by usb_cdc_ncm_poll(). evnt_clbk (interrupt) signals that poll has work.
+// Hooks can be NULL (except rcv_clbk). Members after arg are private,
+// application may read out_err_cnt, out_drop_cnt and in_drop_cnt.
+// max_dgram must not be 0, in_max above 0xFFFF needs ntb32 (NTB16 blocks
+// are limited to 0xFFFF bytes).
+struct usb_cdc_ncm {
+	struct usb_ep_ring *in;
+	struct usb_ep_ring *out;
+	struct usb_ep_ring *ntf;
+	uint8_t comm_iface;
+	boolean_t ntb32; // NTB32 format supported.
+	uint8_t *in_buf;
+	uint32_t in_max;
+	uint8_t *out_buf;
+	uint32_t out_max;
+	uint16_t max_dgram; // Maximum datagram size (without CRC).
+	void (*rcv_clbk)(struct usb_cdc_ncm *ncm, const uint8_t *dgram, int nmb);
+	void (*evnt_clbk)(struct usb_cdc_ncm *ncm);
+	void (*pkt_filter_clbk)(struct usb_cdc_ncm *ncm, int filter);
+	void *arg; // Free for application.
+	struct usb_cdc_ncm_ntb_param param;
+	uint16_t fmt;
+	uint32_t in_sz;
+	uint16_t in_dgram;
+	uint16_t dgram_sz;
+	uint16_t crc_mode;
+	uint16_t pkt_filter;
+	uint16_t seq;
+	struct usb_cdc_ncm_ntb_bld bld;
+	volatile boolean_t in_busy;
+	uint32_t out_nmb;
+	uint32_t out_blk;
+	boolean_t out_eot;
+	boolean_t out_skip;
+	uint32_t out_err_cnt; // Malformed NTBs (or lost NTB boundary).
+	uint32_t out_drop_cnt; // Received datagrams longer than negotiated maximum.
+	uint32_t in_drop_cnt; // Datagrams longer than NTB allows.
+	uint8_t req;
+	uint32_t rcv[2];
+	struct usb_ctl_req_clbks clbks;
+	struct usb_ctl_req_fn fn;
+};
+
+/**
+ * init_usb_cdc_ncm
+ *
+ * Registers class requests of function to engine instance dev.
+ */
+void init_usb_cdc_ncm(struct usb_cdc_ncm *ncm, struct usb_ctl_req_dev *dev);
+
+/**
+ * reset_usb_cdc_ncm
+ *
+ * Restores NTB16 format and default sizes, drops unsent datagrams and
+ * partially received NTB (call when data interface alternate setting is
+ * selected, rings are reset by application).
+ */
+void reset_usb_cdc_ncm(struct usb_cdc_ncm *ncm);
+
+/**
+ * usb_cdc_ncm_write
+ *
+ * Adds datagram (Ethernet frame) of nmb bytes to NTB. Returns FALSE if
+ * datagram does not fit into NTB being aggregated (try again after poll).
+ * Datagram longer than negotiated maximum or than empty NTB is dropped
+ * (TRUE returned, in_drop_cnt incremented).
+ */
+boolean_t usb_cdc_ncm_write(struct usb_cdc_ncm *ncm, const void *dgram, int nmb);
+
+/**
+ * usb_cdc_ncm_poll
+ *
+ * Sends aggregated NTB if IN endpoint is idle and passes datagrams of
+ * received NTBs to rcv_clbk.
+ */
+void usb_cdc_ncm_poll(struct usb_cdc_ncm *ncm);
+
+/**
+ * usb_cdc_ncm_set_link
+ *
+ * Sends CONNECTION_SPEED_CHANGE (if link is up) and NETWORK_CONNECTION
+ * notifications. Returns FALSE if notification ring is full.
+ */
+boolean_t usb_cdc_ncm_set_link(struct usb_cdc_ncm *ncm, boolean_t up, uint32_t bit_rate);
+
+#endif
@@ -0,0 +1,318 @@
+/*
+ * usb_cdc_ncm_ntb.c
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+// Builder and parser do not depend on FreeRTOS and udp driver, they are
+// built into host tools as well.
+
+#include <stdint.h>
+#include <stddef.h>
+#include "usb_cdc_ncm_ntb.h"
+
+static uint32_t get16(const uint8_t *p);
+static uint32_t get32(const uint8_t *p);
+static void put16(uint8_t *p, uint32_t v);
+static void put32(uint8_t *p, uint32_t v);
+static uint32_t dgram_offs(struct usb_cdc_ncm_ntb_bld *bld);
+static uint32_t ndp_sz(struct usb_cdc_ncm_ntb_bld *bld, int nmb);
+static int load_ndp(struct usb_cdc_ncm_ntb_prs *prs, uint32_t ndp);
+static const uint8_t *prs_err(struct usb_cdc_ncm_ntb_prs *prs);
+
+/**
+ * init_usb_cdc_ncm_ntb_bld
+ */
+void init_usb_cdc_ncm_ntb_bld(struct usb_cdc_ncm_ntb_bld *bld, uint8_t *buf, uint32_t sz, int ntb32,
+			      int div, int rem, uint16_t seq)
+{
+	bld->buf = buf;
+	bld->sz = sz;
+	bld->ntb32 = ntb32;
+	bld->div = (div) ? div : 4;
+	bld->rem = rem % bld->div;
+	bld->seq = seq;
+	bld->max = USB_CDC_NCM_NTB_DGRAM_NMB;
+	bld->offs = (ntb32) ? USB_CDC_NCM_NTH32_SZ : USB_CDC_NCM_NTH16_SZ;
+	bld->pos = 0;
+	bld->nmb = 0;
+}
+
+/**
+ * usb_cdc_ncm_ntb_bld_reserve
+ */
+uint8_t *usb_cdc_ncm_ntb_bld_reserve(struct usb_cdc_ncm_ntb_bld *bld, uint32_t len)
+{
+	uint32_t offs;
+
+	if (bld->nmb >= bld->max) {
+		return (NULL);
+	}
+	offs = dgram_offs(bld);
+	if (offs + len + 3 + ndp_sz(bld, bld->nmb + 1) > bld->sz) {
+		return (NULL);
+	}
+	bld->pos = offs;
+	return (bld->buf + offs);
+}
+
+/**
+ * usb_cdc_ncm_ntb_bld_add
+ */
+void usb_cdc_ncm_ntb_bld_add(struct usb_cdc_ncm_ntb_bld *bld, uint32_t len)
+{
+	bld->idx[bld->nmb] = bld->pos;
+	bld->len[bld->nmb] = len;
+	bld->nmb++;
+	bld->offs = bld->pos + len;
+}
+
+/**
+ * usb_cdc_ncm_ntb_bld_end
+ */
+uint32_t usb_cdc_ncm_ntb_bld_end(struct usb_cdc_ncm_ntb_bld *bld)
+{
+	uint8_t *p;
+	uint32_t ndp, blk;
+	int i;
+
+	if (bld->nmb == 0) {
+		return (0);
+	}
+	ndp = (bld->offs + 3) & ~3UL;
+	blk = ndp + ndp_sz(bld, bld->nmb);
+	p = bld->buf + ndp;
+	if (bld->ntb32) {
+		put32(bld->buf, USB_CDC_NCM_NTH32_SIGN);
+		put16(bld->buf + 4, USB_CDC_NCM_NTH32_SZ);
+		put16(bld->buf + 6, bld->seq);
+		put32(bld->buf + 8, blk);
+		put32(bld->buf + 12, ndp);
+		put32(p, USB_CDC_NCM_NDP32_SIGN);
+		put16(p + 4, ndp_sz(bld, bld->nmb));
+		put16(p + 6, 0);
+		put32(p + 8, 0);
+		put32(p + 12, 0);
+		for (i = 0, p += 16; i < bld->nmb; i++, p += 8) {
+			put32(p, bld->idx[i]);
+			put32(p + 4, bld->len[i]);
+		}
+		put32(p, 0);
+		put32(p + 4, 0);
+	} else {
+		put32(bld->buf, USB_CDC_NCM_NTH16_SIGN);
+		put16(bld->buf + 4, USB_CDC_NCM_NTH16_SZ);
+		put16(bld->buf + 6, bld->seq);
+		put16(bld->buf + 8, blk);
+		put16(bld->buf + 10, ndp);
+		put32(p, USB_CDC_NCM_NDP16_SIGN);
+		put16(p + 4, ndp_sz(bld, bld->nmb));
+		put16(p + 6, 0);
+		for (i = 0, p += 8; i < bld->nmb; i++, p += 4) {
+			put16(p, bld->idx[i]);
+			put16(p + 2, bld->len[i]);
+		}
+		put16(p, 0);
+		put16(p + 2, 0);
+	}
+	return (blk);
+}
+
+/**
+ * dgram_offs
+ */
+static uint32_t dgram_offs(struct usb_cdc_ncm_ntb_bld *bld)
+{
+	uint32_t offs;
+
+	offs = bld->offs - bld->offs % bld->div + bld->rem;
+	if (offs < bld->offs) {
+		offs += bld->div;
+	}
+	return (offs);
+}
+
+/**
+ * ndp_sz
+ *
+ * NDP with nmb entries and terminating zero entry.
+ */
+static uint32_t ndp_sz(struct usb_cdc_ncm_ntb_bld *bld, int nmb)
+{
+	return ((bld->ntb32) ? 16 + 8 * (nmb + 1) : 8 + 4 * (nmb + 1));
+}
+
+/**
+ * usb_cdc_ncm_ntb_blk_len
+ */
+uint32_t usb_cdc_ncm_ntb_blk_len(const uint8_t *buf)
+{
+	switch (get32(buf)) {
+	case USB_CDC_NCM_NTH16_SIGN :
+		return ((get16(buf + 4) == USB_CDC_NCM_NTH16_SZ) ? get16(buf + 8) : 0);
+	case USB_CDC_NCM_NTH32_SIGN :
+		return ((get16(buf + 4) == USB_CDC_NCM_NTH32_SZ) ? get32(buf + 8) : 0);
+	default :
+		return (0);
+	}
+}
+
+/**
+ * usb_cdc_ncm_ntb_blk_eot
+ */
+int usb_cdc_ncm_ntb_blk_eot(const uint8_t *buf)
+{
+	return ((get32(buf) == USB_CDC_NCM_NTH16_SIGN && get16(buf + 4) == USB_CDC_NCM_NTH16_SZ &&
+		 get16(buf + 8) == 0) ? 1 : 0);
+}
+
+/**
+ * init_usb_cdc_ncm_ntb_prs
+ */
+int init_usb_cdc_ncm_ntb_prs(struct usb_cdc_ncm_ntb_prs *prs, const uint8_t *buf, uint32_t len)
+{
+	uint32_t blk;
+
+	prs->err = 0;
+	if (len < USB_CDC_NCM_NTH16_SZ) {
+		return (-1);
+	}
+	prs->buf = buf;
+	prs->ntb32 = (get32(buf) == USB_CDC_NCM_NTH32_SIGN) ? 1 : 0;
+	if (prs->ntb32 && len < USB_CDC_NCM_NTH32_SZ) {
+		return (-1);
+	}
+	blk = usb_cdc_ncm_ntb_blk_len(buf);
+	// NTB16 block length 0 means transfer length.
+	if ((blk == 0 && (prs->ntb32 || get32(buf) != USB_CDC_NCM_NTH16_SIGN)) || blk > len) {
+		return (-1);
+	}
+	prs->len = (blk) ? blk : len;
+	return (load_ndp(prs, (prs->ntb32) ? get32(buf + 12) : get16(buf + 10)));
+}
+
+/**
+ * usb_cdc_ncm_ntb_prs_next
+ */
+const uint8_t *usb_cdc_ncm_ntb_prs_next(struct usb_cdc_ncm_ntb_prs *prs, uint32_t *len)
+{
+	const uint8_t *p;
+	uint32_t idx, n, nxt, esz;
+
+	esz = (prs->ntb32) ? 8 : 4;
+	while (prs->ndp) {
+		if (prs->ent + esz > prs->ndp_end) {
+			// NDP without terminating entry.
+			return (prs_err(prs));
+		}
+		p = prs->buf + prs->ent;
+		prs->ent += esz;
+		if (prs->ntb32) {
+			idx = get32(p);
+			n = get32(p + 4);
+		} else {
+			idx = get16(p);
+			n = get16(p + 2);
+		}
+		if (idx && n) {
+			if (idx > prs->len || n > prs->len - idx) {
+				return (prs_err(prs));
+			}
+			*len = n;
+			return (prs->buf + idx);
+		}
+		// End of NDP, continue with next one (forward only, so chain ends).
+		p = prs->buf + prs->ndp;
+		nxt = (prs->ntb32) ? get32(p + 8) : get16(p + 6);
+		if ((nxt && nxt <= prs->ndp) || load_ndp(prs, nxt) < 0) {
+			return (prs_err(prs));
+		}
+	}
+	return (NULL);
+}
+
+/**
+ * load_ndp
+ *
+ * NDP must hold header and at least terminating entry.
+ */
+static int load_ndp(struct usb_cdc_ncm_ntb_prs *prs, uint32_t ndp)
+{
+	uint32_t sz, hdr;
+
+	prs->ndp = 0;
+	if (ndp == 0) {
+		return (0);
+	}
+	hdr = (prs->ntb32) ? 16 : 8;
+	if ((ndp & 3) || ndp > prs->len || prs->len - ndp < hdr) {
+		return (-1);
+	}
+	sz = get16(prs->buf + ndp + 4);
+	if (sz < hdr + ((prs->ntb32) ? 8 : 4) || sz > prs->len - ndp ||
+	    get32(prs->buf + ndp) != ((prs->ntb32) ? USB_CDC_NCM_NDP32_SIGN : USB_CDC_NCM_NDP16_SIGN)) {
+		return (-1);
+	}
+	prs->ndp = ndp;
+	prs->ndp_end = ndp + sz;
+	prs->ent = ndp + hdr;
+	return (0);
+}
+
+/**
+ * prs_err
+ */
+static const uint8_t *prs_err(struct usb_cdc_ncm_ntb_prs *prs)
+{
+	prs->ndp = 0;
+	prs->err = 1;
+	return (NULL);
+}
+
+/**
+ * get16
+ */
+static uint32_t get16(const uint8_t *p)
+{
+	return (p[0] | (p[1] << 8));
+}
+
+/**
+ * get32
+ */
+static uint32_t get32(const uint8_t *p)
+{
+	return (p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24));
+}
+
+/**
+ * put16
+ */
+static void put16(uint8_t *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+/**
+ * put32
+ */
+static void put32(uint8_t *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
@@ -0,0 +1,128 @@
+/*
+ * usb_cdc_ncm_ntb.h
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef USB_CDC_NCM_NTB_H
+#define USB_CDC_NCM_NTB_H
+
+// NCM transfer block (NTB16, NTB32) builder and parser. Header depends on
+// <stdint.h> only, so blocks can be built and checked by host tools.
+
+#ifndef USB_CDC_NCM_NTB_DGRAM_NMB
+ #define USB_CDC_NCM_NTB_DGRAM_NMB 16 // Datagrams per built NTB.
+#endif
+
+#define USB_CDC_NCM_NTH16_SIGN 0x484D434E // "NCMH"
+#define USB_CDC_NCM_NTH32_SIGN 0x686D636E // "ncmh"
+#define USB_CDC_NCM_NDP16_SIGN 0x304D434E // "NCM0"
+#define USB_CDC_NCM_NDP32_SIGN 0x306D636E // "ncm0"
+#define USB_CDC_NCM_NTH16_SZ 12
+#define USB_CDC_NCM_NTH32_SZ 16
+
+// Builder. Datagrams are placed after NTH at offsets satisfying divisor
+// and payload remainder, single NDP is appended by end.
+struct usb_cdc_ncm_ntb_bld {
+	uint8_t *buf;
+	uint32_t sz;
+	uint8_t ntb32;
+	uint16_t div;
+	uint16_t rem;
+	uint16_t seq;
+	uint16_t max; // Datagram limit (USB_CDC_NCM_NTB_DGRAM_NMB by init).
+	uint32_t offs;
+	uint32_t pos;
+	int nmb;
+	uint32_t idx[USB_CDC_NCM_NTB_DGRAM_NMB];
+	uint32_t len[USB_CDC_NCM_NTB_DGRAM_NMB];
+};
+
+// Parser. Walks NDP chain of received NTB (each next NDP must follow
+// previous one). err is set when block turns out to be malformed.
+struct usb_cdc_ncm_ntb_prs {
+	const uint8_t *buf;
+	uint32_t len;
+	uint8_t ntb32;
+	uint8_t err;
+	uint32_t ndp;
+	uint32_t ndp_end;
+	uint32_t ent;
+};
+
+/**
+ * init_usb_cdc_ncm_ntb_bld
+ *
+ * Starts empty NTB in buf of size sz (negotiated input size). div and
+ * rem are wNdpInDivisor and wNdpInPayloadRemainder.
+ */
+void init_usb_cdc_ncm_ntb_bld(struct usb_cdc_ncm_ntb_bld *bld, uint8_t *buf, uint32_t sz, int ntb32,
+			      int div, int rem, uint16_t seq);
+
+/**
+ * usb_cdc_ncm_ntb_bld_reserve
+ *
+ * Returns place for datagram of len bytes or NULL if it does not fit
+ * into NTB. Datagram is added by usb_cdc_ncm_ntb_bld_add().
+ */
+uint8_t *usb_cdc_ncm_ntb_bld_reserve(struct usb_cdc_ncm_ntb_bld *bld, uint32_t len);
+
+/**
+ * usb_cdc_ncm_ntb_bld_add
+ */
+void usb_cdc_ncm_ntb_bld_add(struct usb_cdc_ncm_ntb_bld *bld, uint32_t len);
+
+/**
+ * usb_cdc_ncm_ntb_bld_end
+ *
+ * Writes NTH and NDP. Returns block length (0 if NTB is empty).
+ */
+uint32_t usb_cdc_ncm_ntb_bld_end(struct usb_cdc_ncm_ntb_bld *bld);
+
+/**
+ * init_usb_cdc_ncm_ntb_prs
+ *
+ * Checks NTH of block (NTB16 or NTB32) of len bytes. Returns 0 or -1 if
+ * block is malformed.
+ */
+int init_usb_cdc_ncm_ntb_prs(struct usb_cdc_ncm_ntb_prs *prs, const uint8_t *buf, uint32_t len);
+
+/**
+ * usb_cdc_ncm_ntb_prs_next
+ *
+ * Returns next datagram (len set to its length) or NULL at the end of
+ * block or if block is malformed (err set). Datagrams returned before
+ * error was found come from malformed block too, walk whole chain first
+ * to drop such block.
+ */
+const uint8_t *usb_cdc_ncm_ntb_prs_next(struct usb_cdc_ncm_ntb_prs *prs, uint32_t *len);
+
+/**
+ * usb_cdc_ncm_ntb_blk_len
+ *
+ * Returns block length from NTH at buf (at least USB_CDC_NCM_NTH32_SZ
+ * bytes) or 0 if NTH is not valid.
+ */
+uint32_t usb_cdc_ncm_ntb_blk_len(const uint8_t *buf);
+
+/**
+ * usb_cdc_ncm_ntb_blk_eot
+ *
+ * Returns 1 if NTH at buf is NTB16 with zero block length (block ends
+ * with transfer), otherwise 0.
+ */
+int usb_cdc_ncm_ntb_blk_eot(const uint8_t *buf);
+
+#endif
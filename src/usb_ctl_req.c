@@ -16,17 +16,32 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <string.h>
 #include <FreeRTOS.h>
 #include <task.h>
 #include <semphr.h>
-#include <queue.h>
 #include <gentyp.h>
 #include "sysconf.h"
 #include "msgconf.h"
 #include "criterr.h"
 #include "udp.h"
+#include "usb_std_def.h"
+#include "usb_ctl_req_trc.h"
 #include "usb_ctl_req.h"
 
+#if !defined(USB_CTL_REQ_TMSTMP) && (USB_CTL_REQ_TRC == 1 || USB_CTL_REQ_INSTR == 1)
+ #if USB_CTL_REQ_DWT_TMSTMP == 1
+  #define USB_CTL_REQ_TMSTMP() (*(volatile uint32_t *) 0xE0001004) // DWT_CYCCNT
+ #elif defined(__linux__)
+  #include <time.h>
+  #define USB_CTL_REQ_TMSTMP() host_tmstmp()
+  #define USB_CTL_REQ_HOST_TMSTMP
+  static uint32_t host_tmstmp(void);
+ #else
+  #define USB_CTL_REQ_TMSTMP() xTaskGetTickCountFromISR()
+ #endif
+#endif
+
 enum trans_state {
 	STP_TRANS_IDLE,
 	STP_TRANS_DATA_IN,
@@ -35,74 +50,243 @@ enum trans_state {
 	STP_TRANS_DATA_OUT_STATUS,
         STP_TRANS_NO_DATA,
         STP_TRANS_NO_DATA_STATUS,
-        STP_TRANS_STALL
+        STP_TRANS_STALL,
+        STP_TRANS_DEFER,
+        STP_TRANS_DATA_OUT_DEFER,
+        STP_TRANS_NO_DATA_PEND,
+        STP_TRANS_DATA_OUT_PEND,
+        STP_TRANS_STATE_NMB
 };
+_Static_assert(STP_TRANS_STATE_NMB == USB_CTL_REQ_TRC_STATE_NMB, "usb_ctl_req_trc.c state_nm");
 
-static struct usb_ctl_req_stats stats;
-static struct usb_stp_pkt stp_pkt;
-static enum trans_state state;
-static int16_t pkt_sz;
-static boolean_t sent_zero_pkt;
-static struct usb_ctl_req_clbks *p_std_clbks;
-static struct usb_ctl_req_clbks *p_cls_clbks;
-static struct usb_ctl_req_clbks *p_vnd_clbks;
-static struct usb_ctl_req_clbks *p_clbks;
-static struct usb_ctl_req ctl_req;
+#if USB_CTL_REQ_DEFER == 1
+#ifndef USB_CTL_REQ_DEFER_TASK_PRIO
+ #define USB_CTL_REQ_DEFER_TASK_PRIO (configMAX_PRIORITIES - 1)
+#endif
+#ifndef USB_CTL_REQ_DEFER_TASK_STACK_SIZE
+ #define USB_CTL_REQ_DEFER_TASK_STACK_SIZE (2 * configMINIMAL_STACK_SIZE)
+#endif
 
-#if USB_LOG_CTL_REQ_EVENTS == 1
-static logger_t usb_logger;
-static BaseType_t dmy;
+enum defer_evnt_type {
+	DEFER_STP_EVNT,
+	DEFER_OUT_REC_EVNT
+};
 #endif
 
+#if USB_CTL_REQ_INSTR == 1
+enum req_end {
+	REQ_DONE,
+	REQ_STALL,
+	REQ_ABORT
+};
+#endif
+
+#if USB_CTL_REQ_TRC == 1
+ #define trc(dev, evnt, arg) trc_rec(dev, evnt, arg)
+#else
+ #define trc(dev, evnt, arg)
+#endif
+
+static struct usb_ctl_req_dev *udp_dev;
+
 static void check_clbks(struct usb_ctl_req_clbks *clbks);
-static void rxstp(void);
-static void txcomp(void);
-static void rxdata(int nmb);
-static void stlsnt(void);
-#if USB_LOG_CTL_REQ_EVENTS == 1
-static void log_usb_ctl_req_event(const char *txt);
+static struct usb_ctl_req_clbks *find_clbks(struct usb_ctl_req_dev *dev);
+static void isr_evnt(struct usb_ctl_req_dev *dev, enum usb_ctl_req_isr isr, int nmb);
+static void rxstp(struct usb_ctl_req_dev *dev);
+static void abort_req(struct usb_ctl_req_dev *dev);
+static void start_req(struct usb_ctl_req_dev *dev);
+static void txcomp(struct usb_ctl_req_dev *dev);
+static void rxdata(struct usb_ctl_req_dev *dev, int nmb);
+static void stlsnt(struct usb_ctl_req_dev *dev);
+static void write_in_pkt(struct usb_ctl_req_dev *dev);
+static void write_in_bat(struct usb_ctl_req_dev *dev, int nmb);
+static boolean_t read_out_pkt(struct usb_ctl_req_dev *dev, int nmb);
+static void end_out_data(struct usb_ctl_req_dev *dev, int nmb);
+static void end_out_req(struct usb_ctl_req_dev *dev, boolean_t ok);
+#if USB_CTL_REQ_DEFER == 1
+static boolean_t post_defer_evnt(struct usb_ctl_req_dev *dev, enum defer_evnt_type type);
+static void defer_tsk(void *p);
+#endif
+static void stall_req(struct usb_ctl_req_dev *dev, enum usb_ctl_req_trc_cause cause);
+static void done_req(struct usb_ctl_req_dev *dev);
+#if USB_CTL_REQ_INSTR == 1
+static void instr_isr(struct usb_ctl_req_dev *dev, enum usb_ctl_req_isr isr, uint32_t tm);
+static void instr_req_start(struct usb_ctl_req_dev *dev);
+static void instr_req_end(struct usb_ctl_req_dev *dev, enum req_end end);
 #endif
+#if USB_CTL_REQ_TRC == 1
+static void trc_rec(struct usb_ctl_req_dev *dev, enum usb_ctl_req_trc_evnt evnt, int arg);
+#endif
+static int udp_pkt_sz(void *hw);
+static void udp_read_fifo(void *hw, void *buf, int nmb);
+static void udp_write_fifo(void *hw, const void *buf, int nmb);
+static void udp_rxstp_done(void *hw, int dir);
+static void udp_tx_pkt_rdy(void *hw);
+static void udp_req_stl(void *hw);
+static void udp_disable_stl(void *hw);
+static void udp_txcomp_accept(void *hw);
+static void udp_rxdata_done(void *hw);
+static void udp_stlsnt_accept(void *hw);
+static void udp_rxstp_clbk(void);
+static void udp_txcomp_clbk(void);
+static void udp_rxdata_clbk(int nmb);
+static void udp_stlsnt_clbk(void);
+
+const struct usb_ctl_req_drv usb_ctl_req_udp_drv = {
+	.in_bat = 1,
+	.pkt_sz = udp_pkt_sz,
+	.read_fifo = udp_read_fifo,
+	.write_fifo = udp_write_fifo,
+	.rxstp_done = udp_rxstp_done,
+	.tx_pkt_rdy = udp_tx_pkt_rdy,
+	.req_stl = udp_req_stl,
+	.disable_stl = udp_disable_stl,
+	.txcomp_accept = udp_txcomp_accept,
+	.rxdata_done = udp_rxdata_done,
+	.stlsnt_accept = udp_stlsnt_accept
+};
 
 /**
  * init_usb_ctl_req
  */
-void init_usb_ctl_req(logger_t *logger)
+void init_usb_ctl_req(struct usb_ctl_req_dev *dev, const struct usb_ctl_req_drv *drv, void *hw)
 {
-#if USB_LOG_CTL_REQ_EVENTS == 1
-	usb_logger = *logger;
+#if USB_CTL_REQ_INSTR == 1
+	int i;
+
+#endif
+	dev->drv = drv;
+	dev->hw = hw;
+        dev->pkt_sz = drv->pkt_sz(hw);
+#if USB_CTL_REQ_DEFER == 1
+	if (pdPASS != xTaskCreate(defer_tsk, "USBCTL", USB_CTL_REQ_DEFER_TASK_STACK_SIZE, dev,
+				  USB_CTL_REQ_DEFER_TASK_PRIO, &dev->defer_tsk_hndl)) {
+		crit_err_exit(MALLOC_ERROR);
+	}
+#endif
+#if USB_CTL_REQ_INSTR == 1
+	for (i = 0; i < USB_CTL_REQ_INSTR_REQ_NMB; i++) {
+		dev->instr.req[i].key = USB_CTL_REQ_INSTR_NO_KEY;
+	}
+#endif
+#if USB_CTL_REQ_DWT_TMSTMP == 1 && (USB_CTL_REQ_TRC == 1 || USB_CTL_REQ_INSTR == 1)
+	*(volatile uint32_t *) 0xE000EDFC |= 1 << 24; // DEMCR TRCENA
+	*(volatile uint32_t *) 0xE0001000 |= 1; // DWT_CTRL CYCCNTENA
 #endif
-        pkt_sz = udp_endp0_pkt_sz();
-        add_udp_endp0_rxstp_clbk(rxstp);
-        add_udp_endp0_txcomp_clbk(txcomp);
-        add_udp_endp0_rxdata_clbk(rxdata);
-        add_udp_endp0_stlsnt_clbk(stlsnt);
+}
+
+/**
+ * init_usb_ctl_req_udp
+ */
+void init_usb_ctl_req_udp(struct usb_ctl_req_dev *dev)
+{
+	if (udp_dev) {
+		crit_err_exit(BAD_PARAMETER);
+	}
+	init_usb_ctl_req(dev, &usb_ctl_req_udp_drv, NULL);
+	udp_dev = dev;
+        add_udp_endp0_rxstp_clbk(udp_rxstp_clbk);
+        add_udp_endp0_txcomp_clbk(udp_txcomp_clbk);
+        add_udp_endp0_rxdata_clbk(udp_rxdata_clbk);
+        add_udp_endp0_stlsnt_clbk(udp_stlsnt_clbk);
 }
 
 /**
  * add_usb_ctl_req_std_clbks
  */
-void add_usb_ctl_req_std_clbks(struct usb_ctl_req_clbks *clbks)
+void add_usb_ctl_req_std_clbks(struct usb_ctl_req_dev *dev, struct usb_ctl_req_clbks *clbks)
 {
 	check_clbks(clbks);
-	p_std_clbks = clbks;
+	dev->p_std_clbks = clbks;
 }
 
 /**
  * add_usb_ctl_req_cls_clbks
  */
-void add_usb_ctl_req_cls_clbks(struct usb_ctl_req_clbks *clbks)
+void add_usb_ctl_req_cls_clbks(struct usb_ctl_req_dev *dev, struct usb_ctl_req_clbks *clbks)
 {
 	check_clbks(clbks);
-	p_cls_clbks = clbks;
+	dev->p_cls_clbks = clbks;
 }
 
 /**
  * add_usb_ctl_req_vnd_clbks
  */
-void add_usb_ctl_req_vnd_clbks(struct usb_ctl_req_clbks *clbks)
+void add_usb_ctl_req_vnd_clbks(struct usb_ctl_req_dev *dev, struct usb_ctl_req_clbks *clbks)
 {
 	check_clbks(clbks);
-	p_vnd_clbks = clbks;
+	dev->p_vnd_clbks = clbks;
+}
+
+/**
+ * add_usb_ctl_req_hndlr
+ */
+void add_usb_ctl_req_hndlr(struct usb_ctl_req_dev *dev, struct usb_ctl_req_hndlr *hndlr)
+{
+	struct usb_ctl_req_hndlr **pp;
+
+	if (hndlr->type > USB_VENDOR_REQUEST || hndlr->recp > USB_OTHER_RECIPIENT) {
+		crit_err_exit(BAD_PARAMETER);
+	}
+	check_clbks(hndlr->clbks);
+	pp = &dev->hndlr_tbl[hndlr->type][hndlr->b_request % USB_CTL_REQ_HNDLR_TBL_SZ];
+	if (hndlr->scope == USB_CTL_REQ_ANY_SCOPE) {
+		// Scoped handlers are matched first.
+		while (*pp) {
+			pp = &(*pp)->next;
+		}
+	}
+	hndlr->next = *pp;
+	*pp = hndlr;
+}
+
+/**
+ * add_usb_ctl_req_fn_clbks
+ */
+void add_usb_ctl_req_fn_clbks(struct usb_ctl_req_dev *dev, struct usb_ctl_req_fn *fn)
+{
+	if (fn->first_iface >= USB_DESC_IDX_IFACE_NMB) {
+		crit_err_exit(BAD_PARAMETER);
+	}
+	check_clbks(fn->clbks);
+	fn->next = dev->fn_list;
+	dev->fn_list = fn;
+}
+
+/**
+ * set_usb_ctl_req_fn_conf
+ */
+void set_usb_ctl_req_fn_conf(struct usb_ctl_req_dev *dev, const struct usb_desc_idx *idx)
+{
+	struct usb_ctl_req_fn *fn;
+	int i, cnt, ifc;
+
+	for (i = 0; i < USB_DESC_IDX_IFACE_NMB; i++) {
+		dev->iface_fn_clbks[i] = NULL;
+	}
+	for (i = 0; i < 32; i++) {
+		dev->endp_fn_clbks[i] = NULL;
+	}
+	if (idx == NULL) {
+		return;
+	}
+	for (fn = dev->fn_list; fn; fn = fn->next) {
+		cnt = 1;
+		for (i = 0; i < idx->iad_nmb; i++) {
+			if (idx->iad[i]->b_first_interface == fn->first_iface) {
+				cnt = idx->iad[i]->b_interface_count;
+				break;
+			}
+		}
+		for (i = fn->first_iface; i < fn->first_iface + cnt && i < USB_DESC_IDX_IFACE_NMB; i++) {
+			dev->iface_fn_clbks[i] = fn->clbks;
+		}
+	}
+	for (i = 0; i < 32; i++) {
+		if ((ifc = idx->endp_iface[i]) >= 0) {
+			dev->endp_fn_clbks[i] = dev->iface_fn_clbks[ifc];
+		}
+	}
 }
 
 /**
@@ -114,122 +298,263 @@ static void check_clbks(struct usb_ctl_req_clbks *clbks)
 	      clbks->out_req_rec_clbk && clbks->out_req_ack_clbk)) {
 		crit_err_exit(BAD_PARAMETER);
 	}
+#if USB_CTL_REQ_DEFER != 1
+	if (clbks->defer) {
+		crit_err_exit(BAD_PARAMETER);
+	}
+#endif
 }
 
 /**
- * rxstp
+ * usb_ctl_req_rxstp
  */
-static void rxstp(void)
+void usb_ctl_req_rxstp(struct usb_ctl_req_dev *dev)
 {
-	udp_endp0_disable_stl();
-	ctl_req.valid = FALSE;
-        p_clbks = NULL;
-	read_udp_endp0_fifo(&stp_pkt, sizeof(stp_pkt));
-	switch ((stp_pkt.bm_request_type >> 5) & 3) {
-	case USB_STANDARD_REQUEST :
-		if (p_std_clbks) {
-			p_clbks = p_std_clbks;
-		}
+	isr_evnt(dev, USB_CTL_REQ_RXSTP_ISR, 0);
+}
+
+/**
+ * usb_ctl_req_txcomp
+ */
+void usb_ctl_req_txcomp(struct usb_ctl_req_dev *dev)
+{
+	isr_evnt(dev, USB_CTL_REQ_TXCOMP_ISR, 0);
+}
+
+/**
+ * usb_ctl_req_rxdata
+ */
+void usb_ctl_req_rxdata(struct usb_ctl_req_dev *dev, int nmb)
+{
+	isr_evnt(dev, USB_CTL_REQ_RXDATA_ISR, nmb);
+}
+
+/**
+ * usb_ctl_req_stlsnt
+ */
+void usb_ctl_req_stlsnt(struct usb_ctl_req_dev *dev)
+{
+	isr_evnt(dev, USB_CTL_REQ_STLSNT_ISR, 0);
+}
+
+/**
+ * isr_evnt
+ *
+ * Interrupt may preempt deferred callback, callbacks called from
+ * interrupt must not see request of deferred one.
+ */
+static void isr_evnt(struct usb_ctl_req_dev *dev, enum usb_ctl_req_isr isr, int nmb)
+{
+#if USB_CTL_REQ_INSTR == 1
+	uint32_t tm = USB_CTL_REQ_TMSTMP();
+#endif
+#if USB_CTL_REQ_DEFER == 1
+	struct usb_ctl_req_clbks *defer_clbks = dev->defer_clbks;
+
+	dev->defer_clbks = NULL;
+#endif
+	switch (isr) {
+	case USB_CTL_REQ_RXSTP_ISR :
+		rxstp(dev);
 		break;
-	case USB_CLASS_REQUEST :
-		if (p_cls_clbks) {
-			p_clbks = p_cls_clbks;
-		}
+	case USB_CTL_REQ_TXCOMP_ISR :
+		txcomp(dev);
 		break;
-	case USB_VENDOR_REQUEST :
-		if (p_vnd_clbks) {
-			p_clbks = p_vnd_clbks;
-		}
+	case USB_CTL_REQ_RXDATA_ISR :
+		rxdata(dev, nmb);
 		break;
-	default :
-#if USB_LOG_CTL_REQ_EVENTS == 1
-		log_usb_ctl_req_event("stp !bad request type!");
-#endif
-		stats.bad_stp_req_cnt++;
+	case USB_CTL_REQ_STLSNT_ISR :
+		stlsnt(dev);
 		break;
 	}
-        if (p_clbks) {
-		ctl_req = p_clbks->stp_clbk(&stp_pkt);
+#if USB_CTL_REQ_DEFER == 1
+	dev->defer_clbks = defer_clbks;
+#endif
+#if USB_CTL_REQ_INSTR == 1
+	instr_isr(dev, isr, tm);
+#endif
+}
+
+/**
+ * rxstp
+ */
+static void rxstp(struct usb_ctl_req_dev *dev)
+{
+	dev->drv->disable_stl(dev->hw);
+	abort_req(dev);
+	dev->ctl_req.valid = FALSE;
+	dev->drv->read_fifo(dev->hw, &dev->stp_pkt, sizeof(dev->stp_pkt));
+	dev->stp_seq++;
+	trc(dev, USB_CTL_REQ_TRC_STP, 0);
+#if USB_CTL_REQ_INSTR == 1
+	instr_req_start(dev);
+#endif
+	dev->p_clbks = find_clbks(dev);
+#if USB_CTL_REQ_DEFER == 1
+	if (dev->p_clbks && dev->p_clbks->defer &&
+	    ((dev->stp_pkt.bm_request_type & 0x80) || dev->stp_pkt.w_length == 0)) {
+		// Data or status stage is NAKed until task completes request.
+		dev->drv->rxstp_done(dev->hw, (dev->stp_pkt.bm_request_type & 0x80) ? UDP_CTL_TRANS_IN :
+										      UDP_CTL_TRANS_OUT);
+		if (post_defer_evnt(dev, DEFER_STP_EVNT)) {
+			dev->state = STP_TRANS_DEFER;
+			trc(dev, USB_CTL_REQ_TRC_DEFER, 0);
+		} else {
+			stall_req(dev, USB_CTL_REQ_TRC_DEFER_QUE_FULL);
+		}
+		return;
+	}
+#endif
+	dev->pend_req = FALSE;
+        if (dev->p_clbks) {
+		dev->ctl_req = dev->p_clbks->stp_clbk(dev, &dev->stp_pkt);
 	}
-	if (ctl_req.valid) {
-		if (ctl_req.trans_dir == UDP_CTL_TRANS_IN) {
-			udp_endp0_rxstp_done(UDP_CTL_TRANS_IN);
-			state = STP_TRANS_DATA_IN;
+	if (dev->ctl_req.valid && dev->ctl_req.trans_dir == UDP_CTL_TRANS_IN) {
+		dev->drv->rxstp_done(dev->hw, UDP_CTL_TRANS_IN);
+	} else {
+		dev->drv->rxstp_done(dev->hw, UDP_CTL_TRANS_OUT);
+	}
+	start_req(dev);
+}
+
+/**
+ * abort_req
+ *
+ * Unfinished request is closed before SETUP packet is overwritten, so
+ * abort_clbk sees setup packet and clbks of aborted request. abort_clbk
+ * of deferred request is called by defer_tsk() after its queued or
+ * running callback, never ahead of it.
+ */
+static void abort_req(struct usb_ctl_req_dev *dev)
+{
+	int state = dev->state;
+
+	if (state == STP_TRANS_IDLE || state == STP_TRANS_STALL) {
+		return;
+	}
+	dev->stats.cancel_cnt++;
+	trc(dev, USB_CTL_REQ_TRC_ABORT, 0);
+#if USB_CTL_REQ_INSTR == 1
+	instr_req_end(dev, REQ_ABORT);
+#endif
+	dev->state = STP_TRANS_IDLE;
+	if (state == STP_TRANS_DEFER || state == STP_TRANS_DATA_OUT_DEFER) {
+		return;
+	}
+	if (dev->p_clbks && dev->p_clbks->abort_clbk) {
+		dev->p_clbks->abort_clbk(dev);
+	}
+}
+
+/**
+ * start_req
+ */
+static void start_req(struct usb_ctl_req_dev *dev)
+{
+	if (dev->ctl_req.valid) {
+		if (dev->ctl_req.trans_dir == UDP_CTL_TRANS_IN) {
+			dev->state = STP_TRANS_DATA_IN;
 		} else {
-			udp_endp0_rxstp_done(UDP_CTL_TRANS_OUT);
-			if (ctl_req.nmb == 0) {
-				state = STP_TRANS_NO_DATA;
+			if (dev->ctl_req.nmb == 0) {
+				dev->state = STP_TRANS_NO_DATA;
 			} else {
-				state = STP_TRANS_DATA_OUT;
+				dev->state = STP_TRANS_DATA_OUT;
 			}
 		}
 	} else {
-		udp_endp0_rxstp_done(UDP_CTL_TRANS_OUT);
-                state = STP_TRANS_STALL;
+		stall_req(dev, (dev->p_clbks) ? USB_CTL_REQ_TRC_REJECTED : USB_CTL_REQ_TRC_NO_HNDLR);
+		return;
 	}
-	if (state == STP_TRANS_DATA_IN) {
-		if (ctl_req.trans_nmb > ctl_req.nmb) {
-			sent_zero_pkt = (ctl_req.nmb % pkt_sz) ? FALSE : TRUE;
+	if (dev->state == STP_TRANS_DATA_IN) {
+		if (dev->ctl_req.trans_nmb > dev->ctl_req.nmb) {
+			dev->sent_zero_pkt = (dev->ctl_req.nmb % dev->pkt_sz || dev->ctl_req.nmb == 0) ? FALSE : TRUE;
 		} else {
-			sent_zero_pkt = FALSE;
+			dev->sent_zero_pkt = FALSE;
 		}
-		if (ctl_req.nmb >= pkt_sz) {
-			write_udp_endp0_fifo(ctl_req.buf, pkt_sz);
-			ctl_req.nmb -= pkt_sz;
-			ctl_req.buf += pkt_sz;
+		dev->frag_offs = 0;
+		write_in_pkt(dev);
+		dev->drv->tx_pkt_rdy(dev->hw);
+		write_in_bat(dev, dev->drv->in_bat - 1);
+	} else if (dev->state == STP_TRANS_NO_DATA) {
+		if (dev->pend_req) {
+			dev->state = STP_TRANS_NO_DATA_PEND;
+			trc(dev, USB_CTL_REQ_TRC_PEND, 0);
 		} else {
-			write_udp_endp0_fifo(ctl_req.buf, ctl_req.nmb);
-			ctl_req.nmb = 0;
+			dev->drv->tx_pkt_rdy(dev->hw);
+			dev->state = STP_TRANS_NO_DATA_STATUS;
 		}
-		udp_endp0_tx_pkt_rdy();
-	} else if (state == STP_TRANS_NO_DATA) {
-		udp_endp0_tx_pkt_rdy();
-                state = STP_TRANS_NO_DATA_STATUS;
-	} else if (state == STP_TRANS_STALL) {
-		udp_endp0_req_stl();
+	}
+}
+
+/**
+ * find_clbks
+ */
+static struct usb_ctl_req_clbks *find_clbks(struct usb_ctl_req_dev *dev)
+{
+	struct usb_stp_pkt *stp = &dev->stp_pkt;
+	struct usb_ctl_req_hndlr *h;
+	int type, recp;
+
+	type = (stp->bm_request_type >> 5) & 3;
+	recp = stp->bm_request_type & 0x1F;
+	if (type <= USB_VENDOR_REQUEST) {
+		h = dev->hndlr_tbl[type][stp->b_request % USB_CTL_REQ_HNDLR_TBL_SZ];
+		for (; h; h = h->next) {
+			if (h->b_request == stp->b_request && h->recp == recp &&
+			    (h->scope == USB_CTL_REQ_ANY_SCOPE || h->scope == (stp->w_index & 0xFF))) {
+				return (h->clbks);
+			}
+		}
+	}
+	switch (type) {
+	case USB_STANDARD_REQUEST :
+		return (dev->p_std_clbks);
+	case USB_CLASS_REQUEST :
+		if (recp == USB_IFACE_RECIPIENT) {
+			if ((stp->w_index & 0xFF) < USB_DESC_IDX_IFACE_NMB &&
+			    dev->iface_fn_clbks[stp->w_index & 0xFF]) {
+				return (dev->iface_fn_clbks[stp->w_index & 0xFF]);
+			}
+		} else if (recp == USB_ENDP_RECIPIENT) {
+			if (dev->endp_fn_clbks[usb_desc_idx_endp_ix(stp->w_index)]) {
+				return (dev->endp_fn_clbks[usb_desc_idx_endp_ix(stp->w_index)]);
+			}
+		}
+		return (dev->p_cls_clbks);
+	case USB_VENDOR_REQUEST :
+		return (dev->p_vnd_clbks);
+	default :
+		trc(dev, USB_CTL_REQ_TRC_ERR, USB_CTL_REQ_TRC_BAD_REQ_TYPE);
+		dev->stats.bad_stp_req_cnt++;
+		return (NULL);
 	}
 }
 
 /**
  * txcomp
  */
-static void txcomp(void)
+static void txcomp(struct usb_ctl_req_dev *dev)
 {
-	switch (state) {
+	switch (dev->state) {
 	case STP_TRANS_DATA_IN :
-		if (ctl_req.nmb == 0) {
-			if (sent_zero_pkt) {
-				udp_endp0_tx_pkt_rdy();
-				sent_zero_pkt = FALSE;
-			} else {
-				udp_endp0_txcomp_accept();
-                                state = STP_TRANS_DATA_IN_STATUS;
-			}
+		if (dev->ctl_req.nmb == 0 && !dev->sent_zero_pkt) {
+			dev->drv->txcomp_accept(dev->hw);
+                        dev->state = STP_TRANS_DATA_IN_STATUS;
 		} else {
-			if (ctl_req.nmb >= pkt_sz) {
-				write_udp_endp0_fifo(ctl_req.buf, pkt_sz);
-				ctl_req.nmb -= pkt_sz;
-				ctl_req.buf += pkt_sz;
-			} else {
-				write_udp_endp0_fifo(ctl_req.buf, ctl_req.nmb);
-				ctl_req.nmb = 0;
-			}
-			udp_endp0_tx_pkt_rdy();
+			write_in_bat(dev, (dev->drv->in_bat > 1) ? dev->drv->in_bat : 1);
 		}
 		break;
 	case STP_TRANS_NO_DATA_STATUS :
 		/* FALLTHRU */
 	case STP_TRANS_DATA_OUT_STATUS :
-		udp_endp0_txcomp_accept();
-                p_clbks->out_req_ack_clbk();
-                state = STP_TRANS_IDLE;
+		dev->drv->txcomp_accept(dev->hw);
+                dev->p_clbks->out_req_ack_clbk(dev);
+		done_req(dev);
 		break;
 	default :
-#if USB_LOG_CTL_REQ_EVENTS == 1
-		log_usb_ctl_req_event("unexp txcomp");
-#endif
-		stats.unexp_udp_evnt_cnt++;
-		udp_endp0_txcomp_accept();
+		trc(dev, USB_CTL_REQ_TRC_ERR, USB_CTL_REQ_TRC_UNEXP_TXCOMP);
+		dev->stats.unexp_udp_evnt_cnt++;
+		dev->drv->txcomp_accept(dev->hw);
 		break;
 	}
 }
@@ -237,83 +562,55 @@ static void txcomp(void)
 /**
  * rxdata
  */
-static void rxdata(int nmb)
+static void rxdata(struct usb_ctl_req_dev *dev, int nmb)
 {
-	switch (state) {
+	switch (dev->state) {
 	case STP_TRANS_DATA_IN_STATUS :
 		if (nmb != 0) {
-#if USB_LOG_CTL_REQ_EVENTS == 1
-			log_usb_ctl_req_event("data_in !not zero handshake pkt!");
-#endif
-                        stats.nzr_hs_pkt_cnt++;
+			trc(dev, USB_CTL_REQ_TRC_ERR, USB_CTL_REQ_TRC_NZR_HS_PKT);
+                        dev->stats.nzr_hs_pkt_cnt++;
 		}
-                p_clbks->in_req_ack_clbk();
-                udp_endp0_rxdata_done();
-                state = STP_TRANS_IDLE;
+                dev->p_clbks->in_req_ack_clbk(dev);
+                dev->drv->rxdata_done(dev->hw);
+		done_req(dev);
 		break;
 	case STP_TRANS_DATA_OUT :
-		if (nmb == pkt_sz) {
-			if (nmb < ctl_req.nmb) {
-				read_udp_endp0_fifo(ctl_req.buf, pkt_sz);
-				ctl_req.nmb -= pkt_sz;
-				ctl_req.buf += pkt_sz;
-				udp_endp0_rxdata_done();
-				return;
-			} else if (nmb == ctl_req.nmb) {
-				read_udp_endp0_fifo(ctl_req.buf, pkt_sz);
-				udp_endp0_rxdata_done();
-				if (p_clbks->out_req_rec_clbk()) {
-					udp_endp0_tx_pkt_rdy();
-					state = STP_TRANS_DATA_OUT_STATUS;
+		if (nmb == dev->pkt_sz) {
+			if (nmb < dev->ctl_req.nmb) {
+				if (read_out_pkt(dev, nmb)) {
+					dev->drv->rxdata_done(dev->hw);
 				} else {
-					udp_endp0_req_stl();
-                                        state = STP_TRANS_STALL;
+					dev->drv->rxdata_done(dev->hw);
+					stall_req(dev, USB_CTL_REQ_TRC_OUT_REJECTED);
 				}
 				return;
-			} else {
-#if USB_LOG_CTL_REQ_EVENTS == 1
-				log_usb_ctl_req_event("data_out !more bytes received!");
-#endif
-				stats.unexp_data_sz_cnt++;
-			}
-		} else if (nmb < pkt_sz) {
-			if (nmb == ctl_req.nmb) {
-				read_udp_endp0_fifo(ctl_req.buf, nmb);
-                                udp_endp0_rxdata_done();
-				if (p_clbks->out_req_rec_clbk()) {
-					udp_endp0_tx_pkt_rdy();
-					state = STP_TRANS_DATA_OUT_STATUS;
-				} else {
-					udp_endp0_req_stl();
-                                        state = STP_TRANS_STALL;
-				}
+			} else if (nmb == dev->ctl_req.nmb) {
+				end_out_data(dev, nmb);
 				return;
-#if USB_LOG_CTL_REQ_EVENTS == 1
-			} else if (nmb > ctl_req.nmb) {
-				log_usb_ctl_req_event("data_out !more bytes received!");
 			} else {
-				log_usb_ctl_req_event("data_out !fewer bytes received!");
+				dev->stats.unexp_data_sz_cnt++;
+				dev->drv->rxdata_done(dev->hw);
+				stall_req(dev, USB_CTL_REQ_TRC_MORE_BYTES);
 			}
-#else
+		} else if (nmb < dev->pkt_sz) {
+			if (nmb == dev->ctl_req.nmb) {
+				end_out_data(dev, nmb);
+				return;
 			}
-#endif
-			stats.unexp_data_sz_cnt++;
+			dev->stats.unexp_data_sz_cnt++;
+			dev->drv->rxdata_done(dev->hw);
+			stall_req(dev, (nmb > dev->ctl_req.nmb) ? USB_CTL_REQ_TRC_MORE_BYTES :
+								  USB_CTL_REQ_TRC_FEWER_BYTES);
 		} else {
-#if USB_LOG_CTL_REQ_EVENTS == 1
-			log_usb_ctl_req_event("data_out !udp pkt_sz error!");
-#endif
-			stats.udp_pkt_sz_err_cnt++;
+			dev->stats.udp_pkt_sz_err_cnt++;
+			dev->drv->rxdata_done(dev->hw);
+			stall_req(dev, USB_CTL_REQ_TRC_PKT_SZ_ERR);
 		}
-		udp_endp0_rxdata_done();
-		udp_endp0_req_stl();
-		state = STP_TRANS_STALL;
 		break;
 	default :
-#if USB_LOG_CTL_REQ_EVENTS == 1
-		log_usb_ctl_req_event("unexp rxdata");
-#endif
-		stats.unexp_udp_evnt_cnt++;
-		udp_endp0_rxdata_done();
+		trc(dev, USB_CTL_REQ_TRC_ERR, USB_CTL_REQ_TRC_UNEXP_RXDATA);
+		dev->stats.unexp_udp_evnt_cnt++;
+		dev->drv->rxdata_done(dev->hw);
 		break;
 	}
 }
@@ -321,77 +618,608 @@ static void rxdata(int nmb)
 /**
  * stlsnt
  */
-static void stlsnt(void)
+static void stlsnt(struct usb_ctl_req_dev *dev)
 {
-	switch (state) {
+	switch (dev->state) {
 	case STP_TRANS_STALL :
-		udp_endp0_stlsnt_accept();
+		dev->drv->stlsnt_accept(dev->hw);
 		break;
 	default :
-#if USB_LOG_CTL_REQ_EVENTS == 1
-		log_usb_ctl_req_event("unexp stlsnt");
-#endif
-		stats.unexp_udp_evnt_cnt++;
-		udp_endp0_stlsnt_accept();
+		trc(dev, USB_CTL_REQ_TRC_ERR, USB_CTL_REQ_TRC_UNEXP_STLSNT);
+		dev->stats.unexp_udp_evnt_cnt++;
+		dev->drv->stlsnt_accept(dev->hw);
 		break;
 	}
 }
 
+/**
+ * write_in_pkt
+ */
+static void write_in_pkt(struct usb_ctl_req_dev *dev)
+{
+	struct usb_ctl_req *req = &dev->ctl_req;
+	short n, sz;
+
+	n = (req->nmb >= dev->pkt_sz) ? dev->pkt_sz : req->nmb;
+	req->nmb -= n;
+	trc(dev, USB_CTL_REQ_TRC_IN_PKT, n);
+	if (req->in_pkt_clbk) {
+		req->in_pkt_clbk(req->arg, req->buf, n, req->nmb);
+		dev->drv->write_fifo(dev->hw, req->buf, n);
+	} else if (req->frag) {
+		while (n) {
+			sz = req->frag->nmb - dev->frag_offs;
+			if (sz > n) {
+				sz = n;
+			}
+			dev->drv->write_fifo(dev->hw, (const uint8_t *) req->frag->buf + dev->frag_offs, sz);
+			n -= sz;
+			dev->frag_offs += sz;
+			if (dev->frag_offs == req->frag->nmb) {
+				req->frag++;
+				dev->frag_offs = 0;
+			}
+		}
+	} else {
+		dev->drv->write_fifo(dev->hw, req->buf, n);
+		req->buf += n;
+	}
+}
+
+/**
+ * write_in_bat
+ *
+ * Queues up to nmb data packets (zero length packet after last full
+ * packet included).
+ */
+static void write_in_bat(struct usb_ctl_req_dev *dev, int nmb)
+{
+	while (nmb-- > 0) {
+		if (dev->ctl_req.nmb) {
+			write_in_pkt(dev);
+		} else if (dev->sent_zero_pkt) {
+			dev->sent_zero_pkt = FALSE;
+		} else {
+			break;
+		}
+		dev->drv->tx_pkt_rdy(dev->hw);
+	}
+}
+
+/**
+ * read_out_pkt
+ */
+static boolean_t read_out_pkt(struct usb_ctl_req_dev *dev, int nmb)
+{
+	struct usb_ctl_req *req = &dev->ctl_req;
+
+	dev->drv->read_fifo(dev->hw, req->buf, nmb);
+	req->nmb -= nmb;
+	trc(dev, USB_CTL_REQ_TRC_OUT_PKT, nmb);
+	if (req->out_pkt_clbk) {
+		req->buf = req->out_pkt_clbk(req->arg, req->buf, nmb);
+		// Buffer is not needed after last packet.
+		if (req->buf == NULL && req->nmb != 0) {
+			return (FALSE);
+		}
+	} else {
+		req->buf += nmb;
+	}
+	return (TRUE);
+}
+
+/**
+ * end_out_data
+ */
+static void end_out_data(struct usb_ctl_req_dev *dev, int nmb)
+{
+	boolean_t ok;
+
+	ok = read_out_pkt(dev, nmb);
+	dev->drv->rxdata_done(dev->hw);
+#if USB_CTL_REQ_DEFER == 1
+	if (ok && dev->p_clbks->defer) {
+		// Status stage is NAKed until task accepts data.
+		if (post_defer_evnt(dev, DEFER_OUT_REC_EVNT)) {
+			dev->state = STP_TRANS_DATA_OUT_DEFER;
+			trc(dev, USB_CTL_REQ_TRC_DEFER, 0);
+			return;
+		}
+		ok = FALSE;
+	}
+#endif
+	if (ok) {
+		dev->pend_req = FALSE;
+		ok = dev->p_clbks->out_req_rec_clbk(dev);
+	}
+	end_out_req(dev, ok);
+}
+
+/**
+ * end_out_req
+ */
+static void end_out_req(struct usb_ctl_req_dev *dev, boolean_t ok)
+{
+	if (!ok) {
+		stall_req(dev, USB_CTL_REQ_TRC_OUT_REJECTED);
+	} else if (dev->pend_req) {
+		dev->state = STP_TRANS_DATA_OUT_PEND;
+		trc(dev, USB_CTL_REQ_TRC_PEND, 0);
+	} else {
+		dev->drv->tx_pkt_rdy(dev->hw);
+		dev->state = STP_TRANS_DATA_OUT_STATUS;
+	}
+}
+
+/**
+ * usb_ctl_req_get_arg
+ */
+void *usb_ctl_req_get_arg(struct usb_ctl_req_dev *dev)
+{
+#if USB_CTL_REQ_DEFER == 1
+	if (dev->defer_clbks) {
+		return (dev->defer_clbks->arg);
+	}
+#endif
+	return (dev->p_clbks->arg);
+}
+
+/**
+ * pend_usb_ctl_req
+ */
+int pend_usb_ctl_req(struct usb_ctl_req_dev *dev)
+{
+	dev->pend_req = TRUE;
+#if USB_CTL_REQ_DEFER == 1
+	if (dev->defer_clbks) {
+		return (dev->defer_seq);
+	}
+#endif
+	return (dev->stp_seq);
+}
+
+/**
+ * complete_usb_ctl_req
+ */
+boolean_t complete_usb_ctl_req(struct usb_ctl_req_dev *dev, int tag, boolean_t ack)
+{
+	UBaseType_t msk;
+	boolean_t ret = TRUE;
+
+	msk = taskENTER_CRITICAL_FROM_ISR();
+	if (tag != dev->stp_seq) {
+		ret = FALSE;
+	} else if (dev->state == STP_TRANS_NO_DATA_PEND || dev->state == STP_TRANS_DATA_OUT_PEND) {
+		if (ack) {
+			dev->drv->tx_pkt_rdy(dev->hw);
+			dev->state = (dev->state == STP_TRANS_NO_DATA_PEND) ? STP_TRANS_NO_DATA_STATUS :
+									      STP_TRANS_DATA_OUT_STATUS;
+		} else {
+			stall_req(dev, USB_CTL_REQ_TRC_OUT_REJECTED);
+		}
+	} else {
+		ret = FALSE;
+	}
+	taskEXIT_CRITICAL_FROM_ISR(msk);
+	return (ret);
+}
+
+#if USB_CTL_REQ_DEFER == 1
+/**
+ * post_defer_evnt
+ */
+static boolean_t post_defer_evnt(struct usb_ctl_req_dev *dev, enum defer_evnt_type type)
+{
+	struct usb_ctl_req_defer_evnt *ev;
+	BaseType_t tsk_wkn = pdFALSE;
+
+	if ((uint8_t) (dev->defer_que_head - dev->defer_que_tail) == USB_CTL_REQ_DEFER_QUE_SZ) {
+		dev->stats.defer_que_full_cnt++;
+		return (FALSE);
+	}
+	ev = &dev->defer_que[dev->defer_que_head % USB_CTL_REQ_DEFER_QUE_SZ];
+	ev->type = type;
+	ev->seq = dev->stp_seq;
+	ev->clbks = dev->p_clbks;
+	ev->stp_pkt = dev->stp_pkt;
+	dev->defer_que_head++;
+	vTaskNotifyGiveFromISR(dev->defer_tsk_hndl, &tsk_wkn);
+	portYIELD_FROM_ISR(tsk_wkn);
+	return (TRUE);
+}
+
+/**
+ * defer_tsk
+ */
+static void defer_tsk(void *p)
+{
+	struct usb_ctl_req_dev *dev = p;
+	struct usb_ctl_req_defer_evnt *ev;
+	struct usb_ctl_req req;
+	boolean_t ok, stale;
+
+	while (TRUE) {
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		while (dev->defer_que_tail != dev->defer_que_head) {
+			ev = &dev->defer_que[dev->defer_que_tail % USB_CTL_REQ_DEFER_QUE_SZ];
+			dev->pend_req = FALSE;
+			dev->defer_seq = ev->seq;
+			dev->defer_clbks = ev->clbks;
+			stale = TRUE;
+			if (ev->type == DEFER_STP_EVNT) {
+				req = ev->clbks->stp_clbk(dev, &ev->stp_pkt);
+				dev->defer_clbks = NULL;
+				if (req.valid && ((req.trans_dir == UDP_CTL_TRANS_IN) !=
+						  ((ev->stp_pkt.bm_request_type & 0x80) != 0) ||
+						  (req.trans_dir != UDP_CTL_TRANS_IN && req.nmb != 0))) {
+					req.valid = FALSE;
+				}
+				taskENTER_CRITICAL();
+				// Request may be overrun by new SETUP in meantime.
+				if (ev->seq == dev->stp_seq && dev->state == STP_TRANS_DEFER) {
+					dev->ctl_req = req;
+					start_req(dev);
+					stale = FALSE;
+				}
+				taskEXIT_CRITICAL();
+			} else {
+				ok = ev->clbks->out_req_rec_clbk(dev);
+				dev->defer_clbks = NULL;
+				taskENTER_CRITICAL();
+				if (ev->seq == dev->stp_seq && dev->state == STP_TRANS_DATA_OUT_DEFER) {
+					end_out_req(dev, ok);
+					stale = FALSE;
+				}
+				taskEXIT_CRITICAL();
+			}
+			if (stale && ev->clbks->abort_clbk) {
+				// Left by abort_req(), callback is finished now.
+				dev->defer_clbks = ev->clbks;
+				ev->clbks->abort_clbk(dev);
+				dev->defer_clbks = NULL;
+			}
+			dev->defer_que_tail++;
+		}
+	}
+}
+#endif
+
+/**
+ * stall_req
+ */
+static void stall_req(struct usb_ctl_req_dev *dev, enum usb_ctl_req_trc_cause cause)
+{
+	dev->drv->req_stl(dev->hw);
+	dev->state = STP_TRANS_STALL;
+	trc(dev, USB_CTL_REQ_TRC_STALL, cause);
+#if USB_CTL_REQ_INSTR == 1
+	instr_req_end(dev, REQ_STALL);
+#endif
+}
+
+/**
+ * done_req
+ */
+static void done_req(struct usb_ctl_req_dev *dev)
+{
+	dev->state = STP_TRANS_IDLE;
+	trc(dev, USB_CTL_REQ_TRC_DONE, 0);
+#if USB_CTL_REQ_INSTR == 1
+	instr_req_end(dev, REQ_DONE);
+#endif
+}
+
+#if USB_CTL_REQ_INSTR == 1
+/**
+ * instr_isr
+ */
+static void instr_isr(struct usb_ctl_req_dev *dev, enum usb_ctl_req_isr isr, uint32_t tm)
+{
+	struct usb_ctl_req_isr_instr *p = &dev->instr.isr[isr];
+
+	tm = USB_CTL_REQ_TMSTMP() - tm;
+	p->cnt++;
+	p->sum += tm;
+	if (tm > p->max) {
+		p->max = tm;
+	}
+}
+
+/**
+ * instr_req_start
+ */
+static void instr_req_start(struct usb_ctl_req_dev *dev)
+{
+	struct usb_ctl_req_req_instr *req = dev->instr.req;
+	uint16_t key;
+	int i, j;
+
+	dev->req_tm = USB_CTL_REQ_TMSTMP();
+	key = ((dev->stp_pkt.bm_request_type & 0x60) << 3) | dev->stp_pkt.b_request;
+	i = key % USB_CTL_REQ_INSTR_REQ_NMB;
+	for (j = 0; j < USB_CTL_REQ_INSTR_REQ_NMB; j++) {
+		if (req[i].key == key) {
+			break;
+		}
+		if (req[i].key == USB_CTL_REQ_INSTR_NO_KEY) {
+			req[i].key = key;
+			break;
+		}
+		i = (i + 1) % USB_CTL_REQ_INSTR_REQ_NMB;
+	}
+	if (j == USB_CTL_REQ_INSTR_REQ_NMB) {
+		dev->instr.req_ovf_cnt++;
+		dev->instr_req = NULL;
+		return;
+	}
+	dev->instr_req = &req[i];
+	dev->instr_req->cnt++;
+}
+
+/**
+ * instr_req_end
+ */
+static void instr_req_end(struct usb_ctl_req_dev *dev, enum req_end end)
+{
+	uint32_t tm;
+	int b;
+
+	if (!dev->instr_req) {
+		return;
+	}
+	if (end == REQ_STALL) {
+		dev->instr_req->stall_cnt++;
+	} else if (end == REQ_ABORT) {
+		dev->instr_req->abort_cnt++;
+	} else {
+		tm = (USB_CTL_REQ_TMSTMP() - dev->req_tm) >> USB_CTL_REQ_INSTR_HIST_BASE;
+		for (b = 0; tm > 1 && b < USB_CTL_REQ_INSTR_HIST_NMB - 1; b++) {
+			tm >>= 1;
+		}
+		dev->instr_req->hist[b]++;
+	}
+	dev->instr_req = NULL;
+}
+
+/**
+ * snap_usb_ctl_req_instr
+ */
+void snap_usb_ctl_req_instr(struct usb_ctl_req_dev *dev, struct usb_ctl_req_instr *snap)
+{
+	taskENTER_CRITICAL();
+	*snap = dev->instr;
+	taskEXIT_CRITICAL();
+}
+#endif
+
+#if USB_CTL_REQ_TRC == 1
+/**
+ * trc_rec
+ */
+static void trc_rec(struct usb_ctl_req_dev *dev, enum usb_ctl_req_trc_evnt evnt, int arg)
+{
+	struct usb_ctl_req_trc *p;
+
+	if ((uint16_t) (dev->trc_head - dev->trc_tail) == USB_CTL_REQ_TRC_SZ) {
+		dev->stats.trc_drop_cnt++;
+		return;
+	}
+	p = &dev->trc_buf[dev->trc_head % USB_CTL_REQ_TRC_SZ];
+	p->tm = USB_CTL_REQ_TMSTMP();
+	p->evnt = evnt;
+	p->state = dev->state;
+	p->arg = arg;
+	if (evnt == USB_CTL_REQ_TRC_STP) {
+		memcpy(p->stp, &dev->stp_pkt, sizeof(p->stp));
+	}
+	dev->trc_head++;
+}
+
+/**
+ * drain_usb_ctl_req_trc
+ */
+int drain_usb_ctl_req_trc(struct usb_ctl_req_dev *dev, struct usb_ctl_req_trc *buf, int nmb)
+{
+	int n = 0;
+
+	while (n < nmb && dev->trc_tail != dev->trc_head) {
+		buf[n++] = dev->trc_buf[dev->trc_tail % USB_CTL_REQ_TRC_SZ];
+		dev->trc_tail++;
+	}
+	return (n);
+}
+#endif
+
 /**
  * get_usb_ctl_req_stats
  */
-struct usb_ctl_req_stats *get_usb_ctl_req_stats(void)
+struct usb_ctl_req_stats *get_usb_ctl_req_stats(struct usb_ctl_req_dev *dev)
+{
+	return (&dev->stats);
+}
+
+/**
+ * snap_usb_ctl_req_stats
+ */
+void snap_usb_ctl_req_stats(struct usb_ctl_req_dev *dev, struct usb_ctl_req_stats *snap)
 {
-	return (&stats);
+	taskENTER_CRITICAL();
+	*snap = dev->stats;
+	taskEXIT_CRITICAL();
 }
 
 #if TERMOUT == 1
 /**
  * log_usb_ctl_req_stats
  */
-void log_usb_ctl_req_stats(void)
+void log_usb_ctl_req_stats(struct usb_ctl_req_dev *dev)
 {
-	if (stats.unexp_data_sz_cnt) {
-        	msg(INF, "usb_ctl_req.c: unexp_data_sz=%hu\n", stats.unexp_data_sz_cnt);
+	struct usb_ctl_req_stats *st = &dev->stats;
+
+	if (st->unexp_data_sz_cnt) {
+        	msg(INF, "usb_ctl_req.c: unexp_data_sz=%u\n", st->unexp_data_sz_cnt);
+	}
+	if (st->nzr_hs_pkt_cnt) {
+		msg(INF, "usb_ctl_req.c: nzr_hs_pkt=%u\n", st->nzr_hs_pkt_cnt);
+	}
+	if (st->bad_stp_req_cnt) {
+		msg(INF, "usb_ctl_req.c: bad_stp_req=%u\n", st->bad_stp_req_cnt);
+	}
+        if (st->unexp_udp_evnt_cnt) {
+		msg(INF, "usb_ctl_req.c: unexp_udp_evnt=%u\n", st->unexp_udp_evnt_cnt);
+	}
+	if (st->udp_pkt_sz_err_cnt) {
+		msg(INF, "usb_ctl_req.c: udp_pkt_sz_err=%u\n", st->udp_pkt_sz_err_cnt);
 	}
-	if (stats.nzr_hs_pkt_cnt) {
-		msg(INF, "usb_ctl_req.c: nzr_hs_pkt=%hu\n", stats.nzr_hs_pkt_cnt);
+	if (st->defer_que_full_cnt) {
+		msg(INF, "usb_ctl_req.c: defer_que_full=%u\n", st->defer_que_full_cnt);
 	}
-	if (stats.bad_stp_req_cnt) {
-		msg(INF, "usb_ctl_req.c: bad_stp_req=%hu\n", stats.bad_stp_req_cnt);
+	if (st->trc_drop_cnt) {
+		msg(INF, "usb_ctl_req.c: trc_drop=%u\n", st->trc_drop_cnt);
 	}
-        if (stats.unexp_udp_evnt_cnt) {
-		msg(INF, "usb_ctl_req.c: unexp_udp_evnt=%hu\n", stats.unexp_udp_evnt_cnt);
+	if (st->cancel_cnt) {
+		msg(INF, "usb_ctl_req.c: cancel=%u\n", st->cancel_cnt);
 	}
-	if (stats.udp_pkt_sz_err_cnt) {
-		msg(INF, "usb_ctl_req.c: udp_pkt_sz_err=%hu\n", stats.udp_pkt_sz_err_cnt);
+}
+
+#if USB_CTL_REQ_TRC == 1
+/**
+ * log_usb_ctl_req_trc
+ */
+void log_usb_ctl_req_trc(struct usb_ctl_req_dev *dev)
+{
+	struct usb_ctl_req_trc trc;
+	char buf[80];
+
+	while (drain_usb_ctl_req_trc(dev, &trc, 1)) {
+		fmt_usb_ctl_req_trc(&trc, buf, sizeof(buf));
+		msg(INF, "usb_ctl_req.c: %s\n", buf);
 	}
 }
 #endif
+#endif
 
-#if USB_LOG_CTL_REQ_EVENTS == 1
 /**
- * fmt_usb_ctl_req_event
+ * udp_pkt_sz
  */
-static void fmt_usb_ctl_req_event(struct usb_ctl_req_event *p);
-static void fmt_usb_ctl_req_event(struct usb_ctl_req_event *p)
+static int udp_pkt_sz(void *hw)
 {
-	msg(INF, "usb_ctl_req.c: %s\n", p->txt);
+	return (udp_endp0_pkt_sz());
 }
 
-static struct usb_ctl_req_event ucre = {
-	.type = USB_CTL_REQ_EVENT_TYPE,
-	.fmt = fmt_usb_ctl_req_event
-};
+/**
+ * udp_read_fifo
+ */
+static void udp_read_fifo(void *hw, void *buf, int nmb)
+{
+	read_udp_endp0_fifo(buf, nmb);
+}
 
 /**
- * log_usb_ctl_req_event
+ * udp_write_fifo
  */
-static void log_usb_ctl_req_event(const char *txt)
+static void udp_write_fifo(void *hw, const void *buf, int nmb)
 {
-	ucre.txt = txt;
-	if (pdTRUE != xQueueSendFromISR(usb_logger.que, &ucre, &dmy)) {
-		usb_logger.que_err();
-	}
+	write_udp_endp0_fifo(buf, nmb);
+}
+
+/**
+ * udp_rxstp_done
+ */
+static void udp_rxstp_done(void *hw, int dir)
+{
+	udp_endp0_rxstp_done(dir);
+}
+
+/**
+ * udp_tx_pkt_rdy
+ */
+static void udp_tx_pkt_rdy(void *hw)
+{
+	udp_endp0_tx_pkt_rdy();
+}
+
+/**
+ * udp_req_stl
+ */
+static void udp_req_stl(void *hw)
+{
+	udp_endp0_req_stl();
+}
+
+/**
+ * udp_disable_stl
+ */
+static void udp_disable_stl(void *hw)
+{
+	udp_endp0_disable_stl();
+}
+
+/**
+ * udp_txcomp_accept
+ */
+static void udp_txcomp_accept(void *hw)
+{
+	udp_endp0_txcomp_accept();
+}
+
+/**
+ * udp_rxdata_done
+ */
+static void udp_rxdata_done(void *hw)
+{
+	udp_endp0_rxdata_done();
+}
+
+/**
+ * udp_stlsnt_accept
+ */
+static void udp_stlsnt_accept(void *hw)
+{
+	udp_endp0_stlsnt_accept();
+}
+
+/**
+ * udp_rxstp_clbk
+ */
+static void udp_rxstp_clbk(void)
+{
+	usb_ctl_req_rxstp(udp_dev);
+}
+
+/**
+ * udp_txcomp_clbk
+ */
+static void udp_txcomp_clbk(void)
+{
+	usb_ctl_req_txcomp(udp_dev);
+}
+
+/**
+ * udp_rxdata_clbk
+ */
+static void udp_rxdata_clbk(int nmb)
+{
+	usb_ctl_req_rxdata(udp_dev, nmb);
+}
+
+/**
+ * udp_stlsnt_clbk
+ */
+static void udp_stlsnt_clbk(void)
+{
+	usb_ctl_req_stlsnt(udp_dev);
+}
+
+#ifdef USB_CTL_REQ_HOST_TMSTMP
+/**
+ * host_tmstmp
+ */
+static uint32_t host_tmstmp(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1000000000UL + ts.tv_nsec);
 }
 #endif
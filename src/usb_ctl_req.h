@@ -19,6 +19,24 @@
 #ifndef USB_CTL_REQ_H
 #define USB_CTL_REQ_H
 
+// Include order: sysconf.h, FreeRTOS.h, task.h (USB_CTL_REQ_DEFER == 1),
+// gentyp.h, usb_std_def.h, usb_ctl_req_trc.h (USB_CTL_REQ_TRC == 1),
+// usb_ctl_req.h. USB_CTL_REQ_DEFER, USB_CTL_REQ_TRC and USB_CTL_REQ_INSTR
+// change layout of struct usb_ctl_req_dev, they have no defaults and must
+// be set in sysconf.h, so all translation units agree.
+#if !defined(USB_CTL_REQ_DEFER) || !defined(USB_CTL_REQ_TRC) || !defined(USB_CTL_REQ_INSTR)
+ #error "USB_CTL_REQ_DEFER, USB_CTL_REQ_TRC and USB_CTL_REQ_INSTR must be set in sysconf.h"
+#endif
+#ifndef USB_STD_DEF_H
+ #error "usb_ctl_req.h must be included after usb_std_def.h"
+#endif
+#if USB_CTL_REQ_TRC == 1 && !defined(USB_CTL_REQ_TRC_H)
+ #error "usb_ctl_req.h must be included after usb_ctl_req_trc.h"
+#endif
+#if USB_CTL_REQ_DEFER == 1 && !defined(INC_TASK_H)
+ #error "usb_ctl_req.h must be included after task.h"
+#endif
+
 struct usb_stp_pkt {
 	uint8_t bm_request_type;
         uint8_t b_request;
@@ -60,67 +78,375 @@ enum usb_ctl_std_feat {
         USB_TEST_MODE_FEAT
 };
 
+// IN data stage fragment.
+struct usb_ctl_req_frag {
+	const void *buf;
+	short nmb;
+};
+
+// If frag is set, IN data stage is sent from fragment list (buf is not used).
+// Packets may straddle fragment boundaries.
+// If in_pkt_clbk is set, IN data stage is generated on demand. Before each
+// packet in_pkt_clbk fills nmb bytes to buf (must hold one EP0 packet),
+// rem is number of bytes left after this packet.
+// If out_pkt_clbk is set, OUT data stage is streamed. Each received packet
+// is stored to buf (must hold one EP0 packet) and passed to out_pkt_clbk,
+// which returns buffer for next packet (NULL stalls request, return value
+// after last packet is ignored). out_req_rec_clbk is called after last
+// packet as usual.
+// Members not used by request must be zeroed.
 struct usb_ctl_req {
 	boolean_t valid;
 	uint8_t *buf;
 	short nmb;
 	short trans_nmb;
         int8_t trans_dir;
+        const struct usb_ctl_req_frag *frag;
+        void (*in_pkt_clbk)(void *arg, uint8_t *pkt, int nmb, int rem);
+        uint8_t *(*out_pkt_clbk)(void *arg, uint8_t *pkt, int nmb);
+        void *arg;
 };
 
+// If defer is TRUE (needs USB_CTL_REQ_DEFER == 1), stp_clbk of requests
+// without OUT data stage and out_req_rec_clbk run in USB control task.
+// Data or status stage is NAKed until callback returns. stp_clbk of
+// requests with OUT data stage and ack callbacks run in interrupt.
+// Callbacks get engine instance which received request.
+// abort_clbk (can be NULL) is called in interrupt when SETUP arrives before
+// request finished (data or status stage running or request pended),
+// before new request is dispatched. Aborted deferred request gets its
+// abort_clbk in USB control task after its deferred callback returned
+// (possibly after new request was dispatched).
+struct usb_ctl_req_dev;
+
 struct usb_ctl_req_clbks {
-	struct usb_ctl_req (*stp_clbk)(struct usb_stp_pkt *stp_pkt);
-	void (*in_req_ack_clbk)(void);
-	boolean_t (*out_req_rec_clbk)(void);
-	void (*out_req_ack_clbk)(void);
+	struct usb_ctl_req (*stp_clbk)(struct usb_ctl_req_dev *dev, struct usb_stp_pkt *stp_pkt);
+	void (*in_req_ack_clbk)(struct usb_ctl_req_dev *dev);
+	boolean_t (*out_req_rec_clbk)(struct usb_ctl_req_dev *dev);
+	void (*out_req_ack_clbk)(struct usb_ctl_req_dev *dev);
+	void (*abort_clbk)(struct usb_ctl_req_dev *dev);
+	boolean_t defer;
+	void *arg; // Free for owner, see usb_ctl_req_get_arg().
 };
 
-#define USB_CTL_REQ_EVENT_TYPE 8
+#define USB_CTL_REQ_ANY_SCOPE (-1)
+
+// Request handler selected by type, recipient and bRequest. Scope limits
+// handler to one interface or endpoint (w_index low byte). Handler object
+// can be registered to one engine instance only (same for usb_ctl_req_fn).
+struct usb_ctl_req_hndlr {
+	uint8_t type;
+	uint8_t recp;
+	uint8_t b_request;
+	int16_t scope;
+	struct usb_ctl_req_clbks *clbks;
+	struct usb_ctl_req_hndlr *next;
+};
 
-struct usb_ctl_req_event {
-	int8_t type;
-        const char *txt;
-        void (*fmt)(struct usb_ctl_req_event *);
+// Function of composite device. Class requests addressed to interfaces
+// of function (IAD of active configuration, single interface without IAD)
+// or to their endpoints are routed to clbks.
+struct usb_ctl_req_fn {
+	uint8_t first_iface;
+	struct usb_ctl_req_clbks *clbks;
+	struct usb_ctl_req_fn *next;
 };
 
+struct usb_desc_idx;
+
 struct usb_ctl_req_stats {
-	unsigned short unexp_data_sz_cnt;
-        unsigned short nzr_hs_pkt_cnt;
-        unsigned short bad_stp_req_cnt;
-        unsigned short unexp_udp_evnt_cnt;
-        unsigned short udp_pkt_sz_err_cnt;
+	unsigned int unexp_data_sz_cnt;
+        unsigned int nzr_hs_pkt_cnt;
+        unsigned int bad_stp_req_cnt;
+        unsigned int unexp_udp_evnt_cnt;
+        unsigned int udp_pkt_sz_err_cnt;
+        unsigned int defer_que_full_cnt;
+        unsigned int trc_drop_cnt;
+        unsigned int cancel_cnt;
+};
+
+#ifndef USB_CTL_REQ_INSTR_REQ_NMB
+ #define USB_CTL_REQ_INSTR_REQ_NMB 16
+#endif
+#ifndef USB_CTL_REQ_INSTR_HIST_NMB
+ #define USB_CTL_REQ_INSTR_HIST_NMB 16
+#endif
+#ifndef USB_CTL_REQ_DWT_TMSTMP
+ #define USB_CTL_REQ_DWT_TMSTMP 0 // Time stamps from Cortex-M DWT cycle counter.
+#endif
+#ifndef USB_CTL_REQ_INSTR_HIST_BASE
+ #if USB_CTL_REQ_DWT_TMSTMP == 1
+  #define USB_CTL_REQ_INSTR_HIST_BASE 10
+ #else
+  #define USB_CTL_REQ_INSTR_HIST_BASE 0
+ #endif
+#endif
+#define USB_CTL_REQ_INSTR_NO_KEY 0xFFFF
+
+enum usb_ctl_req_isr {
+	USB_CTL_REQ_RXSTP_ISR,
+	USB_CTL_REQ_TXCOMP_ISR,
+	USB_CTL_REQ_RXDATA_ISR,
+	USB_CTL_REQ_STLSNT_ISR
+};
+
+// Time spent in interrupt callback (USB_CTL_REQ_TMSTMP units).
+struct usb_ctl_req_isr_instr {
+	uint32_t cnt;
+	uint32_t max;
+	uint64_t sum;
+};
+
+// Requests with key ((type << 8) | bRequest). hist[i] counts setup to
+// status latencies in <2^i, 2^(i+1)) << USB_CTL_REQ_INSTR_HIST_BASE
+// (hist[0] starts at zero, last bucket is unbounded).
+struct usb_ctl_req_req_instr {
+	uint16_t key;
+	uint32_t cnt;
+	uint32_t stall_cnt;
+	uint32_t abort_cnt;
+	uint32_t hist[USB_CTL_REQ_INSTR_HIST_NMB];
+};
+
+struct usb_ctl_req_instr {
+	struct usb_ctl_req_isr_instr isr[USB_CTL_REQ_STLSNT_ISR + 1];
+	struct usb_ctl_req_req_instr req[USB_CTL_REQ_INSTR_REQ_NMB];
+	uint32_t req_ovf_cnt;
+};
+
+#ifndef USB_CTL_REQ_HNDLR_TBL_SZ
+ #define USB_CTL_REQ_HNDLR_TBL_SZ 16
+#endif
+#ifndef USB_CTL_REQ_DEFER_QUE_SZ
+ #define USB_CTL_REQ_DEFER_QUE_SZ 4 // Power of 2.
+#endif
+#ifndef USB_CTL_REQ_TRC_SZ
+ #define USB_CTL_REQ_TRC_SZ 32 // Power of 2.
+#endif
+
+// Endpoint 0 driver of device controller. hw is passed to all functions.
+// Driver reports endpoint 0 interrupts by usb_ctl_req_rxstp(),
+// usb_ctl_req_txcomp(), usb_ctl_req_rxdata() and usb_ctl_req_stlsnt().
+// If in_bat > 1 (ping-pong banks, DMA descriptor chain), engine queues up
+// to in_bat IN data packets (write_fifo, tx_pkt_rdy per packet) and driver
+// reports txcomp once after all queued packets were sent. write_fifo must
+// copy data before it returns.
+struct usb_ctl_req_drv {
+	uint8_t in_bat;
+	int (*pkt_sz)(void *hw);
+	void (*read_fifo)(void *hw, void *buf, int nmb);
+	void (*write_fifo)(void *hw, const void *buf, int nmb);
+	void (*rxstp_done)(void *hw, int dir);
+	void (*tx_pkt_rdy)(void *hw);
+	void (*req_stl)(void *hw);
+	void (*disable_stl)(void *hw);
+	void (*txcomp_accept)(void *hw);
+	void (*rxdata_done)(void *hw);
+	void (*stlsnt_accept)(void *hw);
+};
+
+// Binding of udp.h driver.
+extern const struct usb_ctl_req_drv usb_ctl_req_udp_drv;
+
+#if USB_CTL_REQ_DEFER == 1
+struct usb_ctl_req_defer_evnt {
+	uint8_t type;
+	uint8_t seq;
+	struct usb_ctl_req_clbks *clbks;
+	struct usb_stp_pkt stp_pkt;
+};
+#endif
+
+// Engine instance, one per device controller. Members are private to
+// usb_ctl_req.c.
+struct usb_ctl_req_dev {
+	const struct usb_ctl_req_drv *drv;
+	void *hw;
+	void *arg; // Free for application.
+	struct usb_ctl_req_stats stats;
+	struct usb_stp_pkt stp_pkt;
+	uint8_t state;
+	uint8_t stp_seq;
+	int16_t pkt_sz;
+	boolean_t sent_zero_pkt;
+	boolean_t pend_req;
+	short frag_offs;
+	struct usb_ctl_req ctl_req;
+	struct usb_ctl_req_clbks *p_std_clbks;
+	struct usb_ctl_req_clbks *p_cls_clbks;
+	struct usb_ctl_req_clbks *p_vnd_clbks;
+	struct usb_ctl_req_clbks *p_clbks;
+	struct usb_ctl_req_hndlr *hndlr_tbl[USB_VENDOR_REQUEST + 1][USB_CTL_REQ_HNDLR_TBL_SZ];
+	struct usb_ctl_req_fn *fn_list;
+	struct usb_ctl_req_clbks *iface_fn_clbks[USB_DESC_IDX_IFACE_NMB];
+	struct usb_ctl_req_clbks *endp_fn_clbks[32];
+#if USB_CTL_REQ_DEFER == 1
+	struct usb_ctl_req_defer_evnt defer_que[USB_CTL_REQ_DEFER_QUE_SZ];
+	volatile uint8_t defer_que_head;
+	volatile uint8_t defer_que_tail;
+	TaskHandle_t defer_tsk_hndl;
+	struct usb_ctl_req_clbks *defer_clbks;
+	uint8_t defer_seq;
+#endif
+#if USB_CTL_REQ_TRC == 1
+	struct usb_ctl_req_trc trc_buf[USB_CTL_REQ_TRC_SZ];
+	volatile uint16_t trc_head;
+	volatile uint16_t trc_tail;
+#endif
+#if USB_CTL_REQ_INSTR == 1
+	struct usb_ctl_req_instr instr;
+	struct usb_ctl_req_req_instr *instr_req;
+	uint32_t req_tm;
+#endif
 };
 
 /**
  * init_usb_ctl_req
+ *
+ * Initializes engine instance dev (zeroed static object) bound to endpoint 0
+ * driver drv of controller hw. Engine events are recorded to binary trace
+ * (USB_CTL_REQ_TRC == 1).
+ */
+void init_usb_ctl_req(struct usb_ctl_req_dev *dev, const struct usb_ctl_req_drv *drv, void *hw);
+
+/**
+ * init_usb_ctl_req_udp
+ *
+ * Initializes engine instance dev bound to udp.h driver and registers
+ * endpoint 0 interrupt callbacks (single instance).
+ */
+void init_usb_ctl_req_udp(struct usb_ctl_req_dev *dev);
+
+/**
+ * usb_ctl_req_rxstp
+ */
+void usb_ctl_req_rxstp(struct usb_ctl_req_dev *dev);
+
+/**
+ * usb_ctl_req_txcomp
  */
-void init_usb_ctl_req(logger_t *logger);
+void usb_ctl_req_txcomp(struct usb_ctl_req_dev *dev);
+
+/**
+ * usb_ctl_req_rxdata
+ */
+void usb_ctl_req_rxdata(struct usb_ctl_req_dev *dev, int nmb);
+
+/**
+ * usb_ctl_req_stlsnt
+ */
+void usb_ctl_req_stlsnt(struct usb_ctl_req_dev *dev);
 
 /**
  * add_usb_ctl_req_std_clbks
  */
-void add_usb_ctl_req_std_clbks(struct usb_ctl_req_clbks *clbks);
+void add_usb_ctl_req_std_clbks(struct usb_ctl_req_dev *dev, struct usb_ctl_req_clbks *clbks);
 
 /**
  * add_usb_ctl_req_cls_clbks
  */
-void add_usb_ctl_req_cls_clbks(struct usb_ctl_req_clbks *clbks);
+void add_usb_ctl_req_cls_clbks(struct usb_ctl_req_dev *dev, struct usb_ctl_req_clbks *clbks);
 
 /**
  * add_usb_ctl_req_vnd_clbks
  */
-void add_usb_ctl_req_vnd_clbks(struct usb_ctl_req_clbks *clbks);
+void add_usb_ctl_req_vnd_clbks(struct usb_ctl_req_dev *dev, struct usb_ctl_req_clbks *clbks);
+
+/**
+ * add_usb_ctl_req_hndlr
+ *
+ * Registers handler of one request (call before device is attached).
+ * Registered handlers take precedence over std/cls/vnd callbacks.
+ */
+void add_usb_ctl_req_hndlr(struct usb_ctl_req_dev *dev, struct usb_ctl_req_hndlr *hndlr);
+
+/**
+ * add_usb_ctl_req_fn_clbks
+ *
+ * Registers class callbacks of composite device function (call before
+ * device is attached).
+ */
+void add_usb_ctl_req_fn_clbks(struct usb_ctl_req_dev *dev, struct usb_ctl_req_fn *fn);
+
+/**
+ * set_usb_ctl_req_fn_conf
+ *
+ * Builds class request routing from index of active configuration
+ * (call on SET_CONFIGURATION, NULL if device is not configured).
+ */
+void set_usb_ctl_req_fn_conf(struct usb_ctl_req_dev *dev, const struct usb_desc_idx *idx);
+
+/**
+ * usb_ctl_req_get_arg
+ *
+ * Returns arg of callbacks handling current request (call from callbacks,
+ * deferred callback gets arg of callbacks of its own request).
+ */
+void *usb_ctl_req_get_arg(struct usb_ctl_req_dev *dev);
+
+/**
+ * pend_usb_ctl_req
+ *
+ * Called from stp_clbk (request without data stage) or out_req_rec_clbk
+ * which returned TRUE. Status stage is NAKed until complete_usb_ctl_req()
+ * is called with returned tag (deferred callback gets tag of its own
+ * request even if new SETUP arrived meanwhile).
+ */
+int pend_usb_ctl_req(struct usb_ctl_req_dev *dev);
+
+/**
+ * complete_usb_ctl_req
+ *
+ * Finishes status stage of pending request (ack TRUE) or stalls it.
+ * Can be called from task or interrupt. Returns FALSE if request is not
+ * pending anymore (host sent new SETUP).
+ */
+boolean_t complete_usb_ctl_req(struct usb_ctl_req_dev *dev, int tag, boolean_t ack);
 
 /**
  * get_usb_ctl_req_stats
  */
-struct usb_ctl_req_stats *get_usb_ctl_req_stats(void);
+struct usb_ctl_req_stats *get_usb_ctl_req_stats(struct usb_ctl_req_dev *dev);
+
+/**
+ * snap_usb_ctl_req_stats
+ *
+ * Copies consistent snapshot of stats.
+ */
+void snap_usb_ctl_req_stats(struct usb_ctl_req_dev *dev, struct usb_ctl_req_stats *snap);
+
+/**
+ * snap_usb_ctl_req_instr
+ *
+ * Copies consistent snapshot of instrumentation (USB_CTL_REQ_INSTR == 1).
+ * Times are in USB_CTL_REQ_TMSTMP() units, RTOS ticks by default (DWT
+ * cycles if USB_CTL_REQ_DWT_TMSTMP == 1, monotonic clock ns in Linux host
+ * build).
+ */
+void snap_usb_ctl_req_instr(struct usb_ctl_req_dev *dev, struct usb_ctl_req_instr *snap);
+
+#if USB_CTL_REQ_TRC == 1
+/**
+ * drain_usb_ctl_req_trc
+ *
+ * Moves up to nmb oldest trace records to buf. Returns number of records.
+ * Must be called from single task.
+ */
+int drain_usb_ctl_req_trc(struct usb_ctl_req_dev *dev, struct usb_ctl_req_trc *buf, int nmb);
+#endif
 
 #if TERMOUT == 1
 /**
  * log_usb_ctl_req_stats
  */
-void log_usb_ctl_req_stats(void);
+void log_usb_ctl_req_stats(struct usb_ctl_req_dev *dev);
+
+/**
+ * log_usb_ctl_req_trc
+ *
+ * Drains trace and logs records as text (USB_CTL_REQ_TRC == 1).
+ */
+void log_usb_ctl_req_trc(struct usb_ctl_req_dev *dev);
 #endif
 
 #endif
@@ -0,0 +1,77 @@
+/*
+ * usb_ctl_req_trc.c
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+// Decoder does not depend on FreeRTOS and udp driver, it is built into
+// host tools as well.
+
+#include <stdint.h>
+#include <stdio.h>
+#include "usb_ctl_req_trc.h"
+
+#define ARRAY_SZ(a) ((int) (sizeof(a) / sizeof((a)[0])))
+
+static const char *const evnt_nm[] = {
+	"stp", "in", "out", "done", "stall", "err", "defer", "pend", "abort"
+};
+_Static_assert(ARRAY_SZ(evnt_nm) == USB_CTL_REQ_TRC_ABORT + 1, "evnt_nm");
+
+// Order of enum trans_state in usb_ctl_req.c.
+static const char *const state_nm[] = {
+	"idle", "data_in", "data_in_status", "data_out", "data_out_status",
+	"no_data", "no_data_status", "stall", "defer", "data_out_defer",
+	"no_data_pend", "data_out_pend"
+};
+_Static_assert(ARRAY_SZ(state_nm) == USB_CTL_REQ_TRC_STATE_NMB, "state_nm");
+
+static const char *const cause_nm[] = {
+	"no handler", "rejected", "out rejected", "more bytes received",
+	"fewer bytes received", "udp pkt_sz error", "defer queue full",
+	"bad request type", "not zero handshake pkt", "unexp txcomp",
+	"unexp rxdata", "unexp stlsnt"
+};
+_Static_assert(ARRAY_SZ(cause_nm) == USB_CTL_REQ_TRC_UNEXP_STLSNT + 1, "cause_nm");
+
+/**
+ * fmt_usb_ctl_req_trc
+ */
+int fmt_usb_ctl_req_trc(const struct usb_ctl_req_trc *trc, char *buf, int sz)
+{
+	const char *ev, *st;
+
+	ev = (trc->evnt < ARRAY_SZ(evnt_nm)) ? evnt_nm[trc->evnt] : "?";
+	st = (trc->state < ARRAY_SZ(state_nm)) ? state_nm[trc->state] : "?";
+	switch (trc->evnt) {
+	case USB_CTL_REQ_TRC_STP :
+		return (snprintf(buf, sz, "%10lu %-5s %02x %02x %02x%02x %02x%02x %02x%02x -> %s",
+				 (unsigned long) trc->tm, ev, trc->stp[0], trc->stp[1],
+				 trc->stp[3], trc->stp[2], trc->stp[5], trc->stp[4],
+				 trc->stp[7], trc->stp[6], st));
+	case USB_CTL_REQ_TRC_IN_PKT :
+		/* FALLTHRU */
+	case USB_CTL_REQ_TRC_OUT_PKT :
+		return (snprintf(buf, sz, "%10lu %-5s %u -> %s", (unsigned long) trc->tm, ev,
+				 (unsigned int) trc->arg, st));
+	case USB_CTL_REQ_TRC_STALL :
+		/* FALLTHRU */
+	case USB_CTL_REQ_TRC_ERR :
+		return (snprintf(buf, sz, "%10lu %-5s %s -> %s", (unsigned long) trc->tm, ev,
+				 (trc->arg < ARRAY_SZ(cause_nm)) ? cause_nm[trc->arg] : "?", st));
+	default :
+		return (snprintf(buf, sz, "%10lu %-5s -> %s", (unsigned long) trc->tm, ev, st));
+	}
+}
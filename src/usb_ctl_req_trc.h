@@ -0,0 +1,73 @@
+/*
+ * usb_ctl_req_trc.h
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef USB_CTL_REQ_TRC_H
+#define USB_CTL_REQ_TRC_H
+
+// Binary trace of control request engine. Header depends on <stdint.h>
+// only, so records can be decoded by host tools.
+
+enum usb_ctl_req_trc_evnt {
+	USB_CTL_REQ_TRC_STP,
+	USB_CTL_REQ_TRC_IN_PKT,
+	USB_CTL_REQ_TRC_OUT_PKT,
+	USB_CTL_REQ_TRC_DONE,
+	USB_CTL_REQ_TRC_STALL,
+	USB_CTL_REQ_TRC_ERR,
+	USB_CTL_REQ_TRC_DEFER,
+	USB_CTL_REQ_TRC_PEND,
+	USB_CTL_REQ_TRC_ABORT
+};
+
+enum usb_ctl_req_trc_cause {
+	USB_CTL_REQ_TRC_NO_HNDLR,
+	USB_CTL_REQ_TRC_REJECTED,
+	USB_CTL_REQ_TRC_OUT_REJECTED,
+	USB_CTL_REQ_TRC_MORE_BYTES,
+	USB_CTL_REQ_TRC_FEWER_BYTES,
+	USB_CTL_REQ_TRC_PKT_SZ_ERR,
+	USB_CTL_REQ_TRC_DEFER_QUE_FULL,
+	USB_CTL_REQ_TRC_BAD_REQ_TYPE,
+	USB_CTL_REQ_TRC_NZR_HS_PKT,
+	USB_CTL_REQ_TRC_UNEXP_TXCOMP,
+	USB_CTL_REQ_TRC_UNEXP_RXDATA,
+	USB_CTL_REQ_TRC_UNEXP_STLSNT
+};
+
+#define USB_CTL_REQ_TRC_STATE_NMB 12 // Engine states (record state member).
+
+// Trace record. stp holds raw setup packet (STP event), arg holds byte
+// count (IN_PKT, OUT_PKT) or cause (STALL, ERR), state is engine state
+// at time of record (ABORT record shows state of transfer cut by SETUP).
+struct usb_ctl_req_trc {
+	uint32_t tm;
+	uint8_t evnt;
+	uint8_t state;
+	uint16_t arg;
+	uint8_t stp[8];
+};
+
+/**
+ * fmt_usb_ctl_req_trc
+ *
+ * Renders trace record as text line (without newline) to buf. Returns
+ * length of text like snprintf().
+ */
+int fmt_usb_ctl_req_trc(const struct usb_ctl_req_trc *trc, char *buf, int sz);
+
+#endif
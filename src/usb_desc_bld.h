@@ -0,0 +1,147 @@
+/*
+ * usb_desc_bld.h
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef USB_DESC_BLD_H
+#define USB_DESC_BLD_H
+
+/*
+ * Compile-time descriptor builder.
+ *
+ * Configuration is described by list macros and emitted as one packed
+ * const object (flash). w_total_size, b_num_interfaces and b_num_endpoints
+ * are computed, inconsistent trees fail with _Static_assert.
+ *
+ * #define COMM_CS(CS) \
+ *         CS(struct usb_cdc_head_desc, head, usb_cdc_head_desc_init(USB_CDC_CDC1_10_VER_BCD)) \
+ *         CS(struct usb_cdc_union_desc, uni, usb_cdc_union_desc_init(0, 1))
+ * #define COMM_EP(EP) \
+ *         EP(ntf, usb_std_endp_addr(3, USB_STD_IN_ENDP), USB_STD_TRANS_INTERRUPT, 8, 16)
+ * #define DATA_EP(EP) \
+ *         EP(out, usb_std_endp_addr(1, USB_STD_OUT_ENDP), USB_STD_TRANS_BULK, 64, 0) \
+ *         EP(in, usb_std_endp_addr(2, USB_STD_IN_ENDP), USB_STD_TRANS_BULK, 64, 0)
+ * #define CONF(IAD, IFACE) \
+ *         IAD(iad, 0, 2, 2, 2, 0, 0) \
+ *         IFACE(comm, 0, 0, 2, 2, 0, 0, COMM_CS, COMM_EP) \
+ *         IFACE(data, 1, 0, 0x0A, 0, 0, 0, USB_DESC_BLD_NONE, DATA_EP)
+ *
+ * USB_DESC_BLD_CONF(conf_desc, CONF, 1, 0, USB_STD_BUS_POWER_NO_RWAKE,
+ *                   usb_std_max_power_mamp(100));
+ *
+ * IAD(name, first_iface, iface_count, class, subclass, protocol, i_function)
+ * IFACE(name, num, alt, class, subclass, protocol, i_interface, CS_LIST, EP_LIST)
+ * CS(type, name, initializer)
+ * EP(name, address, attributes, max_packet_size, interval)
+ *
+ * Names become members of struct <conf>_desc and must be unique.
+ */
+
+#define USB_DESC_BLD_NONE(X)
+#define USB_DESC_BLD_NOP(...)
+
+#define USB_DESC_BLD_ONE(...) + 1
+#define USB_DESC_BLD_EP_BIT(name, addr, attr, mps, ival) | (1UL << usb_desc_idx_endp_ix(addr))
+#define USB_DESC_BLD_EP_MEMB(name, addr, attr, mps, ival) struct usb_endp_desc name;
+#define USB_DESC_BLD_EP_INIT(name, addr, attr, mps, ival) \
+	.name = {sizeof(struct usb_endp_desc), USB_ENDP_DESC, (addr), (attr), (mps), (ival)},
+#define USB_DESC_BLD_CS_MEMB(type, name, init) type name;
+#define USB_DESC_BLD_CS_INIT(type, name, init) .name = init,
+
+#define USB_DESC_BLD_IAD_MEMB(name, first, cnt, cls, sub, prot, i) \
+	struct usb_iface_assoc_desc name;
+#define USB_DESC_BLD_IAD_INIT(name, first, cnt, cls, sub, prot, i) \
+	.name = {sizeof(struct usb_iface_assoc_desc), USB_IFACE_ASSOC_DESC, (first), (cnt), \
+                 (cls), (sub), (prot), (i)},
+#define USB_DESC_BLD_IAD_LAST_BIT(name, first, cnt, cls, sub, prot, i) \
+	| (1UL << ((first) + (cnt) - 1))
+
+#define USB_DESC_BLD_IFACE_MEMB(name, num, alt, cls, sub, prot, i, CS, EP) \
+	struct usb_iface_desc name; \
+	CS(USB_DESC_BLD_CS_MEMB) \
+	EP(USB_DESC_BLD_EP_MEMB)
+#define USB_DESC_BLD_IFACE_INIT(name, num, alt, cls, sub, prot, i, CS, EP) \
+	.name = {sizeof(struct usb_iface_desc), USB_IFACE_DESC, (num), (alt), \
+                 (0 EP(USB_DESC_BLD_ONE)), (cls), (sub), (prot), (i)}, \
+	CS(USB_DESC_BLD_CS_INIT) \
+	EP(USB_DESC_BLD_EP_INIT)
+#define USB_DESC_BLD_IFACE_CNT(name, num, alt, cls, sub, prot, i, CS, EP) \
+	+ ((alt) == 0)
+#define USB_DESC_BLD_IFACE_NUM_BIT(name, num, alt, cls, sub, prot, i, CS, EP) \
+	| ((alt) == 0 ? 1UL << (num) : 0)
+#define USB_DESC_BLD_IFACE_EP_CNT(name, num, alt, cls, sub, prot, i, CS, EP) \
+	+ ((alt) == 0 ? (0 EP(USB_DESC_BLD_ONE)) : 0)
+#define USB_DESC_BLD_IFACE_EP_BITS(name, num, alt, cls, sub, prot, i, CS, EP) \
+	| ((alt) == 0 ? (0 EP(USB_DESC_BLD_EP_BIT)) : 0)
+#define USB_DESC_BLD_IFACE_CHK(name, num, alt, cls, sub, prot, i, CS, EP) \
+	_Static_assert(__builtin_popcountl(0 EP(USB_DESC_BLD_EP_BIT)) == (0 EP(USB_DESC_BLD_ONE)), \
+                       "usb_desc_bld: duplicate endpoint address in " #name); \
+	_Static_assert(((0 EP(USB_DESC_BLD_EP_BIT)) & ((1UL << 16) | 1UL)) == 0, \
+                       "usb_desc_bld: endpoint 0 in " #name);
+
+/**
+ * USB_DESC_BLD_CONF
+ *
+ * Defines struct name##_desc and const object name (configuration blob).
+ */
+#define USB_DESC_BLD_CONF(name, TREE, value, i_conf, attr, power) \
+	struct name##_desc { \
+		struct usb_conf_desc conf; \
+		TREE(USB_DESC_BLD_IAD_MEMB, USB_DESC_BLD_IFACE_MEMB) \
+	} __attribute__ ((__packed__)); \
+	enum {name##_iface_nmb = 0 TREE(USB_DESC_BLD_NOP, USB_DESC_BLD_IFACE_CNT)}; \
+	TREE(USB_DESC_BLD_NOP, USB_DESC_BLD_IFACE_CHK) \
+	_Static_assert((0 TREE(USB_DESC_BLD_NOP, USB_DESC_BLD_IFACE_NUM_BIT)) == \
+                       (1UL << name##_iface_nmb) - 1, \
+                       "usb_desc_bld: interface numbers of " #name " not 0..n-1"); \
+	_Static_assert(__builtin_popcountl(0 TREE(USB_DESC_BLD_NOP, USB_DESC_BLD_IFACE_EP_BITS)) == \
+                       (0 TREE(USB_DESC_BLD_NOP, USB_DESC_BLD_IFACE_EP_CNT)), \
+                       "usb_desc_bld: endpoint address used by two interfaces of " #name); \
+	_Static_assert((0 TREE(USB_DESC_BLD_IAD_LAST_BIT, USB_DESC_BLD_NOP)) < \
+                       (1UL << name##_iface_nmb), \
+                       "usb_desc_bld: IAD of " #name " refers to missing interface"); \
+	const struct name##_desc name = { \
+		.conf = {sizeof(struct usb_conf_desc), USB_CONF_DESC, sizeof(struct name##_desc), \
+                         name##_iface_nmb, (value), (i_conf), (attr), (power)}, \
+		TREE(USB_DESC_BLD_IAD_INIT, USB_DESC_BLD_IFACE_INIT) \
+	}
+
+/**
+ * USB_DESC_BLD_STR
+ *
+ * Defines string descriptor from UTF-16 literal, e.g. USB_DESC_BLD_STR(prod, u"Device").
+ */
+#define USB_DESC_BLD_STR(name, lit) \
+	const struct { \
+		uint8_t size; \
+		uint8_t type; \
+		uint16_t str[sizeof(lit) / 2 - 1]; \
+	} __attribute__ ((__packed__)) name = {sizeof(lit), USB_STR_DESC, lit}
+
+/**
+ * USB_DESC_BLD_LANGID
+ *
+ * Defines string descriptor zero, e.g. USB_DESC_BLD_LANGID(langid, USB_STD_LANGID_EN_US).
+ */
+#define USB_DESC_BLD_LANGID(name, ...) \
+	const struct { \
+		uint8_t size; \
+		uint8_t type; \
+		uint16_t langid[sizeof((uint16_t []) {__VA_ARGS__}) / 2]; \
+	} __attribute__ ((__packed__)) name = {2 + sizeof((uint16_t []) {__VA_ARGS__}), USB_STR_DESC, \
+                                               {__VA_ARGS__}}
+
+#endif
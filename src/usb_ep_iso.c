@@ -0,0 +1,297 @@
+/*
+ * usb_ep_iso.c
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <gentyp.h>
+#include "sysconf.h"
+#include "criterr.h"
+#include "udp.h"
+#include "usb_std_def.h"
+#include "usb_ep_ring.h"
+#include "usb_ep_iso.h"
+
+#define ONE_SAMPLE (1UL << 16)
+
+static void send_pkt(struct usb_ep_iso *iso);
+static void update_fb(struct usb_ep_iso *iso);
+static void copy_in(struct usb_ep_iso *iso, const uint8_t *buf, int nmb);
+static void copy_out(struct usb_ep_iso *iso, uint8_t *buf, int nmb);
+
+/**
+ * init_usb_ep_iso
+ */
+void init_usb_ep_iso(struct usb_ep_iso *iso, const struct usb_ep_ring_drv *drv, void *hw,
+		     const struct usb_endp_desc *desc, uint8_t *buf, int sz)
+{
+	switch (usb_endp_desc_get_ep_type(desc)) {
+	case UDP_ISO_IN_ENDP :
+		iso->in = TRUE;
+		break;
+	case UDP_ISO_OUT_ENDP :
+		iso->in = FALSE;
+		break;
+	default :
+		crit_err_exit(BAD_PARAMETER);
+		break;
+	}
+	iso->mps = desc->w_max_packet_size & 0x7FF;
+	if (sz & (sz - 1) || sz < 2 * iso->mps || sz > 32768 || (iso->fps != 1000 && iso->fps != 8000) ||
+	    iso->frame_sz == 0 || iso->rate == 0 || (iso->rate / iso->fps + 1) * iso->frame_sz > iso->mps) {
+		crit_err_exit(BAD_PARAMETER);
+	}
+	iso->drv = drv;
+	iso->hw = hw;
+	iso->addr = desc->b_endpoint_address;
+	iso->buf = buf;
+	iso->msk = sz - 1;
+	iso->nom = ((uint64_t) iso->rate << 16) / iso->fps;
+	reset_usb_ep_iso(iso);
+}
+
+/**
+ * reset_usb_ep_iso
+ */
+void reset_usb_ep_iso(struct usb_ep_iso *iso)
+{
+	UBaseType_t msk;
+
+	msk = taskENTER_CRITICAL_FROM_ISR();
+	iso->head = iso->tail = 0;
+	iso->acc = 0;
+	iso->flt = 0;
+	iso->fb = iso->nom;
+	memset(&iso->stats, 0, sizeof(struct usb_ep_iso_stats));
+	if (!iso->in) {
+		// First feedback packet (nominal rate), next ones are written
+		// by usb_ep_iso_fb_done().
+		usb_ep_iso_fb_done(iso);
+	}
+	taskEXIT_CRITICAL_FROM_ISR(msk);
+}
+
+/**
+ * usb_ep_iso_avail
+ */
+int usb_ep_iso_avail(struct usb_ep_iso *iso)
+{
+	return ((uint16_t) (iso->head - iso->tail));
+}
+
+/**
+ * usb_ep_iso_write
+ */
+int usb_ep_iso_write(struct usb_ep_iso *iso, const void *buf, int nmb)
+{
+	int n;
+
+	n = iso->msk + 1 - usb_ep_iso_avail(iso);
+	if (n < nmb) {
+		iso->stats.overrun_cnt++;
+	} else {
+		n = nmb;
+	}
+	copy_in(iso, buf, n);
+	iso->head += n;
+	return (n);
+}
+
+/**
+ * usb_ep_iso_read
+ */
+void usb_ep_iso_read(struct usb_ep_iso *iso, void *buf, int nmb)
+{
+	int n;
+
+	n = usb_ep_iso_avail(iso);
+	if (n < nmb) {
+		memset((uint8_t *) buf + n, 0, nmb - n);
+		iso->stats.underrun_cnt++;
+	} else {
+		n = nmb;
+	}
+	copy_out(iso, buf, n);
+	iso->tail += n;
+}
+
+/**
+ * usb_ep_iso_sof
+ */
+void usb_ep_iso_sof(struct usb_ep_iso *iso)
+{
+	if (iso->in) {
+		send_pkt(iso);
+	} else {
+		update_fb(iso);
+	}
+}
+
+/**
+ * send_pkt
+ *
+ * Nominal rate gives whole samples per frame, fraction is carried over.
+ * Fill level off half of ring by more than one packet adds or removes
+ * one sample.
+ */
+static void send_pkt(struct usb_ep_iso *iso)
+{
+	int n, avail, half, offs, sz;
+
+	iso->acc += iso->nom;
+	n = (iso->acc >> 16) * iso->frame_sz;
+	iso->acc &= ONE_SAMPLE - 1;
+	avail = usb_ep_iso_avail(iso);
+	half = (iso->msk + 1) / 2;
+	if (avail > half + n && n + iso->frame_sz <= iso->mps) {
+		n += iso->frame_sz;
+	} else if (avail < half - n && n) {
+		n -= iso->frame_sz;
+	}
+	if (avail < n) {
+		iso->stats.underrun_cnt++;
+		n = avail - avail % iso->frame_sz;
+	}
+	offs = iso->tail & iso->msk;
+	sz = iso->msk + 1 - offs;
+	if (sz >= n) {
+		iso->drv->write_fifo(iso->hw, iso->addr, iso->buf + offs, n);
+	} else {
+		iso->drv->write_fifo(iso->hw, iso->addr, iso->buf + offs, sz);
+		iso->drv->write_fifo(iso->hw, iso->addr, iso->buf, n - sz);
+	}
+	iso->tail += n;
+	iso->drv->tx_pkt_rdy(iso->hw, iso->addr);
+}
+
+/**
+ * update_fb
+ *
+ * Proportional control of fill level around half of ring. flt is fill
+ * level (bytes, 4 fractional bits) averaged over 8 frames.
+ */
+static void update_fb(struct usb_ep_iso *iso)
+{
+	int32_t err;
+
+	iso->flt += ((usb_ep_iso_avail(iso) << 4) - iso->flt) >> 3;
+	err = ((iso->msk + 1) / 2 << 4) - iso->flt;
+	// Bytes (4 fractional bits) to samples (16 fractional bits).
+	err = (int32_t) (((int64_t) err << 12) / iso->frame_sz) >> USB_EP_ISO_FB_SHIFT;
+	if (err > (int32_t) ONE_SAMPLE) {
+		err = ONE_SAMPLE;
+	} else if (err < -(int32_t) ONE_SAMPLE) {
+		err = -(int32_t) ONE_SAMPLE;
+	}
+	iso->fb = iso->nom + err;
+}
+
+/**
+ * usb_ep_iso_out_rcv
+ */
+void usb_ep_iso_out_rcv(struct usb_ep_iso *iso, int nmb)
+{
+	int offs, sz;
+
+	if (nmb > iso->msk + 1 - usb_ep_iso_avail(iso)) {
+		// Isochronous packet can not be held back.
+		iso->stats.overrun_cnt++;
+	} else {
+		offs = iso->head & iso->msk;
+		sz = iso->msk + 1 - offs;
+		if (sz >= nmb) {
+			iso->drv->read_fifo(iso->hw, iso->addr, iso->buf + offs, nmb);
+		} else {
+			iso->drv->read_fifo(iso->hw, iso->addr, iso->buf + offs, sz);
+			iso->drv->read_fifo(iso->hw, iso->addr, iso->buf, nmb - sz);
+		}
+		iso->head += nmb;
+	}
+	iso->drv->rx_done(iso->hw, iso->addr);
+}
+
+/**
+ * usb_ep_iso_fb_done
+ */
+void usb_ep_iso_fb_done(struct usb_ep_iso *iso)
+{
+	uint32_t v;
+
+	if (!iso->fb_addr) {
+		return;
+	}
+	v = (iso->fps == 1000) ? iso->fb >> 2 : iso->fb;
+	iso->fb_pkt[0] = v;
+	iso->fb_pkt[1] = v >> 8;
+	iso->fb_pkt[2] = v >> 16;
+	iso->fb_pkt[3] = v >> 24;
+	iso->drv->write_fifo(iso->hw, iso->fb_addr, iso->fb_pkt, (iso->fps == 1000) ? 3 : 4);
+	iso->drv->tx_pkt_rdy(iso->hw, iso->fb_addr);
+}
+
+/**
+ * usb_ep_iso_get_fb
+ */
+uint32_t usb_ep_iso_get_fb(struct usb_ep_iso *iso)
+{
+	return (iso->fb);
+}
+
+/**
+ * usb_ep_iso_get_stats
+ */
+void usb_ep_iso_get_stats(struct usb_ep_iso *iso, struct usb_ep_iso_stats *stats)
+{
+	taskENTER_CRITICAL();
+	*stats = iso->stats;
+	taskEXIT_CRITICAL();
+}
+
+/**
+ * copy_in
+ */
+static void copy_in(struct usb_ep_iso *iso, const uint8_t *buf, int nmb)
+{
+	int offs, sz;
+
+	offs = iso->head & iso->msk;
+	sz = iso->msk + 1 - offs;
+	if (sz >= nmb) {
+		memcpy(iso->buf + offs, buf, nmb);
+	} else {
+		memcpy(iso->buf + offs, buf, sz);
+		memcpy(iso->buf, buf + sz, nmb - sz);
+	}
+}
+
+/**
+ * copy_out
+ */
+static void copy_out(struct usb_ep_iso *iso, uint8_t *buf, int nmb)
+{
+	int offs, sz;
+
+	offs = iso->tail & iso->msk;
+	sz = iso->msk + 1 - offs;
+	if (sz >= nmb) {
+		memcpy(buf, iso->buf + offs, nmb);
+	} else {
+		memcpy(buf, iso->buf + offs, sz);
+		memcpy(buf + sz, iso->buf, nmb - sz);
+	}
+}
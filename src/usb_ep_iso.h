@@ -0,0 +1,140 @@
+/*
+ * usb_ep_iso.h
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef USB_EP_ISO_H
+#define USB_EP_ISO_H
+
+#ifndef USB_EP_ISO_FB_SHIFT
+ #define USB_EP_ISO_FB_SHIFT 8 // Feedback gain 2^-n sample/frame per sample of fill error.
+#endif
+
+// Isochronous stream counters.
+struct usb_ep_iso_stats {
+	unsigned int underrun_cnt;
+	unsigned int overrun_cnt;
+};
+
+// Isochronous streaming endpoint (driver ops of usb_ep_ring). Stream of
+// sample frames (frame_sz bytes) at rate Hz is kept in ring which is
+// fed and drained in (micro)frames given by fps (1000 full speed, 8000
+// high speed). IN packets are sized from nominal rate and trimmed by one
+// sample when fill level drifts from half of ring. OUT stream reports
+// rate derived from fill level to feedback endpoint fb_addr (0 if none),
+// 10.14 format at full speed, 16.16 at high speed. Members after arg are
+// private.
+struct usb_ep_iso {
+	const struct usb_ep_ring_drv *drv;
+	void *hw;
+	uint8_t fb_addr;
+	uint16_t fps;
+	uint16_t frame_sz;
+	uint32_t rate;
+	void *arg; // Free for application.
+	uint8_t addr;
+	boolean_t in;
+	uint16_t mps;
+	uint8_t *buf;
+	uint16_t msk;
+	volatile uint16_t head;
+	volatile uint16_t tail;
+	uint32_t nom;
+	uint32_t acc;
+	int32_t flt;
+	uint32_t fb;
+	uint8_t fb_pkt[4];
+	struct usb_ep_iso_stats stats;
+};
+
+/**
+ * init_usb_ep_iso
+ *
+ * Binds stream to isochronous endpoint desc (fb_addr, fps, frame_sz and
+ * rate must be set). sz (buf size) must be power of 2, at least two max
+ * packet sizes and not greater than 32768.
+ */
+void init_usb_ep_iso(struct usb_ep_iso *iso, const struct usb_ep_ring_drv *drv, void *hw,
+		     const struct usb_endp_desc *desc, uint8_t *buf, int sz);
+
+/**
+ * reset_usb_ep_iso
+ *
+ * Empties ring, restores nominal rate and clears counters (call when
+ * streaming alternate setting is selected, from task or from SET_INTERFACE
+ * handler in interrupt). OUT stream with feedback endpoint gets its first
+ * feedback packet (nominal rate) written here, driver then calls
+ * usb_ep_iso_fb_done() after every sent one.
+ */
+void reset_usb_ep_iso(struct usb_ep_iso *iso);
+
+/**
+ * usb_ep_iso_write
+ *
+ * Copies up to nmb bytes to IN stream. Returns number of bytes queued,
+ * shortfall is counted as overrun.
+ */
+int usb_ep_iso_write(struct usb_ep_iso *iso, const void *buf, int nmb);
+
+/**
+ * usb_ep_iso_read
+ *
+ * Moves nmb bytes of OUT stream to buf, missing bytes are filled with
+ * zeros and counted as underrun.
+ */
+void usb_ep_iso_read(struct usb_ep_iso *iso, void *buf, int nmb);
+
+/**
+ * usb_ep_iso_avail
+ */
+int usb_ep_iso_avail(struct usb_ep_iso *iso);
+
+/**
+ * usb_ep_iso_sof
+ *
+ * Called from SOF interrupt each (micro)frame. Sends IN packet, updates
+ * fill level filter and feedback value of OUT stream.
+ */
+void usb_ep_iso_sof(struct usb_ep_iso *iso);
+
+/**
+ * usb_ep_iso_out_rcv
+ *
+ * Driver reports received OUT packet of nmb bytes (packet which does not
+ * fit is dropped and counted as overrun).
+ */
+void usb_ep_iso_out_rcv(struct usb_ep_iso *iso, int nmb);
+
+/**
+ * usb_ep_iso_fb_done
+ *
+ * Driver reports sent feedback packet, next one is written.
+ */
+void usb_ep_iso_fb_done(struct usb_ep_iso *iso);
+
+/**
+ * usb_ep_iso_get_fb
+ *
+ * Returns feedback in samples per (micro)frame, 16.16 fixed point.
+ */
+uint32_t usb_ep_iso_get_fb(struct usb_ep_iso *iso);
+
+/**
+ * usb_ep_iso_get_stats
+ */
+void usb_ep_iso_get_stats(struct usb_ep_iso *iso, struct usb_ep_iso_stats *stats);
+
+#endif
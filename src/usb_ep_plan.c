@@ -0,0 +1,210 @@
+/*
+ * usb_ep_plan.c
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+#include <FreeRTOS.h>
+#include <gentyp.h>
+#include "sysconf.h"
+#include "criterr.h"
+#include "udp.h"
+#include "usb_std_def.h"
+#include "usb_ep_plan.h"
+
+static int alt_ram_sz(struct usb_ep_plan *plan, const struct usb_desc_idx *idx, int num, int alt);
+static void add_alt(struct usb_ep_plan *plan, struct usb_ep_plan_conf *c, int num, int alt, int base);
+static int ep_ram_sz(struct usb_ep_plan *plan, const struct usb_endp_desc *desc);
+
+/**
+ * init_usb_ep_plan
+ */
+void init_usb_ep_plan(struct usb_ep_plan *plan, const struct usb_ep_plan_drv *drv, void *hw,
+		      int ram_sz, int banks)
+{
+	if (banks < 1 || banks > 2) {
+		crit_err_exit(BAD_PARAMETER);
+	}
+	plan->drv = drv;
+	plan->hw = hw;
+	plan->ram_sz = ram_sz;
+	plan->banks = banks;
+	plan->conf_nmb = 0;
+	plan->act = NULL;
+	memset(plan->iface_msk, 0, sizeof(plan->iface_msk));
+}
+
+/**
+ * add_usb_ep_plan_conf
+ */
+const struct usb_ep_plan_conf *add_usb_ep_plan_conf(struct usb_ep_plan *plan, const struct usb_desc_idx *idx)
+{
+	struct usb_ep_plan_conf *c;
+	int base[USB_DESC_IDX_IFACE_NMB];
+	int i, a, sz, max, offs = 0;
+
+	if (plan->conf_nmb == USB_EP_PLAN_CONF_NMB) {
+		crit_err_exit(BAD_PARAMETER);
+	}
+	c = &plan->conf[plan->conf_nmb];
+	c->idx = idx;
+	c->ep_nmb = 0;
+	for (i = 0; i < USB_DESC_IDX_IFACE_NMB; i++) {
+		base[i] = offs;
+		max = 0;
+		for (a = 0; a < usb_desc_idx_get_alt_nmb(idx, i); a++) {
+			if ((sz = alt_ram_sz(plan, idx, i, a)) > max) {
+				max = sz;
+			}
+		}
+		offs += max;
+	}
+	if (offs > plan->ram_sz) {
+		crit_err_exit(BAD_PARAMETER);
+	}
+	c->ram_sz = offs;
+	for (i = 0; i < USB_DESC_IDX_IFACE_NMB; i++) {
+		if (usb_desc_idx_get_alt_nmb(idx, i)) {
+			add_alt(plan, c, i, 0, base[i]);
+		}
+	}
+	c->alt0_nmb = c->ep_nmb;
+	for (i = 0; i < USB_DESC_IDX_IFACE_NMB; i++) {
+		for (a = 1; a < usb_desc_idx_get_alt_nmb(idx, i); a++) {
+			add_alt(plan, c, i, a, base[i]);
+		}
+	}
+	plan->conf_nmb++;
+	return (c);
+}
+
+/**
+ * alt_ram_sz
+ */
+static int alt_ram_sz(struct usb_ep_plan *plan, const struct usb_desc_idx *idx, int num, int alt)
+{
+	struct usb_desc_iter iter;
+	const struct usb_gen_desc *d;
+	int sz = 0;
+
+	usb_desc_idx_get_iface_iter(idx, num, alt, &iter);
+	while ((d = usb_desc_iter_next(&iter, USB_ENDP_DESC))) {
+		sz += ep_ram_sz(plan, (const struct usb_endp_desc *) d);
+	}
+	return (sz);
+}
+
+/**
+ * add_alt
+ */
+static void add_alt(struct usb_ep_plan *plan, struct usb_ep_plan_conf *c, int num, int alt, int base)
+{
+	struct usb_desc_iter iter;
+	const struct usb_gen_desc *d;
+	const struct usb_endp_desc *ed;
+	struct usb_ep_plan_alt *pa;
+	struct usb_ep_plan_ep *ep;
+
+	pa = &c->alt[c->idx->iface_alt0[num] + alt];
+	pa->first = c->ep_nmb;
+	pa->nmb = 0;
+	usb_desc_idx_get_iface_iter(c->idx, num, alt, &iter);
+	while ((d = usb_desc_iter_next(&iter, USB_ENDP_DESC))) {
+		if (c->ep_nmb == USB_EP_PLAN_EP_NMB) {
+			crit_err_exit(BAD_PARAMETER);
+		}
+		ed = (const struct usb_endp_desc *) d;
+		ep = &c->ep[c->ep_nmb++];
+		ep->addr = ed->b_endpoint_address;
+		ep->type = usb_endp_desc_get_ep_type(ed);
+		ep->ival = ed->b_interval;
+		ep->iface = num;
+		ep->mps = ed->w_max_packet_size & 0x7FF;
+		ep->ram_offs = base;
+		ep->ram_sz = ep_ram_sz(plan, ed);
+		base += ep->ram_sz;
+		pa->nmb++;
+	}
+}
+
+/**
+ * ep_ram_sz
+ */
+static int ep_ram_sz(struct usb_ep_plan *plan, const struct usb_endp_desc *desc)
+{
+	int sz;
+
+	sz = plan->banks * (desc->w_max_packet_size & 0x7FF);
+	return ((sz + USB_EP_PLAN_RAM_ALIGN - 1) & ~(USB_EP_PLAN_RAM_ALIGN - 1));
+}
+
+/**
+ * usb_ep_plan_set_conf
+ */
+boolean_t usb_ep_plan_set_conf(struct usb_ep_plan *plan, const struct usb_desc_idx *idx)
+{
+	const struct usb_ep_plan_conf *c = NULL;
+	uint32_t dis_msk = 0;
+	int i;
+
+	if (idx) {
+		for (i = 0; i < plan->conf_nmb; i++) {
+			if (plan->conf[i].idx == idx) {
+				c = &plan->conf[i];
+				break;
+			}
+		}
+		if (c == NULL) {
+			return (FALSE);
+		}
+	}
+	for (i = 0; i < USB_DESC_IDX_IFACE_NMB; i++) {
+		dis_msk |= plan->iface_msk[i];
+		plan->iface_msk[i] = 0;
+	}
+	plan->act = c;
+	if (c) {
+		for (i = 0; i < c->alt0_nmb; i++) {
+			plan->iface_msk[c->ep[i].iface] |= 1UL << usb_desc_idx_endp_ix(c->ep[i].addr);
+		}
+		plan->drv->config(plan->hw, dis_msk, c->ep, c->alt0_nmb);
+	} else {
+		plan->drv->config(plan->hw, dis_msk, NULL, 0);
+	}
+	return (TRUE);
+}
+
+/**
+ * usb_ep_plan_set_iface
+ */
+boolean_t usb_ep_plan_set_iface(struct usb_ep_plan *plan, int iface, int alt)
+{
+	const struct usb_ep_plan_alt *pa;
+	uint32_t dis_msk;
+	int i;
+
+	if (!plan->act || alt < 0 || alt >= usb_desc_idx_get_alt_nmb(plan->act->idx, iface)) {
+		return (FALSE);
+	}
+	pa = &plan->act->alt[plan->act->idx->iface_alt0[iface] + alt];
+	dis_msk = plan->iface_msk[iface];
+	plan->iface_msk[iface] = 0;
+	for (i = pa->first; i < pa->first + pa->nmb; i++) {
+		plan->iface_msk[iface] |= 1UL << usb_desc_idx_endp_ix(plan->act->ep[i].addr);
+	}
+	plan->drv->config(plan->hw, dis_msk, &plan->act->ep[pa->first], pa->nmb);
+	return (TRUE);
+}
@@ -0,0 +1,112 @@
+/*
+ * usb_ep_plan.h
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef USB_EP_PLAN_H
+#define USB_EP_PLAN_H
+
+#ifndef USB_EP_PLAN_CONF_NMB
+ #define USB_EP_PLAN_CONF_NMB 1
+#endif
+#ifndef USB_EP_PLAN_EP_NMB
+ #define USB_EP_PLAN_EP_NMB 16
+#endif
+#ifndef USB_EP_PLAN_RAM_ALIGN
+ #define USB_EP_PLAN_RAM_ALIGN 8 // Power of 2.
+#endif
+
+// Endpoint configuration. ram_offs and ram_sz describe endpoint buffer
+// (banks * max packet size, aligned) in controller DPRAM.
+struct usb_ep_plan_ep {
+	uint8_t addr;
+	uint8_t type; // enum udp_endp_type
+	uint8_t ival;
+	uint8_t iface;
+	uint16_t mps;
+	uint16_t ram_offs;
+	uint16_t ram_sz;
+};
+
+// Endpoints of alternate setting (ep[first], ... ep[first + nmb - 1]).
+struct usb_ep_plan_alt {
+	uint8_t first;
+	uint8_t nmb;
+};
+
+// Plan of configuration. Endpoints of alternate settings 0 are stored
+// first (ep[0], ... ep[alt0_nmb - 1]). Interfaces own disjoint DPRAM
+// regions sized by their largest alternate setting, so any combination
+// of alternate settings fits.
+struct usb_ep_plan_conf {
+	const struct usb_desc_idx *idx;
+	struct usb_ep_plan_alt alt[USB_DESC_IDX_ALT_NMB]; // Indexed as idx->alt[].
+	struct usb_ep_plan_ep ep[USB_EP_PLAN_EP_NMB];
+	uint8_t ep_nmb;
+	uint8_t alt0_nmb;
+	uint16_t ram_sz;
+};
+
+// Controller driver. config disables endpoints in dis_msk (bitmap by
+// usb_desc_idx_endp_ix()) and configures endpoints ep in one batch.
+struct usb_ep_plan_drv {
+	void (*config)(void *hw, uint32_t dis_msk, const struct usb_ep_plan_ep *ep, int nmb);
+};
+
+struct usb_ep_plan {
+	const struct usb_ep_plan_drv *drv;
+	void *hw;
+	int ram_sz;
+	uint8_t banks;
+	struct usb_ep_plan_conf conf[USB_EP_PLAN_CONF_NMB];
+	uint8_t conf_nmb;
+	const struct usb_ep_plan_conf *act;
+	uint32_t iface_msk[USB_DESC_IDX_IFACE_NMB];
+};
+
+/**
+ * init_usb_ep_plan
+ *
+ * ram_sz is size of endpoint DPRAM, banks number of buffers per endpoint.
+ */
+void init_usb_ep_plan(struct usb_ep_plan *plan, const struct usb_ep_plan_drv *drv, void *hw,
+		      int ram_sz, int banks);
+
+/**
+ * add_usb_ep_plan_conf
+ *
+ * Precomputes plan of configuration (call at init, before device is
+ * attached). Configuration which does not fit into DPRAM is fatal error.
+ */
+const struct usb_ep_plan_conf *add_usb_ep_plan_conf(struct usb_ep_plan *plan, const struct usb_desc_idx *idx);
+
+/**
+ * usb_ep_plan_set_conf
+ *
+ * Applies plan on SET_CONFIGURATION (idx NULL disables all endpoints).
+ * Returns FALSE if configuration has no plan. Called from set_conf hook
+ * of usb_std_req.
+ */
+boolean_t usb_ep_plan_set_conf(struct usb_ep_plan *plan, const struct usb_desc_idx *idx);
+
+/**
+ * usb_ep_plan_set_iface
+ *
+ * Applies plan on SET_INTERFACE (set_iface hook of usb_std_req).
+ */
+boolean_t usb_ep_plan_set_iface(struct usb_ep_plan *plan, int iface, int alt);
+
+#endif
@@ -0,0 +1,354 @@
+/*
+ * usb_ep_ring.c
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <gentyp.h>
+#include "sysconf.h"
+#include "criterr.h"
+#include "udp.h"
+#include "usb_std_def.h"
+#include "usb_ep_ring.h"
+
+static void send_pkt(struct usb_ep_ring *ep);
+static int copy_in(struct usb_ep_ring *ep, const void *buf, int nmb);
+static void read_pkt(struct usb_ep_ring *ep, int nmb);
+
+/**
+ * init_usb_ep_ring
+ */
+void init_usb_ep_ring(struct usb_ep_ring *ep, const struct usb_ep_ring_drv *drv, void *hw,
+		      const struct usb_endp_desc *desc, uint8_t *buf, int sz)
+{
+	switch (usb_endp_desc_get_ep_type(desc)) {
+	case UDP_BULK_IN_ENDP :
+	case UDP_BULK_OUT_ENDP :
+	case UDP_INT_IN_ENDP :
+	case UDP_INT_OUT_ENDP :
+		break;
+	default :
+		crit_err_exit(BAD_PARAMETER);
+		break;
+	}
+	ep->mps = desc->w_max_packet_size & 0x7FF;
+	if (sz & (sz - 1) || sz < ep->mps || sz > 32768) {
+		crit_err_exit(BAD_PARAMETER);
+	}
+	ep->drv = drv;
+	ep->hw = hw;
+	ep->addr = desc->b_endpoint_address;
+	ep->buf = buf;
+	ep->msk = sz - 1;
+	reset_usb_ep_ring(ep);
+}
+
+/**
+ * reset_usb_ep_ring
+ */
+void reset_usb_ep_ring(struct usb_ep_ring *ep)
+{
+	UBaseType_t msk;
+
+	msk = taskENTER_CRITICAL_FROM_ISR();
+	ep->head = ep->tail = 0;
+	ep->busy = FALSE;
+	ep->last_full = FALSE;
+	ep->flush = FALSE;
+	ep->out_pend = 0;
+	ep->end_head = ep->end_tail = 0;
+	taskEXIT_CRITICAL_FROM_ISR(msk);
+}
+
+/**
+ * usb_ep_ring_avail
+ */
+int usb_ep_ring_avail(struct usb_ep_ring *ep)
+{
+	return ((uint16_t) (ep->head - ep->tail));
+}
+
+/**
+ * usb_ep_ring_free
+ */
+int usb_ep_ring_free(struct usb_ep_ring *ep)
+{
+	return (ep->msk + 1 - (uint16_t) (ep->head - ep->tail));
+}
+
+/**
+ * usb_ep_ring_reserve
+ */
+uint8_t *usb_ep_ring_reserve(struct usb_ep_ring *ep, int *nmb)
+{
+	int n, offs;
+
+	offs = ep->head & ep->msk;
+	n = usb_ep_ring_free(ep);
+	if (n > ep->msk + 1 - offs) {
+		n = ep->msk + 1 - offs;
+	}
+	*nmb = n;
+	return (ep->buf + offs);
+}
+
+/**
+ * usb_ep_ring_commit
+ */
+void usb_ep_ring_commit(struct usb_ep_ring *ep, int nmb)
+{
+	UBaseType_t msk;
+
+	ep->head += nmb;
+	msk = taskENTER_CRITICAL_FROM_ISR();
+	if (!ep->busy) {
+		send_pkt(ep);
+	}
+	taskEXIT_CRITICAL_FROM_ISR(msk);
+}
+
+/**
+ * usb_ep_ring_write
+ */
+int usb_ep_ring_write(struct usb_ep_ring *ep, const void *buf, int nmb)
+{
+	int ret;
+
+	if ((ret = copy_in(ep, buf, nmb))) {
+		usb_ep_ring_commit(ep, 0);
+	}
+	return (ret);
+}
+
+/**
+ * usb_ep_ring_write_isr
+ */
+int usb_ep_ring_write_isr(struct usb_ep_ring *ep, const void *buf, int nmb)
+{
+	int ret;
+
+	if ((ret = copy_in(ep, buf, nmb)) && !ep->busy) {
+		send_pkt(ep);
+	}
+	return (ret);
+}
+
+/**
+ * copy_in
+ */
+static int copy_in(struct usb_ep_ring *ep, const void *buf, int nmb)
+{
+	uint8_t *p;
+	int n, sz, ret = 0;
+
+	while (nmb) {
+		p = usb_ep_ring_reserve(ep, &sz);
+		if (sz == 0) {
+			break;
+		}
+		n = (nmb < sz) ? nmb : sz;
+		memcpy(p, (const uint8_t *) buf + ret, n);
+		ep->head += n;
+		ret += n;
+		nmb -= n;
+	}
+	return (ret);
+}
+
+/**
+ * usb_ep_ring_flush
+ */
+void usb_ep_ring_flush(struct usb_ep_ring *ep)
+{
+	UBaseType_t msk;
+
+	msk = taskENTER_CRITICAL_FROM_ISR();
+	ep->flush = TRUE;
+	if (!ep->busy) {
+		send_pkt(ep);
+	}
+	taskEXIT_CRITICAL_FROM_ISR(msk);
+}
+
+/**
+ * usb_ep_ring_peek
+ */
+const uint8_t *usb_ep_ring_peek(struct usb_ep_ring *ep, int *nmb)
+{
+	int n, offs;
+
+	offs = ep->tail & ep->msk;
+	n = usb_ep_ring_avail(ep);
+	if (n > ep->msk + 1 - offs) {
+		n = ep->msk + 1 - offs;
+	}
+	*nmb = n;
+	return (ep->buf + offs);
+}
+
+/**
+ * usb_ep_ring_consume
+ */
+void usb_ep_ring_consume(struct usb_ep_ring *ep, int nmb)
+{
+	UBaseType_t msk;
+	uint8_t eh;
+
+	ep->tail += nmb;
+	// Drop transfer ends passed by consumer. Ends queued after head was
+	// read are not checked (they may lie past head).
+	eh = ep->end_head;
+	while (ep->end_tail != eh && (uint16_t) (ep->end[ep->end_tail & (USB_EP_RING_END_NMB - 1)] - ep->tail) >
+	       (uint16_t) (ep->head - ep->tail)) {
+		ep->end_tail++;
+	}
+	if (ep->out_pend) {
+		msk = taskENTER_CRITICAL_FROM_ISR();
+		if (ep->out_pend && ep->out_pend <= usb_ep_ring_free(ep)) {
+			read_pkt(ep, ep->out_pend);
+			ep->out_pend = 0;
+		}
+		taskEXIT_CRITICAL_FROM_ISR(msk);
+	}
+}
+
+/**
+ * usb_ep_ring_read
+ */
+int usb_ep_ring_read(struct usb_ep_ring *ep, void *buf, int nmb)
+{
+	const uint8_t *p;
+	int n, sz, ret = 0;
+
+	while (nmb) {
+		p = usb_ep_ring_peek(ep, &sz);
+		if (sz == 0) {
+			break;
+		}
+		n = (nmb < sz) ? nmb : sz;
+		memcpy((uint8_t *) buf + ret, p, n);
+		ep->tail += n;
+		ret += n;
+		nmb -= n;
+	}
+	if (ret) {
+		usb_ep_ring_consume(ep, 0);
+	}
+	return (ret);
+}
+
+/**
+ * usb_ep_ring_out_end
+ */
+int usb_ep_ring_out_end(struct usb_ep_ring *ep)
+{
+	usb_ep_ring_consume(ep, 0);
+	if (ep->end_tail == ep->end_head) {
+		return (-1);
+	}
+	return ((uint16_t) (ep->end[ep->end_tail & (USB_EP_RING_END_NMB - 1)] - ep->tail));
+}
+
+/**
+ * usb_ep_ring_in_done
+ */
+void usb_ep_ring_in_done(struct usb_ep_ring *ep)
+{
+	ep->busy = FALSE;
+	send_pkt(ep);
+	if (!ep->busy && ep->head == ep->tail && ep->clbk) {
+		ep->clbk(ep);
+	}
+}
+
+/**
+ * usb_ep_ring_out_rcv
+ */
+void usb_ep_ring_out_rcv(struct usb_ep_ring *ep, int nmb)
+{
+	if (nmb > usb_ep_ring_free(ep)) {
+		// Packet stays in controller (endpoint NAKs) until consumer
+		// frees space.
+		ep->out_pend = nmb;
+		return;
+	}
+	read_pkt(ep, nmb);
+	if (ep->clbk) {
+		ep->clbk(ep);
+	}
+}
+
+/**
+ * send_pkt
+ */
+static void send_pkt(struct usb_ep_ring *ep)
+{
+	int n, sz, offs;
+
+	n = usb_ep_ring_avail(ep);
+	if (n > ep->mps) {
+		n = ep->mps;
+	}
+	if (n < ep->mps) {
+		if (ep->coal && !ep->flush) {
+			return;
+		}
+		ep->flush = FALSE;
+	}
+	if (n == 0 && !(ep->zlp && ep->last_full)) {
+		ep->last_full = FALSE;
+		return;
+	}
+	offs = ep->tail & ep->msk;
+	sz = ep->msk + 1 - offs;
+	if (n == 0) {
+		// Zero length packet.
+	} else if (sz >= n) {
+		ep->drv->write_fifo(ep->hw, ep->addr, ep->buf + offs, n);
+	} else {
+		ep->drv->write_fifo(ep->hw, ep->addr, ep->buf + offs, sz);
+		ep->drv->write_fifo(ep->hw, ep->addr, ep->buf, n - sz);
+	}
+	ep->tail += n;
+	ep->last_full = (n == ep->mps) ? TRUE : FALSE;
+	ep->busy = TRUE;
+	ep->drv->tx_pkt_rdy(ep->hw, ep->addr);
+}
+
+/**
+ * read_pkt
+ */
+static void read_pkt(struct usb_ep_ring *ep, int nmb)
+{
+	int sz, offs;
+
+	offs = ep->head & ep->msk;
+	sz = ep->msk + 1 - offs;
+	if (sz >= nmb) {
+		ep->drv->read_fifo(ep->hw, ep->addr, ep->buf + offs, nmb);
+	} else {
+		ep->drv->read_fifo(ep->hw, ep->addr, ep->buf + offs, sz);
+		ep->drv->read_fifo(ep->hw, ep->addr, ep->buf, nmb - sz);
+	}
+	ep->head += nmb;
+	if (nmb < ep->mps && (uint8_t) (ep->end_head - ep->end_tail) < USB_EP_RING_END_NMB) {
+		ep->end[ep->end_head & (USB_EP_RING_END_NMB - 1)] = ep->head;
+		ep->end_head++;
+	}
+	ep->drv->rx_done(ep->hw, ep->addr);
+}
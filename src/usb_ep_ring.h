@@ -0,0 +1,181 @@
+/*
+ * usb_ep_ring.h
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef USB_EP_RING_H
+#define USB_EP_RING_H
+
+#ifndef USB_EP_RING_END_NMB
+ #define USB_EP_RING_END_NMB 4 // Queued OUT transfer ends (power of 2).
+#endif
+
+// Bulk and interrupt endpoint driver. hw and endpoint address are passed
+// to all functions. tx_pkt_rdy sends packet written by write_fifo (zero
+// length packet if nothing was written), rx_done releases received packet.
+// Driver reports sent IN packet by usb_ep_ring_in_done() and received OUT
+// packet by usb_ep_ring_out_rcv().
+struct usb_ep_ring_drv {
+	void (*write_fifo)(void *hw, int addr, const void *buf, int nmb);
+	void (*tx_pkt_rdy)(void *hw, int addr);
+	void (*read_fifo)(void *hw, int addr, void *buf, int nmb);
+	void (*rx_done)(void *hw, int addr);
+};
+
+// Endpoint with single producer single consumer ring. IN endpoint is fed
+// by task and drained by interrupt, OUT endpoint the other way. Data are
+// sent in max packet size packets, zero length packet terminates transfer
+// which ended with full packet (zlp TRUE). If coal is TRUE, IN data are
+// sent in full packets only, rest is held until usb_ep_ring_flush().
+// clbk (interrupt) is called when all IN data were sent or OUT packet was
+// received (not for packet read later by usb_ep_ring_consume()). OUT ring
+// keeps positions of last USB_EP_RING_END_NMB transfer ends (short
+// packets) for usb_ep_ring_out_end(). Members after clbk are private.
+struct usb_ep_ring {
+	const struct usb_ep_ring_drv *drv;
+	void *hw;
+	boolean_t zlp;
+	boolean_t coal;
+	void (*clbk)(struct usb_ep_ring *ep);
+	void *arg; // Free for application.
+	uint8_t addr;
+	uint16_t mps;
+	uint8_t *buf;
+	uint16_t msk;
+	volatile uint16_t head;
+	volatile uint16_t tail;
+	volatile boolean_t busy;
+	boolean_t last_full;
+	volatile boolean_t flush;
+	volatile uint16_t out_pend;
+	uint16_t end[USB_EP_RING_END_NMB];
+	volatile uint8_t end_head;
+	uint8_t end_tail;
+};
+
+/**
+ * init_usb_ep_ring
+ *
+ * Binds ring to bulk or interrupt endpoint desc. sz (buf size) must be
+ * power of 2, at least max packet size and not greater than 32768.
+ */
+void init_usb_ep_ring(struct usb_ep_ring *ep, const struct usb_ep_ring_drv *drv, void *hw,
+		      const struct usb_endp_desc *desc, uint8_t *buf, int sz);
+
+/**
+ * reset_usb_ep_ring
+ *
+ * Drops ring content (call when endpoint is configured or disabled).
+ * Can be called from task or interrupt.
+ */
+void reset_usb_ep_ring(struct usb_ep_ring *ep);
+
+/**
+ * usb_ep_ring_avail
+ *
+ * Returns number of bytes in ring.
+ */
+int usb_ep_ring_avail(struct usb_ep_ring *ep);
+
+/**
+ * usb_ep_ring_free
+ *
+ * Returns free space of ring.
+ */
+int usb_ep_ring_free(struct usb_ep_ring *ep);
+
+/**
+ * usb_ep_ring_reserve
+ *
+ * Returns contiguous free space of IN ring (nmb set to its size, 0 if
+ * ring is full). Producer writes data in place and calls commit.
+ */
+uint8_t *usb_ep_ring_reserve(struct usb_ep_ring *ep, int *nmb);
+
+/**
+ * usb_ep_ring_commit
+ *
+ * Queues nmb bytes written to reserved space and starts IN transfer.
+ * Can be called from task or interrupt.
+ */
+void usb_ep_ring_commit(struct usb_ep_ring *ep, int nmb);
+
+/**
+ * usb_ep_ring_write
+ *
+ * Copies up to nmb bytes to IN ring. Returns number of bytes queued.
+ */
+int usb_ep_ring_write(struct usb_ep_ring *ep, const void *buf, int nmb);
+
+/**
+ * usb_ep_ring_write_isr
+ *
+ * usb_ep_ring_write() for endpoint interrupt (clbk) or code running with
+ * interrupts masked.
+ */
+int usb_ep_ring_write_isr(struct usb_ep_ring *ep, const void *buf, int nmb);
+
+/**
+ * usb_ep_ring_flush
+ *
+ * Sends IN data held by coalescing. Can be called from task or interrupt.
+ */
+void usb_ep_ring_flush(struct usb_ep_ring *ep);
+
+/**
+ * usb_ep_ring_peek
+ *
+ * Returns contiguous received data of OUT ring (nmb set to its size).
+ */
+const uint8_t *usb_ep_ring_peek(struct usb_ep_ring *ep, int *nmb);
+
+/**
+ * usb_ep_ring_consume
+ *
+ * Frees nmb bytes of OUT ring. Packet held by controller because ring
+ * was full is read when space is available. Can be called from task or
+ * interrupt.
+ */
+void usb_ep_ring_consume(struct usb_ep_ring *ep, int nmb);
+
+/**
+ * usb_ep_ring_read
+ *
+ * Moves up to nmb bytes from OUT ring to buf. Returns number of bytes.
+ */
+int usb_ep_ring_read(struct usb_ep_ring *ep, void *buf, int nmb);
+
+/**
+ * usb_ep_ring_out_end
+ *
+ * Returns number of bytes of OUT ring up to end of oldest received
+ * transfer or -1 if transfer goes on. End at first unread byte (0
+ * returned) is kept until data past it are read. Transfer ends not
+ * fitting into queue are lost.
+ */
+int usb_ep_ring_out_end(struct usb_ep_ring *ep);
+
+/**
+ * usb_ep_ring_in_done
+ */
+void usb_ep_ring_in_done(struct usb_ep_ring *ep);
+
+/**
+ * usb_ep_ring_out_rcv
+ */
+void usb_ep_ring_out_rcv(struct usb_ep_ring *ep, int nmb);
+
+#endif
@@ -0,0 +1,360 @@
+/*
+ * usb_hid.c
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <gentyp.h>
+#include "sysconf.h"
+#include "criterr.h"
+#include "udp.h"
+#include "usb_std_def.h"
+#include "usb_hid_def.h"
+#include "usb_ctl_req_trc.h"
+#include "usb_ctl_req.h"
+#include "usb_ep_ring.h"
+#include "usb_hid.h"
+
+#define IDLE_UNIT_MS 4
+
+static struct usb_hid_rep *find_rep(struct usb_hid *hid, int id);
+static void sched(struct usb_hid *hid);
+static void in_clbk(struct usb_ep_ring *ep);
+static struct usb_ctl_req stp_clbk(struct usb_ctl_req_dev *dev, struct usb_stp_pkt *stp);
+static struct usb_ctl_req get_desc(struct usb_hid *hid, struct usb_stp_pkt *stp);
+static struct usb_ctl_req in_req(struct usb_hid *hid, const void *buf, int nmb, int w_length);
+static void in_req_ack_clbk(struct usb_ctl_req_dev *dev);
+static boolean_t out_req_rec_clbk(struct usb_ctl_req_dev *dev);
+static void out_req_ack_clbk(struct usb_ctl_req_dev *dev);
+
+/**
+ * init_usb_hid
+ */
+void init_usb_hid(struct usb_hid *hid, struct usb_ctl_req_dev *dev)
+{
+	int i;
+
+	if (!hid->in || !hid->rep_desc || hid->rep_nmb > 255) {
+		crit_err_exit(BAD_PARAMETER);
+	}
+	for (i = 0; i < hid->rep_nmb; i++) {
+		if (hid->rep[i].sz > usb_ep_ring_free(hid->in) || hid->rep[i].sz > USB_HID_REP_SZ ||
+		    hid->rep[i].sz < ((hid->rep[i].id) ? 2 : 1)) {
+			crit_err_exit(BAD_PARAMETER);
+		}
+		if (hid->rep[i].id) {
+			hid->rep[i].buf[0] = hid->rep[i].id;
+		}
+		hid->rep[i].idle0 = hid->rep[i].idle;
+	}
+	hid->in->clbk = in_clbk;
+	hid->in->arg = hid;
+	reset_usb_hid(hid);
+	hid->clbks.stp_clbk = stp_clbk;
+	hid->clbks.in_req_ack_clbk = in_req_ack_clbk;
+	hid->clbks.out_req_rec_clbk = out_req_rec_clbk;
+	hid->clbks.out_req_ack_clbk = out_req_ack_clbk;
+	hid->clbks.arg = hid;
+	hid->fn.first_iface = hid->iface;
+	hid->fn.clbks = &hid->clbks;
+	add_usb_ctl_req_fn_clbks(dev, &hid->fn);
+	// Class descriptors are requested by standard GET_DESCRIPTOR.
+	hid->desc_hndlr.type = USB_STANDARD_REQUEST;
+	hid->desc_hndlr.recp = USB_IFACE_RECIPIENT;
+	hid->desc_hndlr.b_request = USB_GET_DESCRIPTOR;
+	hid->desc_hndlr.scope = hid->iface;
+	hid->desc_hndlr.clbks = &hid->clbks;
+	add_usb_ctl_req_hndlr(dev, &hid->desc_hndlr);
+}
+
+/**
+ * reset_usb_hid
+ */
+void reset_usb_hid(struct usb_hid *hid)
+{
+	int i;
+
+	hid->protocol = 1;
+	hid->busy = FALSE;
+	hid->next = 0;
+	for (i = 0; i < hid->rep_nmb; i++) {
+		hid->rep[i].idle = hid->rep[i].idle0;
+		hid->rep[i].elapsed = 0;
+		hid->rep[i].chg = FALSE;
+	}
+}
+
+/**
+ * usb_hid_write
+ */
+boolean_t usb_hid_write(struct usb_hid *hid, int id, const void *data)
+{
+	struct usb_hid_rep *rep;
+	boolean_t chg = FALSE;
+	UBaseType_t msk;
+	int offs;
+
+	if (!(rep = find_rep(hid, id))) {
+		crit_err_exit(BAD_PARAMETER);
+	}
+	offs = (id) ? 1 : 0;
+	msk = taskENTER_CRITICAL_FROM_ISR();
+	if (memcmp(rep->buf + offs, data, rep->sz - offs)) {
+		memcpy(rep->buf + offs, data, rep->sz - offs);
+		rep->chg = chg = TRUE;
+		sched(hid);
+	}
+	taskEXIT_CRITICAL_FROM_ISR(msk);
+	return (chg);
+}
+
+/**
+ * usb_hid_tick
+ */
+void usb_hid_tick(struct usb_hid *hid, int ms)
+{
+	struct usb_hid_rep *rep;
+	boolean_t exp = FALSE;
+
+	for (rep = hid->rep; rep < hid->rep + hid->rep_nmb; rep++) {
+		if (rep->idle) {
+			rep->elapsed = (rep->elapsed + ms < 0xFFFF) ? rep->elapsed + ms : 0xFFFF;
+			if (rep->elapsed >= rep->idle * IDLE_UNIT_MS) {
+				exp = TRUE;
+			}
+		}
+	}
+	if (exp) {
+		sched(hid);
+	}
+}
+
+/**
+ * usb_hid_get_protocol
+ */
+int usb_hid_get_protocol(struct usb_hid *hid)
+{
+	return (hid->protocol);
+}
+
+/**
+ * find_rep
+ */
+static struct usb_hid_rep *find_rep(struct usb_hid *hid, int id)
+{
+	int i;
+
+	for (i = 0; i < hid->rep_nmb; i++) {
+		if (hid->rep[i].id == id) {
+			return (&hid->rep[i]);
+		}
+	}
+	return (NULL);
+}
+
+/**
+ * sched
+ *
+ * Sends one report if endpoint is idle. Changed reports go first, round
+ * robin keeps single busy report from starving others.
+ */
+static void sched(struct usb_hid *hid)
+{
+	struct usb_hid_rep *rep = NULL;
+	int i, ix;
+
+	if (hid->busy || hid->rep_nmb == 0) {
+		return;
+	}
+	for (i = 0; i < hid->rep_nmb; i++) {
+		ix = (hid->next + i) % hid->rep_nmb;
+		if (hid->rep[ix].chg) {
+			rep = &hid->rep[ix];
+			break;
+		}
+	}
+	if (!rep) {
+		for (i = 0; i < hid->rep_nmb; i++) {
+			ix = (hid->next + i) % hid->rep_nmb;
+			if (hid->rep[ix].idle && hid->rep[ix].elapsed >= hid->rep[ix].idle * IDLE_UNIT_MS) {
+				rep = &hid->rep[ix];
+				break;
+			}
+		}
+		if (!rep) {
+			return;
+		}
+	}
+	hid->next = (ix + 1) % hid->rep_nmb;
+	rep->chg = FALSE;
+	rep->elapsed = 0;
+	hid->busy = TRUE;
+	usb_ep_ring_write_isr(hid->in, rep->buf, rep->sz);
+}
+
+/**
+ * in_clbk
+ */
+static void in_clbk(struct usb_ep_ring *ep)
+{
+	struct usb_hid *hid = ep->arg;
+
+	hid->busy = FALSE;
+	sched(hid);
+}
+
+/**
+ * stp_clbk
+ */
+static struct usb_ctl_req stp_clbk(struct usb_ctl_req_dev *dev, struct usb_stp_pkt *stp)
+{
+	struct usb_hid *hid = usb_ctl_req_get_arg(dev);
+	struct usb_hid_rep *rep;
+	struct usb_ctl_req req;
+	UBaseType_t msk;
+	uint8_t *buf;
+	int i, sz;
+
+	memset(&req, 0, sizeof(req));
+	if ((stp->bm_request_type & 0x1F) != USB_IFACE_RECIPIENT || (stp->w_index & 0xFF) != hid->iface) {
+		return (req);
+	}
+	if (((stp->bm_request_type >> 5) & 3) == USB_STANDARD_REQUEST) {
+		return (get_desc(hid, stp));
+	}
+	hid->req = stp->b_request;
+	hid->req_type = stp->w_value >> 8;
+	hid->req_id = stp->w_value & 0xFF;
+	switch (stp->b_request) {
+	case USB_HID_GET_REPORT :
+		if (hid->req_type == USB_HID_REPORT_IN) {
+			if ((rep = find_rep(hid, hid->req_id))) {
+				// Snapshot, usb_hid_write() can change report during transfer.
+				msk = taskENTER_CRITICAL_FROM_ISR();
+				memcpy(hid->rep_reply, rep->buf, rep->sz);
+				taskEXIT_CRITICAL_FROM_ISR(msk);
+				return (in_req(hid, hid->rep_reply, rep->sz, stp->w_length));
+			}
+		} else if (hid->rep_buf_clbk && (buf = hid->rep_buf_clbk(hid, hid->req_type, hid->req_id, &sz))) {
+			return (in_req(hid, buf, sz, stp->w_length));
+		}
+		break;
+	case USB_HID_SET_REPORT :
+		if (hid->req_type != USB_HID_REPORT_IN && hid->rep_buf_clbk &&
+		    (buf = hid->rep_buf_clbk(hid, hid->req_type, hid->req_id, &sz)) && stp->w_length <= sz) {
+			req.valid = TRUE;
+			req.trans_dir = UDP_CTL_TRANS_OUT;
+			req.buf = buf;
+			req.nmb = req.trans_nmb = stp->w_length;
+			hid->req_nmb = stp->w_length;
+		}
+		break;
+	case USB_HID_GET_IDLE :
+		if ((rep = find_rep(hid, hid->req_id))) {
+			hid->reply = rep->idle;
+			return (in_req(hid, &hid->reply, 1, stp->w_length));
+		}
+		break;
+	case USB_HID_SET_IDLE :
+		// Report ID 0 applies to all reports.
+		for (i = 0; i < hid->rep_nmb; i++) {
+			if (hid->req_id == 0 || hid->rep[i].id == hid->req_id) {
+				hid->rep[i].idle = hid->req_type;
+				req.valid = TRUE;
+			}
+		}
+		req.trans_dir = UDP_CTL_TRANS_OUT;
+		break;
+	case USB_HID_GET_PROTOCOL :
+		hid->reply = hid->protocol;
+		return (in_req(hid, &hid->reply, 1, stp->w_length));
+	case USB_HID_SET_PROTOCOL :
+		if (stp->w_value <= 1) {
+			hid->protocol = stp->w_value;
+			req.valid = TRUE;
+			req.trans_dir = UDP_CTL_TRANS_OUT;
+		}
+		break;
+	}
+	return (req);
+}
+
+/**
+ * get_desc
+ */
+static struct usb_ctl_req get_desc(struct usb_hid *hid, struct usb_stp_pkt *stp)
+{
+	struct usb_ctl_req req;
+
+	switch (stp->w_value >> 8) {
+	case USB_HID_REPORT_DESC :
+		return (in_req(hid, hid->rep_desc, hid->rep_desc_sz, stp->w_length));
+	case USB_HID_DESC :
+		if (hid->hid_desc) {
+			return (in_req(hid, hid->hid_desc, sizeof(struct usb_hid_desc), stp->w_length));
+		}
+		break;
+	}
+	memset(&req, 0, sizeof(req));
+	return (req);
+}
+
+/**
+ * in_req
+ */
+static struct usb_ctl_req in_req(struct usb_hid *hid, const void *buf, int nmb, int w_length)
+{
+	struct usb_ctl_req req;
+
+	memset(&req, 0, sizeof(req));
+	hid->frag.buf = buf;
+	hid->frag.nmb = nmb;
+	req.valid = TRUE;
+	req.trans_dir = UDP_CTL_TRANS_IN;
+	req.frag = &hid->frag;
+	req.trans_nmb = w_length;
+	req.nmb = (w_length < nmb) ? w_length : nmb;
+	return (req);
+}
+
+/**
+ * in_req_ack_clbk
+ */
+static void in_req_ack_clbk(struct usb_ctl_req_dev *dev)
+{
+}
+
+/**
+ * out_req_rec_clbk
+ */
+static boolean_t out_req_rec_clbk(struct usb_ctl_req_dev *dev)
+{
+	struct usb_hid *hid = usb_ctl_req_get_arg(dev);
+
+	if (hid->req == USB_HID_SET_REPORT && hid->set_rep_clbk) {
+		hid->set_rep_clbk(hid, hid->req_type, hid->req_id, hid->req_nmb);
+	}
+	return (TRUE);
+}
+
+/**
+ * out_req_ack_clbk
+ */
+static void out_req_ack_clbk(struct usb_ctl_req_dev *dev)
+{
+}
@@ -0,0 +1,112 @@
+/*
+ * usb_hid.h
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef USB_HID_H
+#define USB_HID_H
+
+#ifndef USB_HID_REP_SZ
+ #define USB_HID_REP_SZ 64 // Max input report size (GET_REPORT reply buffer).
+#endif
+
+// Input report. buf holds sz bytes of report (first byte is report ID if
+// id is not 0). idle is initial idle rate (4 ms units, 0 is infinite).
+// Members after buf are private.
+struct usb_hid_rep {
+	uint8_t id;
+	uint8_t idle;
+	uint16_t sz;
+	uint8_t *buf;
+	uint8_t idle0;
+	uint16_t elapsed;
+	boolean_t chg;
+};
+
+// HID function. Input reports are sent by in (interrupt IN ring), changed
+// report on next polling interval, unchanged one only when its idle period
+// expires. Report changed several times while endpoint is busy is sent
+// once with latest data. Output and feature reports are served by
+// rep_buf_clbk (returns buffer and its size or NULL), set_rep_clbk is
+// called when SET_REPORT data were received. Hooks run in interrupt and
+// can be NULL. Members after arg are private.
+struct usb_hid {
+	struct usb_ep_ring *in;
+	uint8_t iface;
+	struct usb_hid_rep *rep;
+	int rep_nmb;
+	const struct usb_hid_desc *hid_desc;
+	const uint8_t *rep_desc;
+	uint16_t rep_desc_sz;
+	uint8_t *(*rep_buf_clbk)(struct usb_hid *hid, int type, int id, int *sz);
+	void (*set_rep_clbk)(struct usb_hid *hid, int type, int id, int nmb);
+	void *arg; // Free for application.
+	uint8_t protocol;
+	volatile boolean_t busy;
+	uint8_t next;
+	uint8_t req;
+	uint8_t req_type;
+	uint8_t req_id;
+	uint16_t req_nmb;
+	uint8_t reply;
+	uint8_t rep_reply[USB_HID_REP_SZ];
+	struct usb_ctl_req_frag frag;
+	struct usb_ctl_req_clbks clbks;
+	struct usb_ctl_req_fn fn;
+	struct usb_ctl_req_hndlr desc_hndlr;
+};
+
+/**
+ * init_usb_hid
+ *
+ * Registers class requests and report descriptor of function to engine
+ * instance dev.
+ */
+void init_usb_hid(struct usb_hid *hid, struct usb_ctl_req_dev *dev);
+
+/**
+ * reset_usb_hid
+ *
+ * Restores report protocol and idle rates (call on SET_CONFIGURATION,
+ * in ring is reset by application).
+ */
+void reset_usb_hid(struct usb_hid *hid);
+
+/**
+ * usb_hid_write
+ *
+ * Updates input report id (data without report ID byte). Report is
+ * scheduled only if data changed. Returns TRUE if data changed. Can be
+ * called from task or from interrupt.
+ */
+boolean_t usb_hid_write(struct usb_hid *hid, int id, const void *data);
+
+/**
+ * usb_hid_tick
+ *
+ * Advances idle timers by ms milliseconds (call from SOF or other
+ * periodic interrupt of udp priority).
+ */
+void usb_hid_tick(struct usb_hid *hid, int ms);
+
+/**
+ * usb_hid_get_protocol
+ *
+ * Returns 0 (boot) or 1 (report protocol).
+ */
+int usb_hid_get_protocol(struct usb_hid *hid);
+
+#endif
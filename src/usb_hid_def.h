@@ -44,6 +44,36 @@ enum usb_hid_ctl_req_code {
         USB_HID_SET_PROTOCOL
 };
 
+enum usb_hid_usage_page {
+	USB_HID_PAGE_GENERIC_DESKTOP = 0x01,
+	USB_HID_PAGE_KEYBOARD = 0x07,
+	USB_HID_PAGE_LED = 0x08,
+	USB_HID_PAGE_BUTTON = 0x09,
+	USB_HID_PAGE_CONSUMER = 0x0C,
+	USB_HID_PAGE_VENDOR = 0xFF00
+};
+
+// Generic desktop page usages.
+enum usb_hid_gd_usage {
+	USB_HID_USAGE_POINTER = 0x01,
+	USB_HID_USAGE_MOUSE = 0x02,
+	USB_HID_USAGE_JOYSTICK = 0x04,
+	USB_HID_USAGE_GAMEPAD = 0x05,
+	USB_HID_USAGE_KEYBOARD = 0x06,
+	USB_HID_USAGE_X = 0x30,
+	USB_HID_USAGE_Y = 0x31,
+	USB_HID_USAGE_Z = 0x32,
+	USB_HID_USAGE_WHEEL = 0x38
+};
+
+// Input, Output and Feature item flags.
+#define USB_HID_DATA 0x00
+#define USB_HID_CONST 0x01
+#define USB_HID_ARRAY 0x00
+#define USB_HID_VAR 0x02
+#define USB_HID_ABS 0x00
+#define USB_HID_REL 0x04
+
 // HID descriptor.
 struct usb_hid_desc {
 	uint8_t size;
@@ -55,4 +85,7 @@ struct usb_hid_desc {
 	uint16_t rep_desc_size;
 } __attribute__ ((packed));
 
+#define usb_hid_desc_init(bcd, country, rep_sz) \
+	{sizeof(struct usb_hid_desc), USB_HID_DESC, (bcd), (country), 1, USB_HID_REPORT_DESC, (rep_sz)}
+
 #endif
@@ -0,0 +1,191 @@
+/*
+ * usb_hid_rep_bld.h
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef USB_HID_REP_BLD_H
+#define USB_HID_REP_BLD_H
+
+/*
+ * Compile-time HID report descriptor builder and report packer.
+ *
+ * Reports are described by list macros. Descriptor is emitted as const
+ * byte array (its sizeof is rep_desc_size of HID descriptor), every report
+ * gets bit layout from which field offsets are constants, so packing
+ * inlines to few shifts and masks.
+ *
+ * #define MOUSE_FIELDS(F, P) \
+ *         F(btn, USB_HID_PAGE_BUTTON, 1, 3, 0, 1, 1, 3, USB_HID_DATA | USB_HID_VAR) \
+ *         P(btn_pad, 5) \
+ *         F(xy, USB_HID_PAGE_GENERIC_DESKTOP, USB_HID_USAGE_X, USB_HID_USAGE_Y, -127, 127, 8, 2, \
+ *           USB_HID_DATA | USB_HID_VAR | USB_HID_REL)
+ * #define MOUSE_REPS(R) \
+ *         R(mouse_in, 0, INPUT, MOUSE_FIELDS)
+ * #define MOUSE_TREE(APP) \
+ *         APP(USB_HID_PAGE_GENERIC_DESKTOP, USB_HID_USAGE_MOUSE, MOUSE_REPS)
+ *
+ * USB_HID_REP_BLD_DESC(mouse_rep_desc, MOUSE_TREE);
+ * ... usb_hid_desc_init(USB_HID_REL_1_11_VER_BCD, 0, sizeof(mouse_rep_desc))
+ * ... USB_HID_REP_SET(mouse_in, xy, buf, 1, dy);
+ *
+ * APP(usage_page, usage, REP_LIST)
+ * R(name, report_id, INPUT | OUTPUT | FEATURE, FIELD_LIST)
+ * F(name, usage_page, usage_min, usage_max, logical_min, logical_max, size, count, flags)
+ * P(name, size)
+ *
+ * Every APP is application collection. Report id 0 means report without
+ * ID byte (only report of descriptor). Field size is 1..32 bits, report
+ * length must be whole bytes (P fields pad). Report names define
+ * <name>_id and <name>_sz (bytes with ID byte) and must be unique, field
+ * names must be unique in report.
+ *
+ * Packed buffer (<name>_sz bytes) includes ID byte when <name>_id is not
+ * 0, usb_hid_write() takes data without it, so pass buf + 1 in that case
+ * (buf if report has no ID).
+ */
+
+#define USB_HID_REP_BLD_NOP(...)
+
+#define USB_HID_REP_BLD_B2(v) ((uint32_t) (v) & 0xFF), (((uint32_t) (v) >> 8) & 0xFF)
+#define USB_HID_REP_BLD_B4(v) \
+	((uint32_t) (v) & 0xFF), (((uint32_t) (v) >> 8) & 0xFF), \
+	(((uint32_t) (v) >> 16) & 0xFF), (((uint32_t) (v) >> 24) & 0xFF)
+
+// Items have fixed data size, so descriptor length does not depend on values.
+#define USB_HID_REP_BLD_F_ITEMS(main, name, page, umin, umax, lmin, lmax, size, count, flags) \
+	0x06, USB_HID_REP_BLD_B2(page), 0x1A, USB_HID_REP_BLD_B2(umin), \
+	0x2A, USB_HID_REP_BLD_B2(umax), 0x17, USB_HID_REP_BLD_B4(lmin), \
+	0x27, USB_HID_REP_BLD_B4(lmax), 0x75, (size), 0x95, (count), (main), (flags),
+#define USB_HID_REP_BLD_P_ITEMS(main, name, size) \
+	0x75, (size), 0x95, 1, (main), USB_HID_CONST,
+#define USB_HID_REP_BLD_F_INPUT(...) USB_HID_REP_BLD_F_ITEMS(0x81, __VA_ARGS__)
+#define USB_HID_REP_BLD_F_OUTPUT(...) USB_HID_REP_BLD_F_ITEMS(0x91, __VA_ARGS__)
+#define USB_HID_REP_BLD_F_FEATURE(...) USB_HID_REP_BLD_F_ITEMS(0xB1, __VA_ARGS__)
+#define USB_HID_REP_BLD_P_INPUT(...) USB_HID_REP_BLD_P_ITEMS(0x81, __VA_ARGS__)
+#define USB_HID_REP_BLD_P_OUTPUT(...) USB_HID_REP_BLD_P_ITEMS(0x91, __VA_ARGS__)
+#define USB_HID_REP_BLD_P_FEATURE(...) USB_HID_REP_BLD_P_ITEMS(0xB1, __VA_ARGS__)
+// Report ID 0 is replaced by Push, Pop pair of same length.
+#define USB_HID_REP_BLD_R_ITEMS(name, id, type, FIELDS) \
+	((id) ? 0x85 : 0xA4), ((id) ? (id) : 0xB4), \
+	FIELDS(USB_HID_REP_BLD_F_##type, USB_HID_REP_BLD_P_##type)
+#define USB_HID_REP_BLD_APP_ITEMS(page, usage, REPS) \
+	0x06, USB_HID_REP_BLD_B2(page), 0x0A, USB_HID_REP_BLD_B2(usage), 0xA1, 0x01, \
+	REPS(USB_HID_REP_BLD_R_ITEMS) 0xC0,
+
+#define USB_HID_REP_BLD_F_MEMB(name, page, umin, umax, lmin, lmax, size, count, flags) \
+	char name[count][size];
+#define USB_HID_REP_BLD_P_MEMB(name, size) char name[1][size];
+#define USB_HID_REP_BLD_F_SIGN(name, page, umin, umax, lmin, lmax, size, count, flags) \
+	char name[((lmin) < 0) ? 2 : 1];
+#define USB_HID_REP_BLD_P_SIGN(name, size) char name[1];
+#define USB_HID_REP_BLD_F_CHK(name, page, umin, umax, lmin, lmax, size, count, flags) \
+	_Static_assert((size) >= 1 && (size) <= 32, "usb_hid_rep_bld: size of field " #name); \
+	_Static_assert((count) >= 1 && (count) <= 255, "usb_hid_rep_bld: count of field " #name); \
+	_Static_assert((umin) <= (umax) && (lmin) <= (lmax), "usb_hid_rep_bld: range of field " #name);
+#define USB_HID_REP_BLD_P_CHK(name, size) \
+	_Static_assert((size) >= 1 && (size) <= 255, "usb_hid_rep_bld: size of field " #name);
+// Bit layout of report, member size is field size in bits.
+#define USB_HID_REP_BLD_R_DEFS(name, id, type, FIELDS) \
+	struct name##_bits { \
+		FIELDS(USB_HID_REP_BLD_F_MEMB, USB_HID_REP_BLD_P_MEMB) \
+	}; \
+	struct name##_sign { \
+		FIELDS(USB_HID_REP_BLD_F_SIGN, USB_HID_REP_BLD_P_SIGN) \
+	}; \
+	enum {name##_id = (id), name##_sz = sizeof(struct name##_bits) / 8 + ((id) ? 1 : 0)}; \
+	_Static_assert(sizeof(struct name##_bits) % 8 == 0, "usb_hid_rep_bld: " #name " not whole bytes"); \
+	_Static_assert((id) >= 0 && (id) <= 255, "usb_hid_rep_bld: report id of " #name); \
+	FIELDS(USB_HID_REP_BLD_F_CHK, USB_HID_REP_BLD_P_CHK)
+#define USB_HID_REP_BLD_APP_DEFS(page, usage, REPS) \
+	REPS(USB_HID_REP_BLD_R_DEFS)
+
+/**
+ * USB_HID_REP_BLD_DESC
+ *
+ * Defines report layouts and const report descriptor name.
+ */
+#define USB_HID_REP_BLD_DESC(name, TREE) \
+	TREE(USB_HID_REP_BLD_APP_DEFS) \
+	const uint8_t name[] = { \
+		TREE(USB_HID_REP_BLD_APP_ITEMS) \
+	}
+
+#define USB_HID_REP_FLD_SZ(rep, field) sizeof(((struct rep##_bits *) 0)->field[0])
+#define USB_HID_REP_FLD_OFFS(rep, field) \
+	(__builtin_offsetof(struct rep##_bits, field) + ((rep##_id) ? 8 : 0))
+#define USB_HID_REP_FLD_SIGN(rep, field) (sizeof(((struct rep##_sign *) 0)->field) == 2)
+
+/**
+ * USB_HID_REP_SET
+ *
+ * Stores v to element ix of field of report rep in buf (ID byte is not
+ * written).
+ */
+#define USB_HID_REP_SET(rep, field, buf, ix, v) \
+	usb_hid_rep_put((buf), USB_HID_REP_FLD_OFFS(rep, field) + (ix) * USB_HID_REP_FLD_SZ(rep, field), \
+			USB_HID_REP_FLD_SZ(rep, field), (v))
+
+/**
+ * USB_HID_REP_GET
+ *
+ * Returns element ix of field (sign extended if logical minimum < 0).
+ */
+#define USB_HID_REP_GET(rep, field, buf, ix) \
+	usb_hid_rep_get((buf), USB_HID_REP_FLD_OFFS(rep, field) + (ix) * USB_HID_REP_FLD_SZ(rep, field), \
+			USB_HID_REP_FLD_SZ(rep, field), USB_HID_REP_FLD_SIGN(rep, field))
+
+/**
+ * usb_hid_rep_put
+ *
+ * With constant offs and sz loop is unrolled to straight-line code.
+ */
+static inline __attribute__ ((always_inline)) void usb_hid_rep_put(uint8_t *buf, unsigned int offs,
+								   unsigned int sz, uint32_t v)
+{
+	uint64_t m, w;
+	unsigned int i, n;
+
+	m = ((1ULL << sz) - 1) << (offs & 7);
+	w = ((uint64_t) v << (offs & 7)) & m;
+	n = ((offs & 7) + sz + 7) >> 3;
+	buf += offs >> 3;
+	for (i = 0; i < n; i++) {
+		buf[i] = (buf[i] & ~(m >> (8 * i))) | (w >> (8 * i));
+	}
+}
+
+/**
+ * usb_hid_rep_get
+ */
+static inline __attribute__ ((always_inline)) int32_t usb_hid_rep_get(const uint8_t *buf, unsigned int offs,
+								      unsigned int sz, int sign)
+{
+	uint64_t w = 0;
+	unsigned int i, n;
+
+	n = ((offs & 7) + sz + 7) >> 3;
+	buf += offs >> 3;
+	for (i = 0; i < n; i++) {
+		w |= (uint64_t) buf[i] << (8 * i);
+	}
+	w = (w >> (offs & 7)) & ((1ULL << sz) - 1);
+	if (sign && (w >> (sz - 1)) & 1) {
+		w |= ~((1ULL << sz) - 1);
+	}
+	return ((int32_t) w);
+}
+
+#endif
@@ -0,0 +1,350 @@
+/*
+ * usb_pcap.c
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+// Reader and writer do not depend on FreeRTOS and udp driver, they are
+// built into host tools.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "usb_ctl_req_trc.h"
+#include "usb_pcap.h"
+
+#define PCAP_MAGIC 0xA1B2C3D4
+#define PCAP_NSEC_MAGIC 0xA1B23C4D
+#define MON_HDR_SZ 48
+#define MON_MMAPPED_HDR_SZ 64
+#define MON_CTL_XFER 2
+
+static int write_rec(struct usb_pcap_wr *wr, const struct usb_pcap_ctl *ctl, int sub);
+static int end_trc(struct usb_pcap_wr *wr, int32_t status, uint32_t tm);
+static struct usb_pcap_pend *find_pend(struct usb_pcap_rd *rd, uint64_t id);
+static uint32_t get16(const uint8_t *p);
+static uint32_t get32(const uint8_t *p);
+static uint64_t get64(const uint8_t *p);
+static void put16(uint8_t *p, uint32_t v);
+static void put32(uint8_t *p, uint32_t v);
+static void put64(uint8_t *p, uint64_t v);
+
+/**
+ * init_usb_pcap_rd
+ */
+int init_usb_pcap_rd(struct usb_pcap_rd *rd, FILE *f)
+{
+	uint8_t hdr[24];
+	uint32_t magic;
+
+	rd->f = f;
+	rd->pend_nmb = 0;
+	rd->drop_cnt = 0;
+	if (fread(hdr, 1, sizeof(hdr), f) != sizeof(hdr)) {
+		return (-1);
+	}
+	magic = get32(hdr);
+	if (magic != PCAP_MAGIC && magic != PCAP_NSEC_MAGIC) {
+		return (-1);
+	}
+	switch (get32(hdr + 20)) {
+	case USB_PCAP_LINKTYPE_USB_LINUX :
+		rd->hdr_sz = MON_HDR_SZ;
+		return (0);
+	case USB_PCAP_LINKTYPE_USB_LINUX_MMAPPED :
+		rd->hdr_sz = MON_MMAPPED_HDR_SZ;
+		return (0);
+	default :
+		return (-1);
+	}
+}
+
+/**
+ * usb_pcap_rd_ctl
+ *
+ * Submission with SETUP is kept until completion (or error) with same URB
+ * id arrives. Other transfer types are skipped.
+ */
+int usb_pcap_rd_ctl(struct usb_pcap_rd *rd, struct usb_pcap_ctl *ctl)
+{
+	struct usb_pcap_pend *p;
+	uint8_t hdr[16], *rec = rd->rec;
+	uint32_t incl, cap;
+	size_t n;
+
+	while (1) {
+		if ((n = fread(hdr, 1, sizeof(hdr), rd->f)) != sizeof(hdr)) {
+			return ((n == 0) ? 0 : -1);
+		}
+		incl = get32(hdr + 8);
+		if (incl > USB_PCAP_REC_SZ || fread(rec, 1, incl, rd->f) != incl) {
+			return (-1);
+		}
+		if (incl < (uint32_t) rd->hdr_sz || rec[9] != MON_CTL_XFER) {
+			continue;
+		}
+		cap = get32(rec + 36);
+		if (cap > incl - rd->hdr_sz) {
+			cap = incl - rd->hdr_sz;
+		}
+		if (rec[8] == 'S') {
+			if (rec[14] != 0) {
+				continue;
+			}
+			if (rd->pend_nmb == USB_PCAP_PEND_NMB) {
+				// Oldest submission never completed.
+				rd->drop_cnt++;
+				memmove(rd->pend, rd->pend + 1, (USB_PCAP_PEND_NMB - 1) * sizeof(struct usb_pcap_pend));
+				rd->pend_nmb--;
+			}
+			p = &rd->pend[rd->pend_nmb++];
+			p->id = get64(rec);
+			p->ctl.bus = get16(rec + 12);
+			p->ctl.dev = rec[11];
+			memcpy(p->ctl.stp, rec + 40, sizeof(p->ctl.stp));
+			p->ctl.status = USB_PCAP_STATUS_PEND;
+			p->ctl.sec = get64(rec + 16);
+			p->ctl.usec = get32(rec + 24);
+			p->ctl.len = get16(p->ctl.stp + 6);
+			p->ctl.nmb = 0;
+			if (!(p->ctl.stp[0] & 0x80)) {
+				p->ctl.nmb = (cap < USB_PCAP_DATA_SZ) ? cap : USB_PCAP_DATA_SZ;
+				memcpy(p->ctl.data, rec + rd->hdr_sz, p->ctl.nmb);
+			}
+		} else if (rec[8] == 'C' || rec[8] == 'E') {
+			if (!(p = find_pend(rd, get64(rec)))) {
+				continue;
+			}
+			*ctl = p->ctl;
+			ctl->status = (int32_t) get32(rec + 28);
+			ctl->len = get32(rec + 32);
+			if (ctl->stp[0] & 0x80) {
+				ctl->nmb = (cap < USB_PCAP_DATA_SZ) ? cap : USB_PCAP_DATA_SZ;
+				memcpy(ctl->data, rec + rd->hdr_sz, ctl->nmb);
+			} else if (ctl->nmb > ctl->len) {
+				ctl->nmb = ctl->len;
+			}
+			rd->pend_nmb--;
+			memmove(p, p + 1, (rd->pend + rd->pend_nmb - p) * sizeof(struct usb_pcap_pend));
+			return (1);
+		}
+	}
+}
+
+/**
+ * find_pend
+ */
+static struct usb_pcap_pend *find_pend(struct usb_pcap_rd *rd, uint64_t id)
+{
+	int i;
+
+	for (i = 0; i < rd->pend_nmb; i++) {
+		if (rd->pend[i].id == id) {
+			return (&rd->pend[i]);
+		}
+	}
+	return (NULL);
+}
+
+/**
+ * init_usb_pcap_wr
+ */
+int init_usb_pcap_wr(struct usb_pcap_wr *wr, FILE *f)
+{
+	uint8_t hdr[24];
+
+	wr->f = f;
+	wr->bus = 1;
+	wr->dev = 1;
+	wr->tm_hz = 1000000;
+	wr->id = 0;
+	wr->open = 0;
+	put32(hdr, PCAP_MAGIC);
+	put16(hdr + 4, 2);
+	put16(hdr + 6, 4);
+	put32(hdr + 8, 0);
+	put32(hdr + 12, 0);
+	put32(hdr + 16, USB_PCAP_REC_SZ);
+	put32(hdr + 20, USB_PCAP_LINKTYPE_USB_LINUX_MMAPPED);
+	return ((fwrite(hdr, 1, sizeof(hdr), f) == sizeof(hdr)) ? 0 : -1);
+}
+
+/**
+ * usb_pcap_wr_ctl
+ */
+int usb_pcap_wr_ctl(struct usb_pcap_wr *wr, const struct usb_pcap_ctl *ctl)
+{
+	wr->id++;
+	if (write_rec(wr, ctl, 1) < 0 || write_rec(wr, ctl, 0) < 0) {
+		return (-1);
+	}
+	return (0);
+}
+
+/**
+ * write_rec
+ *
+ * Submission carries SETUP and OUT data, completion IN data.
+ */
+static int write_rec(struct usb_pcap_wr *wr, const struct usb_pcap_ctl *ctl, int sub)
+{
+	uint8_t rec[16 + MON_MMAPPED_HDR_SZ];
+	int in = ctl->stp[0] & 0x80;
+	uint32_t nmb;
+
+	nmb = (sub == !in) ? ctl->nmb : 0;
+	memset(rec, 0, sizeof(rec));
+	put32(rec, ctl->sec);
+	put32(rec + 4, ctl->usec);
+	put32(rec + 8, MON_MMAPPED_HDR_SZ + nmb);
+	put32(rec + 12, MON_MMAPPED_HDR_SZ + nmb);
+	put64(rec + 16, wr->id);
+	rec[16 + 8] = (sub) ? 'S' : 'C';
+	rec[16 + 9] = MON_CTL_XFER;
+	rec[16 + 10] = (in) ? 0x80 : 0;
+	rec[16 + 11] = ctl->dev;
+	put16(rec + 16 + 12, ctl->bus);
+	rec[16 + 14] = (sub) ? 0 : '-';
+	rec[16 + 15] = (nmb) ? 0 : ((in) ? '<' : '>');
+	put64(rec + 16 + 16, ctl->sec);
+	put32(rec + 16 + 24, ctl->usec);
+	put32(rec + 16 + 28, (sub) ? (uint32_t) USB_PCAP_STATUS_PEND : (uint32_t) ctl->status);
+	put32(rec + 16 + 32, (sub) ? get16(ctl->stp + 6) : ctl->len);
+	put32(rec + 16 + 36, nmb);
+	if (sub) {
+		memcpy(rec + 16 + 40, ctl->stp, sizeof(ctl->stp));
+	}
+	if (fwrite(rec, 1, sizeof(rec), wr->f) != sizeof(rec) ||
+	    (nmb && fwrite(ctl->data, 1, nmb, wr->f) != nmb)) {
+		return (-1);
+	}
+	return (0);
+}
+
+/**
+ * usb_pcap_wr_trc
+ */
+int usb_pcap_wr_trc(struct usb_pcap_wr *wr, const struct usb_ctl_req_trc *trc)
+{
+	struct usb_pcap_ctl ctl;
+	int ret;
+
+	switch (trc->evnt) {
+	case USB_CTL_REQ_TRC_STP :
+		if ((ret = end_trc(wr, USB_PCAP_STATUS_RESET, trc->tm)) < 0) {
+			return (ret);
+		}
+		memcpy(wr->stp, trc->stp, sizeof(wr->stp));
+		wr->tm = trc->tm;
+		wr->nmb = 0;
+		wr->open = 1;
+		wr->id++;
+		ctl.bus = wr->bus;
+		ctl.dev = wr->dev;
+		memcpy(ctl.stp, wr->stp, sizeof(ctl.stp));
+		ctl.sec = trc->tm / wr->tm_hz;
+		ctl.usec = (uint64_t) (trc->tm % wr->tm_hz) * 1000000 / wr->tm_hz;
+		ctl.nmb = 0;
+		return (write_rec(wr, &ctl, 1));
+	case USB_CTL_REQ_TRC_IN_PKT :
+		/* FALLTHRU */
+	case USB_CTL_REQ_TRC_OUT_PKT :
+		wr->nmb += trc->arg;
+		return (0);
+	case USB_CTL_REQ_TRC_DONE :
+		return (end_trc(wr, USB_PCAP_STATUS_OK, trc->tm));
+	case USB_CTL_REQ_TRC_STALL :
+		return (end_trc(wr, USB_PCAP_STATUS_STALL, trc->tm));
+	case USB_CTL_REQ_TRC_ABORT :
+		return (end_trc(wr, USB_PCAP_STATUS_RESET, trc->tm));
+	default :
+		return (0);
+	}
+}
+
+/**
+ * end_trc
+ */
+static int end_trc(struct usb_pcap_wr *wr, int32_t status, uint32_t tm)
+{
+	struct usb_pcap_ctl ctl;
+
+	if (!wr->open) {
+		return (0);
+	}
+	wr->open = 0;
+	ctl.bus = wr->bus;
+	ctl.dev = wr->dev;
+	memcpy(ctl.stp, wr->stp, sizeof(ctl.stp));
+	ctl.status = status;
+	ctl.sec = tm / wr->tm_hz;
+	ctl.usec = (uint64_t) (tm % wr->tm_hz) * 1000000 / wr->tm_hz;
+	ctl.len = wr->nmb;
+	ctl.nmb = 0;
+	return (write_rec(wr, &ctl, 0));
+}
+
+/**
+ * get16
+ */
+static uint32_t get16(const uint8_t *p)
+{
+	return (p[0] | (p[1] << 8));
+}
+
+/**
+ * get32
+ */
+static uint32_t get32(const uint8_t *p)
+{
+	return (p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24));
+}
+
+/**
+ * get64
+ */
+static uint64_t get64(const uint8_t *p)
+{
+	return (get32(p) | ((uint64_t) get32(p + 4) << 32));
+}
+
+/**
+ * put16
+ */
+static void put16(uint8_t *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+/**
+ * put32
+ */
+static void put32(uint8_t *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+/**
+ * put64
+ */
+static void put64(uint8_t *p, uint64_t v)
+{
+	put32(p, v);
+	put32(p + 4, v >> 32);
+}
@@ -0,0 +1,127 @@
+/*
+ * usb_pcap.h
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef USB_PCAP_H
+#define USB_PCAP_H
+
+// Control transfers in pcap files of Linux usbmon (LINKTYPE_USB_LINUX 189
+// and LINKTYPE_USB_LINUX_MMAPPED 220, little endian). Header depends on
+// <stdint.h> and <stdio.h> only (trace record is declared incomplete),
+// it is built into host tools.
+
+#ifndef USB_PCAP_DATA_SZ
+ #define USB_PCAP_DATA_SZ 4096 // Data stage bytes kept per transfer.
+#endif
+#ifndef USB_PCAP_PEND_NMB
+ #define USB_PCAP_PEND_NMB 8 // Submitted, not completed transfers.
+#endif
+#define USB_PCAP_REC_SZ (64 + 65536)
+
+#define USB_PCAP_LINKTYPE_USB_LINUX 189
+#define USB_PCAP_LINKTYPE_USB_LINUX_MMAPPED 220
+
+#define USB_PCAP_STATUS_OK 0
+#define USB_PCAP_STATUS_STALL (-32) // -EPIPE
+#define USB_PCAP_STATUS_RESET (-104) // -ECONNRESET
+#define USB_PCAP_STATUS_PEND (-115) // -EINPROGRESS
+
+// Control transfer. data holds IN or OUT data stage (nmb bytes, length of
+// data stage is len). Time is time of SETUP.
+struct usb_pcap_ctl {
+	uint16_t bus;
+	uint8_t dev;
+	uint8_t stp[8];
+	int32_t status;
+	uint32_t sec;
+	uint32_t usec;
+	uint32_t len;
+	uint32_t nmb;
+	uint8_t data[USB_PCAP_DATA_SZ];
+};
+
+struct usb_pcap_pend {
+	uint64_t id;
+	struct usb_pcap_ctl ctl;
+};
+
+// Reader. Members are private.
+struct usb_pcap_rd {
+	FILE *f;
+	int hdr_sz;
+	struct usb_pcap_pend pend[USB_PCAP_PEND_NMB];
+	int pend_nmb;
+	uint32_t drop_cnt;
+	uint8_t rec[USB_PCAP_REC_SZ];
+};
+
+// Writer (LINKTYPE_USB_LINUX_MMAPPED). bus, dev and tm_hz (units of
+// trace time stamps per second) can be changed after init. Other members
+// are private.
+struct usb_pcap_wr {
+	FILE *f;
+	uint16_t bus;
+	uint8_t dev;
+	uint32_t tm_hz;
+	uint64_t id;
+	int open;
+	uint8_t stp[8];
+	uint32_t tm;
+	uint32_t nmb;
+};
+
+/**
+ * init_usb_pcap_rd
+ *
+ * Reads pcap file header. Returns 0 or -1 if file is not usbmon capture.
+ */
+int init_usb_pcap_rd(struct usb_pcap_rd *rd, FILE *f);
+
+/**
+ * usb_pcap_rd_ctl
+ *
+ * Reads next completed control transfer. Returns 1, 0 at end of file or
+ * -1 if file is damaged.
+ */
+int usb_pcap_rd_ctl(struct usb_pcap_rd *rd, struct usb_pcap_ctl *ctl);
+
+/**
+ * init_usb_pcap_wr
+ *
+ * Writes pcap file header. Returns 0 or -1 on write error.
+ */
+int init_usb_pcap_wr(struct usb_pcap_wr *wr, FILE *f);
+
+/**
+ * usb_pcap_wr_ctl
+ *
+ * Writes submission and completion records of transfer.
+ */
+int usb_pcap_wr_ctl(struct usb_pcap_wr *wr, const struct usb_pcap_ctl *ctl);
+
+struct usb_ctl_req_trc;
+
+/**
+ * usb_pcap_wr_trc
+ *
+ * Converts trace record of control engine. Transfer is written when it
+ * ends (DONE, STALL or ABORT record), without data stage bytes (trace
+ * keeps their count only).
+ */
+int usb_pcap_wr_trc(struct usb_pcap_wr *wr, const struct usb_ctl_req_trc *trc);
+
+#endif
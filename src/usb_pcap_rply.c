@@ -0,0 +1,260 @@
+/*
+ * usb_pcap_rply.c
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <gentyp.h>
+#include "sysconf.h"
+#include "criterr.h"
+#include "udp.h"
+#include "usb_std_def.h"
+#include "usb_ctl_req_trc.h"
+#include "usb_ctl_req.h"
+#include "usb_pcap.h"
+#include "usb_pcap_rply.h"
+
+#define PKT_LIMIT 4096
+
+static int pkt_sz(void *hw);
+static void read_fifo(void *hw, void *buf, int nmb);
+static void write_fifo(void *hw, const void *buf, int nmb);
+static void rxstp_done(void *hw, int dir);
+static void tx_pkt_rdy(void *hw);
+static void req_stl(void *hw);
+static void nop(void *hw);
+static boolean_t run_in(struct usb_pcap_rply *rply);
+static boolean_t run_out(struct usb_pcap_rply *rply, const struct usb_pcap_ctl *ctl);
+static enum usb_pcap_rply_res cmp(struct usb_pcap_rply *rply, const struct usb_pcap_ctl *ctl, boolean_t status);
+
+// Driver of emulated endpoint 0, host side is played by replay.
+const struct usb_ctl_req_drv usb_pcap_rply_drv = {
+	.in_bat = 1,
+	.pkt_sz = pkt_sz,
+	.read_fifo = read_fifo,
+	.write_fifo = write_fifo,
+	.rxstp_done = rxstp_done,
+	.tx_pkt_rdy = tx_pkt_rdy,
+	.req_stl = req_stl,
+	.disable_stl = nop,
+	.txcomp_accept = nop,
+	.rxdata_done = nop,
+	.stlsnt_accept = nop
+};
+
+/**
+ * init_usb_pcap_rply
+ */
+void init_usb_pcap_rply(struct usb_pcap_rply *rply, struct usb_ctl_req_dev *dev)
+{
+	if (rply->mps != 8 && rply->mps != 16 && rply->mps != 32 && rply->mps != 64) {
+		crit_err_exit(BAD_PARAMETER);
+	}
+	rply->dev = dev;
+	memset(&rply->stats, 0, sizeof(struct usb_pcap_rply_stats));
+}
+
+/**
+ * usb_pcap_rply_ctl
+ */
+enum usb_pcap_rply_res usb_pcap_rply_ctl(struct usb_pcap_rply *rply, const struct usb_pcap_ctl *ctl,
+					 struct usb_pcap_ctl *res)
+{
+	enum usb_pcap_rply_res r;
+	boolean_t status;
+
+	*res = *ctl;
+	rply->tx = res->data;
+	rply->tx_sz = USB_PCAP_DATA_SZ;
+	rply->tx_nmb = 0;
+	rply->rdy = 0;
+	rply->stall = FALSE;
+	rply->rx = ctl->stp;
+	rply->rx_nmb = sizeof(ctl->stp);
+	usb_ctl_req_rxstp(rply->dev);
+	if (ctl->stp[0] & 0x80) {
+		status = run_in(rply);
+	} else {
+		status = run_out(rply, ctl);
+	}
+	if (rply->stall) {
+		usb_ctl_req_stlsnt(rply->dev);
+		res->status = USB_PCAP_STATUS_STALL;
+		res->len = 0;
+	} else {
+		res->status = (status) ? USB_PCAP_STATUS_OK : USB_PCAP_STATUS_PEND;
+		res->len = (ctl->stp[0] & 0x80) ? (uint32_t) rply->tx_nmb : ctl->len;
+	}
+	if (ctl->stp[0] & 0x80) {
+		res->nmb = rply->tx_nmb;
+	}
+	r = cmp(rply, ctl, status);
+	rply->stats.cnt[r]++;
+	return (r);
+}
+
+/**
+ * run_in
+ *
+ * Host reads packets while engine queues them, then sends zero length
+ * OUT status packet.
+ */
+static boolean_t run_in(struct usb_pcap_rply *rply)
+{
+	int i;
+
+	for (i = 0; i < PKT_LIMIT && rply->rdy && !rply->stall; i++) {
+		rply->rdy = 0;
+		usb_ctl_req_txcomp(rply->dev);
+	}
+	if (rply->stall || rply->rdy) {
+		return (FALSE);
+	}
+	rply->rx_nmb = 0;
+	usb_ctl_req_rxdata(rply->dev, 0);
+	return (TRUE);
+}
+
+/**
+ * run_out
+ *
+ * Host sends OUT data stage in max packet size packets, then reads zero
+ * length IN status packet. Data missing in capture (snap length) are sent
+ * as zeros. Returns FALSE if status stage is NAKed.
+ */
+static boolean_t run_out(struct usb_pcap_rply *rply, const struct usb_pcap_ctl *ctl)
+{
+	uint8_t pkt[64];
+	int len, offs, n, m;
+
+	len = ctl->stp[6] | (ctl->stp[7] << 8);
+	for (offs = 0; offs < len && !rply->stall; offs += n) {
+		n = (len - offs < rply->mps) ? len - offs : rply->mps;
+		if (offs + n <= (int) ctl->nmb) {
+			rply->rx = ctl->data + offs;
+		} else {
+			m = (offs < (int) ctl->nmb) ? (int) ctl->nmb - offs : 0;
+			memset(pkt, 0, n);
+			memcpy(pkt, ctl->data + offs, m);
+			rply->rx = pkt;
+		}
+		rply->rx_nmb = n;
+		usb_ctl_req_rxdata(rply->dev, n);
+	}
+	if (rply->stall || !rply->rdy) {
+		return (FALSE);
+	}
+	rply->rdy = 0;
+	usb_ctl_req_txcomp(rply->dev);
+	return (TRUE);
+}
+
+/**
+ * cmp
+ */
+static enum usb_pcap_rply_res cmp(struct usb_pcap_rply *rply, const struct usb_pcap_ctl *ctl, boolean_t status)
+{
+	int n;
+
+	if (ctl->status != USB_PCAP_STATUS_OK && ctl->status != USB_PCAP_STATUS_STALL) {
+		return (USB_PCAP_RPLY_SKIP);
+	}
+	if (!(ctl->stp[0] & 0x80) && ctl->nmb < (uint32_t) (ctl->stp[6] | (ctl->stp[7] << 8))) {
+		// OUT data truncated in capture, engine got zeros.
+		return (USB_PCAP_RPLY_SKIP);
+	}
+	if ((ctl->status == USB_PCAP_STATUS_STALL) != rply->stall) {
+		return (USB_PCAP_RPLY_STALL_DIFF);
+	}
+	if (rply->stall) {
+		return (USB_PCAP_RPLY_MATCH);
+	}
+	if (!status) {
+		return (USB_PCAP_RPLY_NO_STATUS);
+	}
+	if (ctl->stp[0] & 0x80) {
+		// Capture may be truncated by snap length.
+		n = (ctl->nmb < (uint32_t) rply->tx_nmb) ? (int) ctl->nmb : rply->tx_nmb;
+		if (ctl->len != (uint32_t) rply->tx_nmb || memcmp(ctl->data, rply->tx, n)) {
+			return (USB_PCAP_RPLY_DATA_DIFF);
+		}
+	}
+	return (USB_PCAP_RPLY_MATCH);
+}
+
+/**
+ * pkt_sz
+ */
+static int pkt_sz(void *hw)
+{
+	return (((struct usb_pcap_rply *) hw)->mps);
+}
+
+/**
+ * read_fifo
+ */
+static void read_fifo(void *hw, void *buf, int nmb)
+{
+	struct usb_pcap_rply *rply = hw;
+
+	memcpy(buf, rply->rx, (nmb < rply->rx_nmb) ? nmb : rply->rx_nmb);
+}
+
+/**
+ * write_fifo
+ */
+static void write_fifo(void *hw, const void *buf, int nmb)
+{
+	struct usb_pcap_rply *rply = hw;
+	int n;
+
+	n = (rply->tx_nmb + nmb <= rply->tx_sz) ? nmb : rply->tx_sz - rply->tx_nmb;
+	memcpy(rply->tx + rply->tx_nmb, buf, n);
+	rply->tx_nmb += n;
+}
+
+/**
+ * rxstp_done
+ */
+static void rxstp_done(void *hw, int dir)
+{
+}
+
+/**
+ * tx_pkt_rdy
+ */
+static void tx_pkt_rdy(void *hw)
+{
+	((struct usb_pcap_rply *) hw)->rdy++;
+}
+
+/**
+ * req_stl
+ */
+static void req_stl(void *hw)
+{
+	((struct usb_pcap_rply *) hw)->stall = TRUE;
+}
+
+/**
+ * nop
+ */
+static void nop(void *hw)
+{
+}
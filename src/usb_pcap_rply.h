@@ -0,0 +1,71 @@
+/*
+ * usb_pcap_rply.h
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef USB_PCAP_RPLY_H
+#define USB_PCAP_RPLY_H
+
+// Replay of captured control transfers against engine instance (host
+// build). Engine is initialized with usb_pcap_rply_drv and replay object
+// as hw, application registers its callbacks as on target.
+
+enum usb_pcap_rply_res {
+	USB_PCAP_RPLY_MATCH,
+	USB_PCAP_RPLY_STALL_DIFF, // Stalled in one of capture and replay only.
+	USB_PCAP_RPLY_DATA_DIFF, // IN data stage differs.
+	USB_PCAP_RPLY_NO_STATUS, // Status stage not reached (pended request).
+	USB_PCAP_RPLY_SKIP // Transfer failed in capture (not stall) or its OUT data are truncated.
+};
+
+struct usb_pcap_rply_stats {
+	unsigned int cnt[USB_PCAP_RPLY_SKIP + 1];
+};
+
+// Replay state. mps is max packet size of endpoint 0 (set before init of
+// engine). Members after stats are private.
+struct usb_pcap_rply {
+	uint8_t mps;
+	struct usb_pcap_rply_stats stats;
+	struct usb_ctl_req_dev *dev;
+	const uint8_t *rx;
+	int rx_nmb;
+	uint8_t *tx;
+	int tx_sz;
+	int tx_nmb;
+	int rdy;
+	boolean_t stall;
+};
+
+extern const struct usb_ctl_req_drv usb_pcap_rply_drv;
+
+/**
+ * init_usb_pcap_rply
+ *
+ * Binds replay to engine instance dev (initialized with hw rply).
+ */
+void init_usb_pcap_rply(struct usb_pcap_rply *rply, struct usb_ctl_req_dev *dev);
+
+/**
+ * usb_pcap_rply_ctl
+ *
+ * Runs transfer ctl through engine and compares result. Transfer as
+ * performed by engine is stored to res (for usb_pcap_wr_ctl()).
+ */
+enum usb_pcap_rply_res usb_pcap_rply_ctl(struct usb_pcap_rply *rply, const struct usb_pcap_ctl *ctl,
+					 struct usb_pcap_ctl *res);
+
+#endif
@@ -89,3 +89,203 @@ enum udp_endp_type usb_endp_desc_get_ep_type(const struct usb_endp_desc *desc)
 	}
         return (UDP_CTRL_ENDP);
 }
+
+/**
+ * init_usb_desc_iter
+ */
+void init_usb_desc_iter(struct usb_desc_iter *iter, const void *descs, int descs_sz)
+{
+	iter->dsc = descs;
+	iter->end = (const uint8_t *) descs + descs_sz;
+}
+
+/**
+ * usb_desc_iter_next
+ */
+const struct usb_gen_desc *usb_desc_iter_next(struct usb_desc_iter *iter, int type)
+{
+	const uint8_t *ret;
+
+	while (iter->end - iter->dsc >= 2) {
+		ret = iter->dsc;
+		if (*ret < 2 || *ret > iter->end - ret) {
+			break;
+		}
+		iter->dsc += *ret;
+		if (type == 0 || *(ret + 1) == type) {
+			return ((const struct usb_gen_desc *) ret);
+		}
+	}
+	iter->dsc = iter->end;
+	return (NULL);
+}
+
+/**
+ * init_usb_desc_idx
+ */
+boolean_t init_usb_desc_idx(struct usb_desc_idx *idx, const void *conf_descs, int conf_descs_sz)
+{
+	const uint8_t *dsc, *end;
+	struct usb_desc_idx_iface *ifc = NULL;
+	const struct usb_iface_desc *id;
+	const struct usb_endp_desc *ed;
+	int i;
+
+	idx->conf = conf_descs;
+	idx->conf_sz = conf_descs_sz;
+	idx->alt_nmb = 0;
+	idx->iad_nmb = 0;
+	for (i = 0; i < USB_DESC_IDX_IFACE_NMB; i++) {
+		idx->iface_alt0[i] = -1;
+		idx->iface_alt_cnt[i] = 0;
+	}
+	for (i = 0; i < 32; i++) {
+		idx->endp[i] = NULL;
+		idx->endp_iface[i] = -1;
+	}
+	dsc = conf_descs;
+	end = dsc + conf_descs_sz;
+	while (dsc < end) {
+		if (end - dsc < 2 || *dsc < 2 || *dsc > end - dsc) {
+			return (FALSE);
+		}
+		switch (*(dsc + 1)) {
+		case USB_IFACE_ASSOC_DESC :
+			if (ifc) {
+				ifc->end = dsc;
+				ifc = NULL;
+			}
+			if (idx->iad_nmb == USB_DESC_IDX_IAD_NMB) {
+				return (FALSE);
+			}
+			idx->iad[idx->iad_nmb++] = (const struct usb_iface_assoc_desc *) dsc;
+			break;
+		case USB_IFACE_DESC :
+			if (ifc) {
+				ifc->end = dsc;
+			}
+			id = (const struct usb_iface_desc *) dsc;
+			if (id->b_interface_number >= USB_DESC_IDX_IFACE_NMB ||
+			    idx->alt_nmb == USB_DESC_IDX_ALT_NMB) {
+				return (FALSE);
+			}
+			if (id->b_alternate_setting == 0) {
+				if (idx->iface_alt0[id->b_interface_number] != -1) {
+					return (FALSE);
+				}
+				idx->iface_alt0[id->b_interface_number] = idx->alt_nmb;
+			} else {
+				// Alternate settings must follow each other in order.
+				if (ifc == NULL || ifc->desc->b_interface_number != id->b_interface_number ||
+				    ifc->desc->b_alternate_setting + 1 != id->b_alternate_setting) {
+					return (FALSE);
+				}
+			}
+			idx->iface_alt_cnt[id->b_interface_number]++;
+			ifc = &idx->alt[idx->alt_nmb++];
+			ifc->desc = id;
+			ifc->cs = dsc + *dsc;
+			ifc->end = end;
+			break;
+		case USB_ENDP_DESC :
+			ed = (const struct usb_endp_desc *) dsc;
+			i = usb_desc_idx_endp_ix(ed->b_endpoint_address);
+			if (idx->endp[i] == NULL) {
+				idx->endp[i] = ed;
+				if (ifc) {
+					idx->endp_iface[i] = ifc->desc->b_interface_number;
+				}
+			}
+			break;
+		}
+		dsc += *dsc;
+	}
+	return (TRUE);
+}
+
+/**
+ * usb_desc_idx_get_endp
+ */
+const struct usb_endp_desc *usb_desc_idx_get_endp(const struct usb_desc_idx *idx, int addr)
+{
+	return (idx->endp[usb_desc_idx_endp_ix(addr)]);
+}
+
+/**
+ * usb_desc_idx_get_endp_iface
+ */
+int usb_desc_idx_get_endp_iface(const struct usb_desc_idx *idx, int addr)
+{
+	return (idx->endp_iface[usb_desc_idx_endp_ix(addr)]);
+}
+
+/**
+ * usb_desc_idx_get_alt_nmb
+ */
+int usb_desc_idx_get_alt_nmb(const struct usb_desc_idx *idx, int num)
+{
+	if (num < 0 || num >= USB_DESC_IDX_IFACE_NMB) {
+		return (0);
+	}
+	return (idx->iface_alt_cnt[num]);
+}
+
+/**
+ * get_alt
+ */
+static const struct usb_desc_idx_iface *get_alt(const struct usb_desc_idx *idx, int num, int alt);
+static const struct usb_desc_idx_iface *get_alt(const struct usb_desc_idx *idx, int num, int alt)
+{
+	if (alt < 0 || alt >= usb_desc_idx_get_alt_nmb(idx, num)) {
+		return (NULL);
+	}
+	return (&idx->alt[idx->iface_alt0[num] + alt]);
+}
+
+/**
+ * usb_desc_idx_get_iface
+ */
+const struct usb_iface_desc *usb_desc_idx_get_iface(const struct usb_desc_idx *idx, int num, int alt)
+{
+	const struct usb_desc_idx_iface *ifc;
+
+	if (!(ifc = get_alt(idx, num, alt))) {
+		return (NULL);
+	}
+	return (ifc->desc);
+}
+
+/**
+ * usb_desc_idx_get_cs
+ */
+boolean_t usb_desc_idx_get_cs(const struct usb_desc_idx *idx, int num, int alt, struct usb_desc_iter *iter)
+{
+	const struct usb_desc_idx_iface *ifc;
+	const uint8_t *dsc;
+
+	if (!(ifc = get_alt(idx, num, alt))) {
+		return (FALSE);
+	}
+	for (dsc = ifc->cs; dsc < ifc->end; dsc += *dsc) {
+		if (*(dsc + 1) == USB_ENDP_DESC) {
+			break;
+		}
+	}
+	init_usb_desc_iter(iter, ifc->cs, dsc - ifc->cs);
+	return (TRUE);
+}
+
+/**
+ * usb_desc_idx_get_iface_iter
+ */
+boolean_t usb_desc_idx_get_iface_iter(const struct usb_desc_idx *idx, int num, int alt,
+                                      struct usb_desc_iter *iter)
+{
+	const struct usb_desc_idx_iface *ifc;
+
+	if (!(ifc = get_alt(idx, num, alt))) {
+		return (FALSE);
+	}
+	init_usb_desc_iter(iter, ifc->cs, ifc->end - ifc->cs);
+	return (TRUE);
+}
@@ -45,6 +45,12 @@
 
 #define usb_std_unicode(c) (c), 0
 #define USB_STD_EN_US_CODE 0x09, 0x04
+#define USB_STD_LANGID_EN_US 0x0409
+#define USB_STD_LANGID_EN_GB 0x0809
+#define USB_STD_LANGID_DE_DE 0x0407
+#define USB_STD_LANGID_FR_FR 0x040C
+#define USB_STD_LANGID_CS_CZ 0x0405
+#define USB_STD_LANGID_SK_SK 0x041B
 #define usb_std_str_desc_size(c_num) ((c_num) * 2 + 2)
 
 enum usb_desc_type {
@@ -145,8 +151,49 @@ struct usb_gen_desc {
 	uint8_t type;
 } __attribute__ ((__packed__));
 
+#ifndef USB_DESC_IDX_IFACE_NMB
+ #define USB_DESC_IDX_IFACE_NMB 8
+#endif
+#ifndef USB_DESC_IDX_ALT_NMB
+ #define USB_DESC_IDX_ALT_NMB 16
+#endif
+#ifndef USB_DESC_IDX_IAD_NMB
+ #define USB_DESC_IDX_IAD_NMB 4
+#endif
+
+#define usb_desc_idx_endp_ix(addr) ((((addr) & 0x80) >> 3) | ((addr) & 0x0F))
+
+// Descriptor walk iterator.
+struct usb_desc_iter {
+	const uint8_t *dsc;
+	const uint8_t *end;
+};
+
+// Indexed interface (alternate setting).
+struct usb_desc_idx_iface {
+	const struct usb_iface_desc *desc;
+	const uint8_t *cs;
+	const uint8_t *end;
+};
+
+// Configuration descriptor index.
+struct usb_desc_idx {
+	const struct usb_conf_desc *conf;
+	int conf_sz;
+	struct usb_desc_idx_iface alt[USB_DESC_IDX_ALT_NMB];
+	uint8_t alt_nmb;
+	int8_t iface_alt0[USB_DESC_IDX_IFACE_NMB];
+	uint8_t iface_alt_cnt[USB_DESC_IDX_IFACE_NMB];
+	const struct usb_endp_desc *endp[32];
+	int8_t endp_iface[32];
+	const struct usb_iface_assoc_desc *iad[USB_DESC_IDX_IAD_NMB];
+	uint8_t iad_nmb;
+};
+
 /**
  * find_usb_endp_desc
+ *
+ * Keeps its cursor in static variables (not reentrant), see usb_desc_idx.
  */
 const struct usb_endp_desc *find_usb_endp_desc(const void *conf_descs, int conf_descs_sz);
 
@@ -155,4 +202,70 @@ const struct usb_endp_desc *find_usb_endp_desc(const void *conf_descs, int conf_
  */
 enum udp_endp_type usb_endp_desc_get_ep_type(const struct usb_endp_desc *desc);
 
+/**
+ * init_usb_desc_iter
+ */
+void init_usb_desc_iter(struct usb_desc_iter *iter, const void *descs, int descs_sz);
+
+/**
+ * usb_desc_iter_next
+ *
+ * Returns next descriptor of given type (type 0 matches any descriptor)
+ * or NULL at the end of walk.
+ */
+const struct usb_gen_desc *usb_desc_iter_next(struct usb_desc_iter *iter, int type);
+
+/**
+ * init_usb_desc_idx
+ *
+ * Builds index of configuration descriptor blob (conf_descs must stay
+ * valid while index is used). Returns FALSE if blob is malformed or does
+ * not fit into index.
+ */
+boolean_t init_usb_desc_idx(struct usb_desc_idx *idx, const void *conf_descs, int conf_descs_sz);
+
+/**
+ * usb_desc_idx_get_endp
+ *
+ * Returns endpoint descriptor by endpoint address (first occurrence).
+ */
+const struct usb_endp_desc *usb_desc_idx_get_endp(const struct usb_desc_idx *idx, int addr);
+
+/**
+ * usb_desc_idx_get_endp_iface
+ *
+ * Returns number of interface owning endpoint or -1.
+ */
+int usb_desc_idx_get_endp_iface(const struct usb_desc_idx *idx, int addr);
+
+/**
+ * usb_desc_idx_get_alt_nmb
+ *
+ * Returns number of alternate settings of interface (0 if not present).
+ */
+int usb_desc_idx_get_alt_nmb(const struct usb_desc_idx *idx, int num);
+
+/**
+ * usb_desc_idx_get_iface
+ */
+const struct usb_iface_desc *usb_desc_idx_get_iface(const struct usb_desc_idx *idx, int num, int alt);
+
+/**
+ * usb_desc_idx_get_cs
+ *
+ * Initializes iter to walk class-specific descriptors of interface
+ * (descriptors between interface descriptor and its first endpoint).
+ * Returns FALSE if interface is not present.
+ */
+boolean_t usb_desc_idx_get_cs(const struct usb_desc_idx *idx, int num, int alt, struct usb_desc_iter *iter);
+
+/**
+ * usb_desc_idx_get_iface_iter
+ *
+ * Initializes iter to walk all descriptors following interface descriptor
+ * up to next interface. Returns FALSE if interface is not present.
+ */
+boolean_t usb_desc_idx_get_iface_iter(const struct usb_desc_idx *idx, int num, int alt,
+                                      struct usb_desc_iter *iter);
+
 #endif
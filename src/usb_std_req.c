@@ -0,0 +1,380 @@
+/*
+ * usb_std_req.c
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <gentyp.h>
+#include "sysconf.h"
+#include "criterr.h"
+#include "udp.h"
+#include "usb_std_def.h"
+#include "usb_ctl_req_trc.h"
+#include "usb_ctl_req.h"
+#include "usb_str_desc.h"
+#include "usb_std_req.h"
+
+static struct usb_ctl_req stp_clbk(struct usb_ctl_req_dev *dev, struct usb_stp_pkt *stp);
+static void in_req_ack_clbk(struct usb_ctl_req_dev *dev);
+static boolean_t out_req_rec_clbk(struct usb_ctl_req_dev *dev);
+static void out_req_ack_clbk(struct usb_ctl_req_dev *dev);
+static struct usb_ctl_req get_status(struct usb_std_req *sr, struct usb_stp_pkt *stp);
+static boolean_t set_feat(struct usb_std_req *sr, struct usb_stp_pkt *stp, boolean_t set);
+static struct usb_ctl_req get_desc(struct usb_std_req *sr, struct usb_stp_pkt *stp);
+static boolean_t set_conf(struct usb_std_req *sr, int val);
+static boolean_t set_iface(struct usb_std_req *sr, int iface, int alt);
+static struct usb_ctl_req in_req(struct usb_std_req *sr, const void *buf, int nmb, int w_length);
+static boolean_t endp_valid(struct usb_std_req *sr, int addr);
+
+/**
+ * init_usb_std_req
+ */
+void init_usb_std_req(struct usb_std_req *sr, struct usb_ctl_req_dev *dev)
+{
+	int i;
+
+	if (!sr->dev_desc || !sr->hooks || !sr->hooks->set_addr || sr->conf_nmb < 1) {
+		crit_err_exit(BAD_PARAMETER);
+	}
+	for (i = 0; i < sr->conf_nmb; i++) {
+		if (!init_usb_desc_idx(sr->conf[i].idx, sr->conf[i].desc, sr->conf[i].desc_sz)) {
+			crit_err_exit(BAD_PARAMETER);
+		}
+	}
+	sr->dev = dev;
+	sr->clbks.stp_clbk = stp_clbk;
+	sr->clbks.in_req_ack_clbk = in_req_ack_clbk;
+	sr->clbks.out_req_rec_clbk = out_req_rec_clbk;
+	sr->clbks.out_req_ack_clbk = out_req_ack_clbk;
+	sr->clbks.defer = FALSE;
+	sr->clbks.arg = sr;
+	reset_usb_std_req(sr);
+	add_usb_ctl_req_std_clbks(dev, &sr->clbks);
+}
+
+/**
+ * reset_usb_std_req
+ */
+void reset_usb_std_req(struct usb_std_req *sr)
+{
+	memset(&sr->state, 0, sizeof(sr->state));
+	sr->act_idx = NULL;
+	sr->addr_pend = FALSE;
+	set_usb_ctl_req_fn_conf(sr->dev, NULL);
+}
+
+/**
+ * usb_std_req_get_idx
+ */
+const struct usb_desc_idx *usb_std_req_get_idx(struct usb_std_req *sr)
+{
+	return (sr->act_idx);
+}
+
+/**
+ * stp_clbk
+ */
+static struct usb_ctl_req stp_clbk(struct usb_ctl_req_dev *dev, struct usb_stp_pkt *stp)
+{
+	struct usb_std_req *sr = usb_ctl_req_get_arg(dev);
+	struct usb_ctl_req req;
+	int recp, frame;
+
+	memset(&req, 0, sizeof(req));
+	sr->addr_pend = FALSE;
+	recp = stp->bm_request_type & 0x1F;
+	switch (stp->b_request) {
+	case USB_GET_STATUS :
+		return (get_status(sr, stp));
+	case USB_CLEAR_FEATURE :
+		/* FALLTHRU */
+	case USB_SET_FEATURE :
+		req.valid = set_feat(sr, stp, stp->b_request == USB_SET_FEATURE);
+		break;
+	case USB_SET_ADDRESS :
+		if (recp == USB_DEVICE_RECIPIENT && stp->w_value < 128 && sr->state.conf == 0) {
+			sr->pend_addr = stp->w_value;
+			sr->addr_pend = TRUE;
+			req.valid = TRUE;
+		}
+		break;
+	case USB_GET_DESCRIPTOR :
+		return (get_desc(sr, stp));
+	case USB_GET_CONFIGURATION :
+		if (recp == USB_DEVICE_RECIPIENT && sr->state.addr) {
+			sr->reply[0] = sr->state.conf;
+			return (in_req(sr, sr->reply, 1, stp->w_length));
+		}
+		break;
+	case USB_SET_CONFIGURATION :
+		if (recp == USB_DEVICE_RECIPIENT && sr->state.addr) {
+			req.valid = set_conf(sr, stp->w_value & 0xFF);
+		}
+		break;
+	case USB_GET_INTERFACE :
+		if (recp == USB_IFACE_RECIPIENT && sr->act_idx && stp->w_index < USB_DESC_IDX_IFACE_NMB &&
+		    usb_desc_idx_get_alt_nmb(sr->act_idx, stp->w_index)) {
+			sr->reply[0] = sr->state.alt[stp->w_index];
+			return (in_req(sr, sr->reply, 1, stp->w_length));
+		}
+		break;
+	case USB_SET_INTERFACE :
+		if (recp == USB_IFACE_RECIPIENT && sr->act_idx) {
+			req.valid = set_iface(sr, stp->w_index, stp->w_value);
+		}
+		break;
+	case USB_SYNCH_FRAME :
+		if (recp == USB_ENDP_RECIPIENT && endp_valid(sr, stp->w_index) && sr->hooks->get_frame &&
+		    (frame = sr->hooks->get_frame(sr, stp->w_index)) >= 0) {
+			sr->reply[0] = frame & 0xFF;
+			sr->reply[1] = frame >> 8;
+			return (in_req(sr, sr->reply, 2, stp->w_length));
+		}
+		break;
+	}
+	if (req.valid) {
+		req.trans_dir = UDP_CTL_TRANS_OUT;
+	}
+	return (req);
+}
+
+/**
+ * get_status
+ */
+static struct usb_ctl_req get_status(struct usb_std_req *sr, struct usb_stp_pkt *stp)
+{
+	struct usb_ctl_req req;
+
+	sr->reply[1] = 0;
+	switch (stp->bm_request_type & 0x1F) {
+	case USB_DEVICE_RECIPIENT :
+		sr->reply[0] = ((sr->self_pwr) ? 1 : 0) | ((sr->state.rwkup) ? 2 : 0);
+		return (in_req(sr, sr->reply, 2, stp->w_length));
+	case USB_IFACE_RECIPIENT :
+		if (sr->act_idx && stp->w_index < USB_DESC_IDX_IFACE_NMB &&
+		    usb_desc_idx_get_alt_nmb(sr->act_idx, stp->w_index)) {
+			sr->reply[0] = 0;
+			return (in_req(sr, sr->reply, 2, stp->w_length));
+		}
+		break;
+	case USB_ENDP_RECIPIENT :
+		if ((stp->w_index & 0x0F) == 0 || endp_valid(sr, stp->w_index)) {
+			sr->reply[0] = (sr->state.halt >> usb_desc_idx_endp_ix(stp->w_index)) & 1;
+			return (in_req(sr, sr->reply, 2, stp->w_length));
+		}
+		break;
+	}
+	memset(&req, 0, sizeof(req));
+	return (req);
+}
+
+/**
+ * set_feat
+ */
+static boolean_t set_feat(struct usb_std_req *sr, struct usb_stp_pkt *stp, boolean_t set)
+{
+	uint32_t msk;
+
+	switch (stp->bm_request_type & 0x1F) {
+	case USB_DEVICE_RECIPIENT :
+		if (stp->w_value == USB_DEV_REM_WKUP_FEAT) {
+			sr->state.rwkup = set;
+			return (TRUE);
+		}
+		// Test mode is not supported.
+		return (FALSE);
+	case USB_ENDP_RECIPIENT :
+		if (stp->w_value != USB_ENDP_HALT_FEAT || (stp->w_index & 0x0F) == 0 ||
+		    !endp_valid(sr, stp->w_index)) {
+			return (FALSE);
+		}
+		msk = 1UL << usb_desc_idx_endp_ix(stp->w_index);
+		if (set) {
+			sr->state.halt |= msk;
+		} else {
+			sr->state.halt &= ~msk;
+		}
+		if (sr->hooks->set_endp_halt) {
+			sr->hooks->set_endp_halt(sr, stp->w_index & 0x8F, set);
+		}
+		return (TRUE);
+	default :
+		return (FALSE);
+	}
+}
+
+/**
+ * get_desc
+ */
+static struct usb_ctl_req get_desc(struct usb_std_req *sr, struct usb_stp_pkt *stp)
+{
+	struct usb_ctl_req req;
+	int ix = stp->w_value & 0xFF;
+
+	if ((stp->bm_request_type & 0x1F) == USB_DEVICE_RECIPIENT) {
+		switch (stp->w_value >> 8) {
+		case USB_DEV_DESC :
+			return (in_req(sr, sr->dev_desc, sizeof(struct usb_dev_desc), stp->w_length));
+		case USB_CONF_DESC :
+			if (ix < sr->conf_nmb) {
+				return (in_req(sr, sr->conf[ix].desc, sr->conf[ix].desc_sz, stp->w_length));
+			}
+			break;
+		case USB_STR_DESC :
+			if (sr->str) {
+				return (usb_str_desc_req(sr->str, stp));
+			}
+			break;
+		case USB_DEV_QUAL_DESC :
+			if (sr->qual_desc) {
+				return (in_req(sr, sr->qual_desc, sizeof(struct usb_dev_qual_desc),
+					       stp->w_length));
+			}
+			break;
+		}
+	}
+	memset(&req, 0, sizeof(req));
+	return (req);
+}
+
+/**
+ * set_conf
+ */
+static boolean_t set_conf(struct usb_std_req *sr, int val)
+{
+	const struct usb_desc_idx *idx = NULL;
+	int i, ifc;
+
+	if (val) {
+		for (i = 0; i < sr->conf_nmb; i++) {
+			if (sr->conf[i].idx->conf->b_configuration_value == val) {
+				idx = sr->conf[i].idx;
+				break;
+			}
+		}
+		if (idx == NULL) {
+			return (FALSE);
+		}
+	}
+	if (sr->hooks->set_conf && !sr->hooks->set_conf(sr, idx)) {
+		return (FALSE);
+	}
+	sr->act_idx = idx;
+	sr->state.conf = val;
+	sr->state.halt = 0;
+	sr->state.endp = 0;
+	memset(sr->state.alt, 0, sizeof(sr->state.alt));
+	memset(sr->state.iface_endp, 0, sizeof(sr->state.iface_endp));
+	if (idx) {
+		for (i = 0; i < 32; i++) {
+			if ((ifc = idx->endp_iface[i]) >= 0) {
+				sr->state.endp |= 1UL << i;
+				sr->state.iface_endp[ifc] |= 1UL << i;
+			}
+		}
+	}
+	set_usb_ctl_req_fn_conf(sr->dev, idx);
+	return (TRUE);
+}
+
+/**
+ * set_iface
+ */
+static boolean_t set_iface(struct usb_std_req *sr, int iface, int alt)
+{
+	uint32_t msk;
+	int i;
+
+	if (iface >= USB_DESC_IDX_IFACE_NMB || !usb_desc_idx_get_iface(sr->act_idx, iface, alt)) {
+		return (FALSE);
+	}
+	if (sr->hooks->set_iface && !sr->hooks->set_iface(sr, iface, alt)) {
+		return (FALSE);
+	}
+	sr->state.alt[iface] = alt;
+	// Endpoints of interface restart with halt cleared and DATA0 toggle.
+	msk = sr->state.iface_endp[iface];
+	sr->state.halt &= ~msk;
+	if (sr->hooks->set_endp_halt) {
+		for (i = 0; i < 32; i++) {
+			if (msk & (1UL << i)) {
+				sr->hooks->set_endp_halt(sr, ((i & 0x10) << 3) | (i & 0x0F), FALSE);
+			}
+		}
+	}
+	return (TRUE);
+}
+
+/**
+ * endp_valid
+ */
+static boolean_t endp_valid(struct usb_std_req *sr, int addr)
+{
+	if ((addr & 0x70) || (addr & 0xFF00)) {
+		return (FALSE);
+	}
+	return ((sr->state.endp >> usb_desc_idx_endp_ix(addr)) & 1);
+}
+
+/**
+ * in_req
+ */
+static struct usb_ctl_req in_req(struct usb_std_req *sr, const void *buf, int nmb, int w_length)
+{
+	struct usb_ctl_req req;
+
+	memset(&req, 0, sizeof(req));
+	// Descriptors are sent zero-copy from flash.
+	sr->frag.buf = buf;
+	sr->frag.nmb = nmb;
+	req.valid = TRUE;
+	req.trans_dir = UDP_CTL_TRANS_IN;
+	req.trans_nmb = w_length;
+	req.nmb = (nmb < w_length) ? nmb : w_length;
+	req.frag = &sr->frag;
+	return (req);
+}
+
+/**
+ * in_req_ack_clbk
+ */
+static void in_req_ack_clbk(struct usb_ctl_req_dev *dev)
+{
+}
+
+/**
+ * out_req_rec_clbk
+ */
+static boolean_t out_req_rec_clbk(struct usb_ctl_req_dev *dev)
+{
+	return (FALSE);
+}
+
+/**
+ * out_req_ack_clbk
+ */
+static void out_req_ack_clbk(struct usb_ctl_req_dev *dev)
+{
+	struct usb_std_req *sr = usb_ctl_req_get_arg(dev);
+
+	if (sr->addr_pend) {
+		sr->addr_pend = FALSE;
+		sr->state.addr = sr->pend_addr;
+		sr->hooks->set_addr(sr, sr->pend_addr);
+	}
+}
@@ -0,0 +1,99 @@
+/*
+ * usb_std_req.h
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef USB_STD_REQ_H
+#define USB_STD_REQ_H
+
+// Configuration of device. idx is built by init_usb_std_req().
+struct usb_std_req_conf {
+	const void *desc;
+	int desc_sz;
+	struct usb_desc_idx *idx;
+};
+
+// Hooks of device state changes. set_addr is called after status stage
+// of SET_ADDRESS. set_conf (idx NULL if device is deconfigured) and
+// set_iface are called before status stage, returned FALSE stalls
+// request. set_endp_halt sets or clears endpoint halt in controller
+// (clearing resets data toggle), SET_INTERFACE clears it for each endpoint
+// of interface. get_frame returns frame number for SYNCH_FRAME or -1.
+// All hooks except set_addr can be NULL.
+struct usb_std_req;
+
+struct usb_std_req_hooks {
+	void (*set_addr)(struct usb_std_req *sr, int addr);
+	boolean_t (*set_conf)(struct usb_std_req *sr, const struct usb_desc_idx *idx);
+	boolean_t (*set_iface)(struct usb_std_req *sr, int iface, int alt);
+	void (*set_endp_halt)(struct usb_std_req *sr, int addr, boolean_t halt);
+	int (*get_frame)(struct usb_std_req *sr, int addr);
+};
+
+// Device state. Endpoint bitmaps are indexed by usb_desc_idx_endp_ix().
+struct usb_std_req_state {
+	uint8_t addr;
+	uint8_t conf; // bConfigurationValue, 0 if not configured.
+	boolean_t rwkup;
+	uint32_t endp;
+	uint32_t halt;
+	uint32_t iface_endp[USB_DESC_IDX_IFACE_NMB];
+	uint8_t alt[USB_DESC_IDX_IFACE_NMB];
+};
+
+// Chapter 9 standard request engine. Members after state are private.
+struct usb_std_req {
+	const struct usb_dev_desc *dev_desc;
+	const struct usb_dev_qual_desc *qual_desc; // Can be NULL.
+	const struct usb_std_req_conf *conf;
+	int conf_nmb;
+	struct usb_str_desc *str; // Can be NULL.
+	const struct usb_std_req_hooks *hooks;
+	boolean_t self_pwr;
+	void *arg; // Free for application.
+	struct usb_std_req_state state;
+	const struct usb_desc_idx *act_idx;
+	uint8_t pend_addr;
+	boolean_t addr_pend;
+	uint8_t reply[2];
+	struct usb_ctl_req_frag frag;
+	struct usb_ctl_req_dev *dev;
+	struct usb_ctl_req_clbks clbks;
+};
+
+/**
+ * init_usb_std_req
+ *
+ * Builds configuration indexes and registers standard request callbacks
+ * to engine instance dev. Public members of sr must be set.
+ */
+void init_usb_std_req(struct usb_std_req *sr, struct usb_ctl_req_dev *dev);
+
+/**
+ * reset_usb_std_req
+ *
+ * Returns device to default state (call from bus reset interrupt).
+ */
+void reset_usb_std_req(struct usb_std_req *sr);
+
+/**
+ * usb_std_req_get_idx
+ *
+ * Returns index of active configuration or NULL.
+ */
+const struct usb_desc_idx *usb_std_req_get_idx(struct usb_std_req *sr);
+
+#endif
@@ -0,0 +1,207 @@
+/*
+ * usb_str_desc.c
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <gentyp.h>
+#include "sysconf.h"
+#include "criterr.h"
+#include "udp.h"
+#include "usb_std_def.h"
+#include "usb_ctl_req_trc.h"
+#include "usb_ctl_req.h"
+#include "usb_str_desc.h"
+
+#define MAX_UNITS 126
+
+static uint32_t utf8_dec(const uint8_t **s);
+static int utf16_units(const uint8_t *s);
+static void next_units(struct usb_str_desc *sd);
+static void in_pkt(void *arg, uint8_t *pkt, int nmb, int rem);
+
+/**
+ * init_usb_str_desc
+ */
+void init_usb_str_desc(struct usb_str_desc *sd, const struct usb_str_desc_tbl *tbl, int tbl_nmb,
+		       const char *(*get_str)(uint16_t langid, int idx))
+{
+	if (tbl_nmb < 1 || tbl_nmb > MAX_UNITS) {
+		crit_err_exit(BAD_PARAMETER);
+	}
+	sd->tbl = tbl;
+	sd->tbl_nmb = tbl_nmb;
+	sd->get_str = get_str;
+}
+
+/**
+ * usb_str_desc_req
+ */
+struct usb_ctl_req usb_str_desc_req(struct usb_str_desc *sd, const struct usb_stp_pkt *stp)
+{
+	struct usb_ctl_req req;
+	const struct usb_str_desc_tbl *t;
+	const char *str = NULL;
+	int idx, i, n;
+
+	memset(&req, 0, sizeof(req));
+	idx = stp->w_value & 0xFF;
+	if (idx == 0) {
+		sd->src = NULL;
+		sd->lang = 0;
+		n = sd->tbl_nmb;
+	} else {
+		t = sd->tbl;
+		for (i = 0; i < sd->tbl_nmb; i++) {
+			if (sd->tbl[i].langid == stp->w_index) {
+				t = &sd->tbl[i];
+				break;
+			}
+		}
+		if (idx <= t->nmb) {
+			str = t->str[idx - 1];
+		}
+		if (str == NULL && sd->get_str) {
+			str = sd->get_str(t->langid, idx);
+		}
+		if (str == NULL) {
+			return (req);
+		}
+		sd->src = (const uint8_t *) str;
+		n = utf16_units(sd->src);
+	}
+	sd->size = 2 + 2 * n;
+	sd->hdr = TRUE;
+	sd->unit_nmb = sd->unit_pos = 0;
+	req.valid = TRUE;
+	req.trans_dir = UDP_CTL_TRANS_IN;
+	req.trans_nmb = stp->w_length;
+	req.nmb = (sd->size < stp->w_length) ? sd->size : stp->w_length;
+	req.buf = sd->pkt;
+	req.in_pkt_clbk = in_pkt;
+	req.arg = sd;
+	return (req);
+}
+
+/**
+ * in_pkt
+ */
+static void in_pkt(void *arg, uint8_t *pkt, int nmb, int rem)
+{
+	struct usb_str_desc *sd = arg;
+
+	while (nmb--) {
+		if (sd->unit_pos == sd->unit_nmb) {
+			next_units(sd);
+		}
+		*pkt++ = sd->unit[sd->unit_pos++];
+	}
+}
+
+/**
+ * next_units
+ */
+static void next_units(struct usb_str_desc *sd)
+{
+	uint32_t c;
+
+	sd->unit_pos = 0;
+	if (sd->hdr) {
+		sd->unit[0] = sd->size;
+		sd->unit[1] = USB_STR_DESC;
+		sd->unit_nmb = 2;
+		sd->hdr = FALSE;
+		return;
+	}
+	if (sd->src) {
+		c = utf8_dec(&sd->src);
+	} else {
+		c = sd->tbl[sd->lang++].langid;
+	}
+	if (c >= 0x10000) {
+		c -= 0x10000;
+		sd->unit[0] = (0xD800 | (c >> 10)) & 0xFF;
+		sd->unit[1] = (0xD800 | (c >> 10)) >> 8;
+		sd->unit[2] = (0xDC00 | (c & 0x3FF)) & 0xFF;
+		sd->unit[3] = (0xDC00 | (c & 0x3FF)) >> 8;
+		sd->unit_nmb = 4;
+	} else {
+		sd->unit[0] = c & 0xFF;
+		sd->unit[1] = c >> 8;
+		sd->unit_nmb = 2;
+	}
+}
+
+/**
+ * utf16_units
+ */
+static int utf16_units(const uint8_t *s)
+{
+	int n = 0, u;
+
+	while (*s) {
+		u = (utf8_dec(&s) >= 0x10000) ? 2 : 1;
+		if (n + u > MAX_UNITS) {
+			break;
+		}
+		n += u;
+	}
+	return (n);
+}
+
+/**
+ * utf8_dec
+ *
+ * Invalid sequences are decoded as U+FFFD.
+ */
+static uint32_t utf8_dec(const uint8_t **s)
+{
+	const uint8_t *p = *s;
+	uint32_t c;
+	int n, i;
+
+	if (*p < 0x80) {
+		*s = p + 1;
+		return (*p);
+	} else if ((*p & 0xE0) == 0xC0) {
+		c = *p & 0x1F;
+		n = 1;
+	} else if ((*p & 0xF0) == 0xE0) {
+		c = *p & 0x0F;
+		n = 2;
+	} else if ((*p & 0xF8) == 0xF0) {
+		c = *p & 0x07;
+		n = 3;
+	} else {
+		*s = p + 1;
+		return (0xFFFD);
+	}
+	for (i = 1; i <= n; i++) {
+		if ((p[i] & 0xC0) != 0x80) {
+			*s = p + i;
+			return (0xFFFD);
+		}
+		c = (c << 6) | (p[i] & 0x3F);
+	}
+	*s = p + n + 1;
+	if (c > 0x10FFFF || (c >= 0xD800 && c < 0xE000) ||
+	    c < ((n == 1) ? 0x80 : (n == 2) ? 0x800 : 0x10000)) {
+		return (0xFFFD);
+	}
+	return (c);
+}
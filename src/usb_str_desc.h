@@ -0,0 +1,70 @@
+/*
+ * usb_str_desc.h
+ *
+ * Copyright (c) 2024 Jan Rusnak <jan@rusnak.sk>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef USB_STR_DESC_H
+#define USB_STR_DESC_H
+
+#ifndef USB_STR_DESC_PKT_SZ
+ #define USB_STR_DESC_PKT_SZ 64 // EP0 packet size.
+#endif
+
+// Strings of one language. str[i] is UTF-8 (or ASCII) string with index
+// i + 1, NULL if string is not defined.
+struct usb_str_desc_tbl {
+	uint16_t langid;
+	uint8_t nmb;
+	const char *const *str;
+};
+
+// String descriptor service. String descriptors are encoded to UTF-16LE
+// packet by packet while IN data stage is sent (only one EP0 packet is
+// buffered). Members after get_str are private.
+struct usb_str_desc {
+	const struct usb_str_desc_tbl *tbl;
+	uint8_t tbl_nmb;
+	// Returns runtime string (e.g. serial number) for indexes not defined
+	// in table or NULL. Can be NULL.
+	const char *(*get_str)(uint16_t langid, int idx);
+	const uint8_t *src;
+	uint8_t size;
+	uint8_t lang;
+	boolean_t hdr;
+	uint8_t unit[4];
+	uint8_t unit_nmb;
+	uint8_t unit_pos;
+	uint8_t pkt[USB_STR_DESC_PKT_SZ];
+};
+
+/**
+ * init_usb_str_desc
+ *
+ * First table is used if requested LANGID is not in tables.
+ */
+void init_usb_str_desc(struct usb_str_desc *sd, const struct usb_str_desc_tbl *tbl, int tbl_nmb,
+		       const char *(*get_str)(uint16_t langid, int idx));
+
+/**
+ * usb_str_desc_req
+ *
+ * Returns request of GET_DESCRIPTOR(STRING) setup packet for stp_clbk
+ * (not valid if string is not defined). Descriptor is truncated to
+ * w_length and to 126 characters.
+ */
+struct usb_ctl_req usb_str_desc_req(struct usb_str_desc *sd, const struct usb_stp_pkt *stp);
+
+#endif